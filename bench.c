@@ -0,0 +1,959 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <GL/glew.h>
+
+#include "bench.h"
+#include "cpu.h"
+#include "jobs.h"
+#include "camera.h"
+#include "mat4.h"
+#include "mat4expr.h"
+#include "vertexstream.h"
+#include "cull.h"
+#include "bvh.h"
+#include "quat.h"
+#include "vertexformat.h"
+#include "meshopt.h"
+#include "meshimport.h"
+#include "meshfile.h"
+#include "pack.h"
+
+static unsigned int seed = 1;
+
+static float randomFloat(float lo, float hi) {
+
+    seed = seed * 1664525u + 1013904223u;
+    return lo + (hi - lo) * ((seed >> 8) / (float)(1 << 24));
+}
+
+// ----------------------------------------------------
+// VERTEX STREAMS
+//
+
+static void benchVertexStream() {
+
+    const int count = 1 << 22;
+    const int rounds = 5;
+
+    Camera cam;
+    cameraInit(&cam);
+    cameraSetPosition(&cam, 10, 2, 10);
+    cameraSetTarget(&cam, 0, 2, -5);
+    cameraUpdate(&cam);
+
+    VertexStream in, out;
+    vertexStreamInit(&in);
+    vertexStreamInit(&out);
+    vertexStreamResize(&in, count);
+    vertexStreamResize(&out, count);
+    for (int i = 0; i < count; ++i) {
+        in.x[i] = randomFloat(-20, 20);
+        in.y[i] = randomFloat(-20, 20);
+        in.z[i] = randomFloat(-20, 20);
+        in.w[i] = 1.0f;
+    }
+
+    printf("vertex stream project, %d points, %d threads\n", count, jobsThreadCount());
+
+    CpuIsa bound = cpuIsa();
+    for (int isa = 0; isa <= cpuDetect(); ++isa) {
+        cpuBind((CpuIsa) isa);
+
+        double single = 1e30, threaded = 1e30;
+        for (int r = 0; r < rounds; ++r) {
+            double t0 = cpuSeconds();
+            vertexKernels->project(cam.viewProj.m, &in, &out, 0, count);
+            double t1 = cpuSeconds();
+            vertexStreamProject(&out, &in, cam.viewProj.m);
+            double t2 = cpuSeconds();
+            if (t1 - t0 < single)
+                single = t1 - t0;
+            if (t2 - t1 < threaded)
+                threaded = t2 - t1;
+        }
+
+        printf("  %-7s 1 thread %8.1f Mpts/s   all threads %8.1f Mpts/s, %8.1f Mpts/s per core\n",
+               cpuIsaName((CpuIsa) isa),
+               count / single * 1e-6,
+               count / threaded * 1e-6,
+               count / threaded * 1e-6 / jobsThreadCount());
+    }
+    cpuBind(bound);
+
+    vertexStreamFree(&in);
+    vertexStreamFree(&out);
+}
+
+// ----------------------------------------------------
+// VERTEX FORMATS
+//
+// What filling the vertex buffers costs, and how big they
+// get, with the two arrays of 4 floats g33 used to upload
+// against interleaved packed formats. The errors are the
+// largest distance from the original positions and the
+// largest angle from the original normals.
+//
+
+static void benchVertexFormats() {
+
+    const int count = 1 << 20;
+    const int rounds = 5;
+
+    float *positions = (float *) cpuAlloc(count * 4 * sizeof(float));
+    float *colors = (float *) cpuAlloc(count * 4 * sizeof(float));
+    float *normals = (float *) cpuAlloc(count * 3 * sizeof(float));
+    for (int i = 0; i < count; ++i) {
+        float len = 0.0f;
+        for (int k = 0; k < 3; ++k) {
+            positions[i*4 + k] = randomFloat(-20, 20);
+            normals[i*3 + k] = randomFloat(-1, 1);
+            len += normals[i*3 + k] * normals[i*3 + k];
+        }
+        positions[i*4 + 3] = 1.0f;
+        for (int k = 0; k < 3; ++k) {
+            normals[i*3 + k] /= sqrtf(len);
+            colors[i*4 + k] = randomFloat(0, 1);
+        }
+        colors[i*4 + 3] = 1.0f;
+    }
+
+    VertexSource src;
+    vertexSourceInit(&src, count);
+    vertexSourceSet(&src, VERTEX_POSITION, positions, 4);
+    vertexSourceSet(&src, VERTEX_COLOR, colors, 4);
+    vertexSourceSet(&src, VERTEX_NORMAL, normals, 3);
+
+    const float lo[3] = { -20, -20, -20 }, hi[3] = { 20, 20, 20 };
+    const struct {
+        const char *name;
+        VertexType position;
+        bool normal;
+    } layouts[] = {
+        { "float",   VERTEX_FLOAT,   false },
+        { "half",    VERTEX_HALF,    false },
+        { "snorm16", VERTEX_SNORM16, false },
+        { "half+n",  VERTEX_HALF,    true },
+        { "snorm+n", VERTEX_SNORM16, true },
+    };
+
+    printf("vertex formats, %d vertices\n", count);
+    printf("  %-8s %6s %8s %9s %10s %10s\n", "", "bytes", "MB", "fill ms", "pos error", "n degrees");
+
+    // the two arrays glBufferData copied
+    unsigned char *legacy = (unsigned char *) cpuAlloc(count * 8 * sizeof(float));
+    double best = 1e30;
+    for (int r = 0; r < rounds; ++r) {
+        double t0 = cpuSeconds();
+        memcpy(legacy, positions, count * 4 * sizeof(float));
+        memcpy(legacy + count * 4 * sizeof(float), colors, count * 4 * sizeof(float));
+        double t = cpuSeconds() - t0;
+        if (t < best)
+            best = t;
+    }
+    printf("  %-8s %6d %8.1f %9.3f\n", "2 x vec4", 32, count * 32.0 / (1 << 20), best * 1000.0);
+    cpuFree(legacy);
+
+    for (size_t l = 0; l < sizeof(layouts) / sizeof(layouts[0]); ++l) {
+        VertexFormat fmt;
+        vertexFormatInit(&fmt);
+        vertexFormatSetBounds(&fmt, lo, hi);
+        vertexFormatAdd(&fmt, VERTEX_POSITION, layouts[l].position, 3);
+        vertexFormatAdd(&fmt, VERTEX_COLOR, VERTEX_UNORM8, 4);
+        if (layouts[l].normal)
+            vertexFormatAdd(&fmt, VERTEX_NORMAL, VERTEX_OCT16, 3);
+
+        unsigned char *vertices = (unsigned char *) cpuAlloc((size_t) count * fmt.stride);
+        best = 1e30;
+        for (int r = 0; r < rounds; ++r) {
+            double t0 = cpuSeconds();
+            vertexFormatPack(&fmt, &src, vertices);
+            double t = cpuSeconds() - t0;
+            if (t < best)
+                best = t;
+        }
+
+        float posError = 0.0f, normalDot = 1.0f;
+        for (int i = 0; i < count; ++i) {
+            float v[4], d = 0.0f;
+            vertexFormatUnpack(&fmt, vertices, i, VERTEX_POSITION, v);
+            for (int k = 0; k < 3; ++k)
+                d += (v[k] - positions[i*4 + k]) * (v[k] - positions[i*4 + k]);
+            if (sqrtf(d) > posError)
+                posError = sqrtf(d);
+            if (layouts[l].normal) {
+                vertexFormatUnpack(&fmt, vertices, i, VERTEX_NORMAL, v);
+                float dot = v[0] * normals[i*3] + v[1] * normals[i*3 + 1] + v[2] * normals[i*3 + 2];
+                if (dot < normalDot)
+                    normalDot = dot;
+            }
+        }
+
+        printf("  %-8s %6d %8.1f %9.3f %10.5f", layouts[l].name, fmt.stride,
+               (double) count * fmt.stride / (1 << 20), best * 1000.0, posError);
+        if (layouts[l].normal)
+            printf(" %10.4f", acosf(normalDot > 1.0f ? 1.0f : normalDot) * 57.2957795f);
+        printf("\n");
+
+        cpuFree(vertices);
+    }
+
+    cpuFree(positions);
+    cpuFree(colors);
+    cpuFree(normals);
+}
+
+// ----------------------------------------------------
+// MESH OPTIMIZATION
+//
+// A grid of quads given as a triangle soup, the way an
+// unindexed mesh is set up: welded, then reordered for the
+// vertex cache, with its triangles in rows as a generator
+// makes them and shuffled as some exporters leave them.
+//
+
+static void benchMeshOpt() {
+
+    const int side = 256;
+    const int count = side * side * 6;
+
+    float *soup = (float *) malloc(count * 4 * sizeof(float));
+    float *color = (float *) malloc(count * 4 * sizeof(float));
+    for (int q = 0; q < side * side; ++q) {
+        const int corners[6][2] = { {0,0}, {1,0}, {1,1}, {0,0}, {1,1}, {0,1} };
+        for (int c = 0; c < 6; ++c) {
+            float *v = soup + (q * 6 + c) * 4;
+            v[0] = (float)(q % side + corners[c][0]) - side / 2;
+            v[1] = 0.0f;
+            v[2] = (float)(q / side + corners[c][1]) - side / 2;
+            v[3] = 1.0f;
+        }
+    }
+    for (int i = 0; i < count * 4; ++i)
+        color[i] = 1.0f;
+
+    VertexFormat fmt;
+    vertexFormatInit(&fmt);
+    vertexFormatAdd(&fmt, VERTEX_POSITION, VERTEX_HALF, 3);
+    vertexFormatAdd(&fmt, VERTEX_COLOR, VERTEX_UNORM8, 4);
+
+    VertexSource src;
+    vertexSourceInit(&src, count);
+    vertexSourceSet(&src, VERTEX_POSITION, soup, 4);
+    vertexSourceSet(&src, VERTEX_COLOR, color, 4);
+    unsigned char *packed = (unsigned char *) malloc((size_t) count * fmt.stride);
+
+    printf("mesh optimization, %d triangles, ACMR for a %d entry FIFO\n", count / 3, MESH_ACMR_CACHE_SIZE);
+    printf("  %-9s %8s %8s %9s %9s %9s %9s\n", "", "indices", "vertices", "weld ms", "opt ms", "ACMR in", "ACMR out");
+
+    for (int shuffled = 0; shuffled < 2; ++shuffled) {
+        if (shuffled) {
+            // whole triangles trade places
+            for (int t = count / 3 - 1; t > 0; --t) {
+                int u = (int) randomFloat(0, (float) t + 0.999f);
+                float tmp[12];
+                memcpy(tmp, soup + t * 12, sizeof(tmp));
+                memcpy(soup + t * 12, soup + u * 12, sizeof(tmp));
+                memcpy(soup + u * 12, tmp, sizeof(tmp));
+            }
+        }
+        vertexFormatPack(&fmt, &src, packed);
+
+        IndexedMesh mesh;
+        MeshOptStats stats;
+        double t0 = cpuSeconds();
+        indexedMeshBuild(&mesh, packed, count, fmt.stride);
+        double t1 = cpuSeconds();
+        indexedMeshOptimize(&mesh, &stats);
+        double t2 = cpuSeconds();
+
+        printf("  %-9s %8d %8d %9.2f %9.2f %9.3f %9.3f\n", shuffled ? "shuffled" : "rows",
+               stats.indices, stats.vertices, (t1 - t0) * 1000.0, (t2 - t1) * 1000.0,
+               stats.acmrBefore, stats.acmrAfter);
+        if (stats.vertices != (side + 1) * (side + 1))
+            printf("  the grid should weld to %d vertices\n", (side + 1) * (side + 1));
+        indexedMeshFree(&mesh);
+    }
+
+    free(packed);
+    free(soup);
+    free(color);
+}
+
+// ----------------------------------------------------
+// MESH IMPORT
+//
+// OBJ text of a grid of quads with vertex colors, as
+// exporters write it, parsed from memory.
+//
+
+static void benchImport() {
+
+    const int side = 1000;
+    const int rounds = 3;
+
+    size_t capacity = (size_t)(side + 1) * (side + 1) * 64 + (size_t) side * side * 48;
+    char *text = (char *) malloc(capacity);
+    size_t size = 0;
+    for (int y = 0; y <= side; ++y)
+        for (int x = 0; x <= side; ++x)
+            size += snprintf(text + size, capacity - size, "v %.6f %.6f %.6f %.4f %.4f %.4f\n",
+                             x * 0.01f, y * 0.01f, randomFloat(-1, 1),
+                             randomFloat(0, 1), randomFloat(0, 1), randomFloat(0, 1));
+    for (int y = 0; y < side; ++y)
+        for (int x = 0; x < side; ++x) {
+            int a = y * (side + 1) + x + 1;
+            size += snprintf(text + size, capacity - size, "f %d %d %d %d\n", a, a + 1, a + side + 2, a + side + 1);
+        }
+
+    double best = 1e30;
+    ImportedMesh mesh;
+    for (int r = 0; r < rounds; ++r) {
+        double t0 = cpuSeconds();
+        meshImportObj(&mesh, text, size);
+        double t = cpuSeconds() - t0;
+        if (t < best)
+            best = t;
+        if (r < rounds - 1)
+            importedMeshFree(&mesh);
+    }
+
+    printf("mesh import, %.1f MB of OBJ, %d threads\n", size / (double)(1 << 20), jobsThreadCount());
+    printf("  %d vertices, %d triangles in %.1f ms, %.2f GB/s\n",
+           mesh.vertexCount, mesh.indexCount / 3, best * 1000.0, size / best / 1e9);
+
+    importedMeshFree(&mesh);
+    free(text);
+}
+
+// ----------------------------------------------------
+// MESH FILES
+//
+// A 1 GB mesh file loaded as g33 does, every byte going
+// through a 4 MB staging buffer the way glBufferSubData
+// copies it: cold, out of the page cache, then warm, and
+// warm again read into the heap first as a text or custom
+// loader would.
+//
+
+#define BENCH_MESH_FILE "bench" MESH_FILE_EXTENSION
+#define STAGING_SIZE (4 << 20)
+
+// the OS forgets the pages of the file, where it can
+static bool dropFileCache(const char *path) {
+
+#if defined(__linux__)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    fdatasync(fd);
+    bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return ok;
+#else
+    (void) path;
+    return false;
+#endif
+}
+
+static void stage(unsigned char *staging, const unsigned char *data, size_t size) {
+
+    for (size_t offset = 0; offset < size; offset += STAGING_SIZE) {
+        size_t n = size - offset < STAGING_SIZE ? size - offset : STAGING_SIZE;
+        memcpy(staging, data + offset, n);
+    }
+}
+
+static double loadMapped(unsigned char *staging) {
+
+    MeshFile file;
+    double t0 = cpuSeconds();
+    if (!meshFileOpen(&file, BENCH_MESH_FILE))
+        return 0.0;
+    stage(staging, (const unsigned char *) file.vertices, (size_t) file.header->vertexSize);
+    stage(staging, (const unsigned char *) file.indices, (size_t) file.header->indexSize);
+    meshFileClose(&file);
+    return cpuSeconds() - t0;
+}
+
+static double loadRead(unsigned char *staging, size_t size) {
+
+    double t0 = cpuSeconds();
+    FILE *f = fopen(BENCH_MESH_FILE, "rb");
+    if (!f)
+        return 0.0;
+    unsigned char *data = (unsigned char *) malloc(size);
+    size_t n = fread(data, 1, size, f);
+    fclose(f);
+    stage(staging, data, n);
+    free(data);
+    return cpuSeconds() - t0;
+}
+
+static void benchMeshFile() {
+
+    VertexFormat fmt;
+    vertexFormatInit(&fmt);
+    vertexFormatAdd(&fmt, VERTEX_POSITION, VERTEX_HALF, 3);
+    vertexFormatAdd(&fmt, VERTEX_COLOR, VERTEX_UNORM8, 4);
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    meshFileSetFormat(&header, &fmt);
+    header.vertexCount = 48 << 20;
+    header.indexCount = 112 << 20;
+    header.indexType = GL_UNSIGNED_INT;
+    header.lodCount = 1;
+    header.lods[0].indexCount = header.indexCount;
+
+    size_t vertexSize = (size_t) header.vertexCount * fmt.stride;
+    unsigned char *vertices = (unsigned char *) malloc(vertexSize);
+    unsigned int *indices = (unsigned int *) malloc(header.indexCount * sizeof(unsigned int));
+    for (size_t i = 0; i < vertexSize; ++i)
+        vertices[i] = (unsigned char) i;
+    for (unsigned int i = 0; i < header.indexCount; ++i)
+        indices[i] = i % header.vertexCount;
+
+    double t0 = cpuSeconds();
+    bool written = meshFileWrite(BENCH_MESH_FILE, &header, vertices, indices);
+    double writing = cpuSeconds() - t0;
+    free(vertices);
+    free(indices);
+    if (!written) {
+        printf("mesh file: cannot write %s\n", BENCH_MESH_FILE);
+        return;
+    }
+
+    size_t size = (size_t)(header.indexOffset + header.indexSize);
+    double mb = size / (double)(1 << 20);
+    unsigned char *staging = (unsigned char *) malloc(STAGING_SIZE);
+
+    printf("mesh file, %.0f MB\n", mb);
+    printf("  %-14s %9.1f ms %8.0f MB/s\n", "write", writing * 1000.0, mb / writing);
+
+    if (dropFileCache(BENCH_MESH_FILE)) {
+        double cold = loadMapped(staging);
+        printf("  %-14s %9.1f ms %8.0f MB/s\n", "cold, mapped", cold * 1000.0, mb / cold);
+    } else
+        printf("  %-14s %9s\n", "cold, mapped", "n/a");
+
+    double warm = 1e30, read = 1e30;
+    for (int r = 0; r < 3; ++r) {
+        double t = loadMapped(staging);
+        warm = t < warm ? t : warm;
+        t = loadRead(staging, size);
+        read = t < read ? t : read;
+    }
+    printf("  %-14s %9.1f ms %8.0f MB/s\n", "warm, mapped", warm * 1000.0, mb / warm);
+    printf("  %-14s %9.1f ms %8.0f MB/s\n", "warm, read", read * 1000.0, mb / read);
+
+    free(staging);
+    remove(BENCH_MESH_FILE);
+}
+
+// ----------------------------------------------------
+// PACK FILES
+//
+// A terrain grid of 8M vertices as a mesh file, about
+// 300 MB, loaded whole into memory standing for the mapped
+// GL buffers: copied from the mapped mesh file, and
+// decompressed from a pack holding it, cold then warm.
+// MB/s are of the mesh file, so they compare as the time
+// to get the same data in; the pack wins when the disk is
+// slower than decompression on all the threads.
+//
+
+#define BENCH_PACK_FILE "bench" PACK_FILE_EXTENSION
+#define BENCH_GRID_WIDTH 4096
+#define BENCH_GRID_HEIGHT 2048
+
+static double loadRaw(unsigned char *dst) {
+
+    MeshFile file;
+    double t0 = cpuSeconds();
+    if (!meshFileOpen(&file, BENCH_MESH_FILE))
+        return 0.0;
+    memcpy(dst, file.vertices, (size_t) file.header->vertexSize);
+    memcpy(dst + file.header->vertexSize, file.indices, (size_t) file.header->indexSize);
+    meshFileClose(&file);
+    return cpuSeconds() - t0;
+}
+
+static double loadPacked(unsigned char *dst, size_t size) {
+
+    PackFile pack;
+    double t0 = cpuSeconds();
+    if (!packOpen(&pack, BENCH_PACK_FILE))
+        return 0.0;
+    const PackEntry *entry = packFind(&pack, BENCH_MESH_FILE);
+    bool ok = entry && packRead(&pack, entry, 0, size, dst);
+    packClose(&pack);
+    return ok ? cpuSeconds() - t0 : 0.0;
+}
+
+static void benchPack() {
+
+    const int w = BENCH_GRID_WIDTH, h = BENCH_GRID_HEIGHT;
+    VertexFormat fmt;
+    VertexSource src;
+    MeshFileHeader header;
+
+    vertexFormatScene(&fmt);
+    int count = w * h;
+    float *positions = (float *) malloc((size_t) count * 4 * sizeof(float));
+    float *colors = (float *) malloc((size_t) count * 4 * sizeof(float));
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x) {
+            float *p = &positions[((size_t) y * w + x) * 4];
+            float *c = &colors[((size_t) y * w + x) * 4];
+            float height = sinf(x * 0.01f) * cosf(y * 0.013f) * 20.0f + randomFloat(0.0f, 0.1f);
+            p[0] = x * 0.5f - w * 0.25f;
+            p[1] = height;
+            p[2] = y * 0.5f - h * 0.25f;
+            p[3] = 1.0f;
+            c[0] = height > 10.0f ? 1.0f : 0.3f;
+            c[1] = 0.6f;
+            c[2] = height < 0.0f ? 0.8f : 0.2f;
+            c[3] = 1.0f;
+        }
+
+    memset(&header, 0, sizeof(header));
+    meshFileSetFormat(&header, &fmt);
+    header.vertexCount = count;
+    header.indexCount = (w - 1) * (h - 1) * 6;
+    header.indexType = GL_UNSIGNED_INT;
+    header.lodCount = 1;
+    header.lods[0].indexCount = header.indexCount;
+
+    unsigned char *vertices = (unsigned char *) malloc((size_t) count * fmt.stride);
+    vertexSourceInit(&src, count);
+    vertexSourceSet(&src, VERTEX_POSITION, positions, 4);
+    vertexSourceSet(&src, VERTEX_COLOR, colors, 4);
+    vertexFormatPack(&fmt, &src, vertices);
+    free(positions);
+    free(colors);
+
+    unsigned int *indices = (unsigned int *) malloc(header.indexCount * sizeof(unsigned int));
+    unsigned int *q = indices;
+    for (int y = 0; y + 1 < h; ++y)
+        for (int x = 0; x + 1 < w; ++x) {
+            unsigned int a = y * w + x;
+            *q++ = a; *q++ = a + 1; *q++ = a + w;
+            *q++ = a + 1; *q++ = a + w + 1; *q++ = a + w;
+        }
+
+    bool written = meshFileWrite(BENCH_MESH_FILE, &header, vertices, indices);
+    free(vertices);
+    free(indices);
+
+    MappedFile raw;
+    PackItem item;
+    double writing = 0.0;
+    if (written && mappedFileOpen(&raw, BENCH_MESH_FILE)) {
+        item.name = BENCH_MESH_FILE;
+        item.data = raw.data;
+        item.size = raw.size;
+        double t0 = cpuSeconds();
+        written = packWrite(BENCH_PACK_FILE, &item, 1);
+        writing = cpuSeconds() - t0;
+        mappedFileClose(&raw);
+    } else
+        written = false;
+    if (!written) {
+        printf("pack file: cannot write\n");
+        remove(BENCH_MESH_FILE);
+        return;
+    }
+
+    // the data the loads get, the mesh file's vertices and
+    // indices, as the GL buffers would
+    size_t rawSize = (size_t)(header.vertexSize + header.indexSize);
+    size_t fileSize = (size_t)(header.indexOffset + header.indexSize);
+    unsigned char *dst = (unsigned char *) malloc(fileSize);
+    memset(dst, 0, fileSize);
+    double mb = rawSize / (double)(1 << 20);
+
+    MappedFile packed;
+    double packedMb = 0.0;
+    if (mappedFileOpen(&packed, BENCH_PACK_FILE)) {
+        packedMb = packed.size / (double)(1 << 20);
+        mappedFileClose(&packed);
+    }
+
+    printf("pack file, %.0f MB of mesh file packed to %.0f MB, %d threads\n", mb, packedMb, jobsThreadCount());
+    printf("  %-14s %9.1f ms %8.0f MB/s\n", "pack", writing * 1000.0, fileSize / (double)(1 << 20) / writing);
+
+    if (dropFileCache(BENCH_MESH_FILE) && dropFileCache(BENCH_PACK_FILE)) {
+        double t = loadRaw(dst);
+        printf("  %-14s %9.1f ms %8.0f MB/s\n", "cold, raw", t * 1000.0, mb / t);
+        t = loadPacked(dst, fileSize);
+        printf("  %-14s %9.1f ms %8.0f MB/s\n", "cold, packed", t * 1000.0, mb / t);
+    } else
+        printf("  %-14s %9s\n", "cold", "n/a");
+
+    double warmRaw = 1e30, warmPacked = 1e30;
+    for (int r = 0; r < 3; ++r) {
+        double t = loadRaw(dst);
+        warmRaw = t < warmRaw ? t : warmRaw;
+        t = loadPacked(dst, fileSize);
+        warmPacked = t < warmPacked ? t : warmPacked;
+    }
+    printf("  %-14s %9.1f ms %8.0f MB/s\n", "warm, raw", warmRaw * 1000.0, mb / warmRaw);
+    printf("  %-14s %9.1f ms %8.0f MB/s\n", "warm, packed", warmPacked * 1000.0, mb / warmPacked);
+
+    free(dst);
+    remove(BENCH_PACK_FILE);
+    remove(BENCH_MESH_FILE);
+}
+
+// ----------------------------------------------------
+// MATRIX CHAINS
+//
+// proj * view * model per object, as a multMatrix chain
+// (copy, then two in place multiplies) and as a fused
+// expression. Every count runs about a million objects
+// in total so the times per object compare.
+//
+
+static void benchMatrixChain() {
+
+    const int counts[] = { 1, 1000, 1000000 };
+    const int total = 1000000;
+
+    Camera cam;
+    cameraInit(&cam);
+    cameraSetPosition(&cam, 10, 2, 10);
+    cameraSetTarget(&cam, 0, 2, -5);
+    cameraUpdate(&cam);
+
+    const float *proj = cam.proj.m;
+    const float *view = cam.view.m;
+
+    mat4 *model = (mat4 *) cpuAlloc(total * sizeof(mat4));
+    mat4 *res = (mat4 *) cpuAlloc(total * sizeof(mat4));
+    vec4 *points = (vec4 *) cpuAlloc(total * sizeof(vec4));
+    for (int i = 0; i < total; ++i) {
+        for (int k = 0; k < 16; ++k)
+            model[i].m[k] = randomFloat(-1, 1);
+        points[i].v[0] = randomFloat(-1, 1);
+        points[i].v[1] = randomFloat(-1, 1);
+        points[i].v[2] = randomFloat(-1, 1);
+        points[i].v[3] = 1.0f;
+    }
+
+    printf("proj * view * model, %s kernels, ns per object\n", cpuIsaName(cpuIsa()));
+    printf("  %7s  %14s  %14s  %14s  %14s  %14s\n",
+           "objects", "scalar chain", "mat4 chain", "expression", "chain * v", "expression * v");
+
+    for (int c = 0; c < 3; ++c) {
+        int n = counts[c];
+        int rounds = total / n;
+        double t[5];
+
+        double t0 = cpuSeconds();
+        for (int r = 0; r < rounds; ++r)
+            for (int i = 0; i < n; ++i) {
+                memcpy(res[i].m, proj, 16 * sizeof(float));
+                mat4KernelsScalar.mult(res[i].m, res[i].m, view);
+                mat4KernelsScalar.mult(res[i].m, res[i].m, model[i].m);
+            }
+        t[0] = cpuSeconds() - t0;
+
+        t0 = cpuSeconds();
+        for (int r = 0; r < rounds; ++r)
+            for (int i = 0; i < n; ++i) {
+                memcpy(res[i].m, proj, 16 * sizeof(float));
+                mat4Mult(res[i].m, res[i].m, view);
+                mat4Mult(res[i].m, res[i].m, model[i].m);
+            }
+        t[1] = cpuSeconds() - t0;
+
+        t0 = cpuSeconds();
+        for (int r = 0; r < rounds; ++r)
+            for (int i = 0; i < n; ++i)
+                mat4expr::assign(res[i].m, mat(proj) * mat(view) * mat(model[i]));
+        t[2] = cpuSeconds() - t0;
+
+        t0 = cpuSeconds();
+        for (int r = 0; r < rounds; ++r)
+            for (int i = 0; i < n; ++i) {
+                float m[16];
+                memcpy(m, proj, sizeof(m));
+                mat4Mult(m, m, view);
+                mat4Mult(m, m, model[i].m);
+                mat4TransformPoint(res[i].m, m, points[i].v);
+            }
+        t[3] = cpuSeconds() - t0;
+
+        t0 = cpuSeconds();
+        for (int r = 0; r < rounds; ++r)
+            for (int i = 0; i < n; ++i) {
+                vec4 v = mat(proj) * mat(view) * mat(model[i]) * points[i];
+                memcpy(res[i].m, v.v, sizeof(v.v));
+            }
+        t[4] = cpuSeconds() - t0;
+
+        printf("  %7d", n);
+        for (int k = 0; k < 5; ++k)
+            printf("  %14.2f", t[k] / total * 1e9);
+        printf("\n");
+    }
+
+    cpuFree(model);
+    cpuFree(res);
+    cpuFree(points);
+}
+
+// ----------------------------------------------------
+// FRUSTUM CULLING
+//
+
+static void benchCulling() {
+
+    const int count = 1000000;
+    const int rounds = 10;
+
+    Camera cam;
+    cameraInit(&cam);
+    cameraSetPosition(&cam, 10, 2, 10);
+    cameraSetTarget(&cam, 0, 2, -5);
+    cameraUpdate(&cam);
+
+    Frustum frustum;
+    frustumFromMatrix(&frustum, cam.viewProj.m);
+
+    CullSet set;
+    cullSetInit(&set);
+    for (int i = 0; i < count; ++i) {
+        Bounds b;
+        b.center[0] = randomFloat(-50, 50);
+        b.center[1] = randomFloat(-50, 50);
+        b.center[2] = randomFloat(-50, 50);
+        b.extents[0] = b.extents[1] = b.extents[2] = randomFloat(0.1f, 1.0f);
+        b.radius = b.extents[0] * 1.7320508f;
+        cullSetAdd(&set, &b);
+    }
+
+    printf("frustum culling, %d boxes, %d threads\n", count, jobsThreadCount());
+
+    CpuIsa bound = cpuIsa();
+    for (int isa = 0; isa <= cpuDetect(); ++isa) {
+        cpuBind((CpuIsa) isa);
+
+        double best = 1e30;
+        for (int r = 0; r < rounds; ++r) {
+            cullSetRun(&set, &frustum);
+            if (set.stats.seconds < best)
+                best = set.stats.seconds;
+        }
+
+        printf("  %-7s %8.3f ms, %d visible, %d culled\n",
+               cpuIsaName((CpuIsa) isa), best * 1000.0, set.stats.visible, set.stats.culled);
+    }
+    cpuBind(bound);
+
+    cullSetFree(&set);
+}
+
+// ----------------------------------------------------
+// BVH
+//
+// Boxes spread with the same density whatever their
+// count, so the camera sees about as many of them. Rays
+// go from random points in random directions, spread
+// over the worker threads.
+//
+
+struct RayJob {
+    const Bvh *bvh;
+    const CullSet *set;
+    const float *rays;
+};
+
+static void rayJob(void *ctx, int begin, int end) {
+
+    RayJob *job = (RayJob *) ctx;
+
+    for (int i = begin; i < end; ++i) {
+        const float *ray = job->rays + i * 6;
+        bvhRaycast(job->bvh, job->set, ray, ray + 3, 1e30f, NULL, NULL, NULL);
+    }
+}
+
+static void benchBvh() {
+
+    const int counts[] = { 10000, 100000, 1000000 };
+    const int rays = 1 << 18;
+    const int rounds = 5;
+
+    Camera cam;
+    cameraInit(&cam);
+    cameraSetPosition(&cam, 10, 2, 10);
+    cameraSetTarget(&cam, 0, 2, -5);
+    cameraSetProjection(&cam, 53.13f, 1.0f, 1.0f, 100.0f);
+    cameraUpdate(&cam);
+
+    Frustum frustum;
+    frustumFromMatrix(&frustum, cam.viewProj.m);
+
+    float *ray = (float *) malloc(rays * 6 * sizeof(float));
+
+    printf("bvh, %d threads, times in ms\n", jobsThreadCount());
+    printf("  %7s  %8s  %8s  %9s  %9s  %8s  %10s\n",
+           "objects", "build", "refit", "flat cull", "bvh cull", "visible", "Mrays/s");
+
+    for (int c = 0; c < 3; ++c) {
+        int count = counts[c];
+        float side = 3.0f * cbrtf((float) count);
+
+        CullSet set;
+        cullSetInit(&set);
+        for (int i = 0; i < count; ++i) {
+            Bounds b;
+            b.center[0] = randomFloat(-side, side);
+            b.center[1] = randomFloat(-side, side);
+            b.center[2] = randomFloat(-side, side);
+            b.extents[0] = randomFloat(0.1f, 1.0f);
+            b.extents[1] = randomFloat(0.1f, 1.0f);
+            b.extents[2] = randomFloat(0.1f, 1.0f);
+            b.radius = 0.0f;
+            cullSetAdd(&set, &b);
+        }
+
+        for (int i = 0; i < rays; ++i) {
+            ray[i*6 + 0] = randomFloat(-side, side);
+            ray[i*6 + 1] = randomFloat(-side, side);
+            ray[i*6 + 2] = randomFloat(-side, side);
+            ray[i*6 + 3] = randomFloat(-1, 1);
+            ray[i*6 + 4] = randomFloat(-1, 1);
+            ray[i*6 + 5] = randomFloat(-1, 1);
+        }
+
+        Bvh bvh;
+        bvhInit(&bvh);
+        double t[5] = { 1e30, 1e30, 1e30, 1e30, 1e30 };
+
+        for (int r = 0; r < rounds; ++r) {
+            double t0 = cpuSeconds();
+            bvhBuild(&bvh, &set);
+            double t1 = cpuSeconds();
+            bvhRefit(&bvh, &set);
+            double t2 = cpuSeconds();
+            cullSetRun(&set, &frustum);
+            double t3 = cpuSeconds();
+            bvhCull(&bvh, &set, &frustum);
+            double t4 = cpuSeconds();
+
+            RayJob job = { &bvh, &set, ray };
+            parallelFor(rays, 1024, rayJob, &job);
+            double t5 = cpuSeconds();
+
+            double dt[5] = { t1 - t0, t2 - t1, t3 - t2, t4 - t3, t5 - t4 };
+            for (int k = 0; k < 5; ++k)
+                if (dt[k] < t[k])
+                    t[k] = dt[k];
+        }
+
+        printf("  %7d  %8.2f  %8.2f  %9.3f  %9.3f  %8d  %10.2f\n",
+               count, t[0] * 1000.0, t[1] * 1000.0, t[2] * 1000.0, t[3] * 1000.0,
+               set.visibleCount, rays / t[4] * 1e-6);
+
+        bvhFree(&bvh);
+        cullSetFree(&set);
+    }
+
+    free(ray);
+}
+
+// ----------------------------------------------------
+// CAMERA
+//
+// View matrices from a target (normalize and cross
+// products) and from a quaternion, and the interpolations
+// that drive animated cameras, in ns per call.
+//
+
+static void benchCamera() {
+
+    const int count = 1 << 16;
+    const int rounds = 16;
+
+    quat *q = (quat *) cpuAlloc(count * sizeof(quat));
+    float *pos = (float *) malloc(count * 3 * sizeof(float));
+    for (int i = 0; i < count; ++i) {
+        float len = 0.0f;
+        for (int k = 0; k < 4; ++k) {
+            q[i].q[k] = randomFloat(-1, 1);
+            len += q[i].q[k] * q[i].q[k];
+        }
+        for (int k = 0; k < 4; ++k)
+            q[i].q[k] /= sqrtf(len);
+        for (int k = 0; k < 3; ++k)
+            pos[i*3 + k] = randomFloat(-20, 20);
+    }
+
+    printf("camera, ns per call\n");
+    printf("  %-7s  %8s  %8s  %8s  %8s\n", "", "lookAt", "quat", "nlerp", "slerp");
+
+    mat4 m;
+    quat r;
+    CpuIsa bound = cpuIsa();
+    for (int isa = 0; isa <= cpuDetect(); ++isa) {
+        cpuBind((CpuIsa) isa);
+        double t[4];
+
+        double t0 = cpuSeconds();
+        for (int n = 0; n < rounds; ++n)
+            for (int i = 0; i + 1 < count; ++i)
+                buildLookAt(m.m, pos + i * 3, pos + i * 3 + 3);
+        t[0] = cpuSeconds() - t0;
+
+        t0 = cpuSeconds();
+        for (int n = 0; n < rounds; ++n)
+            for (int i = 0; i + 1 < count; ++i)
+                buildView(m.m, pos + i * 3, q[i].q);
+        t[1] = cpuSeconds() - t0;
+
+        t0 = cpuSeconds();
+        for (int n = 0; n < rounds; ++n)
+            for (int i = 0; i + 1 < count; ++i)
+                quatNlerp(r.q, q[i].q, q[i + 1].q, 0.3f);
+        t[2] = cpuSeconds() - t0;
+
+        t0 = cpuSeconds();
+        for (int n = 0; n < rounds; ++n)
+            for (int i = 0; i + 1 < count; ++i)
+                quatSlerp(r.q, q[i].q, q[i + 1].q, 0.3f);
+        t[3] = cpuSeconds() - t0;
+
+        printf("  %-7s", cpuIsaName((CpuIsa) isa));
+        for (int k = 0; k < 4; ++k)
+            printf("  %8.2f", t[k] / ((double) rounds * (count - 1)) * 1e9);
+        printf("\n");
+    }
+    cpuBind(bound);
+
+    cpuFree(q);
+    free(pos);
+}
+
+void runBenchmarks() {
+
+    benchVertexStream();
+    benchVertexFormats();
+    benchMeshOpt();
+    benchImport();
+    benchMeshFile();
+    benchPack();
+    benchMatrixChain();
+    benchCamera();
+    benchCulling();
+    benchBvh();
+}
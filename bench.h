@@ -0,0 +1,13 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// ----------------------------------------------------
+// BENCHMARKS
+//
+// Run with g33 -bench, after cpuInit and jobsInit.
+// Results are printed to stdout.
+//
+
+void runBenchmarks();
+
+#endif
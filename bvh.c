@@ -0,0 +1,712 @@
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include <atomic>
+
+#include "bvh.h"
+#include "jobs.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BVH_SSE 1
+#else
+#define BVH_SSE 0
+#endif
+
+// SAH bins per axis
+#define BVH_BINS 16
+
+// leaves never hold more objects than this, and a split
+// is only made below it when the SAH says it pays
+#define BVH_MAX_LEAF 8
+
+// ranges at least this large are binned across the workers
+#define BVH_PARALLEL 65536
+#define BVH_CHUNK 16384
+
+// the top of the tree is split until there are this many
+// subtrees per thread, or they get small
+#define BVH_SUBTREES 4
+#define BVH_SUBTREE_MIN 1024
+
+// nodes per refit job
+#define BVH_REFIT_CHUNK 4096
+
+// ----------------------------------------------------
+// BOXES
+//
+
+// the fourth components are only there for SSE
+struct Box {
+    float lo[4];
+    float hi[4];
+};
+
+static void boxEmpty(Box *b) {
+
+    for (int k = 0; k < 4; ++k) {
+        b->lo[k] = FLT_MAX;
+        b->hi[k] = -FLT_MAX;
+    }
+}
+
+static void boxGrow(Box *b, const float *lo, const float *hi) {
+
+    for (int k = 0; k < 3; ++k) {
+        b->lo[k] = lo[k] < b->lo[k] ? lo[k] : b->lo[k];
+        b->hi[k] = hi[k] > b->hi[k] ? hi[k] : b->hi[k];
+    }
+}
+
+// half the surface area, which is all the SAH needs
+static float boxArea(const Box *b) {
+
+    float dx = b->hi[0] - b->lo[0];
+    float dy = b->hi[1] - b->lo[1];
+    float dz = b->hi[2] - b->lo[2];
+    if (dx < 0.0f)
+        return 0.0f;
+    return dx * dy + dy * dz + dz * dx;
+}
+
+static void itemBox(const CullSet *set, int i, Box *b) {
+
+    b->lo[0] = set->cx[i] - set->ex[i];
+    b->lo[1] = set->cy[i] - set->ey[i];
+    b->lo[2] = set->cz[i] - set->ez[i];
+    b->hi[0] = set->cx[i] + set->ex[i];
+    b->hi[1] = set->cy[i] + set->ey[i];
+    b->hi[2] = set->cz[i] + set->ez[i];
+}
+
+// ----------------------------------------------------
+// BUILDING
+//
+
+// an object as the builder moves it around: its box,
+// center and index, packed so ranges are read in order
+struct Prim {
+    float lo[3];
+    int item;
+    float hi[3];
+    float pad;
+};
+
+struct Builder {
+    Bvh *bvh;
+    Prim *prims;
+    std::atomic<int> nodeCount;
+    std::atomic<int> depth;
+    std::atomic<int> leafCount;
+};
+
+// bounds of the objects and of their centers
+struct Range {
+    Box box;
+    Box centers;
+};
+
+// small ranges use fewer bins, about one per 4 objects
+struct Bins {
+    int binCount;
+    Box box[3][BVH_BINS];
+    int count[3][BVH_BINS];
+};
+
+static void rangeEmpty(Range *r) {
+
+    boxEmpty(&r->box);
+    boxEmpty(&r->centers);
+}
+
+static inline void primCenter(const Prim *p, float *c) {
+
+    for (int k = 0; k < 3; ++k)
+        c[k] = (p->lo[k] + p->hi[k]) * 0.5f;
+}
+
+static void rangeBounds(const Builder *b, int begin, int end, Range *r) {
+
+    for (int i = begin; i < end; ++i) {
+        const Prim *p = &b->prims[i];
+        float c[3];
+        primCenter(p, c);
+        boxGrow(&r->box, p->lo, p->hi);
+        boxGrow(&r->centers, c, c);
+    }
+}
+
+static void binsEmpty(Bins *bins, int binCount) {
+
+    bins->binCount = binCount;
+    for (int a = 0; a < 3; ++a)
+        for (int k = 0; k < binCount; ++k) {
+            boxEmpty(&bins->box[a][k]);
+            bins->count[a][k] = 0;
+        }
+}
+
+static inline int binOf(float c, float lo, float scale, int binCount) {
+
+    int k = (int)((c - lo) * scale);
+    return k < 0 ? 0 : k >= binCount ? binCount - 1 : k;
+}
+
+static void binScales(const Box *centers, int binCount, float *scale) {
+
+    for (int a = 0; a < 3; ++a) {
+        float extent = centers->hi[a] - centers->lo[a];
+        scale[a] = extent > 0.0f ? binCount / extent : 0.0f;
+    }
+}
+
+static void rangeBins(const Builder *b, int begin, int end, const Box *centers, Bins *bins) {
+
+    int binCount = bins->binCount;
+    float scale[3];
+    binScales(centers, binCount, scale);
+
+    for (int i = begin; i < end; ++i) {
+        const Prim *p = &b->prims[i];
+        float c[3];
+        primCenter(p, c);
+#if BVH_SSE
+        // the item and pad lanes end up in the unused fourth components
+        __m128 lo = _mm_loadu_ps(p->lo);
+        __m128 hi = _mm_loadu_ps(p->hi);
+#endif
+        for (int a = 0; a < 3; ++a) {
+            int k = binOf(c[a], centers->lo[a], scale[a], binCount);
+            Box *box = &bins->box[a][k];
+#if BVH_SSE
+            _mm_storeu_ps(box->lo, _mm_min_ps(_mm_loadu_ps(box->lo), lo));
+            _mm_storeu_ps(box->hi, _mm_max_ps(_mm_loadu_ps(box->hi), hi));
+#else
+            boxGrow(box, p->lo, p->hi);
+#endif
+            bins->count[a][k]++;
+        }
+    }
+}
+
+// large ranges are binned one chunk per job, then the
+// partial bins are merged
+struct BinJob {
+    const Builder *b;
+    int begin;
+    int end;
+    const Box *centers;
+    Bins *bins;
+};
+
+static void binsJob(void *ctx, int begin, int end) {
+
+    BinJob *job = (BinJob *) ctx;
+
+    for (int c = begin; c < end; ++c) {
+        int first = job->begin + c * BVH_CHUNK;
+        int last = first + BVH_CHUNK < job->end ? first + BVH_CHUNK : job->end;
+        binsEmpty(&job->bins[c], BVH_BINS);
+        rangeBins(job->b, first, last, job->centers, &job->bins[c]);
+    }
+}
+
+static void parallelBins(const Builder *b, int begin, int end, const Box *centers, Bins *bins) {
+
+    int chunks = (end - begin + BVH_CHUNK - 1) / BVH_CHUNK;
+    BinJob job = { b, begin, end, centers, NULL };
+
+    job.bins = (Bins *) malloc(chunks * sizeof(Bins));
+    parallelFor(chunks, 1, binsJob, &job);
+    for (int c = 0; c < chunks; ++c)
+        for (int a = 0; a < 3; ++a)
+            for (int k = 0; k < BVH_BINS; ++k) {
+                boxGrow(&bins->box[a][k], job.bins[c].box[a][k].lo, job.bins[c].box[a][k].hi);
+                bins->count[a][k] += job.bins[c].count[a][k];
+            }
+    free(job.bins);
+}
+
+static void makeLeaf(Builder *b, BvhNode *node, int begin, int end, int depth) {
+
+    node->first = begin;
+    node->count = end - begin;
+    b->leafCount++;
+
+    int deepest = b->depth.load();
+    while (depth > deepest && !b->depth.compare_exchange_weak(deepest, depth))
+        ;
+}
+
+// Given the bounds r of its objects, sets the box of
+// node and either makes it a leaf, returning -1, or
+// splits it, returning where the objects of the right
+// child start. The children bounds come out of the
+// bins and the partition, so each level reads its
+// objects twice: once to bin them, once to move them.
+static int splitNode(Builder *b, int index, int begin, int end, int depth,
+                     const Range *r, Range *left, Range *right) {
+
+    BvhNode *node = &b->bvh->nodes[index];
+    Prim *prims = b->prims;
+    int count = end - begin;
+    Bins bins;
+
+    memcpy(node->lo, r->box.lo, sizeof(node->lo));
+    memcpy(node->hi, r->box.hi, sizeof(node->hi));
+
+    if (count == 1 || depth >= BVH_MAX_DEPTH - 1) {
+        makeLeaf(b, node, begin, end, depth);
+        return -1;
+    }
+
+    binsEmpty(&bins, count / 4 < 4 ? 4 : count / 4 > BVH_BINS ? BVH_BINS : count / 4);
+    if (count >= BVH_PARALLEL)
+        parallelBins(b, begin, end, &r->centers, &bins);
+    else
+        rangeBins(b, begin, end, &r->centers, &bins);
+
+    // cost of splitting after each bin, on every axis
+    float bestCost = FLT_MAX;
+    int bestAxis = -1, bestBin = 0;
+
+    for (int a = 0; a < 3; ++a) {
+        if (r->centers.hi[a] <= r->centers.lo[a])
+            continue;
+
+        float rightArea[BVH_BINS];
+        int rightCount[BVH_BINS];
+        Box box;
+        int n = 0;
+
+        boxEmpty(&box);
+        for (int k = bins.binCount - 1; k > 0; --k) {
+            boxGrow(&box, bins.box[a][k].lo, bins.box[a][k].hi);
+            n += bins.count[a][k];
+            rightArea[k] = boxArea(&box);
+            rightCount[k] = n;
+        }
+
+        boxEmpty(&box);
+        n = 0;
+        for (int k = 0; k < bins.binCount - 1; ++k) {
+            boxGrow(&box, bins.box[a][k].lo, bins.box[a][k].hi);
+            n += bins.count[a][k];
+            if (n == 0 || rightCount[k + 1] == 0)
+                continue;
+            float cost = boxArea(&box) * n + rightArea[k + 1] * rightCount[k + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = a;
+                bestBin = k;
+            }
+        }
+    }
+
+    // a split costs one box test more than the objects it skips
+    float area = boxArea(&r->box);
+    if (count <= BVH_MAX_LEAF && (bestAxis < 0 || area <= 0.0f || 1.0f + bestCost / area >= count)) {
+        makeLeaf(b, node, begin, end, depth);
+        return -1;
+    }
+
+    rangeEmpty(left);
+    rangeEmpty(right);
+
+    int mid;
+    if (bestAxis < 0) {
+        // all the centers are the same, any split will do
+        mid = begin + count / 2;
+        rangeBounds(b, begin, mid, left);
+        rangeBounds(b, mid, end, right);
+    } else {
+        int a = bestAxis;
+        float lo = r->centers.lo[a];
+        float scale[3];
+        binScales(&r->centers, bins.binCount, scale);
+
+        for (int k = 0; k < bins.binCount; ++k) {
+            Range *side = k <= bestBin ? left : right;
+            boxGrow(&side->box, bins.box[a][k].lo, bins.box[a][k].hi);
+        }
+
+        int i = begin, j = end - 1;
+        while (i <= j) {
+            float c[3];
+            primCenter(&prims[i], c);
+            if (binOf(c[a], lo, scale[a], bins.binCount) <= bestBin) {
+                boxGrow(&left->centers, c, c);
+                ++i;
+            } else {
+                boxGrow(&right->centers, c, c);
+                Prim t = prims[i];
+                prims[i] = prims[j];
+                prims[j--] = t;
+            }
+        }
+        mid = i;
+    }
+
+    node->first = b->nodeCount.fetch_add(2);
+    node->count = 0;
+    return mid;
+}
+
+static void buildSubtree(Builder *b, int index, int begin, int end, int depth, const Range *r) {
+
+    Range left, right;
+    int mid = splitNode(b, index, begin, end, depth, r, &left, &right);
+    if (mid < 0)
+        return;
+
+    int first = b->bvh->nodes[index].first;
+    buildSubtree(b, first, begin, mid, depth + 1, &left);
+    buildSubtree(b, first + 1, mid, end, depth + 1, &right);
+}
+
+struct BuildTask {
+    int node;
+    int begin;
+    int end;
+    int depth;
+    Range range;
+};
+
+struct SubtreeJob {
+    Builder *b;
+    BuildTask *tasks;
+};
+
+static void subtreeJob(void *ctx, int begin, int end) {
+
+    SubtreeJob *job = (SubtreeJob *) ctx;
+
+    for (int t = begin; t < end; ++t) {
+        BuildTask *task = &job->tasks[t];
+        buildSubtree(job->b, task->node, task->begin, task->end, task->depth, &task->range);
+    }
+}
+
+void bvhInit(Bvh *bvh) {
+
+    memset(bvh, 0, sizeof(Bvh));
+}
+
+void bvhFree(Bvh *bvh) {
+
+    cpuFree(bvh->nodes);
+    free(bvh->items);
+    bvhInit(bvh);
+}
+
+void bvhBuild(Bvh *bvh, const CullSet *set) {
+
+    int count = set->count;
+
+    bvhFree(bvh);
+    if (count == 0)
+        return;
+
+    // a binary tree with n leaves has 2n - 1 nodes
+    bvh->nodes = (BvhNode *) cpuAlloc(2 * count * sizeof(BvhNode));
+    bvh->items = (int *) malloc(count * sizeof(int));
+    bvh->itemCount = count;
+
+    Builder b;
+    b.bvh = bvh;
+    b.prims = (Prim *) cpuAlloc(count * sizeof(Prim));
+    b.nodeCount = 1;
+    b.depth = 0;
+    b.leafCount = 0;
+
+    int target = jobsThreadCount() * BVH_SUBTREES;
+    BuildTask *tasks = (BuildTask *) malloc((target + 1) * sizeof(BuildTask));
+    int taskCount = 1;
+    tasks[0].node = 0;
+    tasks[0].begin = 0;
+    tasks[0].end = count;
+    tasks[0].depth = 0;
+    rangeEmpty(&tasks[0].range);
+
+    for (int i = 0; i < count; ++i) {
+        Prim *p = &b.prims[i];
+        Box box;
+        float c[3];
+        itemBox(set, i, &box);
+        memcpy(p->lo, box.lo, sizeof(box.lo));
+        memcpy(p->hi, box.hi, sizeof(box.hi));
+        p->item = i;
+        primCenter(p, c);
+        boxGrow(&tasks[0].range.box, p->lo, p->hi);
+        boxGrow(&tasks[0].range.centers, c, c);
+    }
+
+    // split the largest pending range until every thread
+    // has a few subtrees to build
+    while (taskCount > 0 && taskCount < target) {
+        int largest = 0;
+        for (int t = 1; t < taskCount; ++t)
+            if (tasks[t].end - tasks[t].begin > tasks[largest].end - tasks[largest].begin)
+                largest = t;
+
+        BuildTask task = tasks[largest];
+        if (task.end - task.begin < BVH_SUBTREE_MIN)
+            break;
+
+        BuildTask l, r;
+        int mid = splitNode(&b, task.node, task.begin, task.end, task.depth, &task.range, &l.range, &r.range);
+        if (mid < 0) {
+            tasks[largest] = tasks[--taskCount];
+            continue;
+        }
+
+        l.node = bvh->nodes[task.node].first;
+        l.begin = task.begin;
+        l.end = mid;
+        l.depth = task.depth + 1;
+        r.node = l.node + 1;
+        r.begin = mid;
+        r.end = task.end;
+        r.depth = task.depth + 1;
+        tasks[largest] = l;
+        tasks[taskCount++] = r;
+    }
+
+    SubtreeJob job = { &b, tasks };
+    parallelFor(taskCount, 1, subtreeJob, &job);
+    free(tasks);
+
+    for (int i = 0; i < count; ++i)
+        bvh->items[i] = b.prims[i].item;
+    cpuFree(b.prims);
+
+    bvh->nodeCount = b.nodeCount;
+    bvh->depth = b.depth + 1;
+    bvh->leafCount = b.leafCount;
+}
+
+// ----------------------------------------------------
+// REFITTING
+//
+// Leaves are refitted on the workers, then the inner
+// nodes from the last to the first, so both children
+// are up to date when their parent is.
+//
+
+struct RefitJob {
+    Bvh *bvh;
+    const CullSet *set;
+};
+
+static void refitLeaves(void *ctx, int begin, int end) {
+
+    RefitJob *job = (RefitJob *) ctx;
+
+    for (int n = begin; n < end; ++n) {
+        BvhNode *node = &job->bvh->nodes[n];
+        if (!node->count)
+            continue;
+
+        Box box;
+        boxEmpty(&box);
+        for (int i = node->first; i < node->first + node->count; ++i) {
+            Box item;
+            itemBox(job->set, job->bvh->items[i], &item);
+            boxGrow(&box, item.lo, item.hi);
+        }
+        memcpy(node->lo, box.lo, sizeof(node->lo));
+        memcpy(node->hi, box.hi, sizeof(node->hi));
+    }
+}
+
+void bvhRefit(Bvh *bvh, const CullSet *set) {
+
+    RefitJob job = { bvh, set };
+    parallelFor(bvh->nodeCount, BVH_REFIT_CHUNK, refitLeaves, &job);
+
+    for (int n = bvh->nodeCount - 1; n >= 0; --n) {
+        BvhNode *node = &bvh->nodes[n];
+        if (node->count)
+            continue;
+
+        const BvhNode *l = &bvh->nodes[node->first];
+        const BvhNode *r = l + 1;
+        for (int k = 0; k < 3; ++k) {
+            node->lo[k] = l->lo[k] < r->lo[k] ? l->lo[k] : r->lo[k];
+            node->hi[k] = l->hi[k] > r->hi[k] ? l->hi[k] : r->hi[k];
+        }
+    }
+}
+
+// ----------------------------------------------------
+// FRUSTUM TRAVERSAL
+//
+// Each node is only tested against the planes its parent
+// was not entirely inside of, once a node is inside all
+// six its whole subtree is visible without more tests.
+//
+
+#define ALL_PLANES 0x3F
+
+// -1 when outside, else the planes still to test below
+static inline int classify(const Frustum *f, int mask, float cx, float cy, float cz, float ex, float ey, float ez) {
+
+    for (int p = 0; p < 6; ++p) {
+        if (!(mask & (1 << p)))
+            continue;
+        const float *n = f->planes[p];
+        float d = n[0] * cx + n[1] * cy + n[2] * cz + n[3];
+        float r = fabsf(n[0]) * ex + fabsf(n[1]) * ey + fabsf(n[2]) * ez;
+        if (d + r < 0.0f)
+            return -1;
+        if (d - r >= 0.0f)
+            mask &= ~(1 << p);
+    }
+    return mask;
+}
+
+void bvhCull(const Bvh *bvh, CullSet *set, const Frustum *f) {
+
+    double t0 = cpuSeconds();
+
+    int stack[2 * BVH_MAX_DEPTH];
+    int masks[2 * BVH_MAX_DEPTH];
+    int top = 0;
+    int n = 0;
+
+    if (bvh->nodeCount) {
+        stack[0] = 0;
+        masks[0] = ALL_PLANES;
+        top = 1;
+    }
+
+    while (top > 0) {
+        --top;
+        const BvhNode *node = &bvh->nodes[stack[top]];
+        int mask = masks[top];
+
+        if (mask) {
+            mask = classify(f, mask,
+                            (node->lo[0] + node->hi[0]) * 0.5f,
+                            (node->lo[1] + node->hi[1]) * 0.5f,
+                            (node->lo[2] + node->hi[2]) * 0.5f,
+                            (node->hi[0] - node->lo[0]) * 0.5f,
+                            (node->hi[1] - node->lo[1]) * 0.5f,
+                            (node->hi[2] - node->lo[2]) * 0.5f);
+            if (mask < 0)
+                continue;
+        }
+
+        if (node->count) {
+            const int *items = bvh->items + node->first;
+            for (int i = 0; i < node->count; ++i) {
+                int item = items[i];
+                if (mask == 0 ||
+                    classify(f, mask, set->cx[item], set->cy[item], set->cz[item],
+                             set->ex[item], set->ey[item], set->ez[item]) >= 0)
+                    set->visible[n++] = item;
+            }
+        } else {
+            stack[top] = node->first + 1;
+            masks[top++] = mask;
+            stack[top] = node->first;
+            masks[top++] = mask;
+        }
+    }
+    set->visibleCount = n;
+
+    set->stats.tested = set->count;
+    set->stats.visible = n;
+    set->stats.culled = set->count - n;
+    set->stats.seconds = cpuSeconds() - t0;
+}
+
+// ----------------------------------------------------
+// RAY TRAVERSAL
+//
+// Children are visited nearest first, and skipped when
+// the ray enters them further than the closest hit.
+//
+
+// distance at which the ray enters the box, or FLT_MAX
+static inline float slab(const float *lo, const float *hi, const float *origin, const float *inv, float maxT) {
+
+    float tmin = 0.0f, tmax = maxT;
+
+    for (int k = 0; k < 3; ++k) {
+        float t1 = (lo[k] - origin[k]) * inv[k];
+        float t2 = (hi[k] - origin[k]) * inv[k];
+        // fminf and fmaxf drop the NaN of 0 * inf
+        tmin = fmaxf(tmin, fminf(t1, t2));
+        tmax = fminf(tmax, fmaxf(t1, t2));
+    }
+    return tmin <= tmax ? tmin : FLT_MAX;
+}
+
+int bvhRaycast(const Bvh *bvh, const CullSet *set, const float *origin, const float *dir, float maxT,
+               float *t, BvhRayFunc hit, void *ctx) {
+
+    float inv[3] = { 1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2] };
+    int stack[2 * BVH_MAX_DEPTH];
+    float entry[2 * BVH_MAX_DEPTH];
+    int top = 0;
+    float best = maxT;
+    int found = -1;
+
+    if (bvh->nodeCount) {
+        float d = slab(bvh->nodes[0].lo, bvh->nodes[0].hi, origin, inv, maxT);
+        if (d != FLT_MAX) {
+            stack[0] = 0;
+            entry[0] = d;
+            top = 1;
+        }
+    }
+
+    while (top > 0) {
+        --top;
+        if (entry[top] > best)
+            continue;
+        const BvhNode *node = &bvh->nodes[stack[top]];
+
+        if (node->count) {
+            for (int i = node->first; i < node->first + node->count; ++i) {
+                int item = bvh->items[i];
+                Box box;
+                itemBox(set, item, &box);
+                float d = slab(box.lo, box.hi, origin, inv, best);
+                if (d == FLT_MAX)
+                    continue;
+                if (hit) {
+                    d = hit(ctx, item, origin, dir);
+                    if (d < 0.0f || d > best)
+                        continue;
+                }
+                best = d;
+                found = item;
+            }
+        } else {
+            const BvhNode *l = &bvh->nodes[node->first];
+            float dl = slab(l->lo, l->hi, origin, inv, best);
+            float dr = slab(l[1].lo, l[1].hi, origin, inv, best);
+            int first = node->first, second = node->first + 1;
+            if (dr < dl) {
+                float d = dl; dl = dr; dr = d;
+                first = second; second = node->first;
+            }
+            if (dr != FLT_MAX) {
+                stack[top] = second;
+                entry[top++] = dr;
+            }
+            if (dl != FLT_MAX) {
+                stack[top] = first;
+                entry[top++] = dl;
+            }
+        }
+    }
+
+    if (t && found >= 0)
+        *t = best;
+    return found;
+}
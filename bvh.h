@@ -0,0 +1,65 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "cull.h"
+
+// ----------------------------------------------------
+// BOUNDING VOLUME HIERARCHY
+//
+// A binary tree of boxes over the objects of a cull set.
+// It is built with the surface area heuristic (binned),
+// the top levels binning in parallel and the subtrees
+// below them built on the worker threads. When objects
+// move but stay the same objects, bvhRefit recomputes
+// the boxes bottom up and keeps the tree as it is.
+//
+// The objects of any subtree are contiguous in items,
+// and children always come after their parent in nodes.
+//
+
+// nodes deeper than this are made leaves
+#define BVH_MAX_DEPTH 64
+
+struct BvhNode {
+    float lo[3];
+    int first;      // first in items for a leaf, left child otherwise
+    float hi[3];
+    int count;      // objects in a leaf, 0 otherwise
+};
+
+struct Bvh {
+
+    BvhNode *nodes;
+    int nodeCount;
+
+    // object indices, in leaf order
+    int *items;
+    int itemCount;
+
+    int depth;
+    int leafCount;
+};
+
+void bvhInit(Bvh *bvh);
+void bvhFree(Bvh *bvh);
+
+// builds the tree over the boxes of set
+void bvhBuild(Bvh *bvh, const CullSet *set);
+
+// after cullSetUpdate, the set must hold the same objects
+void bvhRefit(Bvh *bvh, const CullSet *set);
+
+// like cullSetRun, but the visible objects are in tree order
+void bvhCull(const Bvh *bvh, CullSet *set, const Frustum *f);
+
+// Narrow phase for rays: returns the distance along dir
+// at which the ray hits the object, or a negative value.
+typedef float (*BvhRayFunc)(void *ctx, int item, const float *origin, const float *dir);
+
+// Closest object hit by origin + t * dir, 0 <= t <= maxT,
+// or -1. Without hit, objects are hit on their box. t gets
+// the distance when not NULL.
+int bvhRaycast(const Bvh *bvh, const CullSet *set, const float *origin, const float *dir, float maxT,
+               float *t, BvhRayFunc hit, void *ctx);
+
+#endif
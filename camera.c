@@ -0,0 +1,219 @@
+#include <string.h>
+#include <math.h>
+
+#include "camera.h"
+
+// ----------------------------------------------------
+// BUILDERS
+//
+
+static float focalLength(float fov) {
+
+    return 1.0f / tan(fov * (3.14159265358979323846 / 360.0));
+}
+
+void buildPerspective(float *mat, float fov, float ratio, float nearPlane, float farPlane) {
+
+    buildPerspectiveFocal(mat, focalLength(fov), ratio, nearPlane, farPlane);
+}
+
+void buildPerspectiveFocal(float *mat, float focal, float ratio, float nearPlane, float farPlane) {
+
+    memset(mat, 0, 16 * sizeof(float));
+
+    mat[0] = focal / ratio;
+    mat[1 * 4 + 1] = focal;
+    mat[2 * 4 + 2] = (farPlane + nearPlane) / (nearPlane - farPlane);
+    mat[3 * 4 + 2] = (2.0f * farPlane * nearPlane) / (nearPlane - farPlane);
+    mat[2 * 4 + 3] = -1.0f;
+}
+
+// With the up vector fixed at (0, 1, 0) the two cross
+// products collapse to a few multiplies, and the view
+// translation is just the basis dotted with the position.
+void buildLookAt(float *mat, const float *pos, const float *target) {
+
+    float dir[3], right[3], up[3];
+
+    dir[0] = target[0] - pos[0];
+    dir[1] = target[1] - pos[1];
+    dir[2] = target[2] - pos[2];
+
+    float invLen = 1.0f / sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+    dir[0] *= invLen;
+    dir[1] *= invLen;
+    dir[2] *= invLen;
+
+    // right = dir x up
+    float invRight = 1.0f / sqrtf(dir[0] * dir[0] + dir[2] * dir[2]);
+    right[0] = -dir[2] * invRight;
+    right[1] = 0.0f;
+    right[2] =  dir[0] * invRight;
+
+    // up = right x dir, unit length already
+    up[0] = -right[2] * dir[1];
+    up[1] =  right[2] * dir[0] - right[0] * dir[2];
+    up[2] =  right[0] * dir[1];
+
+    mat[0]  = right[0];
+    mat[4]  = right[1];
+    mat[8]  = right[2];
+    mat[12] = -(right[0] * pos[0] + right[2] * pos[2]);
+
+    mat[1]  = up[0];
+    mat[5]  = up[1];
+    mat[9]  = up[2];
+    mat[13] = -(up[0] * pos[0] + up[1] * pos[1] + up[2] * pos[2]);
+
+    mat[2]  = -dir[0];
+    mat[6]  = -dir[1];
+    mat[10] = -dir[2];
+    mat[14] = dir[0] * pos[0] + dir[1] * pos[1] + dir[2] * pos[2];
+
+    mat[3]  = 0.0f;
+    mat[7]  = 0.0f;
+    mat[11] = 0.0f;
+    mat[15] = 1.0f;
+}
+
+// The view rotation is the transpose of the camera's,
+// which is the rotation of the conjugate quaternion:
+// the terms of quatToMatrix with x, y and z negated.
+void buildView(float *mat, const float *pos, const float *orientation) {
+
+    float x = orientation[0], y = orientation[1], z = orientation[2], w = orientation[3];
+    float xx = x * x, yy = y * y, zz = z * z;
+    float xy = x * y, xz = x * z, yz = y * z;
+    float wx = w * x, wy = w * y, wz = w * z;
+
+    mat[0]  = 1.0f - 2.0f * (yy + zz);
+    mat[1]  = 2.0f * (xy - wz);
+    mat[2]  = 2.0f * (xz + wy);
+    mat[3]  = 0.0f;
+
+    mat[4]  = 2.0f * (xy + wz);
+    mat[5]  = 1.0f - 2.0f * (xx + zz);
+    mat[6]  = 2.0f * (yz - wx);
+    mat[7]  = 0.0f;
+
+    mat[8]  = 2.0f * (xz - wy);
+    mat[9]  = 2.0f * (yz + wx);
+    mat[10] = 1.0f - 2.0f * (xx + yy);
+    mat[11] = 0.0f;
+
+    mat[12] = -(mat[0] * pos[0] + mat[4] * pos[1] + mat[8] * pos[2]);
+    mat[13] = -(mat[1] * pos[0] + mat[5] * pos[1] + mat[9] * pos[2]);
+    mat[14] = -(mat[2] * pos[0] + mat[6] * pos[1] + mat[10] * pos[2]);
+    mat[15] = 1.0f;
+}
+
+// ----------------------------------------------------
+// CAMERA
+//
+
+void cameraInit(Camera *cam) {
+
+    memset(cam, 0, sizeof(Camera));
+
+    cam->target[2] = -1.0f;
+    quatIdentity(cam->orientation.q);
+    cam->fov = 53.13f;
+    cam->ratio = 1.0f;
+    cam->nearPlane = 1.0f;
+    cam->farPlane = 30.0f;
+    cam->focal = focalLength(cam->fov);
+    cam->dirty = CAMERA_VIEW | CAMERA_PROJ;
+}
+
+static bool same3(const float *a, float x, float y, float z) {
+
+    return a[0] == x && a[1] == y && a[2] == z;
+}
+
+void cameraSetPosition(Camera *cam, float x, float y, float z) {
+
+    if (same3(cam->pos, x, y, z))
+        return;
+    cam->pos[0] = x;
+    cam->pos[1] = y;
+    cam->pos[2] = z;
+    cam->dirty |= CAMERA_VIEW;
+}
+
+void cameraSetTarget(Camera *cam, float x, float y, float z) {
+
+    if (same3(cam->target, x, y, z))
+        return;
+    cam->target[0] = x;
+    cam->target[1] = y;
+    cam->target[2] = z;
+    cam->oriented = false;
+    cam->dirty |= CAMERA_VIEW;
+}
+
+void cameraSetOrientation(Camera *cam, const float *q) {
+
+    if (cam->oriented && memcmp(cam->orientation.q, q, 4 * sizeof(float)) == 0)
+        return;
+    memcpy(cam->orientation.q, q, 4 * sizeof(float));
+    cam->oriented = true;
+    cam->dirty |= CAMERA_VIEW;
+}
+
+void cameraSetProjection(Camera *cam, float fov, float ratio, float nearPlane, float farPlane) {
+
+    if (cam->fov == fov && cam->ratio == ratio && cam->nearPlane == nearPlane && cam->farPlane == farPlane)
+        return;
+    if (cam->fov != fov)
+        cam->focal = focalLength(fov);
+    cam->fov = fov;
+    cam->ratio = ratio;
+    cam->nearPlane = nearPlane;
+    cam->farPlane = farPlane;
+    cam->dirty |= CAMERA_PROJ;
+}
+
+void cameraSetAspect(Camera *cam, float ratio) {
+
+    cameraSetProjection(cam, cam->fov, ratio, cam->nearPlane, cam->farPlane);
+}
+
+// The position, target and orientation are recovered from
+// the matrix, so setting them again to the same values
+// keeps it.
+void cameraSetView(Camera *cam, const float *view) {
+
+    float inv[16];
+
+    memcpy(cam->view.m, view, 16 * sizeof(float));
+    mat4AffineInverse(inv, view);
+
+    cam->pos[0] = inv[12];
+    cam->pos[1] = inv[13];
+    cam->pos[2] = inv[14];
+    cam->target[0] = inv[12] - inv[8];
+    cam->target[1] = inv[13] - inv[9];
+    cam->target[2] = inv[14] - inv[10];
+    quatFromMatrix(cam->orientation.q, inv);
+
+    cam->dirty = (cam->dirty & ~CAMERA_VIEW) | CAMERA_VIEWPROJ;
+}
+
+unsigned int cameraUpdate(Camera *cam) {
+
+    if (!cam->dirty)
+        return cam->generation;
+
+    if (cam->dirty & CAMERA_VIEW) {
+        if (cam->oriented)
+            buildView(cam->view.m, cam->pos, cam->orientation.q);
+        else
+            buildLookAt(cam->view.m, cam->pos, cam->target);
+    }
+    if (cam->dirty & CAMERA_PROJ)
+        buildPerspectiveFocal(cam->proj.m, cam->focal, cam->ratio, cam->nearPlane, cam->farPlane);
+    mat4Mult(cam->viewProj.m, cam->proj.m, cam->view.m);
+
+    cam->dirty = 0;
+    return ++cam->generation;
+}
@@ -0,0 +1,70 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include "quat.h"
+
+// ----------------------------------------------------
+// CAMERA
+//
+// Caches the view, projection and view * projection
+// matrices and only rebuilds the ones invalidated by a
+// change. The generation number moves each time any of
+// them is rebuilt, so users can tell when to re-upload.
+//
+// The view comes either from a position and a target,
+// with a fixed up vector, or from a position and an
+// orientation quaternion, which is what animations and
+// mouse look use: no normalize or cross product then.
+//
+
+enum {
+    CAMERA_VIEW = 1,
+    CAMERA_PROJ = 2,
+    CAMERA_VIEWPROJ = 4
+};
+
+struct Camera {
+
+    float pos[3];
+    float target[3];
+
+    // camera to world rotation, used instead of the target
+    // when oriented is set
+    quat orientation;
+    bool oriented;
+
+    float fov, ratio, nearPlane, farPlane;
+
+    // 1 / tan(fov / 2), only recomputed when the fov changes
+    float focal;
+
+    int dirty;
+    unsigned int generation;
+
+    mat4 view;
+    mat4 proj;
+    mat4 viewProj;
+};
+
+void cameraInit(Camera *cam);
+
+void cameraSetPosition(Camera *cam, float x, float y, float z);
+void cameraSetTarget(Camera *cam, float x, float y, float z);
+void cameraSetOrientation(Camera *cam, const float *q);
+void cameraSetProjection(Camera *cam, float fov, float ratio, float nearPlane, float farPlane);
+void cameraSetAspect(Camera *cam, float ratio);
+
+// uses a prebuilt rigid view matrix, e.g. one from lookAtMatrix,
+// until the position or target is set again
+void cameraSetView(Camera *cam, const float *view);
+
+// rebuilds the dirty matrices, returns the generation
+unsigned int cameraUpdate(Camera *cam);
+
+// closed form builders, writing column major matrices
+void buildPerspective(float *mat, float fov, float ratio, float nearPlane, float farPlane);
+void buildPerspectiveFocal(float *mat, float focal, float ratio, float nearPlane, float farPlane);
+void buildLookAt(float *mat, const float *pos, const float *target);
+void buildView(float *mat, const float *pos, const float *orientation);
+
+#endif
@@ -0,0 +1,669 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#endif
+
+#include <GL/glew.h>
+
+#include "cpu.h"
+#include "jobs.h"
+#include "hash.h"
+#include "mapfile.h"
+#include "manifest.h"
+#include "vertexformat.h"
+#include "meshimport.h"
+#include "meshopt.h"
+#include "meshfile.h"
+#include "texfile.h"
+#include "pack.h"
+#include "shadersource.h"
+#include "cull.h"
+
+// ----------------------------------------------------
+// ASSET COOKER
+//
+// cook [-o dir] [-f] [-p] sources...
+//
+// Turns the sources into what the renderer loads: OBJ and
+// PLY meshes into mesh files in the scene's vertex format,
+// indexed and ordered for the vertex cache, binary PGM and
+// PPM images into RGBA8 texture files with all their
+// levels, and shaders, with the files they #include, into
+// text inside the manifest. The
+// manifest, written last into dir (cooked by default),
+// lists them all by the name they were given.
+//
+// Cooked files are named by the hash of their source, so
+// a source cooks to the same file wherever it comes from.
+// A source whose size and modification time are those in
+// the previous manifest is not even read; one that was
+// touched is hashed, and only cooked when its content
+// changed. Shaders are always read, as what they include
+// may have changed. -f cooks everything again.
+//
+// Inputs are checked by all the threads at once. Meshes
+// are cooked one at a time, as importing one already uses
+// all the threads, the other assets all at once.
+//
+// -p also packs the cooked files, compressed, into one
+// pack file next to the manifest, which g33 then reads
+// them from; it is written again when the cooked files it
+// should hold are not those it holds.
+//
+
+// changing what the cooker writes means a new version
+#define COOK_VERSION 1
+
+struct CookInput {
+    const char *name;           // the path it was given
+    AssetType type;
+    const char *extension;      // of the cooked file
+
+    unsigned long long size;
+    long long time;             // in nanoseconds
+    unsigned long long hash;
+    const ManifestEntry *previous;
+
+    bool stale;
+    bool failed;
+    char file[32];              // the cooked file, in the output
+    const CookInput *sameAs;    // the input cooking that file, when another
+
+    // what the manifest holds, shader text
+    const char *data;
+    size_t dataSize;
+    char *cooked;               // data when it is new
+
+    double seconds;
+};
+
+struct Cooker {
+    const char *dir;
+    bool force;
+    bool pack;
+    Manifest previous;
+
+    CookInput *inputs;
+    int inputCount;
+};
+
+static const char *extensionOf(const char *path) {
+
+    const char *dot = strrchr(path, '.');
+    const char *slash = strrchr(path, '/');
+    return dot && (!slash || dot > slash) ? dot : "";
+}
+
+static bool classify(CookInput *input) {
+
+    const char *ext = extensionOf(input->name);
+    if (strcmp(ext, ".obj") == 0 || strcmp(ext, ".ply") == 0) {
+        input->type = ASSET_MESH;
+        input->extension = MESH_FILE_EXTENSION;
+    } else if (strcmp(ext, ".pgm") == 0 || strcmp(ext, ".ppm") == 0) {
+        input->type = ASSET_TEXTURE;
+        input->extension = TEXTURE_FILE_EXTENSION;
+    } else if (strcmp(ext, ".vert") == 0 || strcmp(ext, ".frag") == 0 ||
+               strcmp(ext, ".geom") == 0 || strcmp(ext, ".glsl") == 0) {
+        input->type = ASSET_SHADER;
+        input->extension = NULL;
+    } else
+        return false;
+    return true;
+}
+
+static bool fileExists(const char *path) {
+
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+static void outputPath(const Cooker *cooker, const char *file, char *path, size_t size) {
+
+    snprintf(path, size, "%s/%s", cooker->dir, file);
+}
+
+// ----------------------------------------------------
+// CHECKING
+//
+
+// the text with what it includes, from a library of its
+// own as the inputs are checked on all the threads
+static char *expandShader(const char *path) {
+
+    ShaderLibrary lib;
+    shaderLibraryInit(&lib, false);
+    int file = shaderLibraryOpen(&lib, path);
+    char *text = file >= 0 ? strdup(shaderLibraryText(&lib, file)) : NULL;
+    shaderLibraryFree(&lib);
+    return text;
+}
+
+static void checkInput(const Cooker *cooker, CookInput *input) {
+
+    MappedFile map;
+    char path[1024];
+
+    if (!fileTime(input->name, &input->size, &input->time)) {
+        printf("%s: cannot open\n", input->name);
+        input->failed = true;
+        return;
+    }
+
+    const ManifestEntry *prev = manifestFind(&cooker->previous, input->name);
+    if (prev && prev->type != (unsigned int) input->type)
+        prev = NULL;
+    input->previous = prev;
+
+    // untouched since the last time, or hashed again
+    if (input->type == ASSET_SHADER) {
+        input->cooked = expandShader(input->name);
+        if (!input->cooked) {
+            input->failed = true;
+            return;
+        }
+        input->hash = hash64(input->cooked, strlen(input->cooked), ((unsigned long long) COOK_VERSION << 8) | input->type);
+    } else if (prev && !cooker->force && prev->sourceSize == input->size && prev->sourceTime == input->time)
+        input->hash = prev->sourceHash;
+    else {
+        if (!mappedFileOpen(&map, input->name)) {
+            printf("%s: cannot open\n", input->name);
+            input->failed = true;
+            return;
+        }
+        input->hash = hash64(map.data, map.size, ((unsigned long long) COOK_VERSION << 8) | input->type);
+        mappedFileClose(&map);
+    }
+
+    input->stale = cooker->force || !prev || prev->sourceHash != input->hash;
+    if (input->extension) {
+        snprintf(input->file, sizeof(input->file), "%016llx%s", input->hash, input->extension);
+        outputPath(cooker, input->file, path, sizeof(path));
+        input->stale = input->stale || !fileExists(path);
+    } else if (!input->stale) {
+        free(input->cooked);
+        input->cooked = NULL;
+        input->data = manifestData(&cooker->previous, prev);
+        input->dataSize = (size_t) prev->dataSize;
+    }
+}
+
+static void checkJob(void *ctx, int begin, int end) {
+
+    Cooker *cooker = (Cooker *) ctx;
+    for (int i = begin; i < end; ++i)
+        checkInput(cooker, &cooker->inputs[i]);
+}
+
+// files are named by the content, so inputs with the same
+// bytes, or given twice, would write one file at the same
+// time; the first cooks it and the others wait for it
+static void dedupeInputs(Cooker *cooker) {
+
+    for (int i = 0; i < cooker->inputCount; ++i) {
+        CookInput *input = &cooker->inputs[i];
+        if (!input->stale || input->failed || !input->extension)
+            continue;
+        for (int j = 0; j < i; ++j) {
+            const CookInput *other = &cooker->inputs[j];
+            if (other->stale && !other->failed && !other->sameAs && strcmp(other->file, input->file) == 0) {
+                input->stale = false;
+                input->sameAs = other;
+                break;
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------
+// MESHES
+//
+
+static bool cookMesh(const Cooker *cooker, CookInput *input) {
+
+    ImportedMesh model;
+    IndexedMesh mesh;
+    MeshOptStats stats;
+    VertexFormat fmt;
+    MeshFileHeader header;
+    Bounds bounds;
+    char path[1024], temporary[1040];
+
+    if (!meshImport(&model, input->name))
+        return false;
+    if (model.indexCount == 0) {
+        printf("%s: no triangles\n", input->name);
+        importedMeshFree(&model);
+        return false;
+    }
+
+    vertexFormatScene(&fmt);
+    VertexSource src;
+    vertexSourceInit(&src, model.vertexCount);
+    vertexSourceSet(&src, VERTEX_POSITION, model.positions, 4);
+    vertexSourceSet(&src, VERTEX_COLOR, model.colors, 4);
+
+    mesh.vertices = (unsigned char *) malloc((size_t) model.vertexCount * fmt.stride);
+    vertexFormatPack(&fmt, &src, mesh.vertices);
+    mesh.vertexCount = model.vertexCount;
+    mesh.stride = fmt.stride;
+    mesh.indices = model.indices;
+    mesh.indexCount = model.indexCount;
+    model.indices = NULL;
+    indexedMeshOptimize(&mesh, &stats);
+    boundsFromPoints(&bounds, model.positions, model.vertexCount);
+
+    memset(&header, 0, sizeof(header));
+    meshFileSetFormat(&header, &fmt);
+    header.vertexCount = mesh.vertexCount;
+    header.indexCount = mesh.indexCount;
+    header.indexType = mesh.vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    header.lodCount = 1;
+    header.lods[0].indexCount = mesh.indexCount;
+    memcpy(header.center, bounds.center, sizeof(header.center));
+    memcpy(header.extents, bounds.extents, sizeof(header.extents));
+    header.radius = bounds.radius;
+
+    void *indices = mesh.indices;
+    if (header.indexType == GL_UNSIGNED_SHORT) {
+        unsigned short *shorts = (unsigned short *) malloc(mesh.indexCount * sizeof(unsigned short));
+        for (int i = 0; i < mesh.indexCount; ++i)
+            shorts[i] = (unsigned short) mesh.indices[i];
+        indices = shorts;
+    }
+
+    outputPath(cooker, input->file, path, sizeof(path));
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    bool ok = commitFile(temporary, path, meshFileWrite(temporary, &header, mesh.vertices, indices));
+    if (!ok)
+        printf("%s: cannot write\n", path);
+    else
+        printf("%s: %d indices, %d vertices, ACMR %.3f, %d triangles\n",
+               input->name, stats.indices, stats.vertices, stats.acmrAfter, mesh.indexCount / 3);
+
+    if (indices != mesh.indices)
+        free(indices);
+    indexedMeshFree(&mesh);
+    importedMeshFree(&model);
+    return ok;
+}
+
+// ----------------------------------------------------
+// TEXTURES
+//
+
+// a number of the netpbm header, after blanks and comments
+static const unsigned char *pnmNumber(const unsigned char *p, const unsigned char *end, unsigned int *value) {
+
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == '#')) {
+        if (*p == '#')
+            while (p < end && *p != '\n')
+                ++p;
+        else
+            ++p;
+    }
+    if (p == end || *p < '0' || *p > '9')
+        return NULL;
+    *value = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p)
+        if (*value < 100000)
+            *value = *value * 10 + (*p - '0');
+    return p;
+}
+
+// binary PGM or PPM to RGBA8, to free
+static unsigned char *readPnm(const char *name, const unsigned char *data, size_t size, unsigned int *width, unsigned int *height) {
+
+    unsigned int maxval;
+
+    const unsigned char *end = data + size;
+    if (size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6')) {
+        printf("%s: not a binary PGM or PPM\n", name);
+        return NULL;
+    }
+    int channels = data[1] == '5' ? 1 : 3;
+
+    const unsigned char *p = data + 2;
+    if (!(p = pnmNumber(p, end, width)) || !(p = pnmNumber(p, end, height)) ||
+        !(p = pnmNumber(p, end, &maxval)) || p == end ||
+        *width == 0 || *height == 0 || *width > 65536 || *height > 65536 || maxval == 0 || maxval > 65535) {
+        printf("%s: bad header\n", name);
+        return NULL;
+    }
+    ++p;    // the one blank before the pixels
+
+    size_t sampleSize = maxval < 256 ? 1 : 2;
+    size_t pixels = (size_t) *width * *height;
+    if ((size_t)(end - p) < pixels * channels * sampleSize) {
+        printf("%s: truncated\n", name);
+        return NULL;
+    }
+
+    unsigned char *rgba = (unsigned char *) malloc(pixels * 4);
+    for (size_t i = 0; i < pixels; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            const unsigned char *s = p + (i * channels + (channels == 1 ? 0 : c)) * sampleSize;
+            unsigned int v = sampleSize == 1 ? s[0] : (s[0] << 8) | s[1];
+            rgba[i * 4 + c] = (unsigned char)((v * 255 + maxval / 2) / maxval);
+        }
+        rgba[i * 4 + 3] = 255;
+    }
+    return rgba;
+}
+
+// the next level, averaging 2x2 pixels, or the last row
+// or column alone on odd sizes
+static unsigned char *halve(const unsigned char *src, unsigned int w, unsigned int h, unsigned int *dw, unsigned int *dh) {
+
+    *dw = w > 1 ? w / 2 : 1;
+    *dh = h > 1 ? h / 2 : 1;
+    unsigned char *dst = (unsigned char *) malloc((size_t) *dw * *dh * 4);
+
+    for (unsigned int y = 0; y < *dh; ++y) {
+        unsigned int y0 = h > 1 ? y * 2 : 0, y1 = h > 1 ? y * 2 + 1 : 0;
+        for (unsigned int x = 0; x < *dw; ++x) {
+            unsigned int x0 = w > 1 ? x * 2 : 0, x1 = w > 1 ? x * 2 + 1 : 0;
+            for (int c = 0; c < 4; ++c) {
+                unsigned int sum = src[((size_t) y0 * w + x0) * 4 + c] + src[((size_t) y0 * w + x1) * 4 + c] +
+                                   src[((size_t) y1 * w + x0) * 4 + c] + src[((size_t) y1 * w + x1) * 4 + c];
+                dst[((size_t) y * *dw + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+    return dst;
+}
+
+static bool cookTexture(const Cooker *cooker, CookInput *input) {
+
+    MappedFile map;
+    TextureFileHeader header;
+    unsigned char *levels[TEXTURE_FILE_MAX_LEVELS];
+    unsigned int w, h;
+    char path[1024], temporary[1040];
+
+    if (!mappedFileOpen(&map, input->name)) {
+        printf("%s: cannot open\n", input->name);
+        return false;
+    }
+    levels[0] = readPnm(input->name, map.data, map.size, &w, &h);
+    mappedFileClose(&map);
+    if (!levels[0])
+        return false;
+
+    memset(&header, 0, sizeof(header));
+    header.internalFormat = GL_RGBA8;
+    header.format = GL_RGBA;
+    header.type = GL_UNSIGNED_BYTE;
+    header.bytesPerPixel = 4;
+    header.levels[0].width = w;
+    header.levels[0].height = h;
+    header.levelCount = 1;
+    while ((w > 1 || h > 1) && header.levelCount < TEXTURE_FILE_MAX_LEVELS) {
+        int l = header.levelCount++;
+        levels[l] = halve(levels[l - 1], w, h, &w, &h);
+        header.levels[l].width = w;
+        header.levels[l].height = h;
+    }
+
+    outputPath(cooker, input->file, path, sizeof(path));
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    bool ok = commitFile(temporary, path, textureFileWrite(temporary, &header, (const void *const *) levels));
+    if (!ok)
+        printf("%s: cannot write\n", path);
+
+    for (unsigned int l = 0; l < header.levelCount; ++l)
+        free(levels[l]);
+    return ok;
+}
+
+// ----------------------------------------------------
+// SHADERS
+//
+
+// the text expanded when checked, with unix line ends and
+// a last one
+static bool cookShader(CookInput *input) {
+
+    const char *source = input->cooked;
+    size_t size = strlen(source);
+
+    char *text = (char *) malloc(size + 1);
+    size_t n = 0;
+    for (size_t i = 0; i < size; ++i)
+        if (source[i] != '\r')
+            text[n++] = source[i];
+        else if (i + 1 == size || source[i + 1] != '\n')
+            text[n++] = '\n';
+    if (n == 0 || text[n - 1] != '\n')
+        text[n++] = '\n';
+
+    free(input->cooked);
+    input->cooked = text;
+    input->data = text;
+    input->dataSize = n;
+    return true;
+}
+
+// ----------------------------------------------------
+// COOKING
+//
+
+static void cookInput(const Cooker *cooker, CookInput *input) {
+
+    double start = cpuSeconds();
+    bool ok = false;
+    switch (input->type) {
+        case ASSET_MESH: ok = cookMesh(cooker, input); break;
+        case ASSET_TEXTURE: ok = cookTexture(cooker, input); break;
+        case ASSET_SHADER: ok = cookShader(input); break;
+        default: break;
+    }
+    input->failed = !ok;
+    input->seconds = cpuSeconds() - start;
+}
+
+static void cookJob(void *ctx, int begin, int end) {
+
+    Cooker *cooker = (Cooker *) ctx;
+    for (int i = begin; i < end; ++i) {
+        CookInput *input = &cooker->inputs[i];
+        if (input->stale && !input->failed && input->type != ASSET_MESH)
+            cookInput(cooker, input);
+    }
+}
+
+// ----------------------------------------------------
+// PACKING
+//
+
+static bool packed(const CookInput *inputs, int i) {
+
+    for (int j = 0; j < i; ++j)
+        if (!inputs[j].failed && inputs[j].extension && strcmp(inputs[j].file, inputs[i].file) == 0)
+            return true;
+    return false;
+}
+
+static bool writePack(const Cooker *cooker) {
+
+    PackFile previous;
+    char path[1024], temporary[1040];
+
+    PackItem *items = (PackItem *) calloc(cooker->inputCount, sizeof(PackItem));
+    MappedFile *maps = (MappedFile *) calloc(cooker->inputCount, sizeof(MappedFile));
+    int count = 0;
+    bool ok = true;
+
+    // each cooked file once, identical sources cooking to one
+    for (int i = 0; i < cooker->inputCount; ++i) {
+        const CookInput *input = &cooker->inputs[i];
+        if (input->failed || !input->extension || packed(cooker->inputs, i))
+            continue;
+        outputPath(cooker, input->file, path, sizeof(path));
+        if (!mappedFileOpen(&maps[count], path)) {
+            printf("%s: cannot open\n", path);
+            ok = false;
+            break;
+        }
+        items[count].name = input->file;
+        items[count].data = maps[count].data;
+        items[count].size = maps[count].size;
+        ++count;
+    }
+
+    // the pack there may hold just those
+    outputPath(cooker, PACK_FILE_NAME, path, sizeof(path));
+    bool current = false;
+    if (ok && fileExists(path) && packOpen(&previous, path)) {
+        current = previous.header->entryCount == (unsigned int) count;
+        for (int i = 0; current && i < count; ++i) {
+            const PackEntry *e = packFind(&previous, items[i].name);
+            current = e && e->size == items[i].size;
+        }
+        packClose(&previous);
+    }
+
+    if (ok && !current) {
+        double start = cpuSeconds();
+        snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+        ok = commitFile(temporary, path, packWrite(temporary, items, count));
+        if (!ok)
+            printf("%s: cannot write\n", path);
+        else {
+            unsigned long long size = 0;
+            for (int i = 0; i < count; ++i)
+                size += items[i].size;
+            MappedFile written;
+            if (mappedFileOpen(&written, path)) {
+                printf("%s: %d files, %.1f MB packed to %.1f MB in %.1f ms\n", path, count, size / (double)(1 << 20),
+                       written.size / (double)(1 << 20), (cpuSeconds() - start) * 1000.0);
+                mappedFileClose(&written);
+            }
+        }
+    }
+
+    for (int i = 0; i < count; ++i)
+        mappedFileClose(&maps[i]);
+    free(maps);
+    free(items);
+    return ok;
+}
+
+static void usage() {
+
+    printf("usage: cook [-o dir] [-f] [-p] sources...\n");
+    printf("  -o dir  where the cooked files and %s go, %s by default\n", MANIFEST_FILE_NAME, MANIFEST_DEFAULT_DIR);
+    printf("  -f      cook everything, whatever the cache says\n");
+    printf("  -p      pack the cooked files into %s\n", PACK_FILE_NAME);
+}
+
+int main(int argc, char **argv) {
+
+    Cooker cooker;
+    char manifestPath[1024];
+
+    memset(&cooker, 0, sizeof(cooker));
+    cooker.dir = MANIFEST_DEFAULT_DIR;
+    cooker.inputs = (CookInput *) calloc(argc, sizeof(CookInput));
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            cooker.dir = argv[++i];
+        else if (strcmp(argv[i], "-f") == 0)
+            cooker.force = true;
+        else if (strcmp(argv[i], "-p") == 0)
+            cooker.pack = true;
+        else if (argv[i][0] == '-') {
+            usage();
+            return 1;
+        } else {
+            CookInput *input = &cooker.inputs[cooker.inputCount];
+            input->name = argv[i];
+            if (classify(input))
+                ++cooker.inputCount;
+            else
+                printf("%s: not a mesh, texture or shader, skipped\n", argv[i]);
+        }
+    }
+    if (cooker.inputCount == 0) {
+        usage();
+        return 1;
+    }
+
+    cpuInit();
+    jobsInit(0);
+    double start = cpuSeconds();
+
+#if defined(_WIN32)
+    _mkdir(cooker.dir);
+#else
+    mkdir(cooker.dir, 0777);
+#endif
+    snprintf(manifestPath, sizeof(manifestPath), "%s/%s", cooker.dir, MANIFEST_FILE_NAME);
+    if (manifestLoad(&cooker.previous, manifestPath) && cooker.previous.header->cookerVersion != COOK_VERSION)
+        manifestFree(&cooker.previous);
+
+    parallelFor(cooker.inputCount, 1, checkJob, &cooker);
+    dedupeInputs(&cooker);
+    double checked = cpuSeconds();
+
+    for (int i = 0; i < cooker.inputCount; ++i) {
+        CookInput *input = &cooker.inputs[i];
+        if (input->stale && !input->failed && input->type == ASSET_MESH)
+            cookInput(&cooker, input);
+    }
+    parallelFor(cooker.inputCount, 1, cookJob, &cooker);
+
+    for (int i = 0; i < cooker.inputCount; ++i) {
+        CookInput *input = &cooker.inputs[i];
+        if (input->sameAs && input->sameAs->failed) {
+            printf("%s: the same as %s, which failed\n", input->name, input->sameAs->name);
+            input->failed = true;
+        }
+    }
+
+    // the manifest lists what cooked and what was up to date
+    ManifestItem *items = (ManifestItem *) calloc(cooker.inputCount, sizeof(ManifestItem));
+    int itemCount = 0, cooked = 0, failed = 0;
+    for (int i = 0; i < cooker.inputCount; ++i) {
+        CookInput *input = &cooker.inputs[i];
+        if (input->failed) {
+            ++failed;
+            continue;
+        }
+        if (input->stale) {
+            ++cooked;
+            printf("%s: cooked in %.1f ms\n", input->name, input->seconds * 1000.0);
+        }
+        ManifestItem *item = &items[itemCount++];
+        item->type = input->type;
+        item->name = input->name;
+        item->file = input->extension ? input->file : NULL;
+        item->sourceHash = input->hash;
+        item->sourceSize = input->size;
+        item->sourceTime = input->time;
+        item->data = input->data;
+        item->dataSize = input->dataSize;
+    }
+
+    bool written = manifestWrite(manifestPath, items, itemCount, COOK_VERSION);
+    if (!written)
+        printf("%s: cannot write\n", manifestPath);
+    if (cooker.pack)
+        written = writePack(&cooker) && written;
+
+    printf("%d assets: %d cooked, %d up to date, %d failed, checked in %.1f ms, done in %.1f ms on %d threads\n",
+           cooker.inputCount, cooked, itemCount - cooked, failed,
+           (checked - start) * 1000.0, (cpuSeconds() - start) * 1000.0, jobsThreadCount());
+
+    for (int i = 0; i < cooker.inputCount; ++i)
+        free(cooker.inputs[i].cooked);
+    free(items);
+    free(cooker.inputs);
+    manifestFree(&cooker.previous);
+    jobsShutdown();
+    return written && failed == 0 ? 0 : 1;
+}
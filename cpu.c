@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#include <chrono>
+
+#include "cpu.h"
+#include "mat4.h"
+#include "vertexstream.h"
+#include "cull.h"
+#include "quat.h"
+
+#if CPU_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+static const char *isaNames[ISA_COUNT] = { "scalar", "sse2", "sse41", "avx2", "avx512" };
+
+static CpuIsa bound = ISA_SCALAR;
+
+const char *cpuIsaName(CpuIsa isa) {
+
+    return isaNames[isa];
+}
+
+CpuIsa cpuIsa() {
+
+    return bound;
+}
+
+// ----------------------------------------------------
+// DETECTION
+//
+
+#if CPU_X86
+
+static void cpuid(int leaf, int subleaf, unsigned int *regs) {
+
+#if defined(_MSC_VER)
+    __cpuidex((int *) regs, leaf, subleaf);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// which register states the os saves on context switches
+static unsigned long long xgetbv() {
+
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ volatile ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+    return ((unsigned long long) hi << 32) | lo;
+#endif
+}
+
+CpuIsa cpuDetect() {
+
+    unsigned int regs[4];
+
+    cpuid(0, 0, regs);
+    unsigned int maxLeaf = regs[0];
+
+    cpuid(1, 0, regs);
+    bool sse2    = (regs[3] >> 26) & 1;
+    bool sse41   = (regs[2] >> 19) & 1;
+    bool osxsave = (regs[2] >> 27) & 1;
+    bool avx     = (regs[2] >> 28) & 1;
+    bool f16c    = (regs[2] >> 29) & 1;
+
+    if (!sse2)
+        return ISA_SCALAR;
+    if (!sse41)
+        return ISA_SSE2;
+    if (!avx || !osxsave || maxLeaf < 7)
+        return ISA_SSE41;
+
+    unsigned long long xcr0 = xgetbv();
+    if ((xcr0 & 0x6) != 0x6)
+        return ISA_SSE41;
+
+    cpuid(7, 0, regs);
+    bool avx2    = (regs[1] >> 5) & 1;
+    bool avx512f = (regs[1] >> 16) & 1;
+
+    if (!avx2 || !f16c)
+        return ISA_SSE41;
+    if (!avx512f || (xcr0 & 0xE6) != 0xE6)
+        return ISA_AVX2;
+    return ISA_AVX512;
+}
+
+#else
+
+CpuIsa cpuDetect() {
+
+    return ISA_SCALAR;
+}
+
+#endif
+
+// ----------------------------------------------------
+// BINDING
+//
+
+void cpuInit() {
+
+    CpuIsa detected = cpuDetect();
+    CpuIsa isa = detected;
+
+    const char *forced = getenv("G33_ISA");
+    if (forced) {
+        int i;
+        for (i = 0; i < ISA_COUNT; ++i)
+            if (strcmp(forced, isaNames[i]) == 0)
+                break;
+        if (i == ISA_COUNT)
+            printf("G33_ISA: unknown level %s\n", forced);
+        else if (i > detected)
+            printf("G33_ISA: %s not supported, using %s\n", forced, isaNames[detected]);
+        else
+            isa = (CpuIsa) i;
+    }
+
+    cpuBind(isa);
+}
+
+void cpuBind(CpuIsa isa) {
+
+    bound = isa;
+
+    mat4Bind(isa);
+    vertexBind(isa);
+    cullBind(isa);
+    quatBind(isa);
+}
+
+// ----------------------------------------------------
+// MEMORY AND TIME
+//
+
+void *cpuAlloc(size_t size) {
+
+#if defined(_WIN32)
+    return _aligned_malloc(size, 64);
+#else
+    void *p;
+    if (posix_memalign(&p, 64, size) != 0)
+        return NULL;
+    return p;
+#endif
+}
+
+void cpuFree(void *p) {
+
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+double cpuSeconds() {
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
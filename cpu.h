@@ -0,0 +1,71 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stddef.h>
+
+// ----------------------------------------------------
+// CPU FEATURE DISPATCH
+//
+// The binary is built for the SSE2 baseline. Wider
+// kernels are compiled with per function target
+// attributes and bound at startup by cpuInit according
+// to what the cpu supports.
+//
+// Setting G33_ISA to scalar, sse2, sse41, avx2 or avx512
+// forces a lower level, to compare the kernels.
+// The AVX2 level also brings the F16C half float
+// conversions, which every AVX2 cpu has.
+//
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_X86 1
+#else
+#define CPU_X86 0
+#endif
+
+#if defined(__GNUC__)
+#define TARGET_SSE2   __attribute__((target("sse2")))
+#define TARGET_SSE41  __attribute__((target("sse4.1")))
+#define TARGET_AVX2   __attribute__((target("avx2")))
+#define TARGET_F16C   __attribute__((target("avx2,f16c")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_SSE2
+#define TARGET_SSE41
+#define TARGET_AVX2
+#define TARGET_F16C
+#define TARGET_AVX512
+#endif
+
+enum CpuIsa {
+    ISA_SCALAR,
+    ISA_SSE2,
+    ISA_SSE41,
+    ISA_AVX2,
+    ISA_AVX512,
+    ISA_COUNT
+};
+
+// highest level supported by the cpu and the os
+CpuIsa cpuDetect();
+
+// level the kernels are bound to
+CpuIsa cpuIsa();
+
+const char *cpuIsaName(CpuIsa isa);
+
+// detects the cpu, applies G33_ISA and binds every kernel table
+void cpuInit();
+
+// rebinds every kernel table to the given level, which
+// must not be above cpuDetect()
+void cpuBind(CpuIsa isa);
+
+// cache line aligned memory for the SIMD kernels
+void *cpuAlloc(size_t size);
+void cpuFree(void *p);
+
+// wall clock, in seconds, for timings
+double cpuSeconds();
+
+#endif
@@ -0,0 +1,332 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "cull.h"
+#include "jobs.h"
+
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
+// objects per job, a multiple of 8 so chunks stay aligned
+#define CULL_CHUNK 4096
+
+// ----------------------------------------------------
+// FRUSTUM AND BOUNDS
+//
+
+// Each plane is the last row of the matrix plus or minus
+// one of the others (Gribb & Hartmann).
+void frustumFromMatrix(Frustum *f, const float *m) {
+
+    for (int i = 0; i < 3; ++i) {
+        for (int k = 0; k < 4; ++k) {
+            f->planes[i*2 + 0][k] = m[k*4 + 3] + m[k*4 + i];
+            f->planes[i*2 + 1][k] = m[k*4 + 3] - m[k*4 + i];
+        }
+    }
+
+    for (int p = 0; p < 6; ++p) {
+        float *plane = f->planes[p];
+        float len = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        for (int k = 0; k < 4; ++k)
+            plane[k] /= len;
+    }
+}
+
+void boundsFromPoints(Bounds *b, const float *xyzw, int count) {
+
+    float lo[3] = { xyzw[0], xyzw[1], xyzw[2] };
+    float hi[3] = { xyzw[0], xyzw[1], xyzw[2] };
+
+    for (int i = 1; i < count; ++i) {
+        for (int k = 0; k < 3; ++k) {
+            float v = xyzw[i*4 + k];
+            lo[k] = v < lo[k] ? v : lo[k];
+            hi[k] = v > hi[k] ? v : hi[k];
+        }
+    }
+
+    for (int k = 0; k < 3; ++k) {
+        b->center[k] = (lo[k] + hi[k]) * 0.5f;
+        b->extents[k] = (hi[k] - lo[k]) * 0.5f;
+    }
+
+    float r2 = 0.0f;
+    for (int i = 0; i < count; ++i) {
+        float dx = xyzw[i*4 + 0] - b->center[0];
+        float dy = xyzw[i*4 + 1] - b->center[1];
+        float dz = xyzw[i*4 + 2] - b->center[2];
+        float d2 = dx * dx + dy * dy + dz * dz;
+        r2 = d2 > r2 ? d2 : r2;
+    }
+    b->radius = sqrtf(r2);
+}
+
+// outside as soon as the box is fully behind one plane
+static inline bool outside(const Frustum *f, float cx, float cy, float cz, float ex, float ey, float ez) {
+
+    for (int p = 0; p < 6; ++p) {
+        const float *n = f->planes[p];
+        float d = n[0] * cx + n[1] * cy + n[2] * cz + n[3];
+        float r = fabsf(n[0]) * ex + fabsf(n[1]) * ey + fabsf(n[2]) * ez;
+        if (d + r < 0.0f)
+            return true;
+    }
+    return false;
+}
+
+bool frustumTestBounds(const Frustum *f, const Bounds *b) {
+
+    return !outside(f, b->center[0], b->center[1], b->center[2], b->extents[0], b->extents[1], b->extents[2]);
+}
+
+// ----------------------------------------------------
+// CULL SETS
+//
+
+void cullSetInit(CullSet *set) {
+
+    memset(set, 0, sizeof(CullSet));
+}
+
+void cullSetFree(CullSet *set) {
+
+    cpuFree(set->cx);
+    free(set->visible);
+    free(set->jobVisible);
+    cullSetInit(set);
+}
+
+// the six arrays share one allocation
+static void grow(CullSet *set, int capacity) {
+
+    capacity = (capacity + 7) & ~7;
+    float *p = (float *) cpuAlloc(6 * capacity * sizeof(float));
+    float **arrays[6] = { &set->cx, &set->cy, &set->cz, &set->ex, &set->ey, &set->ez };
+
+    for (int k = 0; k < 6; ++k) {
+        if (set->count)
+            memcpy(p + k * capacity, *arrays[k], set->count * sizeof(float));
+    }
+    cpuFree(set->cx);
+    for (int k = 0; k < 6; ++k)
+        *arrays[k] = p + k * capacity;
+
+    set->visible = (int *) realloc(set->visible, capacity * sizeof(int));
+    set->jobVisible = (int *) realloc(set->jobVisible, (capacity / CULL_CHUNK + 1) * sizeof(int));
+    set->capacity = capacity;
+}
+
+int cullSetAdd(CullSet *set, const Bounds *b) {
+
+    if (set->count == set->capacity)
+        grow(set, set->capacity ? set->capacity * 2 : 64);
+
+    int index = set->count++;
+    cullSetUpdate(set, index, b);
+    return index;
+}
+
+void cullSetUpdate(CullSet *set, int index, const Bounds *b) {
+
+    set->cx[index] = b->center[0];
+    set->cy[index] = b->center[1];
+    set->cz[index] = b->center[2];
+    set->ex[index] = b->extents[0];
+    set->ey[index] = b->extents[1];
+    set->ez[index] = b->extents[2];
+}
+
+// ----------------------------------------------------
+// SCALAR
+//
+
+static int testScalar(const CullSet *set, const Frustum *f, int begin, int end, int *out) {
+
+    int n = 0;
+
+    for (int i = begin; i < end; ++i) {
+        if (!outside(f, set->cx[i], set->cy[i], set->cz[i], set->ex[i], set->ey[i], set->ez[i]))
+            out[n++] = i;
+    }
+    return n;
+}
+
+static const CullKernels kernelsScalar = {
+    ISA_SCALAR,
+    testScalar
+};
+
+#if CPU_X86
+
+// ----------------------------------------------------
+// SSE2
+//
+
+TARGET_SSE2
+static int testSSE2(const CullSet *set, const Frustum *f, int begin, int end, int *out) {
+
+    const __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    int n = 0;
+    int i = begin;
+
+    for (; i + 4 <= end; i += 4) {
+        __m128 cx = _mm_load_ps(set->cx + i);
+        __m128 cy = _mm_load_ps(set->cy + i);
+        __m128 cz = _mm_load_ps(set->cz + i);
+        __m128 ex = _mm_load_ps(set->ex + i);
+        __m128 ey = _mm_load_ps(set->ey + i);
+        __m128 ez = _mm_load_ps(set->ez + i);
+        __m128 out4 = _mm_setzero_ps();
+
+        for (int p = 0; p < 6; ++p) {
+            const float *pl = f->planes[p];
+            __m128 nx = _mm_set1_ps(pl[0]), ny = _mm_set1_ps(pl[1]), nz = _mm_set1_ps(pl[2]);
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                  _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(pl[3])));
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(nx, abs), ex), _mm_mul_ps(_mm_and_ps(ny, abs), ey)),
+                                  _mm_mul_ps(_mm_and_ps(nz, abs), ez));
+            out4 = _mm_or_ps(out4, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+
+        int mask = ~_mm_movemask_ps(out4) & 0xF;
+        while (mask) {
+            int k = __builtin_ctz(mask);
+            out[n++] = i + k;
+            mask &= mask - 1;
+        }
+    }
+    return n + testScalar(set, f, i, end, out + n);
+}
+
+static const CullKernels kernelsSSE2 = {
+    ISA_SSE2,
+    testSSE2
+};
+
+// ----------------------------------------------------
+// AVX2
+//
+// 8 boxes against a plane per instruction, with the
+// plane coefficients broadcast from memory.
+//
+
+TARGET_AVX2
+static int testAVX2(const CullSet *set, const Frustum *f, int begin, int end, int *out) {
+
+    const __m256 abs = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    int n = 0;
+    int i = begin;
+
+    for (; i + 8 <= end; i += 8) {
+        __m256 cx = _mm256_load_ps(set->cx + i);
+        __m256 cy = _mm256_load_ps(set->cy + i);
+        __m256 cz = _mm256_load_ps(set->cz + i);
+        __m256 ex = _mm256_load_ps(set->ex + i);
+        __m256 ey = _mm256_load_ps(set->ey + i);
+        __m256 ez = _mm256_load_ps(set->ez + i);
+        __m256 out8 = _mm256_setzero_ps();
+
+        for (int p = 0; p < 6; ++p) {
+            const float *pl = f->planes[p];
+            __m256 nx = _mm256_broadcast_ss(pl + 0);
+            __m256 ny = _mm256_broadcast_ss(pl + 1);
+            __m256 nz = _mm256_broadcast_ss(pl + 2);
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)),
+                                     _mm256_add_ps(_mm256_mul_ps(nz, cz), _mm256_broadcast_ss(pl + 3)));
+            __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_and_ps(nx, abs), ex),
+                                                   _mm256_mul_ps(_mm256_and_ps(ny, abs), ey)),
+                                     _mm256_mul_ps(_mm256_and_ps(nz, abs), ez));
+            out8 = _mm256_or_ps(out8, _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+
+        int mask = ~_mm256_movemask_ps(out8) & 0xFF;
+        while (mask) {
+            int k = __builtin_ctz(mask);
+            out[n++] = i + k;
+            mask &= mask - 1;
+        }
+    }
+    return n + testScalar(set, f, i, end, out + n);
+}
+
+static const CullKernels kernelsAVX2 = {
+    ISA_AVX2,
+    testAVX2
+};
+
+static const CullKernels *tables[ISA_COUNT] = {
+    &kernelsScalar,
+    &kernelsSSE2,
+    &kernelsSSE2,
+    &kernelsAVX2,
+    &kernelsAVX2
+};
+
+#else
+
+static const CullKernels *tables[ISA_COUNT] = {
+    &kernelsScalar,
+    &kernelsScalar,
+    &kernelsScalar,
+    &kernelsScalar,
+    &kernelsScalar
+};
+
+#endif
+
+const CullKernels *cullKernels = &kernelsScalar;
+
+void cullBind(CpuIsa isa) {
+
+    cullKernels = tables[isa];
+}
+
+// ----------------------------------------------------
+// RUNNING
+//
+// Each job writes its visible indices at the start of
+// its own chunk of the output, the chunks are then
+// packed together in order.
+//
+
+struct CullJob {
+    CullSet *set;
+    const Frustum *f;
+};
+
+static void cullJob(void *ctx, int begin, int end) {
+
+    CullJob *job = (CullJob *) ctx;
+    CullSet *set = job->set;
+
+    for (int c = begin; c < end; ++c) {
+        int first = c * CULL_CHUNK;
+        int last = first + CULL_CHUNK < set->count ? first + CULL_CHUNK : set->count;
+        set->jobVisible[c] = cullKernels->test(set, job->f, first, last, set->visible + first);
+    }
+}
+
+void cullSetRun(CullSet *set, const Frustum *f) {
+
+    double t0 = cpuSeconds();
+
+    int chunks = (set->count + CULL_CHUNK - 1) / CULL_CHUNK;
+    CullJob job = { set, f };
+    parallelFor(chunks, 1, cullJob, &job);
+
+    int n = 0;
+    for (int c = 0; c < chunks; ++c) {
+        if (n != c * CULL_CHUNK)
+            memmove(set->visible + n, set->visible + c * CULL_CHUNK, set->jobVisible[c] * sizeof(int));
+        n += set->jobVisible[c];
+    }
+    set->visibleCount = n;
+
+    set->stats.tested = set->count;
+    set->stats.visible = n;
+    set->stats.culled = set->count - n;
+    set->stats.seconds = cpuSeconds() - t0;
+}
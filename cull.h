@@ -0,0 +1,85 @@
+#ifndef CULL_H
+#define CULL_H
+
+#include "cpu.h"
+
+// ----------------------------------------------------
+// FRUSTUM CULLING
+//
+// Planes are extracted from projection * view, so the
+// test happens in world space against boxes computed
+// once when the geometry is set up. The boxes are kept
+// as structure of arrays and tested 8 at a time (AVX2)
+// across the worker threads. What survives is a compact
+// list of object indices, in increasing order.
+//
+
+// a plane is (nx, ny, nz, d), inside when n.p + d >= 0
+struct Frustum {
+    float planes[6][4];
+};
+
+struct Bounds {
+    float center[3];
+    float extents[3];   // half sizes of the box
+    float radius;       // bounding sphere around the center
+};
+
+struct CullStats {
+    int tested;
+    int visible;
+    int culled;
+    double seconds;
+};
+
+struct CullSet {
+
+    int count;
+    int capacity;
+
+    // box centers and extents, one array per component
+    float *cx, *cy, *cz;
+    float *ex, *ey, *ez;
+
+    // indices of the visible objects after cullSetRun
+    int *visible;
+    int visibleCount;
+
+    // visible objects per job, while running
+    int *jobVisible;
+
+    CullStats stats;
+};
+
+void frustumFromMatrix(Frustum *f, const float *viewProj);
+
+// bounds of count points given as 4 floats each, like vertices1
+void boundsFromPoints(Bounds *b, const float *xyzw, int count);
+
+// true when the box touches the frustum
+bool frustumTestBounds(const Frustum *f, const Bounds *b);
+
+void cullSetInit(CullSet *set);
+void cullSetFree(CullSet *set);
+
+// returns the index of the new object
+int cullSetAdd(CullSet *set, const Bounds *b);
+void cullSetUpdate(CullSet *set, int index, const Bounds *b);
+
+// fills set->visible and set->stats
+void cullSetRun(CullSet *set, const Frustum *f);
+
+struct CullKernels {
+
+    CpuIsa isa;
+
+    // writes the visible indices of [begin, end) to out, returns how many
+    int (*test)(const CullSet *set, const Frustum *f, int begin, int end, int *out);
+};
+
+extern const CullKernels *cullKernels;
+
+// called by cpuInit with the level to use
+void cullBind(CpuIsa isa);
+
+#endif
@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "drawbatch.h"
+#include "glproc.h"
+
+static GlMultiDrawArraysIndirectProc multiDrawArraysIndirect = NULL;
+static GlMultiDrawElementsIndirectProc multiDrawElementsIndirect = NULL;
+
+// ----------------------------------------------------
+// QUEUE
+//
+
+void drawBatchInit(DrawBatch *batch, StreamBuffer *stream) {
+
+    memset(batch, 0, sizeof(DrawBatch));
+    batch->stream = stream;
+
+    multiDrawArraysIndirect = (GlMultiDrawArraysIndirectProc)
+        glProcFor("glMultiDrawArraysIndirect", "GL_ARB_multi_draw_indirect", 4, 3);
+    multiDrawElementsIndirect = (GlMultiDrawElementsIndirectProc)
+        glProcFor("glMultiDrawElementsIndirect", "GL_ARB_multi_draw_indirect", 4, 3);
+    batch->indirect = stream && multiDrawArraysIndirect && multiDrawElementsIndirect;
+}
+
+void drawBatchFree(DrawBatch *batch) {
+
+    free(batch->entries);
+    free(batch->firsts);
+    free(batch->counts);
+    free(batch->offsets);
+    free(batch->baseVertices);
+    memset(batch, 0, sizeof(DrawBatch));
+}
+
+static DrawBatchEntry *push(DrawBatch *batch) {
+
+    if (batch->count == batch->capacity) {
+        int capacity = batch->capacity ? batch->capacity * 2 : 256;
+        batch->entries = (DrawBatchEntry *) realloc(batch->entries, capacity * sizeof(DrawBatchEntry));
+        batch->firsts = (GLint *) realloc(batch->firsts, capacity * sizeof(GLint));
+        batch->counts = (GLsizei *) realloc(batch->counts, capacity * sizeof(GLsizei));
+        batch->offsets = (const void **) realloc(batch->offsets, capacity * sizeof(const void *));
+        batch->baseVertices = (GLint *) realloc(batch->baseVertices, capacity * sizeof(GLint));
+        batch->capacity = capacity;
+    }
+
+    DrawBatchEntry *e = &batch->entries[batch->count];
+    e->order = batch->count++;
+    return e;
+}
+
+void drawBatchArrays(DrawBatch *batch, GLuint vao, GLenum mode, GLint first, GLsizei count) {
+
+    DrawBatchEntry *e = push(batch);
+    e->vao = vao;
+    e->mode = mode;
+    e->indexType = 0;
+    e->first = first;
+    e->count = count;
+    e->baseVertex = 0;
+}
+
+void drawBatchElements(DrawBatch *batch, GLuint vao, GLenum mode, GLenum indexType,
+                       GLint firstIndex, GLsizei count, GLint baseVertex) {
+
+    DrawBatchEntry *e = push(batch);
+    e->vao = vao;
+    e->mode = mode;
+    e->indexType = indexType;
+    e->first = firstIndex;
+    e->count = count;
+    e->baseVertex = baseVertex;
+}
+
+// ----------------------------------------------------
+// RUNS
+//
+
+static int compareEntries(const void *a, const void *b) {
+
+    const DrawBatchEntry *x = (const DrawBatchEntry *) a;
+    const DrawBatchEntry *y = (const DrawBatchEntry *) b;
+
+    if (x->vao != y->vao)
+        return x->vao < y->vao ? -1 : 1;
+    if (x->mode != y->mode)
+        return x->mode < y->mode ? -1 : 1;
+    if (x->indexType != y->indexType)
+        return x->indexType < y->indexType ? -1 : 1;
+    return x->order - y->order;
+}
+
+static bool sameRun(const DrawBatchEntry *a, const DrawBatchEntry *b) {
+
+    return a->vao == b->vao && a->mode == b->mode && a->indexType == b->indexType;
+}
+
+static int runEnd(const DrawBatch *batch, int begin) {
+
+    int end = begin + 1;
+    while (end < batch->count && sameRun(&batch->entries[begin], &batch->entries[end]))
+        end++;
+    return end;
+}
+
+static size_t indexSize(GLenum type) {
+
+    return type == GL_UNSIGNED_BYTE ? 1 : type == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+// ----------------------------------------------------
+// SUBMISSION
+//
+
+static bool submitIndirect(DrawBatch *batch) {
+
+    size_t size = 0;
+    for (int i = 0; i < batch->count; ++i)
+        size += batch->entries[i].indexType ? sizeof(DrawElementsCommand) : sizeof(DrawArraysCommand);
+
+    size_t base;
+    unsigned char *commands = (unsigned char *) streamBufferMap(batch->stream, size, 4, &base);
+    if (!commands)
+        return false;
+
+    unsigned char *p = commands;
+    for (int i = 0; i < batch->count; ++i) {
+        const DrawBatchEntry *e = &batch->entries[i];
+        if (e->indexType) {
+            DrawElementsCommand c = { (GLuint) e->count, 1, (GLuint) e->first, e->baseVertex, 0 };
+            memcpy(p, &c, sizeof(c));
+            p += sizeof(c);
+        } else {
+            DrawArraysCommand c = { (GLuint) e->count, 1, (GLuint) e->first, 0 };
+            memcpy(p, &c, sizeof(c));
+            p += sizeof(c);
+        }
+    }
+    streamBufferUnmap(batch->stream);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, batch->stream->buffer);
+
+    size_t offset = base;
+    for (int begin = 0; begin < batch->count; ) {
+        int end = runEnd(batch, begin);
+        const DrawBatchEntry *e = &batch->entries[begin];
+
+        glBindVertexArray(e->vao);
+
+        if (e->indexType) {
+            multiDrawElementsIndirect(e->mode, e->indexType, (const void *) offset, end - begin, 0);
+            offset += (end - begin) * sizeof(DrawElementsCommand);
+        } else {
+            multiDrawArraysIndirect(e->mode, (const void *) offset, end - begin, 0);
+            offset += (end - begin) * sizeof(DrawArraysCommand);
+        }
+
+        batch->stats.calls++;
+        batch->stats.runs++;
+        begin = end;
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return true;
+}
+
+static void submitDirect(DrawBatch *batch) {
+
+    for (int begin = 0; begin < batch->count; ) {
+        int end = runEnd(batch, begin);
+        const DrawBatchEntry *run = &batch->entries[begin];
+        int n = end - begin;
+
+        glBindVertexArray(run->vao);
+        batch->stats.runs++;
+
+        for (int k = 0; k < n; ++k) {
+            const DrawBatchEntry *e = &run[k];
+            batch->firsts[k] = e->first;
+            batch->counts[k] = e->count;
+            batch->offsets[k] = (void *)(e->first * indexSize(e->indexType));
+            batch->baseVertices[k] = e->baseVertex;
+        }
+
+        if (run->indexType)
+            glMultiDrawElementsBaseVertex(run->mode, batch->counts, run->indexType,
+                                          (void **) batch->offsets, n, batch->baseVertices);
+        else
+            glMultiDrawArrays(run->mode, batch->firsts, batch->counts, n);
+
+        batch->stats.calls++;
+        begin = end;
+    }
+}
+
+void drawBatchSubmit(DrawBatch *batch) {
+
+    batch->stats.draws = batch->count;
+    batch->stats.calls = 0;
+    batch->stats.runs = 0;
+
+    if (batch->count == 0)
+        return;
+
+    qsort(batch->entries, batch->count, sizeof(DrawBatchEntry), compareEntries);
+
+    if (!batch->indirect || !submitIndirect(batch))
+        submitDirect(batch);
+
+    batch->count = 0;
+}
@@ -0,0 +1,85 @@
+#ifndef DRAWBATCH_H
+#define DRAWBATCH_H
+
+#include <GL/glew.h>
+
+#include "streambuffer.h"
+
+// ----------------------------------------------------
+// DRAW BATCHING
+//
+// Draws are queued during the frame, then sorted by VAO,
+// primitive and index type, and each run of draws that
+// only differ in their ranges goes out as one call:
+// glMultiDraw*Indirect with the commands written to a
+// stream buffer on GL 4.3, glMultiDrawArrays and
+// glMultiDrawElementsBaseVertex before.
+//
+// The draws carry no per draw data: what changes from one
+// to the next is in their vertices, or in the attributes
+// of instanced meshes, which are drawn on their own.
+//
+
+// as GL reads them from GL_DRAW_INDIRECT_BUFFER
+struct DrawArraysCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
+
+struct DrawElementsCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+struct DrawBatchEntry {
+    GLuint vao;
+    GLenum mode;
+    GLenum indexType;   // 0 for glDrawArrays
+    GLint first;        // vertex, or index for indexed draws
+    GLsizei count;
+    GLint baseVertex;
+    int order;          // keeps the queue order within a run
+};
+
+struct DrawBatchStats {
+    int draws;          // queued
+    int calls;          // GL draw calls made for them
+    int runs;           // groups of draws sharing their state
+};
+
+struct DrawBatch {
+    DrawBatchEntry *entries;
+    int count;
+    int capacity;
+
+    // indirect commands go to a stream buffer
+    bool indirect;
+    StreamBuffer *stream;
+
+    // the fallback's arguments, one per draw
+    GLint *firsts;
+    GLsizei *counts;
+    const void **offsets;
+    GLint *baseVertices;
+
+    // of the last submit
+    DrawBatchStats stats;
+};
+
+// after glewInit, stream receives the indirect commands
+void drawBatchInit(DrawBatch *batch, StreamBuffer *stream);
+void drawBatchFree(DrawBatch *batch);
+
+void drawBatchArrays(DrawBatch *batch, GLuint vao, GLenum mode, GLint first, GLsizei count);
+void drawBatchElements(DrawBatch *batch, GLuint vao, GLenum mode, GLenum indexType,
+                       GLint firstIndex, GLsizei count, GLint baseVertex);
+
+// draws the queue and empties it
+void drawBatchSubmit(DrawBatch *batch);
+
+#endif
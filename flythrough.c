@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "flythrough.h"
+
+void flythroughInit(Flythrough *fly) {
+
+    memset(fly, 0, sizeof(Flythrough));
+}
+
+void flythroughFree(Flythrough *fly) {
+
+    free(fly->keys);
+    flythroughInit(fly);
+}
+
+void flythroughAddKey(Flythrough *fly, float time, const float *pos, const float *orientation) {
+
+    if (fly->count == fly->capacity) {
+        fly->capacity = fly->capacity ? fly->capacity * 2 : 16;
+        fly->keys = (CameraKey *) realloc(fly->keys, fly->capacity * sizeof(CameraKey));
+    }
+
+    CameraKey *key = &fly->keys[fly->count++];
+    key->time = time;
+    memcpy(key->pos, pos, sizeof(key->pos));
+    memcpy(key->orientation.q, orientation, sizeof(key->orientation.q));
+}
+
+// the view rotation is the inverse of the camera's
+void flythroughAddLookAt(Flythrough *fly, float time, const float *pos, const float *target) {
+
+    float view[16], q[4], orientation[4];
+
+    buildLookAt(view, pos, target);
+    quatFromMatrix(q, view);
+    quatConjugate(orientation, q);
+    flythroughAddKey(fly, time, pos, orientation);
+}
+
+float flythroughDuration(const Flythrough *fly) {
+
+    return fly->count ? fly->keys[fly->count - 1].time : 0.0f;
+}
+
+// Catmull-Rom through p1 and p2, p0 and p3 giving the tangents
+static float spline(float p0, float p1, float p2, float p3, float u) {
+
+    return 0.5f * ((2.0f * p1) +
+                   (p2 - p0) * u +
+                   (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * u * u +
+                   (3.0f * (p1 - p2) + p3 - p0) * u * u * u);
+}
+
+void flythroughSample(const Flythrough *fly, float time, float *pos, float *orientation) {
+
+    const CameraKey *keys = fly->keys;
+    int n = fly->count;
+
+    if (n == 0)
+        return;
+    if (n == 1 || time <= keys[0].time) {
+        memcpy(pos, keys[0].pos, 3 * sizeof(float));
+        memcpy(orientation, keys[0].orientation.q, 4 * sizeof(float));
+        return;
+    }
+    if (time >= keys[n - 1].time) {
+        memcpy(pos, keys[n - 1].pos, 3 * sizeof(float));
+        memcpy(orientation, keys[n - 1].orientation.q, 4 * sizeof(float));
+        return;
+    }
+
+    // last key at or before time
+    int lo = 0, hi = n - 1;
+    while (hi - lo > 1) {
+        int mid = (lo + hi) / 2;
+        if (keys[mid].time <= time)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    const CameraKey *k0 = &keys[lo > 0 ? lo - 1 : lo];
+    const CameraKey *k1 = &keys[lo];
+    const CameraKey *k2 = &keys[lo + 1];
+    const CameraKey *k3 = &keys[lo + 2 < n ? lo + 2 : lo + 1];
+    float u = (time - k1->time) / (k2->time - k1->time);
+
+    for (int k = 0; k < 3; ++k)
+        pos[k] = spline(k0->pos[k], k1->pos[k], k2->pos[k], k3->pos[k], u);
+    quatSlerp(orientation, k1->orientation.q, k2->orientation.q, u);
+}
+
+void flythroughApply(const Flythrough *fly, Camera *cam, float time) {
+
+    float pos[3];
+    quat orientation;
+
+    flythroughSample(fly, time, pos, orientation.q);
+    cameraSetPosition(cam, pos[0], pos[1], pos[2]);
+    cameraSetOrientation(cam, orientation.q);
+}
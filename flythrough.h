@@ -0,0 +1,44 @@
+#ifndef FLYTHROUGH_H
+#define FLYTHROUGH_H
+
+#include "camera.h"
+
+// ----------------------------------------------------
+// FLYTHROUGHS
+//
+// A camera path given by keys in time. Positions follow
+// a Catmull-Rom spline through the keys and orientations
+// are slerped, so sampling gives the camera a position
+// and an orientation directly. Sampled at fixed steps
+// the path replays the same frames every run, which is
+// what benchmarks need.
+//
+
+struct CameraKey {
+    float time;
+    float pos[3];
+    quat orientation;
+};
+
+struct Flythrough {
+    CameraKey *keys;
+    int count;
+    int capacity;
+};
+
+void flythroughInit(Flythrough *fly);
+void flythroughFree(Flythrough *fly);
+
+// keys must be added in increasing time
+void flythroughAddKey(Flythrough *fly, float time, const float *pos, const float *orientation);
+void flythroughAddLookAt(Flythrough *fly, float time, const float *pos, const float *target);
+
+float flythroughDuration(const Flythrough *fly);
+
+// time is clamped to the path
+void flythroughSample(const Flythrough *fly, float time, float *pos, float *orientation);
+
+// moves the camera to where the path is at time
+void flythroughApply(const Flythrough *fly, Camera *cam, float time);
+
+#endif
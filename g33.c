@@ -1,11 +1,35 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <string.h>
 #include <math.h>
 #include <GL/glew.h>
 #include <GL/glut.h>
  
-// #include "textfile.h"
+#include "cpu.h"
+#include "mat4.h"
+#include "mat4const.h"
+#include "camera.h"
+#include "cull.h"
+#include "bvh.h"
+#include "vertexformat.h"
+#include "gpuarena.h"
+#include "streambuffer.h"
+#include "drawbatch.h"
+#include "meshopt.h"
+#include "meshimport.h"
+#include "meshfile.h"
+#include "manifest.h"
+#include "pack.h"
+#include "programcache.h"
+#include "programqueue.h"
+#include "shadervariant.h"
+#include "shadersource.h"
+#include "programreflect.h"
+#include "instancing.h"
+#include "flythrough.h"
+#include "jobs.h"
+#include "bench.h"
  
 #define M_PI       3.14159265358979323846
  
@@ -26,7 +50,7 @@ float colorAxis[] = {   0.0f, 0.0f, 0.0f, 0.0f,
             0.0f, 0.0f, 0.0f, 0.0f,
             0.0f, 0.0f, 0.0f, 0.0f};
  
-// Data for triangle 1
+// Data for the triangles, one mesh drawn twice
 float vertices1[] = {   -3.0f, 0.0f, -5.0f, 1.0f,
             -1.0f, 0.0f, -5.0f, 1.0f,
             -2.0f, 2.0f, -5.0f, 1.0f};
@@ -35,34 +59,182 @@ float colors1[] = { 0.0f, 0.0f, 1.0f, 1.0f,
             0.0f, 0.0f, 1.0f, 1.0f,
             0.0f,0.0f, 1.0f, 1.0f};
  
-// Data for triangle 2
-float vertices2[] = {   1.0f, 0.0f, -5.0f, 1.0f,
-            3.0f, 0.0f, -5.0f, 1.0f,
-            2.0f, 2.0f, -5.0f, 1.0f};
+// Each triangle is vertices1 moved along x, in its color
+struct TriangleInstance {
+    float offset[3];
+    float color[4];
+};
  
-float colors2[] = { 1.0f, 0.0f, 0.0f, 1.0f,
-            1.0f, 0.0f, 0.0f, 1.0f,
-            1.0f,0.0f, 0.0f, 1.0f};
+TriangleInstance triangles[] = {
+    { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 1.0f } },
+    { { 4.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f, 1.0f } } };
  
 // Shader Names
-char *vertexFileName = "color.vert";
-char *fragmentFileName = "color.frag";
+char *vertexFileName = "scene.vert";
+char *fragmentFileName = "scene.frag";
+ 
+// g33 model.obj, or .ply or .g33m, adds the model to the scene
+char *modelFileName = NULL;
+ 
+// What cook made, when it was run: shaders and models named
+// there are taken from it rather than from their sources,
+// and the cooked files from the pack when there is one
+Manifest assets;
+PackFile assetPack;
  
 // Program and Shader Identifiers
 GLuint p,v,f;
  
-// Vertex Attribute Locations
-GLuint vertexLoc, colorLoc;
+// Vertex Attribute Locations, given by the shaders with
+// layout(location), so known before the programs are and
+// the same in all
+enum {
+    POSITION_LOC,
+    COLOR_LOC,
+    INSTANCE_ROW_LOC,               // 3 rows
+    INSTANCE_COLOR_LOC = INSTANCE_ROW_LOC + 3
+};
+ 
+GLuint vertexLoc = POSITION_LOC, colorLoc = COLOR_LOC;
  
-// Uniform variable Locations
+// Uniform variable Locations, from the reflection of the
+// programs, by the ids of their names
 GLuint projMatrixLoc, viewMatrixLoc;
+unsigned int projMatrixName, viewMatrixName, fogColorName, fogRangeName;
+ProgramReflection sceneReflection, instancedReflection;
+ 
+// Linked programs kept from one run to the next
+ProgramCache programCache;
+ 
+// The programs build while the scene draws with the fallback,
+// the instanced meshes waiting for theirs
+ProgramQueue programQueue;
+GLuint fallbackProgram;
+ 
+// When the startup builds began, 0 once they are all done
+double shaderStart = 0.0;
+ 
+// Both are variants of the scene shaders, f toggles the fog
+// of either, built the first time
+ShaderVariants sceneShaders;
+bool fog = false;
+ 
+// The shader files, watched while the program runs: when
+// they change, their variants are built again while the
+// old ones draw, then all are swapped at once
+ShaderLibrary shaderLibrary;
+int sceneVertexFile = -1, sceneFragmentFile = -1;
+ShaderVariants reloadedShaders;
+bool reloading = false;
+ 
+#define FOG_NEAR 5.0f
+#define FOG_FAR 40.0f
+ 
+// The program drawing instanced meshes, and its locations
+GLuint instancedProgram;
+InstanceLocations instanceLocs;
+GLuint instancedProjLoc, instancedViewLoc;
+ 
+// Interleaved vertices: half float positions, with w left
+// to GL, and unorm8 colors, 12 bytes a vertex
+VertexFormat sceneFormat;
+ 
+// The vertices of all the meshes share a few large buffers,
+// their indices a few others, and the meshes of one pair of
+// buffers share a VAO
+#define VERTEX_PAGE_SIZE (4 << 20)
+#define INDEX_PAGE_SIZE (1 << 20)
+ 
+GpuArena vertexArena;
+GpuArena indexArena;
+GpuVaoCache vaoCache;
+unsigned int linkedGeneration = 0;
+ 
+// What is written for a frame only goes to a ring the GPU
+// reads from: the draw commands and the box of the picked item
+#define FRAME_STREAM_SIZE (1 << 20)
+ 
+VertexFormat debugFormat;
+StreamBuffer frameStream;
+int pickedItem = -1;
+ 
+// The visible items, drawn in as few calls as their VAOs allow
+DrawBatch drawBatch;
+ 
+// What renderScene draws: a range of the vertex arena,
+// from the first vertex of the range in the VAO, or one of
+// the triangles, an instance of triangleMesh. Indexed items
+// draw count indices of a range of the index arena, from
+// its first index, with the first vertex as base vertex.
+struct DrawItem {
+    int alloc;
+    GLuint vao;
+    GLint first;
+    GLenum mode;
+    GLsizei count;
+    int instance;
+ 
+    int indexAlloc;     // -1 when not indexed
+    GLenum indexType;
+    GLint firstIndex;
+};
+ 
+DrawItem *drawItems = NULL;
+int drawItemCount = 0;
+ 
+// The visible triangles are pushed to it every frame
+InstancedMesh triangleMesh;
+int triangleAlloc = -1;
+ 
+// Bounds of the draw items, for frustum culling,
+// and the tree over them for culling and picking
+CullSet cullSet;
+Frustum frustum;
+Bvh sceneBvh;
+ 
+// Window size, to turn mouse positions into rays
+int windowWidth = 320, windowHeight = 320;
+ 
+// Mouse look: dragging with the right button sets the
+// orientation to turn to, which the camera eases into
+bool looking = false, lookEasing = false;
+int lookX, lookY;
+float lookYaw, lookPitch;
+quat lookTarget;
+ 
+// g33 -fly follows a scripted path at a fixed time step,
+// so every run renders the same frames
+Flythrough flythrough;
+bool flying = false;
+int flyFrame = 0;
+double flyTime = 0.0;
+ 
+// Camera, holding the projection and view matrices
+Camera camera;
+ 
+// The scene is looked at from a fixed point, so the view
+// matrix is computed by the compiler
+static constexpr mat4 sceneView = lookAtMatrix(10,2,10, 0,2,-5);
+ 
+// where the view puts a point, along one of its axes
+constexpr float viewAxis(const mat4 &view, int axis, float x, float y, float z) {
+    return view.m[axis] * x + view.m[4 + axis] * y + view.m[8 + axis] * z + view.m[12 + axis];
+}
  
-// Vertex Array Objects Identifiers
-GLuint vao[3];
+constexpr bool nearlyEqual(float a, float b) {
+    return a - b < 1e-3f && b - a < 1e-3f;
+}
  
-// storage for Matrices
-float projMatrix[16];
-float viewMatrix[16];
+static_assert(nearlyEqual(viewAxis(sceneView, 0, 10,2,10), 0.0f) &&
+              nearlyEqual(viewAxis(sceneView, 1, 10,2,10), 0.0f) &&
+              nearlyEqual(viewAxis(sceneView, 2, 10,2,10), 0.0f),
+              "the scene camera must be at its eye");
+static_assert(nearlyEqual(viewAxis(sceneView, 0, 0,2,-5), 0.0f) &&
+              nearlyEqual(viewAxis(sceneView, 1, 0,2,-5), 0.0f) &&
+              nearlyEqual(viewAxis(sceneView, 2, 0,2,-5), (float) -constSqrt(10 * 10 + 15 * 15)),
+              "the scene camera must look straight at its target");
+static_assert(focalLength(53.13f) > 1.9999f && focalLength(53.13f) < 2.0001f,
+              "a 53.13 degrees field of view has a focal length of 2");
  
 // ----------------------------------------------------
 // VECTOR STUFF
@@ -71,19 +243,13 @@ float viewMatrix[16];
 // res = a cross b;
 void crossProduct( float *a, float *b, float *res) {
  
-    res[0] = a[1] * b[2]  -  b[1] * a[2];
-    res[1] = a[2] * b[0]  -  b[2] * a[0];
-    res[2] = a[0] * b[1]  -  b[0] * a[1];
+    vec3Cross(a, b, res);
 }
  
 // Normalize a vec3
 void normalize(float *a) {
  
-    float mag = sqrt(a[0] * a[0]  +  a[1] * a[1]  +  a[2] * a[2]);
- 
-    a[0] /= mag;
-    a[1] /= mag;
-    a[2] /= mag;
+    vec3Normalize(a);
 }
  
 // ----------------------------------------------------
@@ -92,7 +258,7 @@ void normalize(float *a) {
  
 // sets the square matrix mat to the identity matrix,
 // size refers to the number of rows (or columns)
-void setIdentityMatrix( float *mat, int size) {
+constexpr void setIdentityMatrix( float *mat, int size) {
  
     // fill matrix with 0s
     for (int i = 0; i < size * size; ++i)
@@ -108,22 +274,11 @@ void setIdentityMatrix( float *mat, int size) {
 //
 void multMatrix(float *a, float *b) {
  
-    float res[16];
- 
-    for (int i = 0; i < 4; ++i) {
-        for (int j = 0; j < 4; ++j) {
-            res[j*4 + i] = 0.0f;
-            for (int k = 0; k < 4; ++k) {
-                res[j*4 + i] += a[k*4 + i] * b[j*4 + k];
-            }
-        }
-    }
-    memcpy(a, res, 16 * sizeof(float));
- 
+    mat4Mult(a, a, b);
 }
  
 // Defines a transformation matrix mat with a translation
-void setTranslationMatrix(float *mat, float x, float y, float z) {
+constexpr void setTranslationMatrix(float *mat, float x, float y, float z) {
  
     setIdentityMatrix(mat,4);
     mat[12] = x;
@@ -135,18 +290,10 @@ void setTranslationMatrix(float *mat, float x, float y, float z) {
 // Projection Matrix
 //
  
+// the matrix itself is only rebuilt when the values change
 void buildProjectionMatrix(float fov, float ratio, float near, float far) {
  
-    float f = 1.0f / tan (fov * (M_PI / 360.0));
- 
-    setIdentityMatrix(projMatrix,4);
- 
-    projMatrix[0] = f / ratio;
-    projMatrix[1 * 4 + 1] = f;
-    projMatrix[2 * 4 + 2] = (far + near) / (near - far);
-    projMatrix[3 * 4 + 2] = (2.0f * far * near) / (near - far);
-    projMatrix[2 * 4 + 3] = -1.0f;
-    projMatrix[3 * 4 + 3] = 0.0f;
+    cameraSetProjection(&camera, fov, ratio, near, far);
 }
  
 // ----------------------------------------------------
@@ -155,50 +302,14 @@ void buildProjectionMatrix(float fov, float ratio, float near, float far) {
 // note: it assumes the camera is not tilted,
 // i.e. a vertical up vector (remmeber gluLookAt?)
 //
+// the matrix itself is only rebuilt when the values change
+//
  
 void setCamera(float posX, float posY, float posZ,
                float lookAtX, float lookAtY, float lookAtZ) {
  
-    float dir[3], right[3], up[3];
- 
-    up[0] = 0.0f;   up[1] = 1.0f;   up[2] = 0.0f;
- 
-    dir[0] =  (lookAtX - posX);
-    dir[1] =  (lookAtY - posY);
-    dir[2] =  (lookAtZ - posZ);
-    normalize(dir);
- 
-    crossProduct(dir,up,right);
-    normalize(right);
- 
-    crossProduct(right,dir,up);
-    normalize(up);
- 
-    float aux[16];
- 
-    viewMatrix[0]  = right[0];
-    viewMatrix[4]  = right[1];
-    viewMatrix[8]  = right[2];
-    viewMatrix[12] = 0.0f;
- 
-    viewMatrix[1]  = up[0];
-    viewMatrix[5]  = up[1];
-    viewMatrix[9]  = up[2];
-    viewMatrix[13] = 0.0f;
- 
-    viewMatrix[2]  = -dir[0];
-    viewMatrix[6]  = -dir[1];
-    viewMatrix[10] = -dir[2];
-    viewMatrix[14] =  0.0f;
- 
-    viewMatrix[3]  = 0.0f;
-    viewMatrix[7]  = 0.0f;
-    viewMatrix[11] = 0.0f;
-    viewMatrix[15] = 1.0f;
- 
-    setTranslationMatrix(aux, -posX, -posY, -posZ);
- 
-    multMatrix(viewMatrix, aux);
+    cameraSetPosition(&camera, posX, posY, posZ);
+    cameraSetTarget(&camera, lookAtX, lookAtY, lookAtZ);
 }
  
 // ----------------------------------------------------
@@ -213,108 +324,778 @@ void changeSize(int w, int h) {
  
     // Set the viewport to be the entire window
     glViewport(0, 0, w, h);
+    windowWidth = w;
+    windowHeight = h;
  
     ratio = (1.0f * w) / h;
     buildProjectionMatrix(53.13f, ratio, 1.0f, 30.0f);
 }
  
+// ----------------------------------------------------
+// Draw items and culling
+//
+ 
+void addDrawItemBounds(int alloc, GLenum mode, int count, const Bounds *bounds) {
+ 
+    drawItems = (DrawItem *)realloc(drawItems, (drawItemCount + 1) * sizeof(DrawItem));
+    drawItems[drawItemCount].alloc = alloc;
+    drawItems[drawItemCount].vao = 0;
+    drawItems[drawItemCount].first = 0;
+    drawItems[drawItemCount].mode = mode;
+    drawItems[drawItemCount].count = count;
+    drawItems[drawItemCount].instance = -1;
+    drawItems[drawItemCount].indexAlloc = -1;
+    drawItems[drawItemCount].indexType = 0;
+    drawItems[drawItemCount].firstIndex = 0;
+    drawItemCount++;
+ 
+    cullSetAdd(&cullSet, bounds);
+}
+ 
+// vertices are 4 floats each, their bounds are computed once here
+void addDrawItem(int alloc, GLenum mode, const float *vertices, int count) {
+ 
+    Bounds bounds;
+ 
+    boundsFromPoints(&bounds, vertices, count);
+    addDrawItemBounds(alloc, mode, count, &bounds);
+}
+ 
+// where the program reads each vertex attribute
+void attribLocations(int *locations) {
+ 
+    for (int i = 0; i < VERTEX_SEMANTICS; ++i)
+        locations[i] = -1;
+    locations[VERTEX_POSITION] = vertexLoc;
+    locations[VERTEX_COLOR] = colorLoc;
+}
+ 
+// changes when either arena moves allocations
+unsigned int arenaGeneration() {
+ 
+    return vertexArena.generation + indexArena.generation;
+}
+ 
+size_t indexSize(GLenum type) {
+ 
+    return type == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+ 
+// finds the VAO and first vertex of every draw item,
+// again after the arena moved things around
+void linkDrawItems() {
+ 
+    int locations[VERTEX_SEMANTICS];
+ 
+    attribLocations(locations);
+    if (linkedGeneration != arenaGeneration())
+        gpuVaoCacheClear(&vaoCache);
+ 
+    for (int i = 0; i < drawItemCount; ++i) {
+        DrawItem *item = &drawItems[i];
+        GLuint buffer = gpuArenaBuffer(&vertexArena, item->alloc);
+        GLuint indexBuffer = item->indexAlloc >= 0 ? gpuArenaBuffer(&indexArena, item->indexAlloc) : 0;
+        item->vao = gpuVaoGetIndexed(&vaoCache, &sceneFormat, locations, buffer, indexBuffer);
+        item->first = (GLint)(gpuArenaOffset(&vertexArena, item->alloc) / sceneFormat.stride);
+        if (item->indexAlloc >= 0)
+            item->firstIndex = (GLint)(gpuArenaOffset(&indexArena, item->indexAlloc) / indexSize(item->indexType));
+    }
+ 
+    instancedMeshSetVertices(&triangleMesh, &sceneFormat, gpuArenaBuffer(&vertexArena, triangleAlloc),
+                             (GLint)(gpuArenaOffset(&vertexArena, triangleAlloc) / sceneFormat.stride));
+    linkedGeneration = arenaGeneration();
+}
+ 
+// leaves the indices of the draw items to draw in cullSet.visible
+void cullScene() {
+ 
+    static unsigned int frustumGeneration = 0;
+    static int frames = 0;
+    static double culling = 0.0, lastReport = 0.0;
+ 
+    // the planes only move with the camera
+    if (camera.generation != frustumGeneration) {
+        frustumFromMatrix(&frustum, camera.viewProj.m);
+        frustumGeneration = camera.generation;
+    }
+ 
+    bvhCull(&sceneBvh, &cullSet, &frustum);
+ 
+    // report once a second
+    frames++;
+    culling += cullSet.stats.seconds;
+    double now = cpuSeconds();
+    if (now - lastReport >= 1.0) {
+        printf("culling: %d visible, %d culled, %.3f ms per frame, %d draws in %d calls\n",
+               cullSet.stats.visible, cullSet.stats.culled, culling / frames * 1000.0,
+               drawBatch.stats.draws, drawBatch.stats.calls);
+        frames = 0;
+        culling = 0.0;
+        lastReport = now;
+    }
+}
+ 
+// packs vertices and colors, 4 floats per vertex each, in
+// sceneFormat, to free
+void *packMesh(const float *vertices, const float *colors, int count) {
+ 
+    VertexSource src;
+ 
+    vertexSourceInit(&src, count);
+    vertexSourceSet(&src, VERTEX_POSITION, vertices, 4);
+    vertexSourceSet(&src, VERTEX_COLOR, colors, 4);
+ 
+    void *packed = malloc(count * sceneFormat.stride);
+    vertexFormatPack(&sceneFormat, &src, packed);
+    return packed;
+}
+ 
+int uploadToArena(GpuArena *arena, const void *data, size_t size, size_t alignment) {
+ 
+    int alloc = gpuArenaAlloc(arena, size, alignment);
+    if (alloc < 0) {
+        printf("out of video memory\n");
+        exit(1);
+    }
+    gpuArenaUpload(arena, alloc, data, size);
+    return alloc;
+}
+ 
+// count packed vertices into a range of the vertex arena,
+// starting on a whole vertex, so draws only need the first one
+int uploadVertices(const void *packed, int count) {
+ 
+    return uploadToArena(&vertexArena, packed, (size_t) count * sceneFormat.stride, sceneFormat.stride);
+}
+ 
+// into a range of the index arena, in 16 bits when the
+// vertices they index allow it
+int uploadIndices(const unsigned int *indices, int count, int vertexCount, GLenum *type) {
+ 
+    *type = vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    size_t size = count * indexSize(*type);
+ 
+    void *data = (void *) indices;
+    if (*type == GL_UNSIGNED_SHORT) {
+        unsigned short *shorts = (unsigned short *) malloc(size);
+        for (int i = 0; i < count; ++i)
+            shorts[i] = (unsigned short) indices[i];
+        data = shorts;
+    }
+ 
+    int alloc = uploadToArena(&indexArena, data, size, indexSize(*type));
+    if (data != indices)
+        free(data);
+    return alloc;
+}
+ 
+int uploadMesh(const float *vertices, const float *colors, int count) {
+ 
+    void *packed = packMesh(vertices, colors, count);
+    int alloc = uploadVertices(packed, count);
+    free(packed);
+    return alloc;
+}
+ 
+// triangles are reordered for the vertex cache, the bounds
+// are those of the count vertices, 4 floats each
+void addIndexedMesh(GLenum mode, IndexedMesh *mesh, const float *vertices, int count) {
+ 
+    MeshOptStats stats;
+ 
+    if (mode == GL_TRIANGLES) {
+        indexedMeshOptimize(mesh, &stats);
+        printf("mesh: %d indices, %d vertices, ACMR %.3f before, %.3f after\n",
+               stats.indices, stats.vertices, stats.acmrBefore, stats.acmrAfter);
+    }
+ 
+    addDrawItem(uploadVertices(mesh->vertices, mesh->vertexCount), mode, vertices, count);
+    DrawItem *item = &drawItems[drawItemCount - 1];
+    item->indexAlloc = uploadIndices(mesh->indices, mesh->indexCount, mesh->vertexCount, &item->indexType);
+}
+ 
+// the packed vertices are welded and indexed
+void setupMesh(GLenum mode, const float *vertices, const float *colors, int count) {
+ 
+    IndexedMesh mesh;
+ 
+    void *packed = packMesh(vertices, colors, count);
+    indexedMeshBuild(&mesh, packed, count, sceneFormat.stride);
+    free(packed);
+ 
+    addIndexedMesh(mode, &mesh, vertices, count);
+    indexedMeshFree(&mesh);
+}
+ 
+// mesh files are made for the GPU: they go from their
+// mapping to the arenas as they are, the full mesh, their
+// first level of detail, is drawn
+void setupMeshFile(const char *path) {
+ 
+    MeshFile file;
+    Bounds bounds;
+ 
+    double start = cpuSeconds();
+    if (!meshFileOpen(&file, path))
+        return;
+ 
+    const MeshFileHeader *h = file.header;
+    if (!vertexFormatEqual(&file.format, &sceneFormat) || h->lods[0].firstIndex != 0) {
+        printf("%s: not made for this scene\n", path);
+        meshFileClose(&file);
+        return;
+    }
+ 
+    int alloc = uploadVertices(file.vertices, h->vertexCount);
+    int indexAlloc = uploadToArena(&indexArena, file.indices, (size_t) h->indexSize, indexSize(h->indexType));
+ 
+    memcpy(bounds.center, h->center, sizeof(bounds.center));
+    memcpy(bounds.extents, h->extents, sizeof(bounds.extents));
+    bounds.radius = h->radius;
+    addDrawItemBounds(alloc, GL_TRIANGLES, h->lods[0].indexCount, &bounds);
+    drawItems[drawItemCount - 1].indexAlloc = indexAlloc;
+    drawItems[drawItemCount - 1].indexType = h->indexType;
+ 
+    printf("%s: %u vertices, %u triangles, %u levels, loaded in %.1f ms\n", path,
+           h->vertexCount, h->indexCount / 3, h->lodCount, (cpuSeconds() - start) * 1000.0);
+    meshFileClose(&file);
+}
+ 
+// size bytes of a pack entry from offset into a new range
+// of the arena, decompressed straight into the mapped range,
+// or staged when GL cannot map it; -1 when it is corrupt
+int unpackToArena(GpuArena *arena, const PackEntry *entry, unsigned long long offset, size_t size, size_t alignment) {
+ 
+    int alloc = gpuArenaAlloc(arena, size, alignment);
+    if (alloc < 0) {
+        printf("out of video memory\n");
+        exit(1);
+    }
+ 
+    bool ok = false;
+    void *mapped = gpuArenaMap(arena, alloc, size);
+    if (mapped) {
+        ok = packRead(&assetPack, entry, offset, size, mapped);
+        if (!gpuArenaUnmap(arena, alloc) && ok)
+            mapped = NULL;
+    }
+    if (!mapped) {
+        void *staging = malloc(size);
+        ok = packRead(&assetPack, entry, offset, size, staging);
+        if (ok)
+            gpuArenaUpload(arena, alloc, staging, size);
+        free(staging);
+    }
+ 
+    if (!ok) {
+        gpuArenaRelease(arena, alloc);
+        return -1;
+    }
+    return alloc;
+}
+ 
+// packed mesh files are read as mapped ones are, but for
+// their vertices and indices being decompressed on the way
+void setupMeshPack(const PackEntry *entry) {
+ 
+    MeshFileHeader h;
+    VertexFormat format;
+    Bounds bounds;
+ 
+    const char *name = packName(&assetPack, entry);
+    double start = cpuSeconds();
+    if (!packRead(&assetPack, entry, 0, sizeof(h), &h)) {
+        printf("%s: not a mesh file\n", name);
+        return;
+    }
+    if (!meshFileCheckHeader(&h, entry->size, &format, name))
+        return;
+    if (!vertexFormatEqual(&format, &sceneFormat) || h.lods[0].firstIndex != 0) {
+        printf("%s: not made for this scene\n", name);
+        return;
+    }
+ 
+    int alloc = unpackToArena(&vertexArena, entry, h.vertexOffset, (size_t) h.vertexSize, sceneFormat.stride);
+    int indexAlloc = alloc < 0 ? -1 : unpackToArena(&indexArena, entry, h.indexOffset, (size_t) h.indexSize, indexSize(h.indexType));
+    if (indexAlloc < 0) {
+        if (alloc >= 0)
+            gpuArenaRelease(&vertexArena, alloc);
+        printf("%s: corrupt\n", name);
+        return;
+    }
+ 
+    memcpy(bounds.center, h.center, sizeof(bounds.center));
+    memcpy(bounds.extents, h.extents, sizeof(bounds.extents));
+    bounds.radius = h.radius;
+    addDrawItemBounds(alloc, GL_TRIANGLES, h.lods[0].indexCount, &bounds);
+    drawItems[drawItemCount - 1].indexAlloc = indexAlloc;
+    drawItems[drawItemCount - 1].indexType = h.indexType;
+ 
+    double seconds = cpuSeconds() - start;
+    printf("%s: %u vertices, %u triangles, unpacked in %.1f ms, %.0f MB/s\n", name, h.vertexCount, h.indexCount / 3,
+           seconds * 1000.0, (h.vertexSize + h.indexSize) / seconds / (1 << 20));
+}
+ 
+// imported meshes come indexed, their indices are kept;
+// cooked ones are loaded from their mesh file
+void setupModel(const char *path) {
+ 
+    ImportedMesh model;
+    IndexedMesh mesh;
+    char cooked[1024];
+ 
+    const ManifestEntry *entry = manifestFind(&assets, path);
+    if (entry && entry->type == ASSET_MESH && manifestFile(&assets, entry)) {
+        const PackEntry *packed = packFind(&assetPack, manifestFile(&assets, entry));
+        if (packed)
+            setupMeshPack(packed);
+        else if (manifestFilePath(&assets, entry, cooked, sizeof(cooked)))
+            setupMeshFile(cooked);
+        return;
+    }
+ 
+    const char *extension = strrchr(path, '.');
+    if (extension && strcmp(extension, MESH_FILE_EXTENSION) == 0) {
+        setupMeshFile(path);
+        return;
+    }
+ 
+    double start = cpuSeconds();
+    if (!meshImport(&model, path))
+        return;
+    printf("%s: %d vertices, %d triangles, read in %.1f ms\n",
+           path, model.vertexCount, model.indexCount / 3, (cpuSeconds() - start) * 1000.0);
+    if (model.indexCount == 0) {
+        importedMeshFree(&model);
+        return;
+    }
+ 
+    mesh.vertices = (unsigned char *) packMesh(model.positions, model.colors, model.vertexCount);
+    mesh.vertexCount = model.vertexCount;
+    mesh.stride = sceneFormat.stride;
+    mesh.indices = model.indices;
+    mesh.indexCount = model.indexCount;
+    model.indices = NULL;
+ 
+    addIndexedMesh(GL_TRIANGLES, &mesh, model.positions, model.vertexCount);
+    indexedMeshFree(&mesh);
+    importedMeshFree(&model);
+}
+ 
+// the triangle is uploaded once, each instance is a draw
+// item for culling and picking, with the bounds it has moved
+void setupTriangles() {
+ 
+    float moved[12];
+ 
+    triangleAlloc = uploadMesh(vertices1, colors1, 3);
+    instancedMeshInit(&triangleMesh, &sceneFormat, gpuArenaBuffer(&vertexArena, triangleAlloc),
+                      (GLint)(gpuArenaOffset(&vertexArena, triangleAlloc) / sceneFormat.stride),
+                      3, GL_TRIANGLES, &instanceLocs);
+ 
+    for (int t = 0; t < (int)(sizeof(triangles) / sizeof(triangles[0])); ++t) {
+        for (int i = 0; i < 12; ++i)
+            moved[i] = vertices1[i] + (i % 4 < 3 ? triangles[t].offset[i % 4] : 0.0f);
+        addDrawItem(triangleAlloc, GL_TRIANGLES, moved, 3);
+        drawItems[drawItemCount - 1].instance = t;
+    }
+}
+ 
 void setupBuffers() {
  
-    GLuint buffers[2];
+    vertexFormatScene(&sceneFormat);
  
-    glGenVertexArrays(3, vao);
-    //
-    // VAO for first triangle
-    //
-    glBindVertexArray(vao[0]);
-    // Generate two slots for the vertex and color buffers
-    glGenBuffers(2, buffers);
-    // bind buffer for vertices and copy data into buffer
-    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices1), vertices1, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(vertexLoc);
-    glVertexAttribPointer(vertexLoc, 4, GL_FLOAT, 0, 0, 0);
- 
-    // bind buffer for colors and copy data into buffer
-    glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(colors1), colors1, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(colorLoc);
-    glVertexAttribPointer(colorLoc, 4, GL_FLOAT, 0, 0, 0);
+    gpuArenaInit(&vertexArena, GL_ARRAY_BUFFER, VERTEX_PAGE_SIZE, GL_STATIC_DRAW);
+    gpuArenaInit(&indexArena, GL_ELEMENT_ARRAY_BUFFER, INDEX_PAGE_SIZE, GL_STATIC_DRAW);
+    gpuVaoCacheInit(&vaoCache);
  
-    //
-    // VAO for second triangle
-    //
-    glBindVertexArray(vao[1]);
-    // Generate two slots for the vertex and color buffers
-    glGenBuffers(2, buffers);
- 
-    // bind buffer for vertices and copy data into buffer
-    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices2), vertices2, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(vertexLoc);
-    glVertexAttribPointer(vertexLoc, 4, GL_FLOAT, 0, 0, 0);
- 
-    // bind buffer for colors and copy data into buffer
-    glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(colors2), colors2, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(colorLoc);
-    glVertexAttribPointer(colorLoc, 4, GL_FLOAT, 0, 0, 0);
+    // the two triangles
+    setupTriangles();
  
-    //
-    // This VAO is for the Axis
-    //
-    glBindVertexArray(vao[2]);
-    // Generate two slots for the vertex and color buffers
-    glGenBuffers(2, buffers);
-    // bind buffer for vertices and copy data into buffer
-    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verticesAxis), verticesAxis, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(vertexLoc);
-    glVertexAttribPointer(vertexLoc, 4, GL_FLOAT, 0, 0, 0);
+    // the axis
+    setupMesh(GL_LINES, verticesAxis, colorAxis, 6);
+ 
+    if (modelFileName)
+        setupModel(modelFileName);
  
-    // bind buffer for colors and copy data into buffer
-    glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(colorAxis), colorAxis, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(colorLoc);
-    glVertexAttribPointer(colorLoc, 4, GL_FLOAT, 0, 0, 0);
+    linkDrawItems();
+    gpuArenaPrintStats(&vertexArena, "vertices");
+    gpuArenaPrintStats(&indexArena, "indices");
  
+    vertexFormatInit(&debugFormat);
+    vertexFormatAdd(&debugFormat, VERTEX_POSITION, VERTEX_FLOAT, 3);
+    vertexFormatAdd(&debugFormat, VERTEX_COLOR, VERTEX_UNORM8, 4);
+    streamBufferInit(&frameStream, FRAME_STREAM_SIZE);
+    printf("frame stream: %s\n", frameStream.persistent ? "persistent mapping" : "unsynchronized mapping");
+ 
+    drawBatchInit(&drawBatch, &frameStream);
+    printf("draw batching: %s\n", drawBatch.indirect ? "multi draw indirect" : "multi draw");
+ 
+    bvhBuild(&sceneBvh, &cullSet);
+}
+ 
+// ----------------------------------------------------
+// Camera animation
+//
+ 
+#define LOOK_SPEED 0.25f    // degrees per pixel
+#define LOOK_EASING 0.25f   // part of the way done each frame
+#define FLY_STEP (1.0f / 60.0f)
+ 
+void buildFlythrough() {
+ 
+    const float center[3] = { 0.0f, 1.0f, -5.0f };
+ 
+    // one turn around the triangles, rising and falling
+    for (int i = 0; i <= 8; ++i) {
+        float angle = i * (float)(M_PI / 4.0);
+        float pos[3] = { center[0] + 12.0f * sinf(angle),
+                         3.0f + 2.0f * sinf(2.0f * angle),
+                         center[2] + 12.0f * cosf(angle) };
+        flythroughAddLookAt(&flythrough, (float) i, pos, center);
+    }
+}
+ 
+void updateCamera() {
+ 
+    if (flying) {
+        flythroughApply(&flythrough, &camera, flyFrame * FLY_STEP);
+ 
+        // one line per pass over the path
+        if (flyFrame++ * FLY_STEP >= flythroughDuration(&flythrough)) {
+            double now = cpuSeconds();
+            if (flyTime > 0.0)
+                printf("flythrough: %d frames, %.3f ms per frame\n",
+                       flyFrame, (now - flyTime) * 1000.0 / flyFrame);
+            flyTime = now;
+            flyFrame = 0;
+        }
+        return;
+    }
+ 
+    if (lookEasing) {
+        quat q;
+        quatNlerp(q.q, camera.orientation.q, lookTarget.q, LOOK_EASING);
+        float d = q.q[0] * lookTarget.q[0] + q.q[1] * lookTarget.q[1] +
+                  q.q[2] * lookTarget.q[2] + q.q[3] * lookTarget.q[3];
+        if (fabsf(d) > 0.999999f) {
+            q = lookTarget;
+            lookEasing = false;
+        }
+        cameraSetOrientation(&camera, q.q);
+    }
 }
  
 void setUniforms() {
  
+    // generation of the matrices the program holds
+    static unsigned int uploaded = 0;
+ 
+    // and again for a new program
+    static GLuint uploadedProgram = 0;
+ 
+    unsigned int generation = cameraUpdate(&camera);
+    if (generation == uploaded && p == uploadedProgram)
+        return;
+ 
     // must be called after glUseProgram
-    glUniformMatrix4fv(projMatrixLoc,  1, false, projMatrix);
-    glUniformMatrix4fv(viewMatrixLoc,  1, false, viewMatrix);
+    glUniformMatrix4fv(projMatrixLoc,  1, false, camera.proj.m);
+    glUniformMatrix4fv(viewMatrixLoc,  1, false, camera.view.m);
+    uploaded = generation;
+    uploadedProgram = p;
+}
+ 
+// the same for the instanced program, after setUniforms
+void setInstancedUniforms() {
+ 
+    static unsigned int uploaded = 0;
+    static GLuint uploadedProgram = 0;
+ 
+    if (camera.generation == uploaded && instancedProgram == uploadedProgram)
+        return;
+ 
+    glUniformMatrix4fv(instancedProjLoc,  1, false, camera.proj.m);
+    glUniformMatrix4fv(instancedViewLoc,  1, false, camera.view.m);
+    uploaded = camera.generation;
+    uploadedProgram = instancedProgram;
+}
+ 
+// the 12 edges of the box of the picked item, packed
+// straight into the stream buffer
+void drawPickedBounds() {
+ 
+    static const int edges[12][2] = {
+        {0,1}, {2,3}, {4,5}, {6,7},
+        {0,2}, {1,3}, {4,6}, {5,7},
+        {0,4}, {1,5}, {2,6}, {3,7}
+    };
+    static const float color[4] = { 1.0f, 0.5f, 0.0f, 1.0f };
+ 
+    if (pickedItem < 0)
+        return;
+ 
+    float corners[8][3], lines[24][3];
+    for (int c = 0; c < 8; ++c) {
+        corners[c][0] = cullSet.cx[pickedItem] + (c & 1 ? cullSet.ex[pickedItem] : -cullSet.ex[pickedItem]);
+        corners[c][1] = cullSet.cy[pickedItem] + (c & 2 ? cullSet.ey[pickedItem] : -cullSet.ey[pickedItem]);
+        corners[c][2] = cullSet.cz[pickedItem] + (c & 4 ? cullSet.ez[pickedItem] : -cullSet.ez[pickedItem]);
+    }
+    for (int e = 0; e < 12; ++e) {
+        memcpy(lines[e * 2], corners[edges[e][0]], sizeof(lines[0]));
+        memcpy(lines[e * 2 + 1], corners[edges[e][1]], sizeof(lines[0]));
+    }
+ 
+    VertexSource src;
+    vertexSourceInit(&src, 24);
+    vertexSourceSet(&src, VERTEX_POSITION, lines[0], 3);
+    vertexSourceSet(&src, VERTEX_COLOR, color, 0);
+ 
+    size_t offset;
+    void *vertices = streamBufferMap(&frameStream, 24 * debugFormat.stride, debugFormat.stride, &offset);
+    if (!vertices)
+        return;
+    vertexFormatPack(&debugFormat, &src, vertices);
+    streamBufferUnmap(&frameStream);
+ 
+    int locations[VERTEX_SEMANTICS];
+    attribLocations(locations);
+    glBindVertexArray(gpuVaoGet(&vaoCache, &debugFormat, locations, frameStream.buffer));
+    glDrawArrays(GL_LINES, (GLint)(offset / debugFormat.stride), 24);
+}
+ 
+// a program just switched to: its reflection, asked once,
+// gives the locations, and the uniforms that do not change
+// are set
+void reflectProgram(GLuint program, ProgramReflection *r, GLuint *projLoc, GLuint *viewLoc) {
+ 
+    programReflectionFree(r);
+    programReflect(r, program);
+    *projLoc = reflectUniform(r, projMatrixName);
+    *viewLoc = reflectUniform(r, viewMatrixName);
+ 
+    glUseProgram(program);
+    glUniform4f(reflectUniform(r, fogColorName), 1.0f, 1.0f, 1.0f, 1.0f);
+    glUniform2f(reflectUniform(r, fogRangeName), FOG_NEAR, FOG_FAR);
+}
+ 
+// the scene shaders changed on disk, their variants are
+// built again from the new text
+void reloadShaders() {
+ 
+    if (sceneVertexFile < 0 || sceneFragmentFile < 0)
+        return;
+    if (reloading)
+        shaderVariantsFree(&reloadedShaders);
+ 
+    printf("reloading %s\n", vertexFileName);
+    shaderVariantsInit(&reloadedShaders, &programQueue, vertexFileName,
+                       shaderLibraryText(&shaderLibrary, sceneVertexFile),
+                       shaderLibraryText(&shaderLibrary, sceneFragmentFile), NULL);
+    reloading = true;
+}
+ 
+// switches to the variants asked for once they are built,
+// keeping the ones drawing until then
+void updatePrograms() {
+ 
+    programQueuePoll(&programQueue);
+    unsigned int features = fog ? SHADER_FOG : 0;
+ 
+    if (shaderLibraryPoll(&shaderLibrary) > 0)
+        reloadShaders();
+ 
+    // the reloaded ones replace the others once all are built,
+    // or are dropped if any fails, the old ones drawing on
+    if (reloading) {
+        GLuint scene = shaderVariantsGet(&reloadedShaders, SHADER_VERTEX_COLOR | features);
+        GLuint instanced = shaderVariantsGet(&reloadedShaders, SHADER_INSTANCING | features);
+        if (shaderVariantsFailed(&reloadedShaders)) {
+            printf("%s: keeping the shaders running\n", vertexFileName);
+            shaderVariantsFree(&reloadedShaders);
+            reloading = false;
+        } else if (scene && instanced) {
+            shaderVariantsFree(&sceneShaders);
+            sceneShaders = reloadedShaders;
+            reloading = false;
+        }
+    }
+ 
+    GLuint scene = shaderVariantsGet(&sceneShaders, SHADER_VERTEX_COLOR | features);
+    if (scene && p != scene) {
+        p = scene;
+        reflectProgram(p, &sceneReflection, &projMatrixLoc, &viewMatrixLoc);
+    }
+ 
+    GLuint instanced = shaderVariantsGet(&sceneShaders, SHADER_INSTANCING | features);
+    if (instanced && instancedProgram != instanced) {
+        instancedProgram = instanced;
+        reflectProgram(instancedProgram, &instancedReflection, &instancedProjLoc, &instancedViewLoc);
+    }
+ 
+    // the startup time that counts, cold or warm: until the
+    // last program is ready, not until they are submitted
+    if (shaderStart > 0.0 && programQueue.building == 0) {
+        printf("shaders ready: %.1f ms, %d programs loaded from the cache, %d stored, %d rejected\n",
+               (cpuSeconds() - shaderStart) * 1000.0, programCache.loaded, programCache.stored,
+               programCache.rejected);
+        shaderStart = 0.0;
+    }
 }
  
 void renderScene(void) {
  
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
  
-    setCamera(10,2,10,0,2,-5);
- 
+    updatePrograms();
     glUseProgram(p);
+    updateCamera();
     setUniforms();
  
-    glBindVertexArray(vao[0]);
-    glDrawArrays(GL_TRIANGLES, 0, 3);
+    cullScene();
+ 
+    if (linkedGeneration != arenaGeneration())
+        linkDrawItems();
+ 
+    // items in the same page share the VAO, and a draw call,
+    // the visible triangles become instances of one call
+    instancedMeshClear(&triangleMesh);
+    for (int i = 0; i < cullSet.visibleCount; ++i) {
+        DrawItem *item = &drawItems[cullSet.visible[i]];
+        if (item->instance >= 0) {
+            TriangleInstance *t = &triangles[item->instance];
+            mat4 transform = translationMatrix(t->offset[0], t->offset[1], t->offset[2]);
+            instancedMeshPush(&triangleMesh, transform.m, t->color);
+            continue;
+        }
+        if (item->indexAlloc >= 0)
+            drawBatchElements(&drawBatch, item->vao, item->mode, item->indexType,
+                              item->firstIndex, item->count, item->first);
+        else
+            drawBatchArrays(&drawBatch, item->vao, item->mode, item->first, item->count);
+    }
+    drawBatchSubmit(&drawBatch);
  
-    glBindVertexArray(vao[1]);
-    glDrawArrays(GL_TRIANGLES, 0, 3);
+    drawPickedBounds();
  
-    glBindVertexArray(vao[2]);
-    glDrawArrays(GL_LINES, 0, 6);
+    if (instancedProgram) {
+        glUseProgram(instancedProgram);
+        setInstancedUniforms();
+        instancedMeshDraw(&triangleMesh);
+    }
+    streamBufferEndFrame(&frameStream);
  
     glutSwapBuffers();
 }
  
+// yaw around the world up axis, then pitch around the camera's x
+void lookOrientation(float *q, float yaw, float pitch) {
+ 
+    const float up[3] = { 0.0f, 1.0f, 0.0f };
+    const float right[3] = { 1.0f, 0.0f, 0.0f };
+    float qYaw[4], qPitch[4];
+ 
+    quatFromAxisAngle(qYaw, up, yaw);
+    quatFromAxisAngle(qPitch, right, pitch);
+    quatMult(q, qYaw, qPitch);
+}
+ 
+// a left click prints the draw item under the mouse,
+// the right button starts and ends mouse look
+void processMouse(int button, int state, int x, int y) {
+ 
+    if (button == GLUT_RIGHT_BUTTON) {
+        looking = state == GLUT_DOWN;
+        if (looking) {
+            const float forward[3] = { 0.0f, 0.0f, -1.0f };
+            float dir[3];
+ 
+            // the angles the camera looks at right now
+            quatRotate(dir, lookEasing ? lookTarget.q : camera.orientation.q, forward);
+            lookYaw = atan2f(-dir[0], -dir[2]) * (float)(180.0 / M_PI);
+            lookPitch = asinf(dir[1]) * (float)(180.0 / M_PI);
+            lookX = x;
+            lookY = y;
+        }
+        return;
+    }
+ 
+    if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN)
+        return;
+ 
+    cameraUpdate(&camera);
+ 
+    // the ray through the pixel, in view space then in world space,
+    // with a unit z in view space so t is the depth
+    float ndcX = 2.0f * (x + 0.5f) / windowWidth - 1.0f;
+    float ndcY = 1.0f - 2.0f * (y + 0.5f) / windowHeight;
+    float eyeDir[3] = { ndcX / camera.proj.m[0], ndcY / camera.proj.m[5], -1.0f };
+    float world[16], dir[3];
+ 
+    mat4AffineInverse(world, camera.view.m);
+    for (int k = 0; k < 3; ++k)
+        dir[k] = world[k] * eyeDir[0] + world[4 + k] * eyeDir[1] + world[8 + k] * eyeDir[2];
+ 
+    float t;
+    int item = bvhRaycast(&sceneBvh, &cullSet, world + 12, dir, camera.farPlane, &t, NULL, NULL);
+    if (item >= 0)
+        printf("picked draw item %d at depth %.2f\n", item, t);
+    pickedItem = item;
+}
+ 
+void processMotion(int x, int y) {
+ 
+    if (!looking || flying)
+        return;
+ 
+    lookYaw -= (x - lookX) * LOOK_SPEED;
+    lookPitch -= (y - lookY) * LOOK_SPEED;
+    lookPitch = lookPitch > 89.0f ? 89.0f : lookPitch < -89.0f ? -89.0f : lookPitch;
+    lookX = x;
+    lookY = y;
+ 
+    lookOrientation(lookTarget.q, lookYaw, lookPitch);
+    lookEasing = true;
+}
+ 
 void processNormalKeys(unsigned char key, int x, int y) {
  
+    // f toggles the fog, building its variants the first time
+    if (key == 'f') {
+        fog = !fog;
+        printf("fog %s\n", fog ? "on" : "off");
+    }
+ 
+    // d compacts the vertex and index arenas
+    if (key == 'd') {
+        size_t moved = gpuArenaDefrag(&vertexArena) + gpuArenaDefrag(&indexArena);
+        printf("defragmented, %.1f KB moved\n", moved / 1024.0);
+        gpuArenaPrintStats(&vertexArena, "vertices");
+        gpuArenaPrintStats(&indexArena, "indices");
+    }
+ 
     if (key == 27) {
-        glDeleteVertexArrays(3,vao);
-        glDeleteProgram(p);
-        glDeleteShader(v);
-        glDeleteShader(f);
+        gpuVaoCacheClear(&vaoCache);
+        gpuArenaFree(&vertexArena);
+        gpuArenaFree(&indexArena);
+        drawBatchFree(&drawBatch);
+        instancedMeshFree(&triangleMesh);
+        streamBufferFree(&frameStream);
+        programQueueFinish(&programQueue);
+        if (reloading)
+            shaderVariantsFree(&reloadedShaders);
+        shaderVariantsFree(&sceneShaders);
+        for (int i = 0; i < programQueue.count; ++i)
+            glDeleteProgram(programQueue.builds[i].program);
+        programQueueFree(&programQueue);
+        shaderLibraryFree(&shaderLibrary);
+        programReflectionFree(&sceneReflection);
+        programReflectionFree(&instancedReflection);
+        glDeleteProgram(fallbackProgram);
+        bvhFree(&sceneBvh);
+        flythroughFree(&flythrough);
+        cullSetFree(&cullSet);
+        free(drawItems);
+        jobsShutdown();
         exit(0);
     }
 }
@@ -373,50 +1154,316 @@ void printProgramInfoLog(GLuint obj)
     }
 }
  
-GLuint setupShaders() {
+// the cooked text when the manifest has it, else the file
+// from the library, file set to it; NULL when neither
+const char *shaderSource(char *name, int *file) {
+ 
+    *file = -1;
+    const ManifestEntry *entry = manifestFind(&assets, name);
+    if (entry && entry->type == ASSET_SHADER && manifestData(&assets, entry))
+        return manifestData(&assets, entry);
+ 
+    *file = shaderLibraryOpen(&shaderLibrary, name);
+    return *file >= 0 ? shaderLibraryText(&shaderLibrary, *file) : NULL;
+}
  
-    char *vs = NULL,*fs = NULL,*fs2 = NULL;
+// what the scene draws with until its program is built,
+// small enough to compile in no time
+const char *fallbackVertexSource =
+    "#version 330\n"
+    "uniform mat4 viewMatrix, projMatrix;\n"
+    "layout(location = 0) in vec4 position;\n"
+    "layout(location = 1) in vec4 color;\n"
+    "out vec4 Color;\n"
+    "void main() {\n"
+    "    Color = color;\n"
+    "    gl_Position = projMatrix * viewMatrix * position;\n"
+    "}\n";
+ 
+const char *fallbackFragmentSource =
+    "#version 330\n"
+    "in vec4 Color;\n"
+    "layout(location = 0) out vec4 outputF;\n"
+    "void main() {\n"
+    "    outputF = Color;\n"
+    "}\n";
+ 
+GLuint setupFallbackProgram() {
  
     GLuint p,v,f;
  
     v = glCreateShader(GL_VERTEX_SHADER);
     f = glCreateShader(GL_FRAGMENT_SHADER);
- 
-    vs = textFileRead(vertexFileName);
-    fs = textFileRead(fragmentFileName);
- 
-    const char * vv = vs;
-    const char * ff = fs;
- 
-    glShaderSource(v, 1, &vv,NULL);
-    glShaderSource(f, 1, &ff,NULL);
- 
-    free(vs);free(fs);
- 
+    glShaderSource(v, 1, &fallbackVertexSource,NULL);
+    glShaderSource(f, 1, &fallbackFragmentSource,NULL);
     glCompileShader(v);
     glCompileShader(f);
  
-    printShaderInfoLog(v);
-    printShaderInfoLog(f);
- 
     p = glCreateProgram();
     glAttachShader(p,v);
     glAttachShader(p,f);
- 
-    glBindFragDataLocation(p, 0, "outputF");
     glLinkProgram(p);
     printProgramInfoLog(p);
  
-    vertexLoc = glGetAttribLocation(p,"position");
-    colorLoc = glGetAttribLocation(p, "color"); 
- 
-    projMatrixLoc = glGetUniformLocation(p, "projMatrix");
-    viewMatrixLoc = glGetUniformLocation(p, "viewMatrix");
+    glDeleteShader(v);
+    glDeleteShader(f);
  
     return(p);
 }
  
+void setupShaders() {
+ 
+    const char *vs = shaderSource(vertexFileName, &sceneVertexFile);
+    const char *fs = shaderSource(fragmentFileName, &sceneFragmentFile);
+    if (!vs || !fs) {
+        printf("no scene shaders\n");
+        exit(1);
+    }
+    programQueueInit(&programQueue, &programCache);
+    shaderVariantsInit(&sceneShaders, &programQueue, vertexFileName, vs, fs, NULL);
+ 
+    for (int i = 0; i < VERTEX_SEMANTICS; ++i)
+        instanceLocs.vertex[i] = -1;
+    instanceLocs.vertex[VERTEX_POSITION] = POSITION_LOC;
+    for (int i = 0; i < 3; ++i)
+        instanceLocs.rows[i] = INSTANCE_ROW_LOC + i;
+    instanceLocs.color = INSTANCE_COLOR_LOC;
+ 
+    projMatrixName = shaderNameId("projMatrix");
+    viewMatrixName = shaderNameId("viewMatrix");
+    fogColorName = shaderNameId("fogColor");
+    fogRangeName = shaderNameId("fogRange");
+ 
+    fallbackProgram = setupFallbackProgram();
+    p = fallbackProgram;
+    reflectProgram(p, &sceneReflection, &projMatrixLoc, &viewMatrixLoc);
+    instancedProgram = 0;
+ 
+    // submits both
+    updatePrograms();
+}
+ 
+// ----------------------------------------------------
+// Program benchmark
+//
+ 
+// g33 -programs builds many programs of the scene shaders,
+// made different by a comment so the driver cannot reuse
+// them, first one by one asking how each went as most code
+// does, then all through the queue
+#define BENCH_PROGRAMS 500
+ 
+char *programVariant(const char *source, int run, int i) {
+ 
+    size_t size = strlen(source);
+    char *variant = (char *) malloc(size + 64);
+    memcpy(variant, source, size);
+    sprintf(variant + size, "\n// variant %d.%d\n", run, i);
+    return variant;
+}
+ 
+double timeSerialPrograms(const char *vs, const char *fs, GLuint *programs) {
+ 
+    GLint status;
+ 
+    double start = cpuSeconds();
+    for (int i = 0; i < BENCH_PROGRAMS; ++i) {
+        char *vv = programVariant(vs, 0, i);
+        char *ff = programVariant(fs, 0, i);
+ 
+        GLuint v = glCreateShader(GL_VERTEX_SHADER);
+        GLuint f = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(v, 1, (const char **) &vv, NULL);
+        glShaderSource(f, 1, (const char **) &ff, NULL);
+        glCompileShader(v);
+        glGetShaderiv(v, GL_COMPILE_STATUS, &status);
+        glCompileShader(f);
+        glGetShaderiv(f, GL_COMPILE_STATUS, &status);
+ 
+        programs[i] = glCreateProgram();
+        glAttachShader(programs[i], v);
+        glAttachShader(programs[i], f);
+        glLinkProgram(programs[i]);
+        glGetProgramiv(programs[i], GL_LINK_STATUS, &status);
+ 
+        glDeleteShader(v);
+        glDeleteShader(f);
+        free(vv);free(ff);
+    }
+    return cpuSeconds() - start;
+}
+ 
+double timeQueuedPrograms(const char *vs, const char *fs, ProgramQueue *queue) {
+ 
+    double start = cpuSeconds();
+    for (int i = 0; i < BENCH_PROGRAMS; ++i) {
+        char *vv = programVariant(vs, 1, i);
+        char *ff = programVariant(fs, 1, i);
+        programQueueSubmit(queue, "variant", vv, ff, NULL);
+        free(vv);free(ff);
+    }
+    double submitted = cpuSeconds() - start;
+    printf("%d programs submitted in %.1f ms\n", BENCH_PROGRAMS, submitted * 1000.0);
+ 
+    // as the frames would, without their drawing in between
+    while (programQueuePoll(queue) > 0)
+        ;
+    return cpuSeconds() - start;
+}
+ 
+void benchPrograms() {
+ 
+    GLuint *programs = (GLuint *) malloc(BENCH_PROGRAMS * sizeof(GLuint));
+    ProgramQueue queue;
+ 
+    int vertexFile, fragmentFile;
+    const char *vs = shaderSource(vertexFileName, &vertexFile);
+    const char *fs = shaderSource(fragmentFileName, &fragmentFile);
+    if (!vs || !fs)
+        return;
+    programQueueInit(&queue, NULL);
+ 
+    double serial = timeSerialPrograms(vs, fs, programs);
+    double queued = timeQueuedPrograms(vs, fs, &queue);
+ 
+    int failed = 0;
+    for (int i = 0; i < queue.count; ++i)
+        failed += programQueueState(&queue, i) == PROGRAM_FAILED;
+ 
+    printf("%d programs one by one: %.1f ms\n", BENCH_PROGRAMS, serial * 1000.0);
+    printf("%d programs queued: %.1f ms (%.1fx), %d failed%s\n", BENCH_PROGRAMS, queued * 1000.0,
+           serial / queued, failed, queue.parallel ? "" : ", no parallel compile");
+ 
+    for (int i = 0; i < BENCH_PROGRAMS; ++i)
+        glDeleteProgram(programs[i]);
+    for (int i = 0; i < queue.count; ++i)
+        glDeleteProgram(queue.builds[i].program);
+    programQueueFree(&queue);
+    free(programs);
+}
+ 
+// ----------------------------------------------------
+// Instancing benchmark
+//
+ 
+// g33 -instances draws the triangle a million times, as the
+// instances of one call, then as a draw with its own matrix
+// each, and reports how long the GPU takes to be done
+#define BENCH_INSTANCES (1 << 20)
+ 
+double timeInstanced(const mat4 *models) {
+ 
+    const float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+ 
+    glFinish();
+    double start = cpuSeconds();
+ 
+    glUseProgram(instancedProgram);
+    instancedMeshClear(&triangleMesh);
+    for (int i = 0; i < BENCH_INSTANCES; ++i)
+        instancedMeshPush(&triangleMesh, models[i].m, white);
+    instancedMeshDraw(&triangleMesh);
+ 
+    glFinish();
+    return cpuSeconds() - start;
+}
+ 
+double timeIndividual(const mat4 *models) {
+ 
+    int locations[VERTEX_SEMANTICS];
+    mat4 modelView;
+ 
+    attribLocations(locations);
+    GLuint vao = gpuVaoGet(&vaoCache, &sceneFormat, locations, gpuArenaBuffer(&vertexArena, triangleAlloc));
+    GLint first = (GLint)(gpuArenaOffset(&vertexArena, triangleAlloc) / sceneFormat.stride);
+ 
+    glFinish();
+    double start = cpuSeconds();
+ 
+    glUseProgram(p);
+    glBindVertexArray(vao);
+    for (int i = 0; i < BENCH_INSTANCES; ++i) {
+        mat4Mult(modelView.m, camera.view.m, models[i].m);
+        glUniformMatrix4fv(viewMatrixLoc, 1, false, modelView.m);
+        glDrawArrays(GL_TRIANGLES, first, 3);
+    }
+ 
+    glFinish();
+    return cpuSeconds() - start;
+}
+ 
+void benchInstancing() {
+ 
+    double instanced = 1e30, individual = 1e30;
+ 
+    // a 1024 x 1024 grid of small triangles in front of the camera
+    mat4 *models = (mat4 *) malloc(BENCH_INSTANCES * sizeof(mat4));
+    for (int i = 0; i < BENCH_INSTANCES; ++i) {
+        models[i] = scaleMatrix(0.01f, 0.01f, 0.01f);
+        models[i].m[12] = (i % 1024) * 0.02f - 10.0f;
+        models[i].m[13] = (i / 1024) * 0.02f - 8.0f;
+        models[i].m[14] = -5.0f;
+    }
+ 
+    cameraUpdate(&camera);
+    glUseProgram(p);
+    glUniformMatrix4fv(projMatrixLoc, 1, false, camera.proj.m);
+    glUseProgram(instancedProgram);
+    setInstancedUniforms();
+ 
+    // the best of a few runs, the first ones warm the driver up
+    for (int run = 0; run < 3; ++run) {
+        double t = timeInstanced(models);
+        instanced = t < instanced ? t : instanced;
+        t = timeIndividual(models);
+        individual = t < individual ? t : individual;
+    }
+ 
+    printf("%d instances in 1 call: %.2f ms\n", BENCH_INSTANCES, instanced * 1000.0);
+    printf("%d individual draws: %.2f ms (%.1fx)\n", BENCH_INSTANCES, individual * 1000.0, individual / instanced);
+    free(models);
+}
+ 
 int main(int argc, char **argv) {
+ 
+    cpuInit();
+    printf("Using %s kernels\n", cpuIsaName(cpuIsa()));
+    jobsInit(0);
+    cameraInit(&camera);
+    cullSetInit(&cullSet);
+    bvhInit(&sceneBvh);
+    cameraSetView(&camera, sceneView.m);
+    flythroughInit(&flythrough);
+ 
+    // g33 -check verifies the SIMD kernels against the scalar ones,
+    // and that packed meshes weld
+    if (argc > 1 && strcmp(argv[1], "-check") == 0)
+        return mat4Check() + quatCheck() + meshOptCheck() == 0 ? 0 : 1;
+ 
+    // g33 -fly replays the flythrough and reports frame times
+    if (argc > 1 && strcmp(argv[1], "-fly") == 0) {
+        buildFlythrough();
+        flying = true;
+    }
+ 
+    if (argc > 1 && argv[1][0] != '-')
+        modelFileName = argv[1];
+ 
+    if (manifestLoad(&assets, MANIFEST_DEFAULT_DIR "/" MANIFEST_FILE_NAME)) {
+        printf("%u cooked assets\n", assets.header->entryCount);
+        FILE *packed = fopen(MANIFEST_DEFAULT_DIR "/" PACK_FILE_NAME, "rb");
+        if (packed) {
+            fclose(packed);
+            packOpen(&assetPack, MANIFEST_DEFAULT_DIR "/" PACK_FILE_NAME);
+        }
+    }
+ 
+    // g33 -bench times the cpu side kernels
+    if (argc > 1 && strcmp(argv[1], "-bench") == 0) {
+        runBenchmarks();
+        return 0;
+    }
+ 
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
     glutInitWindowPosition(100,100);
@@ -427,6 +1474,8 @@ int main(int argc, char **argv) {
     glutIdleFunc(renderScene);
     glutReshapeFunc(changeSize);
     glutKeyboardFunc(processNormalKeys);
+    glutMouseFunc(processMouse);
+    glutMotionFunc(processMotion);
  
     glEnable(GL_DEPTH_TEST);
     glClearColor(1.0,1.0,1.0,1.0);
@@ -439,10 +1488,37 @@ int main(int argc, char **argv) {
         exit(1);
     }
  
-    p = setupShaders();
+    shaderLibraryInit(&shaderLibrary, true);
+ 
+    // g33 -programs times building programs one by one
+    // against building them through the queue
+    if (argc > 1 && strcmp(argv[1], "-programs") == 0) {
+        benchPrograms();
+        return 0;
+    }
+ 
+    // the time to submit the builds here, and to have them
+    // all ready from updatePrograms; run twice to compare
+    // cold and warm
+    double submitStart = cpuSeconds();
+    shaderStart = submitStart;
+    programCacheInit(&programCache, PROGRAM_CACHE_DIR);
+    setupShaders();
+    glFinish();
+    printf("shaders submitted: %.1f ms, %d programs loaded from the cache, %d building%s%s\n",
+           (cpuSeconds() - submitStart) * 1000.0, programCache.loaded, programQueue.building,
+           programCache.supported ? "" : ", no program binaries",
+           programQueue.parallel ? ", parallel compile" : "");
  
     setupBuffers();
  
+    if (argc > 1 && strcmp(argv[1], "-instances") == 0) {
+        programQueueFinish(&programQueue);
+        updatePrograms();
+        benchInstancing();
+        return 0;
+    }
+ 
     glutMainLoop();
  
 }
\ No newline at end of file
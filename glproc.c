@@ -0,0 +1,39 @@
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "glproc.h"
+
+#ifndef _WIN32
+#include <GL/glx.h>
+#endif
+
+void *glProcAddress(const char *name) {
+
+#ifdef _WIN32
+    return (void *) wglGetProcAddress(name);
+#else
+    return (void *) glXGetProcAddressARB((const GLubyte *) name);
+#endif
+}
+
+bool glVersionAtLeast(int major, int minor) {
+
+    GLint have[2] = { 0, 0 };
+
+    glGetIntegerv(GL_MAJOR_VERSION, &have[0]);
+    glGetIntegerv(GL_MINOR_VERSION, &have[1]);
+    return have[0] > major || (have[0] == major && have[1] >= minor);
+}
+
+void *glProcFor(const char *name, const char *extension, int major, int minor) {
+
+    if (!glVersionAtLeast(major, minor) && !glewGetExtension(extension))
+        return NULL;
+    return glProcAddress(name);
+}
+
+void *glProcForExtension(const char *name, const char *extension) {
+
+    return glewGetExtension(extension) ? glProcAddress(name) : NULL;
+}
@@ -0,0 +1,49 @@
+#ifndef GLPROC_H
+#define GLPROC_H
+
+#include <GL/glew.h>
+
+// ----------------------------------------------------
+// GL ENTRY POINTS
+//
+// The GLEW in opengl/ stops at GL 4.2, so what came
+// after is declared here and loaded by hand. Each proc
+// is NULL when neither the GL version nor the extension
+// provides it.
+//
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT   0x0080
+#endif
+
+// ARB_buffer_storage, GL 4.4
+typedef void (GLAPIENTRY *GlBufferStorageProc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+// ARB_multi_draw_indirect, GL 4.3
+typedef void (GLAPIENTRY *GlMultiDrawArraysIndirectProc)(GLenum mode, const void *indirect, GLsizei drawcount, GLsizei stride);
+typedef void (GLAPIENTRY *GlMultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+
+// KHR_parallel_shader_compile, or ARB_ of the same values,
+// in no GL version
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (GLAPIENTRY *GlMaxShaderCompilerThreadsProc)(GLuint count);
+
+// the address of name, NULL when the driver has none
+void *glProcAddress(const char *name);
+
+// true for a context of at least major.minor
+bool glVersionAtLeast(int major, int minor);
+
+// name when the context has the extension or the version
+void *glProcFor(const char *name, const char *extension, int major, int minor);
+
+// name when the context has the extension, which no GL
+// version provides
+void *glProcForExtension(const char *name, const char *extension);
+
+#endif
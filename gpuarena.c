@@ -0,0 +1,402 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpuarena.h"
+
+// Data goes through the copy targets, binding the arena
+// target could change the element buffer of a bound VAO.
+
+// ----------------------------------------------------
+// FREE LISTS
+//
+
+static void insertBlock(GpuPage *page, int at, size_t offset, size_t size) {
+
+    if (page->freeCount == page->freeCapacity) {
+        page->freeCapacity = page->freeCapacity ? page->freeCapacity * 2 : 16;
+        page->free = (GpuFreeBlock *) realloc(page->free, page->freeCapacity * sizeof(GpuFreeBlock));
+    }
+
+    memmove(page->free + at + 1, page->free + at, (page->freeCount - at) * sizeof(GpuFreeBlock));
+    page->free[at].offset = offset;
+    page->free[at].size = size;
+    page->freeCount++;
+}
+
+static void removeBlock(GpuPage *page, int at) {
+
+    memmove(page->free + at, page->free + at + 1, (page->freeCount - at - 1) * sizeof(GpuFreeBlock));
+    page->freeCount--;
+}
+
+// takes [offset, offset + size) out of the block at,
+// leaving what is before and after it free
+static void carveBlock(GpuPage *page, int at, size_t offset, size_t size) {
+
+    GpuFreeBlock b = page->free[at];
+    size_t before = offset - b.offset;
+    size_t after = b.offset + b.size - (offset + size);
+
+    removeBlock(page, at);
+    if (after)
+        insertBlock(page, at, offset + size, after);
+    if (before)
+        insertBlock(page, at, b.offset, before);
+    page->used += size;
+}
+
+// puts a range back, merging it with its neighbours
+static void returnBlock(GpuPage *page, size_t offset, size_t size) {
+
+    int at = 0;
+    while (at < page->freeCount && page->free[at].offset < offset)
+        at++;
+
+    page->used -= size;
+
+    bool withPrev = at > 0 && page->free[at - 1].offset + page->free[at - 1].size == offset;
+    bool withNext = at < page->freeCount && offset + size == page->free[at].offset;
+
+    if (withPrev && withNext) {
+        page->free[at - 1].size += size + page->free[at].size;
+        removeBlock(page, at);
+    } else if (withPrev) {
+        page->free[at - 1].size += size;
+    } else if (withNext) {
+        page->free[at].offset = offset;
+        page->free[at].size += size;
+    } else {
+        insertBlock(page, at, offset, size);
+    }
+}
+
+static size_t alignUp(size_t offset, size_t alignment) {
+
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// ----------------------------------------------------
+// PAGES
+//
+
+static int addPage(GpuArena *arena, GpuPage **pages, int *count, size_t size) {
+
+    GpuPage page;
+    memset(&page, 0, sizeof(page));
+
+    // errors left by earlier calls are not this one's
+    while (glGetError() != GL_NO_ERROR)
+        ;
+    glGenBuffers(1, &page.buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, page.buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, arena->usage);
+    if (glGetError() == GL_OUT_OF_MEMORY) {
+        glDeleteBuffers(1, &page.buffer);
+        return -1;
+    }
+
+    page.size = size;
+    insertBlock(&page, 0, 0, size);
+
+    *pages = (GpuPage *) realloc(*pages, (*count + 1) * sizeof(GpuPage));
+    (*pages)[*count] = page;
+    return (*count)++;
+}
+
+static void freePages(GpuPage *pages, int count) {
+
+    for (int i = 0; i < count; ++i) {
+        glDeleteBuffers(1, &pages[i].buffer);
+        free(pages[i].free);
+    }
+    free(pages);
+}
+
+// ----------------------------------------------------
+// ARENAS
+//
+
+void gpuArenaInit(GpuArena *arena, GLenum target, size_t pageSize, GLenum usage) {
+
+    memset(arena, 0, sizeof(GpuArena));
+    arena->target = target;
+    arena->usage = usage;
+    arena->pageSize = pageSize;
+    arena->freeHandle = -1;
+}
+
+void gpuArenaFree(GpuArena *arena) {
+
+    freePages(arena->pages, arena->pageCount);
+    free(arena->allocs);
+    gpuArenaInit(arena, arena->target, arena->pageSize, arena->usage);
+}
+
+static int newHandle(GpuArena *arena) {
+
+    if (arena->freeHandle >= 0) {
+        int handle = arena->freeHandle;
+        arena->freeHandle = arena->allocs[handle].next;
+        return handle;
+    }
+
+    if (arena->allocCount == arena->allocCapacity) {
+        arena->allocCapacity = arena->allocCapacity ? arena->allocCapacity * 2 : 64;
+        arena->allocs = (GpuAlloc *) realloc(arena->allocs, arena->allocCapacity * sizeof(GpuAlloc));
+    }
+    return arena->allocCount++;
+}
+
+int gpuArenaAlloc(GpuArena *arena, size_t size, size_t alignment) {
+
+    if (alignment == 0)
+        alignment = 1;
+
+    // first fit, in the pages in order
+    for (int p = 0; p < arena->pageCount; ++p) {
+        GpuPage *page = &arena->pages[p];
+        if (page->size - page->used < size)
+            continue;
+
+        for (int b = 0; b < page->freeCount; ++b) {
+            size_t offset = alignUp(page->free[b].offset, alignment);
+            if (offset + size > page->free[b].offset + page->free[b].size)
+                continue;
+
+            carveBlock(page, b, offset, size);
+
+            int handle = newHandle(arena);
+            GpuAlloc *a = &arena->allocs[handle];
+            a->page = p;
+            a->next = -1;
+            a->offset = offset;
+            a->size = size;
+            a->alignment = alignment;
+            return handle;
+        }
+    }
+
+    // what does not fit in a page gets a page of its own
+    size_t pageSize = size > arena->pageSize ? size : arena->pageSize;
+    if (addPage(arena, &arena->pages, &arena->pageCount, pageSize) < 0)
+        return -1;
+    return gpuArenaAlloc(arena, size, alignment);
+}
+
+void gpuArenaRelease(GpuArena *arena, int handle) {
+
+    GpuAlloc *a = &arena->allocs[handle];
+
+    returnBlock(&arena->pages[a->page], a->offset, a->size);
+    a->page = -1;
+    a->next = arena->freeHandle;
+    arena->freeHandle = handle;
+}
+
+void gpuArenaUpload(GpuArena *arena, int handle, const void *data, size_t size) {
+
+    const GpuAlloc *a = &arena->allocs[handle];
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena->pages[a->page].buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, a->offset, size, data);
+}
+
+void *gpuArenaMap(GpuArena *arena, int handle, size_t size) {
+
+    const GpuAlloc *a = &arena->allocs[handle];
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena->pages[a->page].buffer);
+    return glMapBufferRange(GL_COPY_WRITE_BUFFER, a->offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+bool gpuArenaUnmap(GpuArena *arena, int handle) {
+
+    const GpuAlloc *a = &arena->allocs[handle];
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena->pages[a->page].buffer);
+    return glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_TRUE;
+}
+
+// ----------------------------------------------------
+// DEFRAGMENTATION
+//
+
+struct LiveAlloc {
+    int page;
+    size_t offset;
+    int handle;
+};
+
+static int compareLive(const void *a, const void *b) {
+
+    const LiveAlloc *x = (const LiveAlloc *) a;
+    const LiveAlloc *y = (const LiveAlloc *) b;
+
+    if (x->page != y->page)
+        return x->page < y->page ? -1 : 1;
+    return x->offset < y->offset ? -1 : x->offset > y->offset ? 1 : 0;
+}
+
+// nothing to gain when every page has its free space
+// in one block at its end, and no page is empty
+static bool fragmented(const GpuArena *arena) {
+
+    for (int p = 0; p < arena->pageCount; ++p) {
+        const GpuPage *page = &arena->pages[p];
+        if (page->used == 0 || page->freeCount > 1)
+            return true;
+        if (page->freeCount == 1 && page->free[0].offset + page->free[0].size != page->size)
+            return true;
+    }
+    return false;
+}
+
+size_t gpuArenaDefrag(GpuArena *arena) {
+
+    if (!fragmented(arena))
+        return 0;
+
+    // the allocations in page then offset order keep their order
+    LiveAlloc *live = (LiveAlloc *) malloc((arena->allocCount + 1) * sizeof(LiveAlloc));
+    int liveCount = 0;
+    for (int h = 0; h < arena->allocCount; ++h)
+        if (arena->allocs[h].page >= 0) {
+            live[liveCount].page = arena->allocs[h].page;
+            live[liveCount].offset = arena->allocs[h].offset;
+            live[liveCount].handle = h;
+            liveCount++;
+        }
+    qsort(live, liveCount, sizeof(LiveAlloc), compareLive);
+
+    GpuPage *pages = NULL;
+    int pageCount = 0;
+    int current = -1;
+    size_t cursor = 0, moved = 0;
+
+    for (int i = 0; i < liveCount; ++i) {
+        GpuAlloc *a = &arena->allocs[live[i].handle];
+        size_t offset = current >= 0 ? alignUp(cursor, a->alignment) : 0;
+
+        if (current < 0 || offset + a->size > pages[current].size) {
+            size_t pageSize = a->size > arena->pageSize ? a->size : arena->pageSize;
+            current = addPage(arena, &pages, &pageCount, pageSize);
+            if (current < 0) {
+                // out of memory, the arena stays as it was
+                freePages(pages, pageCount);
+                free(live);
+                return 0;
+            }
+            offset = 0;
+        }
+
+        GpuPage *page = &pages[current];
+        carveBlock(page, page->freeCount - 1, offset, a->size);
+        cursor = offset + a->size;
+
+        glBindBuffer(GL_COPY_READ_BUFFER, arena->pages[a->page].buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, page->buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, a->offset, offset, a->size);
+        moved += a->size;
+
+        live[i].page = current;
+        live[i].offset = offset;
+    }
+
+    for (int i = 0; i < liveCount; ++i) {
+        arena->allocs[live[i].handle].page = live[i].page;
+        arena->allocs[live[i].handle].offset = live[i].offset;
+    }
+
+    freePages(arena->pages, arena->pageCount);
+    arena->pages = pages;
+    arena->pageCount = pageCount;
+    arena->generation++;
+
+    free(live);
+    return moved;
+}
+
+// ----------------------------------------------------
+// STATS
+//
+
+void gpuArenaGetStats(const GpuArena *arena, GpuArenaStats *stats) {
+
+    memset(stats, 0, sizeof(GpuArenaStats));
+    stats->pages = arena->pageCount;
+
+    for (int p = 0; p < arena->pageCount; ++p) {
+        const GpuPage *page = &arena->pages[p];
+        stats->reserved += page->size;
+        stats->used += page->used;
+        stats->freeBlocks += page->freeCount;
+        for (int b = 0; b < page->freeCount; ++b)
+            if (page->free[b].size > stats->largestFree)
+                stats->largestFree = page->free[b].size;
+    }
+
+    for (int h = 0; h < arena->allocCount; ++h)
+        if (arena->allocs[h].page >= 0)
+            stats->allocations++;
+}
+
+void gpuArenaPrintStats(const GpuArena *arena, const char *name) {
+
+    GpuArenaStats stats;
+    gpuArenaGetStats(arena, &stats);
+
+    printf("%s: %d allocations in %d pages, %.1f of %.1f KB used, %d free blocks, largest %.1f KB\n",
+           name, stats.allocations, stats.pages, stats.used / 1024.0, stats.reserved / 1024.0,
+           stats.freeBlocks, stats.largestFree / 1024.0);
+}
+
+// ----------------------------------------------------
+// SHARED VAOS
+//
+
+void gpuVaoCacheInit(GpuVaoCache *cache) {
+
+    memset(cache, 0, sizeof(GpuVaoCache));
+}
+
+void gpuVaoCacheClear(GpuVaoCache *cache) {
+
+    for (int i = 0; i < cache->count; ++i)
+        glDeleteVertexArrays(1, &cache->vaos[i].vao);
+    free(cache->vaos);
+    gpuVaoCacheInit(cache);
+}
+
+GLuint gpuVaoGet(GpuVaoCache *cache, const VertexFormat *fmt, const int *locations, GLuint buffer) {
+
+    return gpuVaoGetIndexed(cache, fmt, locations, buffer, 0);
+}
+
+GLuint gpuVaoGetIndexed(GpuVaoCache *cache, const VertexFormat *fmt, const int *locations,
+                        GLuint buffer, GLuint indexBuffer) {
+
+    for (int i = 0; i < cache->count; ++i)
+        if (cache->vaos[i].buffer == buffer && cache->vaos[i].indexBuffer == indexBuffer &&
+            vertexFormatEqual(&cache->vaos[i].format, fmt))
+            return cache->vaos[i].vao;
+
+    if (cache->count == cache->capacity) {
+        cache->capacity = cache->capacity ? cache->capacity * 2 : 8;
+        cache->vaos = (GpuVao *) realloc(cache->vaos, cache->capacity * sizeof(GpuVao));
+    }
+
+    GpuVao *v = &cache->vaos[cache->count++];
+    v->format = *fmt;
+    v->buffer = buffer;
+    v->indexBuffer = indexBuffer;
+
+    glGenVertexArrays(1, &v->vao);
+    glBindVertexArray(v->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    vertexFormatBind(fmt, locations, 0);
+    glBindVertexArray(0);
+
+    return v->vao;
+}
@@ -0,0 +1,151 @@
+#ifndef GPUARENA_H
+#define GPUARENA_H
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+#include "vertexformat.h"
+
+// ----------------------------------------------------
+// GPU BUFFER ARENAS
+//
+// A few large buffer objects, the pages, shared by all
+// the meshes instead of a buffer pair each. Allocations
+// are ranges of a page, found first fit in a free list
+// kept sorted by offset, and merged back with their
+// neighbours when freed. Allocations are handles: the
+// page and offset of one change when the arena is
+// defragmented, and the arena generation with them.
+//
+// Vertices of one format in one page all go through the
+// same VAO, so drawing a mesh is a draw call at the base
+// vertex of its range, without any rebinding.
+//
+
+struct GpuFreeBlock {
+    size_t offset;
+    size_t size;
+};
+
+struct GpuPage {
+    GLuint buffer;
+    size_t size;
+    size_t used;
+
+    GpuFreeBlock *free;
+    int freeCount;
+    int freeCapacity;
+};
+
+struct GpuAlloc {
+    int page;           // -1 when the handle is free
+    int next;           // next free handle, when free
+    size_t offset;
+    size_t size;
+    size_t alignment;
+};
+
+struct GpuArenaStats {
+    int pages;
+    int allocations;
+    int freeBlocks;
+    size_t reserved;    // bytes in pages
+    size_t used;        // bytes in allocations
+    size_t largestFree;
+};
+
+struct GpuArena {
+    GLenum target;      // GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER
+    GLenum usage;
+    size_t pageSize;
+
+    GpuPage *pages;
+    int pageCount;
+
+    GpuAlloc *allocs;
+    int allocCount;
+    int allocCapacity;
+    int freeHandle;     // first free handle, or -1
+
+    // changes whenever allocations move
+    unsigned int generation;
+};
+
+void gpuArenaInit(GpuArena *arena, GLenum target, size_t pageSize, GLenum usage);
+
+// deletes every page
+void gpuArenaFree(GpuArena *arena);
+
+// a range of size bytes at a multiple of alignment, which
+// needs not be a power of 2 so vertex ranges can start on
+// a whole vertex; returns a handle, or -1 if GL is out of
+// memory
+int gpuArenaAlloc(GpuArena *arena, size_t size, size_t alignment);
+void gpuArenaRelease(GpuArena *arena, int handle);
+
+inline GLuint gpuArenaBuffer(const GpuArena *arena, int handle) {
+    return arena->pages[arena->allocs[handle].page].buffer;
+}
+
+inline size_t gpuArenaOffset(const GpuArena *arena, int handle) {
+    return arena->allocs[handle].offset;
+}
+
+// glBufferSubData into the range, from its start
+void gpuArenaUpload(GpuArena *arena, int handle, const void *data, size_t size);
+
+// the first size bytes of the range mapped for writing
+// only, what they held invalidated; NULL when GL cannot
+// map it. Other threads may write there until the unmap.
+void *gpuArenaMap(GpuArena *arena, int handle, size_t size);
+
+// false when GL lost what was written, which must then be
+// uploaded again
+bool gpuArenaUnmap(GpuArena *arena, int handle);
+
+// moves the allocations to the start of fresh pages with
+// glCopyBufferSubData and deletes the old pages, so the
+// free space ends up in one block at the end; returns
+// the number of bytes moved
+size_t gpuArenaDefrag(GpuArena *arena);
+
+void gpuArenaGetStats(const GpuArena *arena, GpuArenaStats *stats);
+void gpuArenaPrintStats(const GpuArena *arena, const char *name);
+
+// ----------------------------------------------------
+// SHARED VAOS
+//
+// One VAO per vertex format, page buffer and, for indexed
+// meshes, index page buffer, created the first time they
+// are asked for. The attribute locations must be the same
+// for all. Clear the cache when the arena generation
+// changes, the buffers are gone.
+//
+
+struct GpuVao {
+    VertexFormat format;
+    GLuint buffer;
+    GLuint indexBuffer; // 0 without
+    GLuint vao;
+};
+
+struct GpuVaoCache {
+    GpuVao *vaos;
+    int count;
+    int capacity;
+};
+
+void gpuVaoCacheInit(GpuVaoCache *cache);
+
+// deletes the VAOs
+void gpuVaoCacheClear(GpuVaoCache *cache);
+
+// locations are indexed by semantic, as for vertexFormatBind
+GLuint gpuVaoGet(GpuVaoCache *cache, const VertexFormat *fmt, const int *locations, GLuint buffer);
+
+// the same, with indexBuffer as the element buffer
+GLuint gpuVaoGetIndexed(GpuVaoCache *cache, const VertexFormat *fmt, const int *locations,
+                        GLuint buffer, GLuint indexBuffer);
+
+#endif
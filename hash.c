@@ -0,0 +1,83 @@
+#include <string.h>
+
+#include "hash.h"
+
+static const unsigned long long prime1 = 0x9E3779B185EBCA87ull;
+static const unsigned long long prime2 = 0xC2B2AE3D27D4EB4Full;
+static const unsigned long long prime3 = 0x165667B19E3779F9ull;
+static const unsigned long long prime4 = 0x85EBCA77C2B2AE63ull;
+static const unsigned long long prime5 = 0x27D4EB2F165667C5ull;
+
+static inline unsigned long long rotl(unsigned long long x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline unsigned long long read64(const unsigned char *p) {
+    unsigned long long v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline unsigned int read32(const unsigned char *p) {
+    unsigned int v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline unsigned long long xxhRound(unsigned long long acc, unsigned long long input) {
+    acc += input * prime2;
+    return rotl(acc, 31) * prime1;
+}
+
+static inline unsigned long long mergeRound(unsigned long long acc, unsigned long long v) {
+    acc ^= xxhRound(0, v);
+    return acc * prime1 + prime4;
+}
+
+unsigned long long hash64(const void *data, size_t size, unsigned long long seed) {
+
+    const unsigned char *p = (const unsigned char *) data;
+    const unsigned char *end = p + size;
+    unsigned long long h;
+
+    // four lanes over 32 bytes at a time
+    if (size >= 32) {
+        unsigned long long v1 = seed + prime1 + prime2;
+        unsigned long long v2 = seed + prime2;
+        unsigned long long v3 = seed;
+        unsigned long long v4 = seed - prime1;
+        do {
+            v1 = xxhRound(v1, read64(p));
+            v2 = xxhRound(v2, read64(p + 8));
+            v3 = xxhRound(v3, read64(p + 16));
+            v4 = xxhRound(v4, read64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else
+        h = seed + prime5;
+
+    h += size;
+
+    for (; p + 8 <= end; p += 8)
+        h = rotl(h ^ xxhRound(0, read64(p)), 27) * prime1 + prime4;
+    if (p + 4 <= end) {
+        h = rotl(h ^ (read32(p) * prime1), 23) * prime2 + prime3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+        h = rotl(h ^ (*p * prime5), 11) * prime1;
+
+    // avalanche
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return h;
+}
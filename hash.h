@@ -0,0 +1,15 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+
+// ----------------------------------------------------
+// CONTENT HASHES
+//
+// XXH64, 64 bits of hash at memory speed, for telling
+// whether a file's content changed. Not for security.
+//
+
+unsigned long long hash64(const void *data, size_t size, unsigned long long seed);
+
+#endif
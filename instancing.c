@@ -0,0 +1,109 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "instancing.h"
+
+// ----------------------------------------------------
+// MESHES
+//
+
+void instancedMeshInit(InstancedMesh *mesh, const VertexFormat *fmt, GLuint buffer,
+                       GLint first, GLsizei count, GLenum mode, const InstanceLocations *locations) {
+
+    memset(mesh, 0, sizeof(InstancedMesh));
+    mesh->mode = mode;
+    mesh->count = count;
+    mesh->locations = *locations;
+
+    glGenVertexArrays(1, &mesh->vao);
+    glGenBuffers(1, &mesh->instanceBuffer);
+    glBindVertexArray(mesh->vao);
+
+    // the instance attributes, the buffer is filled at each draw
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->instanceBuffer);
+    for (int r = 0; r < 3; ++r) {
+        int location = locations->rows[r];
+        if (location < 0)
+            continue;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (const void *)(offsetof(InstanceData, rows) + r * sizeof(float[4])));
+        glVertexAttribDivisor(location, 1);
+    }
+    if (locations->color >= 0) {
+        glEnableVertexAttribArray(locations->color);
+        glVertexAttribPointer(locations->color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(InstanceData),
+                              (const void *) offsetof(InstanceData, color));
+        glVertexAttribDivisor(locations->color, 1);
+    }
+    glBindVertexArray(0);
+
+    instancedMeshSetVertices(mesh, fmt, buffer, first);
+}
+
+void instancedMeshFree(InstancedMesh *mesh) {
+
+    glDeleteVertexArrays(1, &mesh->vao);
+    glDeleteBuffers(1, &mesh->instanceBuffer);
+    free(mesh->instances);
+    memset(mesh, 0, sizeof(InstancedMesh));
+}
+
+void instancedMeshSetVertices(InstancedMesh *mesh, const VertexFormat *fmt, GLuint buffer, GLint first) {
+
+    mesh->first = first;
+
+    glBindVertexArray(mesh->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    vertexFormatBind(fmt, mesh->locations.vertex, 0);
+    glBindVertexArray(0);
+}
+
+// ----------------------------------------------------
+// INSTANCES
+//
+
+void instancedMeshClear(InstancedMesh *mesh) {
+
+    mesh->instanceCount = 0;
+}
+
+static unsigned char unorm8(float f) {
+
+    f = f < 0.0f ? 0.0f : f > 1.0f ? 1.0f : f;
+    return (unsigned char)(f * 255.0f + 0.5f);
+}
+
+void instancedMeshPush(InstancedMesh *mesh, const float *transform, const float *color) {
+
+    if (mesh->instanceCount == mesh->capacity) {
+        mesh->capacity = mesh->capacity ? mesh->capacity * 2 : 64;
+        mesh->instances = (InstanceData *) realloc(mesh->instances, mesh->capacity * sizeof(InstanceData));
+    }
+
+    InstanceData *d = &mesh->instances[mesh->instanceCount++];
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 4; ++c)
+            d->rows[r][c] = transform[c * 4 + r];
+    for (int k = 0; k < 4; ++k)
+        d->color[k] = unorm8(color[k]);
+}
+
+// The buffer is orphaned, not overwritten, so the upload
+// never waits on the draws of the previous frame
+void instancedMeshDraw(InstancedMesh *mesh) {
+
+    if (mesh->instanceCount == 0)
+        return;
+
+    size_t size = mesh->instanceCount * sizeof(InstanceData);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mesh->instanceBuffer);
+    if (size > mesh->bufferSize)
+        mesh->bufferSize = size;
+    glBufferData(GL_COPY_WRITE_BUFFER, mesh->bufferSize, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, mesh->instances);
+
+    glBindVertexArray(mesh->vao);
+    glDrawArraysInstanced(mesh->mode, mesh->first, mesh->count, mesh->instanceCount);
+}
@@ -0,0 +1,72 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <GL/glew.h>
+
+#include "vertexformat.h"
+
+// ----------------------------------------------------
+// INSTANCING
+//
+// A mesh registered once and drawn as many times as
+// instances were pushed since the last clear, with one
+// glDrawArraysInstanced. Each instance has an affine
+// transform, given as the 3 first rows of a column major
+// matrix, and a color, read by the vertex shader from
+// attributes advancing once per instance:
+//
+//   in vec4 instanceRow0, instanceRow1, instanceRow2;
+//   in vec4 instanceColor;
+//
+//   vec4 world = vec4(dot(instanceRow0, position),
+//                     dot(instanceRow1, position),
+//                     dot(instanceRow2, position), 1.0);
+//
+
+struct InstanceData {
+    float rows[3][4];
+    unsigned char color[4];
+};
+
+// attribute locations, -1 when unused
+struct InstanceLocations {
+    int vertex[VERTEX_SEMANTICS];
+    int rows[3];
+    int color;
+};
+
+struct InstancedMesh {
+    GLuint vao;
+    GLenum mode;
+    GLint first;        // of the mesh in its vertex buffer
+    GLsizei count;
+
+    InstanceData *instances;
+    int instanceCount;
+    int capacity;
+
+    // the instances are uploaded to it at each draw
+    GLuint instanceBuffer;
+    size_t bufferSize;
+
+    InstanceLocations locations;
+};
+
+// count vertices from first in buffer, stored in fmt
+void instancedMeshInit(InstancedMesh *mesh, const VertexFormat *fmt, GLuint buffer,
+                       GLint first, GLsizei count, GLenum mode, const InstanceLocations *locations);
+void instancedMeshFree(InstancedMesh *mesh);
+
+// when the vertices moved to another buffer or place
+void instancedMeshSetVertices(InstancedMesh *mesh, const VertexFormat *fmt, GLuint buffer, GLint first);
+
+void instancedMeshClear(InstancedMesh *mesh);
+
+// transform is a column major matrix whose last row is
+// (0, 0, 0, 1), color 4 floats in [0, 1]
+void instancedMeshPush(InstancedMesh *mesh, const float *transform, const float *color);
+
+// draws every instance pushed since the last clear
+void instancedMeshDraw(InstancedMesh *mesh);
+
+#endif
@@ -0,0 +1,162 @@
+#include <stdlib.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "jobs.h"
+
+#define MAX_THREADS 256
+
+struct Job {
+    JobFunc fn;
+    void *ctx;
+    int count;
+    int chunk;
+    std::atomic<int> next;
+    std::atomic<int> running;
+};
+
+static std::thread *workers = NULL;
+static int workerCount = 0;
+
+static std::mutex lock;
+static std::condition_variable wake;
+static std::condition_variable done;
+static Job *current = NULL;
+static unsigned int jobNumber = 0;
+static bool quit = false;
+
+// serializes parallelFor calls coming from different threads
+static std::mutex submit;
+
+static thread_local bool insideJob = false;
+
+static void runChunks(Job *job) {
+
+    insideJob = true;
+    for (;;) {
+        int begin = job->next.fetch_add(job->chunk);
+        if (begin >= job->count)
+            break;
+        int end = begin + job->chunk < job->count ? begin + job->chunk : job->count;
+        job->fn(job->ctx, begin, end);
+    }
+    insideJob = false;
+}
+
+static void workerLoop() {
+
+    unsigned int seen = 0;
+
+    for (;;) {
+        Job *job;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&] { return quit || jobNumber != seen; });
+            if (quit)
+                return;
+            seen = jobNumber;
+            job = current;
+            // woke up after the job was already over
+            if (!job)
+                continue;
+            job->running++;
+        }
+
+        runChunks(job);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (--job->running == 0)
+            done.notify_all();
+    }
+}
+
+void jobsInit(int threads) {
+
+    if (workers)
+        return;
+
+    const char *forced = getenv("G33_THREADS");
+    if (forced)
+        threads = atoi(forced);
+    if (threads <= 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads <= 0)
+        threads = 1;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    quit = false;
+    workerCount = threads - 1;
+    workers = new std::thread[workerCount > 0 ? workerCount : 1];
+    for (int i = 0; i < workerCount; ++i)
+        workers[i] = std::thread(workerLoop);
+
+    // the condition variables can't be destroyed at exit
+    // while workers still wait on them
+    static bool registered = false;
+    if (!registered) {
+        atexit(jobsShutdown);
+        registered = true;
+    }
+}
+
+void jobsShutdown() {
+
+    if (!workers)
+        return;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for (int i = 0; i < workerCount; ++i)
+        workers[i].join();
+    delete[] workers;
+    workers = NULL;
+    workerCount = 0;
+}
+
+int jobsThreadCount() {
+
+    return workerCount + 1;
+}
+
+void parallelFor(int count, int chunk, JobFunc fn, void *ctx) {
+
+    if (count <= 0)
+        return;
+    if (chunk <= 0)
+        chunk = 1;
+
+    if (insideJob || workerCount == 0 || count <= chunk) {
+        for (int begin = 0; begin < count; begin += chunk)
+            fn(ctx, begin, begin + chunk < count ? begin + chunk : count);
+        return;
+    }
+
+    std::lock_guard<std::mutex> serial(submit);
+
+    Job job;
+    job.fn = fn;
+    job.ctx = ctx;
+    job.count = count;
+    job.chunk = chunk;
+    job.next = 0;
+    job.running = 1;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        current = &job;
+        jobNumber++;
+    }
+    wake.notify_all();
+
+    runChunks(&job);
+
+    std::unique_lock<std::mutex> guard(lock);
+    --job.running;
+    done.wait(guard, [&] { return job.running == 0; });
+    current = NULL;
+}
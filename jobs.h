@@ -0,0 +1,27 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+// ----------------------------------------------------
+// WORKER THREADS
+//
+// A pool of one worker per core, minus the calling
+// thread which takes part in the work. G33_THREADS
+// overrides the thread count.
+//
+
+typedef void (*JobFunc)(void *ctx, int begin, int end);
+
+// starts the workers, threads = 0 means one per core
+void jobsInit(int threads);
+void jobsShutdown();
+
+// threads working on a parallelFor, the caller included
+int jobsThreadCount();
+
+// Calls fn on consecutive [begin, end) ranges of at most
+// chunk items covering [0, count), spread over all the
+// threads, and returns once they are all done. Calls made
+// from inside a job run serially on the calling thread.
+void parallelFor(int count, int chunk, JobFunc fn, void *ctx);
+
+#endif
@@ -0,0 +1,226 @@
+#include <string.h>
+
+#include "lz4.h"
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5     // the format ends on literals
+#define MATCH_LIMIT 12      // no match starts closer to the end
+#define MAX_OFFSET 65535
+#define HASH_LOG 12         // 16 KB of table, on the stack
+#define SKIP_TRIGGER 6
+
+static inline unsigned int read32(const unsigned char *p) {
+    unsigned int v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline unsigned int hash4(unsigned int v) {
+    return (v * 2654435761u) >> (32 - HASH_LOG);
+}
+
+// a length of 15 or more goes on in bytes of 255
+static inline unsigned char *writeLength(unsigned char *op, int length) {
+    for (; length >= 255; length -= 255)
+        *op++ = 255;
+    *op++ = (unsigned char) length;
+    return op;
+}
+
+// ----------------------------------------------------
+// COMPRESSION
+//
+
+int lz4Compress(const void *src, int size, void *dst, int capacity) {
+
+    unsigned int table[1 << HASH_LOG];
+
+    const unsigned char *base = (const unsigned char *) src;
+    const unsigned char *ip = base;
+    const unsigned char *anchor = base;
+    const unsigned char *end = base + size;
+    unsigned char *op = (unsigned char *) dst;
+    unsigned char *oend = op + capacity;
+
+    if (size >= MATCH_LIMIT + 1) {
+        const unsigned char *matchLimit = end - LAST_LITERALS;
+        const unsigned char *startLimit = end - MATCH_LIMIT;
+        memset(table, 0, sizeof(table));
+        ++ip;
+
+        while (ip < startLimit) {
+
+            // the next match, further apart the longer it takes
+            const unsigned char *match;
+            int attempts = 1 << SKIP_TRIGGER;
+            for (;;) {
+                unsigned int h = hash4(read32(ip));
+                match = base + table[h];
+                table[h] = (unsigned int)(ip - base);
+                if (match < ip && ip - match <= MAX_OFFSET && read32(match) == read32(ip))
+                    break;
+                ip += attempts++ >> SKIP_TRIGGER;
+                if (ip >= startLimit)
+                    goto last;
+            }
+
+            // grown backwards over the literals
+            while (ip > anchor && match > base && ip[-1] == match[-1]) {
+                --ip;
+                --match;
+            }
+
+            // and forwards
+            const unsigned char *p = ip + MIN_MATCH, *m = match + MIN_MATCH;
+            while (p < matchLimit && *p == *m) {
+                ++p;
+                ++m;
+            }
+            int literals = (int)(ip - anchor);
+            int matchLength = (int)(p - ip) - MIN_MATCH;
+
+            if (op + 1 + literals / 255 + 1 + literals + 2 + matchLength / 255 + 1 > oend - LAST_LITERALS)
+                return 0;
+
+            unsigned char *token = op++;
+            if (literals >= 15) {
+                *token = 15 << 4;
+                op = writeLength(op, literals - 15);
+            } else
+                *token = (unsigned char)(literals << 4);
+            memcpy(op, anchor, literals);
+            op += literals;
+
+            unsigned int offset = (unsigned int)(ip - match);
+            *op++ = (unsigned char) offset;
+            *op++ = (unsigned char)(offset >> 8);
+            if (matchLength >= 15) {
+                *token |= 15;
+                op = writeLength(op, matchLength - 15);
+            } else
+                *token |= (unsigned char) matchLength;
+
+            ip = p;
+            anchor = ip;
+            if (ip < startLimit)
+                table[hash4(read32(ip - 2))] = (unsigned int)(ip - 2 - base);
+        }
+    }
+
+last:
+    // the rest as literals
+    int literals = (int)(end - anchor);
+    if (op + 1 + literals / 255 + 1 + literals > oend)
+        return 0;
+    if (literals >= 15) {
+        *op++ = 15 << 4;
+        op = writeLength(op, literals - 15);
+    } else
+        *op++ = (unsigned char)(literals << 4);
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return (int)(op - (unsigned char *) dst);
+}
+
+// ----------------------------------------------------
+// DECOMPRESSION
+//
+
+static inline bool readLength(const unsigned char **ip, const unsigned char *iend, int *length) {
+
+    unsigned int b;
+    do {
+        if (*ip >= iend)
+            return false;
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255 && *length < (1 << 30));
+    return b != 255;
+}
+
+int lz4Decompress(const void *src, int size, void *dst, int capacity) {
+
+    const unsigned char *ip = (const unsigned char *) src;
+    const unsigned char *iend = ip + size;
+    unsigned char *op = (unsigned char *) dst;
+    unsigned char *ostart = op;
+    unsigned char *oend = op + capacity;
+
+    while (ip < iend) {
+        unsigned int token = *ip++;
+        int literals = token >> 4;
+        int matchLength = token & 15;
+        int offset;
+
+        // most sequences are a few literals and a short match,
+        // copied in fixed sizes when both sides have room
+        if (literals != 15 && matchLength != 15 && iend - ip >= 32 && oend - op >= 32) {
+            memcpy(op, ip, 16);
+            ip += literals;
+            op += literals;
+            offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            matchLength += MIN_MATCH;
+            if (offset == 0 || offset > op - ostart)
+                return -1;
+            if (offset >= 8) {
+                const unsigned char *match = op - offset;
+                memcpy(op, match, 8);
+                memcpy(op + 8, match + 8, 8);
+                memcpy(op + 16, match + 16, 2);
+                op += matchLength;
+                continue;
+            }
+        } else {
+            if (literals == 15 && !readLength(&ip, iend, &literals))
+                return -1;
+            if (literals > iend - ip || literals > oend - op)
+                return -1;
+
+            // in copies of 16 bytes when both sides have room
+            if (iend - ip >= literals + 16 && oend - op >= literals + 16) {
+                for (int i = 0; i < literals; i += 16)
+                    memcpy(op + i, ip + i, 16);
+            } else
+                memcpy(op, ip, literals);
+            ip += literals;
+            op += literals;
+
+            // the last sequence has no match
+            if (ip == iend)
+                break;
+
+            if (iend - ip < 2)
+                return -1;
+            offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            if (offset == 0 || offset > op - ostart)
+                return -1;
+
+            if (matchLength == 15 && !readLength(&ip, iend, &matchLength))
+                return -1;
+            matchLength += MIN_MATCH;
+        }
+        if (matchLength > oend - op)
+            return -1;
+
+        // copies of 16 or 8 bytes may run past the end of the
+        // match, which the next sequence overwrites
+        const unsigned char *match = op - offset;
+        if (offset >= 16 && oend - op >= matchLength + 16) {
+            for (int i = 0; i < matchLength; i += 16)
+                memcpy(op + i, match + i, 16);
+        } else if (offset >= 8 && oend - op >= matchLength + 8) {
+            for (int i = 0; i < matchLength; i += 8)
+                memcpy(op + i, match + i, 8);
+        } else if (offset >= matchLength)
+            memcpy(op, match, matchLength);
+        else
+            for (int i = 0; i < matchLength; ++i)
+                op[i] = match[i];
+        op += matchLength;
+    }
+
+    return (int)(op - ostart);
+}
@@ -0,0 +1,29 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+// ----------------------------------------------------
+// LZ4 BLOCKS
+//
+// The LZ4 block format, compatible with the reference
+// library: sequences of literals then a match of at
+// least 4 bytes up to 64 KB back. Compression is the
+// greedy single hash probe of the fast mode, skipping
+// ahead faster the longer it finds nothing, so data that
+// does not compress costs little. Decompression checks
+// every length and offset against both buffers, so a
+// corrupt block fails instead of writing out of bounds.
+//
+
+// the worst case compressed size of size bytes
+inline int lz4Bound(int size) {
+    return size + size / 255 + 16;
+}
+
+// returns the compressed size, 0 when it does not fit
+int lz4Compress(const void *src, int size, void *dst, int capacity);
+
+// returns the decompressed size, -1 when the block is
+// corrupt or does not fit
+int lz4Decompress(const void *src, int size, void *dst, int capacity);
+
+#endif
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "manifest.h"
+#include "mapfile.h"
+
+// ----------------------------------------------------
+// READING
+//
+
+static bool fail(Manifest *m, const char *path, const char *why) {
+
+    printf("%s: %s\n", path, why);
+    manifestFree(m);
+    return false;
+}
+
+static bool inFile(const Manifest *m, unsigned long long offset, unsigned long long size) {
+
+    return offset <= m->size && size <= m->size - offset;
+}
+
+bool manifestLoad(Manifest *m, const char *path) {
+
+    memset(m, 0, sizeof(Manifest));
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    // the whole file in one read
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+    }
+    if (size > 0) {
+        m->data = (unsigned char *) malloc(size);
+        m->size = fread(m->data, 1, size, f);
+    }
+    fclose(f);
+    if (m->size != (size_t) size || size <= 0)
+        return fail(m, path, "cannot read");
+
+    const ManifestHeader *h = (const ManifestHeader *) m->data;
+    if (m->size < sizeof(ManifestHeader) || h->magic != MANIFEST_MAGIC)
+        return fail(m, path, "not a manifest");
+    if (h->version != MANIFEST_VERSION)
+        return fail(m, path, "unknown version");
+    if (h->entryOffset % 8 != 0 || !inFile(m, h->entryOffset, (unsigned long long) h->entryCount * sizeof(ManifestEntry)) ||
+        !inFile(m, h->stringOffset, h->stringSize) || !inFile(m, h->dataOffset, h->dataSize) ||
+        h->stringSize == 0 || m->data[h->stringOffset + h->stringSize - 1] != 0)
+        return fail(m, path, "truncated");
+
+    m->header = h;
+    m->entries = (const ManifestEntry *)(m->data + h->entryOffset);
+    m->strings = (const char *)(m->data + h->stringOffset);
+
+    // so the lookups need no checks
+    for (unsigned int i = 0; i < h->entryCount; ++i) {
+        const ManifestEntry *e = &m->entries[i];
+        if (e->type >= ASSET_TYPES || e->name >= h->stringSize ||
+            (e->file != MANIFEST_NONE && e->file >= h->stringSize) ||
+            (e->dataSize > 0 && (e->dataOffset >= h->dataSize || e->dataSize >= h->dataSize - e->dataOffset ||
+                                 m->data[h->dataOffset + e->dataOffset + e->dataSize] != 0)))
+            return fail(m, path, "bad entry");
+    }
+
+    const char *slash = strrchr(path, '/');
+#if defined(_WIN32)
+    const char *backslash = strrchr(path, '\\');
+    if (backslash && (!slash || backslash > slash))
+        slash = backslash;
+#endif
+    size_t dirLength = slash ? slash - path + 1 : 0;
+    if (dirLength >= sizeof(m->dir))
+        return fail(m, path, "path too long");
+    memcpy(m->dir, path, dirLength);
+    m->dir[dirLength] = 0;
+    return true;
+}
+
+void manifestFree(Manifest *m) {
+
+    free(m->data);
+    memset(m, 0, sizeof(Manifest));
+}
+
+const ManifestEntry *manifestFind(const Manifest *m, const char *name) {
+
+    if (!m->header)
+        return NULL;
+
+    int lo = 0, hi = (int) m->header->entryCount;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int c = strcmp(m->strings + m->entries[mid].name, name);
+        if (c == 0)
+            return &m->entries[mid];
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+const char *manifestName(const Manifest *m, const ManifestEntry *e) {
+
+    return m->strings + e->name;
+}
+
+const char *manifestFile(const Manifest *m, const ManifestEntry *e) {
+
+    return e->file == MANIFEST_NONE ? NULL : m->strings + e->file;
+}
+
+const char *manifestData(const Manifest *m, const ManifestEntry *e) {
+
+    if (e->dataSize == 0)
+        return NULL;
+    return (const char *)(m->data + m->header->dataOffset + e->dataOffset);
+}
+
+bool manifestFilePath(const Manifest *m, const ManifestEntry *e, char *path, size_t size) {
+
+    if (e->file == MANIFEST_NONE)
+        return false;
+    return (size_t) snprintf(path, size, "%s%s", m->dir, m->strings + e->file) < size;
+}
+
+// ----------------------------------------------------
+// WRITING
+//
+
+static int compareItems(const void *a, const void *b) {
+
+    return strcmp(((const ManifestItem *) a)->name, ((const ManifestItem *) b)->name);
+}
+
+bool manifestWrite(const char *path, ManifestItem *items, int count, unsigned int cookerVersion) {
+
+    ManifestHeader header;
+    ManifestEntry *entries = (ManifestEntry *) calloc(count > 0 ? count : 1, sizeof(ManifestEntry));
+
+    qsort(items, count, sizeof(ManifestItem), compareItems);
+
+    // the sizes first, to lay out the file
+    size_t stringSize = 0, dataSize = 0;
+    for (int i = 0; i < count; ++i) {
+        stringSize += strlen(items[i].name) + 1;
+        if (items[i].file)
+            stringSize += strlen(items[i].file) + 1;
+        if (items[i].dataSize > 0)
+            dataSize += items[i].dataSize + 1;
+    }
+    stringSize += stringSize == 0;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = MANIFEST_MAGIC;
+    header.version = MANIFEST_VERSION;
+    header.entryCount = count;
+    header.cookerVersion = cookerVersion;
+    header.entryOffset = sizeof(ManifestHeader);
+    header.stringOffset = header.entryOffset + (unsigned long long) count * sizeof(ManifestEntry);
+    header.stringSize = stringSize;
+    header.dataOffset = header.stringOffset + stringSize;
+    header.dataSize = dataSize;
+
+    char *strings = (char *) calloc(stringSize, 1);
+    char *data = (char *) calloc(dataSize > 0 ? dataSize : 1, 1);
+    size_t s = 0, d = 0;
+    for (int i = 0; i < count; ++i) {
+        ManifestEntry *e = &entries[i];
+        e->type = items[i].type;
+        e->name = (unsigned int) s;
+        s += strlen(strcpy(strings + s, items[i].name)) + 1;
+        e->file = MANIFEST_NONE;
+        if (items[i].file) {
+            e->file = (unsigned int) s;
+            s += strlen(strcpy(strings + s, items[i].file)) + 1;
+        }
+        e->sourceHash = items[i].sourceHash;
+        e->sourceSize = items[i].sourceSize;
+        e->sourceTime = items[i].sourceTime;
+        if (items[i].dataSize > 0) {
+            e->dataOffset = d;
+            e->dataSize = items[i].dataSize;
+            memcpy(data + d, items[i].data, items[i].dataSize);
+            d += items[i].dataSize + 1;
+        }
+    }
+
+    char temporary[1024];
+    bool ok = (size_t) snprintf(temporary, sizeof(temporary), "%s.tmp", path) < sizeof(temporary);
+    FILE *f = ok ? fopen(temporary, "wb") : NULL;
+    if (f) {
+        ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+             fwrite(entries, sizeof(ManifestEntry), count, f) == (size_t) count &&
+             fwrite(strings, 1, stringSize, f) == stringSize &&
+             fwrite(data, 1, dataSize, f) == dataSize;
+        ok = commitFile(temporary, path, fclose(f) == 0 && ok);
+    } else
+        ok = false;
+
+    free(data);
+    free(strings);
+    free(entries);
+    return ok;
+}
@@ -0,0 +1,115 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stddef.h>
+
+// ----------------------------------------------------
+// ASSET MANIFESTS
+//
+// What the cooker made, for the runtime: one file holding
+// a header, the entries sorted by name, a string table,
+// then the data small enough to live in the manifest
+// itself, shader text for now. The runtime reads it whole
+// in one read and finds entries by a binary search; mesh
+// and texture entries name their cooked file, found next
+// to the manifest.
+//
+// Each entry keeps the size, modification time and hash
+// of the source it was cooked from, which is the cache
+// the cooker checks its inputs against the next time.
+//
+
+#define MANIFEST_FILE_NAME "manifest.g33a"
+#define MANIFEST_MAGIC 0x41333347       // "G33A"
+#define MANIFEST_VERSION 1
+
+// where the cooker writes and g33 looks by default
+#define MANIFEST_DEFAULT_DIR "cooked"
+
+// the string offset of no string
+#define MANIFEST_NONE 0xffffffffu
+
+enum AssetType {
+    ASSET_MESH,
+    ASSET_TEXTURE,
+    ASSET_SHADER,
+    ASSET_TYPES
+};
+
+struct ManifestHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int entryCount;
+    unsigned int cookerVersion;     // a new cooker recooks everything
+
+    // in bytes from the start of the file
+    unsigned long long entryOffset;
+    unsigned long long stringOffset;
+    unsigned long long stringSize;
+    unsigned long long dataOffset;
+    unsigned long long dataSize;
+};
+
+struct ManifestEntry {
+    unsigned int type;
+    unsigned int name;              // offsets in the strings
+    unsigned int file;              // MANIFEST_NONE when inline
+    unsigned int reserved;
+
+    // the source as it was cooked
+    unsigned long long sourceHash;
+    unsigned long long sourceSize;
+    long long sourceTime;
+
+    // inline data, in the data, followed by a 0
+    unsigned long long dataOffset;
+    unsigned long long dataSize;
+};
+
+struct Manifest {
+    unsigned char *data;            // the whole file
+    size_t size;
+    const ManifestHeader *header;
+    const ManifestEntry *entries;
+    const char *strings;
+
+    // the directory of the manifest, with its separator
+    char dir[256];
+};
+
+// prints why when the file is there but cannot be used,
+// is quiet when it is not there
+bool manifestLoad(Manifest *m, const char *path);
+void manifestFree(Manifest *m);
+
+// NULL when there is no asset of that name
+const ManifestEntry *manifestFind(const Manifest *m, const char *name);
+
+const char *manifestName(const Manifest *m, const ManifestEntry *e);
+
+// the name of the cooked file, NULL when inline
+const char *manifestFile(const Manifest *m, const ManifestEntry *e);
+
+// the inline data, 0 terminated, NULL when none
+const char *manifestData(const Manifest *m, const ManifestEntry *e);
+
+// the path of the cooked file, false when inline or too long
+bool manifestFilePath(const Manifest *m, const ManifestEntry *e, char *path, size_t size);
+
+// what the cooker writes an entry from
+struct ManifestItem {
+    AssetType type;
+    const char *name;
+    const char *file;               // NULL when inline
+    unsigned long long sourceHash;
+    unsigned long long sourceSize;
+    long long sourceTime;
+    const void *data;
+    size_t dataSize;
+};
+
+// sorts the items, writes a temporary file then renames it
+// over path, so a reader never sees half a manifest
+bool manifestWrite(const char *path, ManifestItem *items, int count, unsigned int cookerVersion);
+
+#endif
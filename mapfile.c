@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "mapfile.h"
+
+#if defined(_WIN32)
+
+bool mappedFileOpen(MappedFile *mf, const char *path) {
+
+    memset(mf, 0, sizeof(MappedFile));
+
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+    mf->file = file;
+    mf->size = (size_t) size.QuadPart;
+    if (mf->size == 0)
+        return true;
+
+    mf->mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mf->mapping)
+        mf->data = (const unsigned char *) MapViewOfFile(mf->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!mf->data) {
+        mappedFileClose(mf);
+        return false;
+    }
+    return true;
+}
+
+void mappedFileClose(MappedFile *mf) {
+
+    if (mf->data)
+        UnmapViewOfFile(mf->data);
+    if (mf->mapping)
+        CloseHandle(mf->mapping);
+    if (mf->file)
+        CloseHandle(mf->file);
+    memset(mf, 0, sizeof(MappedFile));
+}
+
+#else
+
+bool mappedFileOpen(MappedFile *mf, const char *path) {
+
+    memset(mf, 0, sizeof(MappedFile));
+    mf->fd = open(path, O_RDONLY);
+    if (mf->fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(mf->fd, &st) != 0) {
+        mappedFileClose(mf);
+        return false;
+    }
+    mf->size = (size_t) st.st_size;
+    if (mf->size == 0)
+        return true;
+
+    void *data = mmap(NULL, mf->size, PROT_READ, MAP_PRIVATE, mf->fd, 0);
+    if (data == MAP_FAILED) {
+        mappedFileClose(mf);
+        return false;
+    }
+    // read front to back, by all the threads at once
+    madvise(data, mf->size, MADV_WILLNEED);
+    mf->data = (const unsigned char *) data;
+    return true;
+}
+
+void mappedFileClose(MappedFile *mf) {
+
+    if (mf->data)
+        munmap((void *) mf->data, mf->size);
+    if (mf->fd >= 0)
+        close(mf->fd);
+    memset(mf, 0, sizeof(MappedFile));
+    mf->fd = -1;
+}
+
+#endif
+
+// ----------------------------------------------------
+// FILES
+//
+
+bool fileTime(const char *path, unsigned long long *size, long long *time) {
+
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+    *size = st.st_size;
+#if defined(_WIN32)
+    *time = (long long) st.st_mtime * 1000000000;
+#elif defined(__APPLE__)
+    *time = (long long) st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    *time = (long long) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+bool commitFile(const char *temporary, const char *path, bool written) {
+
+    if (written) {
+#if defined(_WIN32)
+        // rename does not replace there
+        remove(path);
+#endif
+        written = rename(temporary, path) == 0;
+    }
+    if (!written)
+        remove(temporary);
+    return written;
+}
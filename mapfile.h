@@ -0,0 +1,39 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stddef.h>
+
+// ----------------------------------------------------
+// MAPPED FILES
+//
+// A file mapped read only into memory, so parsers read
+// it in place, from as many threads as they like, with
+// the pages read in by the OS as they are touched.
+//
+
+struct MappedFile {
+    const unsigned char *data;
+    size_t size;
+
+#if defined(_WIN32)
+    void *file;
+    void *mapping;
+#else
+    int fd;
+#endif
+};
+
+// false when the file cannot be opened or mapped, an
+// empty file maps to a NULL data of size 0
+bool mappedFileOpen(MappedFile *mf, const char *path);
+void mappedFileClose(MappedFile *mf);
+
+// the size and modification time, in nanoseconds, of a
+// file; false when it cannot be looked at
+bool fileTime(const char *path, unsigned long long *size, long long *time);
+
+// a file written aside, renamed over path when written is
+// true, else removed; so a file that exists is a whole one
+bool commitFile(const char *temporary, const char *path, bool written);
+
+#endif
@@ -0,0 +1,617 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "mat4.h"
+
+// The SIMD kernels must stay bit identical to the scalar
+// reference, so the compiler may not fuse a*b+c into FMAs.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
+// ----------------------------------------------------
+// SCALAR REFERENCE
+//
+
+// the original multMatrix loop, everything is checked against it
+static void multRef(float *res, const float *a, const float *b) {
+
+    float tmp[16];
+
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            tmp[j*4 + i] = 0.0f;
+            for (int k = 0; k < 4; ++k) {
+                tmp[j*4 + i] += a[k*4 + i] * b[j*4 + k];
+            }
+        }
+    }
+    memcpy(res, tmp, 16 * sizeof(float));
+}
+
+static void transposeRef(float *res, const float *a) {
+
+    float tmp[16];
+
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            tmp[i*4 + j] = a[j*4 + i];
+    memcpy(res, tmp, 16 * sizeof(float));
+}
+
+static void crossRef(const float *a, const float *b, float *res) {
+
+    float x = a[1] * b[2] - a[2] * b[1];
+    float y = a[2] * b[0] - a[0] * b[2];
+    float z = a[0] * b[1] - a[1] * b[0];
+
+    res[0] = x;
+    res[1] = y;
+    res[2] = z;
+}
+
+static void normalizeRef(float *a) {
+
+    float mag = sqrtf((a[0] * a[0] + a[1] * a[1]) + a[2] * a[2]);
+
+    a[0] /= mag;
+    a[1] /= mag;
+    a[2] /= mag;
+}
+
+// The rows of the inverse of the 3x3 part are the cross
+// products of its columns divided by the determinant.
+static void affineInverseRef(float *res, const float *a) {
+
+    float r[3][3], tmp[16];
+
+    crossRef(a + 4, a + 8, r[0]);
+    crossRef(a + 8, a + 0, r[1]);
+    crossRef(a + 0, a + 4, r[2]);
+
+    float det = (a[0] * r[0][0] + a[1] * r[0][1]) + a[2] * r[0][2];
+    float invDet = 1.0f / det;
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j)
+            tmp[j*4 + i] = r[i][j] * invDet;
+        tmp[i*4 + 3] = 0.0f;
+    }
+    for (int i = 0; i < 3; ++i)
+        tmp[12 + i] = -((tmp[i] * a[12] + tmp[4 + i] * a[13]) + tmp[8 + i] * a[14]);
+    tmp[15] = 1.0f;
+
+    memcpy(res, tmp, 16 * sizeof(float));
+}
+
+static void transformPointRef(float *res, const float *m, const float *p) {
+
+    float q[4] = { p[0], p[1], p[2], 1.0f };
+    float tmp[4];
+
+    for (int i = 0; i < 4; ++i) {
+        tmp[i] = 0.0f;
+        for (int k = 0; k < 4; ++k)
+            tmp[i] += m[k*4 + i] * q[k];
+    }
+    memcpy(res, tmp, 4 * sizeof(float));
+}
+
+static void multBatchRef(mat4 *res, const mat4 *a, const mat4 *b, int n) {
+
+    for (int i = 0; i < n; ++i)
+        multRef(res[i].m, a[i].m, b[i].m);
+}
+
+static void multBatchSharedRef(mat4 *res, const mat4 *a, const mat4 *b, int n) {
+
+    for (int i = 0; i < n; ++i)
+        multRef(res[i].m, a->m, b[i].m);
+}
+
+const Mat4Kernels mat4KernelsScalar = {
+    ISA_SCALAR,
+    multRef,
+    transposeRef,
+    affineInverseRef,
+    transformPointRef,
+    multBatchRef,
+    multBatchSharedRef,
+    crossRef,
+    normalizeRef
+};
+
+#if CPU_X86
+
+// ----------------------------------------------------
+// SSE2
+//
+
+// one column of a * b: ((0 + a0*b0) + a1*b1) + a2*b2) + a3*b3
+TARGET_SSE2
+static inline __m128 columnSSE(__m128 a0, __m128 a1, __m128 a2, __m128 a3, const float *b) {
+
+    __m128 r = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(a0, _mm_set1_ps(b[0])));
+    r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[1])));
+    r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[2])));
+    r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[3])));
+    return r;
+}
+
+TARGET_SSE2
+static void multSSE(float *res, const float *a, const float *b) {
+
+    __m128 a0 = _mm_loadu_ps(a + 0);
+    __m128 a1 = _mm_loadu_ps(a + 4);
+    __m128 a2 = _mm_loadu_ps(a + 8);
+    __m128 a3 = _mm_loadu_ps(a + 12);
+
+    __m128 r0 = columnSSE(a0, a1, a2, a3, b + 0);
+    __m128 r1 = columnSSE(a0, a1, a2, a3, b + 4);
+    __m128 r2 = columnSSE(a0, a1, a2, a3, b + 8);
+    __m128 r3 = columnSSE(a0, a1, a2, a3, b + 12);
+
+    _mm_storeu_ps(res + 0, r0);
+    _mm_storeu_ps(res + 4, r1);
+    _mm_storeu_ps(res + 8, r2);
+    _mm_storeu_ps(res + 12, r3);
+}
+
+TARGET_SSE2
+static void transposeSSE(float *res, const float *a) {
+
+    __m128 c0 = _mm_loadu_ps(a + 0);
+    __m128 c1 = _mm_loadu_ps(a + 4);
+    __m128 c2 = _mm_loadu_ps(a + 8);
+    __m128 c3 = _mm_loadu_ps(a + 12);
+
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+    _mm_storeu_ps(res + 0, c0);
+    _mm_storeu_ps(res + 4, c1);
+    _mm_storeu_ps(res + 8, c2);
+    _mm_storeu_ps(res + 12, c3);
+}
+
+TARGET_SSE2
+static inline __m128 crossSSE(__m128 a, __m128 b) {
+
+    __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+    __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+
+    return _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx));
+}
+
+TARGET_SSE2
+static void affineInverseSSE(float *res, const float *a) {
+
+    const __m128 xyz = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    __m128 c0 = _mm_loadu_ps(a + 0);
+    __m128 c1 = _mm_loadu_ps(a + 4);
+    __m128 c2 = _mm_loadu_ps(a + 8);
+    __m128 t  = _mm_loadu_ps(a + 12);
+
+    __m128 r0 = crossSSE(c1, c2);
+    __m128 r1 = crossSSE(c2, c0);
+    __m128 r2 = crossSSE(c0, c1);
+
+    __m128 p = _mm_mul_ps(c0, r0);
+    __m128 det = _mm_add_ss(_mm_add_ss(p, _mm_shuffle_ps(p, p, 1)), _mm_shuffle_ps(p, p, 2));
+    __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), _mm_shuffle_ps(det, det, 0));
+
+    r0 = _mm_and_ps(_mm_mul_ps(r0, invDet), xyz);
+    r1 = _mm_and_ps(_mm_mul_ps(r1, invDet), xyz);
+    r2 = _mm_and_ps(_mm_mul_ps(r2, invDet), xyz);
+    __m128 r3 = _mm_setzero_ps();
+
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+    __m128 tx = _mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 0, 0, 0));
+    __m128 ty = _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1));
+    __m128 tz = _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 2, 2, 2));
+    __m128 tr = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, tx), _mm_mul_ps(r1, ty)), _mm_mul_ps(r2, tz));
+    tr = _mm_xor_ps(tr, sign);
+    tr = _mm_or_ps(_mm_and_ps(tr, xyz), _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f));
+
+    _mm_storeu_ps(res + 0, r0);
+    _mm_storeu_ps(res + 4, r1);
+    _mm_storeu_ps(res + 8, r2);
+    _mm_storeu_ps(res + 12, tr);
+}
+
+TARGET_SSE2
+static void transformPointSSE(float *res, const float *m, const float *p) {
+
+    __m128 r = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(_mm_loadu_ps(m + 0), _mm_set1_ps(p[0])));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(p[1])));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(p[2])));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 12), _mm_set1_ps(1.0f)));
+    _mm_storeu_ps(res, r);
+}
+
+// vec3s are loaded without touching a fourth float
+TARGET_SSE2
+static inline __m128 load3(const float *p) {
+
+    __m128 xy = _mm_castpd_ps(_mm_load_sd((const double *) p));
+    return _mm_movelh_ps(xy, _mm_load_ss(p + 2));
+}
+
+TARGET_SSE2
+static inline void store3(float *p, __m128 v) {
+
+    _mm_storel_pi((__m64 *) p, v);
+    _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+}
+
+TARGET_SSE2
+static void crossSSE2(const float *a, const float *b, float *res) {
+
+    store3(res, crossSSE(load3(a), load3(b)));
+}
+
+TARGET_SSE2
+static void normalizeSSE2(float *a) {
+
+    __m128 v = load3(a);
+    __m128 sq = _mm_mul_ps(v, v);
+    __m128 dot = _mm_add_ss(_mm_add_ss(sq, _mm_shuffle_ps(sq, sq, 1)), _mm_shuffle_ps(sq, sq, 2));
+    __m128 mag = _mm_sqrt_ss(dot);
+
+    store3(a, _mm_div_ps(v, _mm_shuffle_ps(mag, mag, 0)));
+}
+
+TARGET_SSE2
+static void multBatchSSE(mat4 *res, const mat4 *a, const mat4 *b, int n) {
+
+    for (int i = 0; i < n; ++i)
+        multSSE(res[i].m, a[i].m, b[i].m);
+}
+
+TARGET_SSE2
+static void multBatchSharedSSE(mat4 *res, const mat4 *a, const mat4 *b, int n) {
+
+    __m128 a0 = _mm_load_ps(a->m + 0);
+    __m128 a1 = _mm_load_ps(a->m + 4);
+    __m128 a2 = _mm_load_ps(a->m + 8);
+    __m128 a3 = _mm_load_ps(a->m + 12);
+
+    for (int i = 0; i < n; ++i) {
+        const float *bi = b[i].m;
+        __m128 r0 = columnSSE(a0, a1, a2, a3, bi + 0);
+        __m128 r1 = columnSSE(a0, a1, a2, a3, bi + 4);
+        __m128 r2 = columnSSE(a0, a1, a2, a3, bi + 8);
+        __m128 r3 = columnSSE(a0, a1, a2, a3, bi + 12);
+        _mm_store_ps(res[i].m + 0, r0);
+        _mm_store_ps(res[i].m + 4, r1);
+        _mm_store_ps(res[i].m + 8, r2);
+        _mm_store_ps(res[i].m + 12, r3);
+    }
+}
+
+const Mat4Kernels mat4KernelsSSE2 = {
+    ISA_SSE2,
+    multSSE,
+    transposeSSE,
+    affineInverseSSE,
+    transformPointSSE,
+    multBatchSSE,
+    multBatchSharedSSE,
+    crossSSE2,
+    normalizeSSE2
+};
+
+// ----------------------------------------------------
+// SSE4.1
+//
+// dpps adds (x*x + y*y) + (z*z + 0), which is the
+// reference order since z*z + 0 is exact.
+//
+
+TARGET_SSE41
+static void normalizeSSE41(float *a) {
+
+    __m128 v = load3(a);
+    __m128 mag = _mm_sqrt_ps(_mm_dp_ps(v, v, 0x7F));
+
+    store3(a, _mm_div_ps(v, mag));
+}
+
+const Mat4Kernels mat4KernelsSSE41 = {
+    ISA_SSE41,
+    multSSE,
+    transposeSSE,
+    affineInverseSSE,
+    transformPointSSE,
+    multBatchSSE,
+    multBatchSharedSSE,
+    crossSSE2,
+    normalizeSSE41
+};
+
+// ----------------------------------------------------
+// AVX2
+//
+// Two columns of the result per 256 bit register: a
+// column of a is broadcast to both lanes and the matching
+// element of two columns of b is splatted per lane.
+//
+
+TARGET_AVX2
+static inline __m256 twoColumnsAVX2(__m256 a0, __m256 a1, __m256 a2, __m256 a3, const float *b) {
+
+    __m256 bb = _mm256_loadu_ps(b);
+
+    __m256 r = _mm256_add_ps(_mm256_setzero_ps(), _mm256_mul_ps(a0, _mm256_shuffle_ps(bb, bb, 0x00)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_shuffle_ps(bb, bb, 0x55)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_shuffle_ps(bb, bb, 0xAA)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_shuffle_ps(bb, bb, 0xFF)));
+    return r;
+}
+
+TARGET_AVX2
+static void multAVX2(float *res, const float *a, const float *b) {
+
+    __m256 a0 = _mm256_broadcast_ps((const __m128 *) (a + 0));
+    __m256 a1 = _mm256_broadcast_ps((const __m128 *) (a + 4));
+    __m256 a2 = _mm256_broadcast_ps((const __m128 *) (a + 8));
+    __m256 a3 = _mm256_broadcast_ps((const __m128 *) (a + 12));
+
+    __m256 r01 = twoColumnsAVX2(a0, a1, a2, a3, b + 0);
+    __m256 r23 = twoColumnsAVX2(a0, a1, a2, a3, b + 8);
+
+    _mm256_storeu_ps(res + 0, r01);
+    _mm256_storeu_ps(res + 8, r23);
+}
+
+TARGET_AVX2
+static void multBatchAVX2(mat4 *res, const mat4 *a, const mat4 *b, int n) {
+
+    for (int i = 0; i < n; ++i) {
+        const float *ai = a[i].m;
+        __m256 a0 = _mm256_broadcast_ps((const __m128 *) (ai + 0));
+        __m256 a1 = _mm256_broadcast_ps((const __m128 *) (ai + 4));
+        __m256 a2 = _mm256_broadcast_ps((const __m128 *) (ai + 8));
+        __m256 a3 = _mm256_broadcast_ps((const __m128 *) (ai + 12));
+        __m256 r01 = twoColumnsAVX2(a0, a1, a2, a3, b[i].m + 0);
+        __m256 r23 = twoColumnsAVX2(a0, a1, a2, a3, b[i].m + 8);
+        _mm256_store_ps(res[i].m + 0, r01);
+        _mm256_store_ps(res[i].m + 8, r23);
+    }
+}
+
+TARGET_AVX2
+static void multBatchSharedAVX2(mat4 *res, const mat4 *a, const mat4 *b, int n) {
+
+    __m256 a0 = _mm256_broadcast_ps((const __m128 *) (a->m + 0));
+    __m256 a1 = _mm256_broadcast_ps((const __m128 *) (a->m + 4));
+    __m256 a2 = _mm256_broadcast_ps((const __m128 *) (a->m + 8));
+    __m256 a3 = _mm256_broadcast_ps((const __m128 *) (a->m + 12));
+
+    for (int i = 0; i < n; ++i) {
+        __m256 r01 = twoColumnsAVX2(a0, a1, a2, a3, b[i].m + 0);
+        __m256 r23 = twoColumnsAVX2(a0, a1, a2, a3, b[i].m + 8);
+        _mm256_store_ps(res[i].m + 0, r01);
+        _mm256_store_ps(res[i].m + 8, r23);
+    }
+}
+
+// transpose, inverse and point transform gain nothing from
+// 256 bit registers, the SSE versions are reused
+const Mat4Kernels mat4KernelsAVX2 = {
+    ISA_AVX2,
+    multAVX2,
+    transposeSSE,
+    affineInverseSSE,
+    transformPointSSE,
+    multBatchAVX2,
+    multBatchSharedAVX2,
+    crossSSE2,
+    normalizeSSE41
+};
+
+// ----------------------------------------------------
+// AVX-512
+//
+// A whole matrix fits in one 512 bit register, each
+// 128 bit lane holding one column of the result.
+//
+
+TARGET_AVX512
+static inline __m512 matrixAVX512(__m512 a0, __m512 a1, __m512 a2, __m512 a3, const float *b) {
+
+    __m512 bb = _mm512_loadu_ps(b);
+
+    __m512 r = _mm512_add_ps(_mm512_setzero_ps(), _mm512_mul_ps(a0, _mm512_permute_ps(bb, 0x00)));
+    r = _mm512_add_ps(r, _mm512_mul_ps(a1, _mm512_permute_ps(bb, 0x55)));
+    r = _mm512_add_ps(r, _mm512_mul_ps(a2, _mm512_permute_ps(bb, 0xAA)));
+    r = _mm512_add_ps(r, _mm512_mul_ps(a3, _mm512_permute_ps(bb, 0xFF)));
+    return r;
+}
+
+TARGET_AVX512
+static void multAVX512(float *res, const float *a, const float *b) {
+
+    __m512 aa = _mm512_loadu_ps(a);
+    __m512 a0 = _mm512_shuffle_f32x4(aa, aa, 0x00);
+    __m512 a1 = _mm512_shuffle_f32x4(aa, aa, 0x55);
+    __m512 a2 = _mm512_shuffle_f32x4(aa, aa, 0xAA);
+    __m512 a3 = _mm512_shuffle_f32x4(aa, aa, 0xFF);
+
+    _mm512_storeu_ps(res, matrixAVX512(a0, a1, a2, a3, b));
+}
+
+TARGET_AVX512
+static void multBatchAVX512(mat4 *res, const mat4 *a, const mat4 *b, int n) {
+
+    for (int i = 0; i < n; ++i) {
+        __m512 aa = _mm512_loadu_ps(a[i].m);
+        __m512 a0 = _mm512_shuffle_f32x4(aa, aa, 0x00);
+        __m512 a1 = _mm512_shuffle_f32x4(aa, aa, 0x55);
+        __m512 a2 = _mm512_shuffle_f32x4(aa, aa, 0xAA);
+        __m512 a3 = _mm512_shuffle_f32x4(aa, aa, 0xFF);
+        _mm512_storeu_ps(res[i].m, matrixAVX512(a0, a1, a2, a3, b[i].m));
+    }
+}
+
+TARGET_AVX512
+static void multBatchSharedAVX512(mat4 *res, const mat4 *a, const mat4 *b, int n) {
+
+    __m512 aa = _mm512_loadu_ps(a->m);
+    __m512 a0 = _mm512_shuffle_f32x4(aa, aa, 0x00);
+    __m512 a1 = _mm512_shuffle_f32x4(aa, aa, 0x55);
+    __m512 a2 = _mm512_shuffle_f32x4(aa, aa, 0xAA);
+    __m512 a3 = _mm512_shuffle_f32x4(aa, aa, 0xFF);
+
+    for (int i = 0; i < n; ++i)
+        _mm512_storeu_ps(res[i].m, matrixAVX512(a0, a1, a2, a3, b[i].m));
+}
+
+const Mat4Kernels mat4KernelsAVX512 = {
+    ISA_AVX512,
+    multAVX512,
+    transposeSSE,
+    affineInverseSSE,
+    transformPointSSE,
+    multBatchAVX512,
+    multBatchSharedAVX512,
+    crossSSE2,
+    normalizeSSE41
+};
+
+#else
+
+const Mat4Kernels mat4KernelsSSE2 = mat4KernelsScalar;
+const Mat4Kernels mat4KernelsSSE41 = mat4KernelsScalar;
+const Mat4Kernels mat4KernelsAVX2 = mat4KernelsScalar;
+const Mat4Kernels mat4KernelsAVX512 = mat4KernelsScalar;
+
+#endif
+
+// ----------------------------------------------------
+// BINDING
+//
+
+static const Mat4Kernels *tables[ISA_COUNT] = {
+    &mat4KernelsScalar,
+    &mat4KernelsSSE2,
+    &mat4KernelsSSE41,
+    &mat4KernelsAVX2,
+    &mat4KernelsAVX512
+};
+
+const Mat4Kernels *mat4Kernels = &mat4KernelsScalar;
+
+void mat4Bind(CpuIsa isa) {
+
+    mat4Kernels = tables[isa];
+}
+
+// ----------------------------------------------------
+// CHECK
+//
+
+static unsigned int seed = 12345;
+
+static float randomFloat() {
+
+    seed = seed * 1664525u + 1013904223u;
+    return (float)(seed >> 8) / (float)(1 << 24) * 8.0f - 4.0f;
+}
+
+static void randomMatrix(float *m, bool affine) {
+
+    for (int i = 0; i < 16; ++i)
+        m[i] = randomFloat();
+    if (affine) {
+        m[3] = m[7] = m[11] = 0.0f;
+        m[15] = 1.0f;
+    }
+}
+
+static int compare(CpuIsa isa, const char *what, const float *res, const float *ref, int count) {
+
+    if (memcmp(res, ref, count * sizeof(float)) == 0)
+        return 0;
+    printf("mat4Check: %s %s differs from the reference\n", cpuIsaName(isa), what);
+    return 1;
+}
+
+int mat4Check() {
+
+    const int batch = 64;
+    int failures = 0;
+
+    static mat4 a[batch], b[batch], res[batch], ref[batch];
+
+    for (int k = 0; k <= cpuDetect(); ++k) {
+        const Mat4Kernels *kernels = tables[k];
+
+        for (int round = 0; round < 1000; ++round) {
+            float m[16], n[16], r[16], e[16], p[4];
+
+            randomMatrix(m, false);
+            randomMatrix(n, false);
+
+            multRef(e, m, n);
+            kernels->mult(r, m, n);
+            failures += compare(kernels->isa, "mult", r, e, 16);
+
+            memcpy(r, m, sizeof(r));
+            kernels->mult(r, r, n);
+            failures += compare(kernels->isa, "mult in place", r, e, 16);
+
+            transposeRef(e, m);
+            kernels->transpose(r, m);
+            failures += compare(kernels->isa, "transpose", r, e, 16);
+
+            randomMatrix(m, true);
+            affineInverseRef(e, m);
+            kernels->affineInverse(r, m);
+            failures += compare(kernels->isa, "affineInverse", r, e, 16);
+
+            p[0] = randomFloat(); p[1] = randomFloat(); p[2] = randomFloat(); p[3] = 1.0f;
+            float q[16] = { 1,0,0,0, 0,1,0,0, 0,0,1,0, p[0],p[1],p[2],1 };
+            multRef(e, n, q);
+            kernels->transformPoint(r, n, p);
+            failures += compare(kernels->isa, "transformPoint", r, e + 12, 4);
+
+            crossRef(m, n, e);
+            kernels->cross(m, n, r);
+            failures += compare(kernels->isa, "cross", r, e, 3);
+
+            memcpy(e, m, 3 * sizeof(float));
+            memcpy(r, m, 3 * sizeof(float));
+            normalizeRef(e);
+            kernels->normalize(r);
+            failures += compare(kernels->isa, "normalize", r, e, 3);
+        }
+
+        for (int i = 0; i < batch; ++i) {
+            randomMatrix(a[i].m, false);
+            randomMatrix(b[i].m, false);
+        }
+
+        for (int i = 0; i < batch; ++i)
+            multRef(ref[i].m, a[i].m, b[i].m);
+        kernels->multBatch(res, a, b, batch);
+        failures += compare(kernels->isa, "multBatch", res[0].m, ref[0].m, 16 * batch);
+
+        for (int i = 0; i < batch; ++i)
+            multRef(ref[i].m, a[0].m, b[i].m);
+        kernels->multBatchShared(res, a, b, batch);
+        failures += compare(kernels->isa, "multBatchShared", res[0].m, ref[0].m, 16 * batch);
+    }
+    return failures;
+}
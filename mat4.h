@@ -0,0 +1,110 @@
+#ifndef MAT4_H
+#define MAT4_H
+
+// ----------------------------------------------------
+// MAT4 / VEC4
+//
+// Matrices are 16 floats in column major order, the
+// layout glUniformMatrix4fv expects: element (row i,
+// column j) lives at m[j*4 + i].
+//
+// Every kernel exists in a scalar reference version
+// and in SIMD versions that perform the very same
+// float operations in the very same order, so all of
+// them produce bit identical results.
+//
+
+#include "cpu.h"
+
+#if defined(_MSC_VER)
+#define ALIGNED(n) __declspec(align(n))
+#else
+#define ALIGNED(n) __attribute__((aligned(n)))
+#endif
+
+struct ALIGNED(32) mat4 {
+    float m[16];
+};
+
+struct ALIGNED(16) vec4 {
+    float v[4];
+};
+
+struct Mat4Kernels {
+
+    CpuIsa isa;
+
+    // res = a * b (res may alias a or b)
+    void (*mult)(float *res, const float *a, const float *b);
+
+    // res = transpose(a) (res may alias a)
+    void (*transpose)(float *res, const float *a);
+
+    // res = inverse(a), a being affine (last row 0 0 0 1)
+    void (*affineInverse)(float *res, const float *a);
+
+    // res = m * (p[0], p[1], p[2], 1)
+    void (*transformPoint)(float *res, const float *m, const float *p);
+
+    // res[i] = a[i] * b[i] for i in [0, n)
+    void (*multBatch)(mat4 *res, const mat4 *a, const mat4 *b, int n);
+
+    // res[i] = a * b[i] for i in [0, n), e.g. viewProj * model[i]
+    void (*multBatchShared)(mat4 *res, const mat4 *a, const mat4 *b, int n);
+
+    // res = a cross b, on vec3s
+    void (*cross)(const float *a, const float *b, float *res);
+
+    // normalize a vec3
+    void (*normalize)(float *a);
+};
+
+extern const Mat4Kernels mat4KernelsScalar;
+extern const Mat4Kernels mat4KernelsSSE2;
+extern const Mat4Kernels mat4KernelsSSE41;
+extern const Mat4Kernels mat4KernelsAVX2;
+extern const Mat4Kernels mat4KernelsAVX512;
+
+// kernels in use, the scalar ones until cpuInit is called
+extern const Mat4Kernels *mat4Kernels;
+
+// called by cpuInit with the level to use
+void mat4Bind(CpuIsa isa);
+
+// compares every kernel set against the scalar reference
+// on random input, returns the number of mismatches
+int mat4Check();
+
+inline void mat4Mult(float *res, const float *a, const float *b) {
+    mat4Kernels->mult(res, a, b);
+}
+
+inline void mat4Transpose(float *res, const float *a) {
+    mat4Kernels->transpose(res, a);
+}
+
+inline void mat4AffineInverse(float *res, const float *a) {
+    mat4Kernels->affineInverse(res, a);
+}
+
+inline void mat4TransformPoint(float *res, const float *m, const float *p) {
+    mat4Kernels->transformPoint(res, m, p);
+}
+
+inline void mat4MultBatch(mat4 *res, const mat4 *a, const mat4 *b, int n) {
+    mat4Kernels->multBatch(res, a, b, n);
+}
+
+inline void mat4MultBatchShared(mat4 *res, const mat4 *a, const mat4 *b, int n) {
+    mat4Kernels->multBatchShared(res, a, b, n);
+}
+
+inline void vec3Cross(const float *a, const float *b, float *res) {
+    mat4Kernels->cross(a, b, res);
+}
+
+inline void vec3Normalize(float *a) {
+    mat4Kernels->normalize(a);
+}
+
+#endif
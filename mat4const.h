@@ -0,0 +1,192 @@
+#ifndef MAT4CONST_H
+#define MAT4CONST_H
+
+#include "mat4.h"
+
+// ----------------------------------------------------
+// CONSTEXPR MATRICES
+//
+// Builders the compiler can evaluate, so fixed cameras,
+// HUD projections and static transforms are baked into
+// .rodata and can be checked with static_assert. They
+// work at runtime too, but the camera's builders are
+// faster there.
+//
+// sqrt and tan are evaluated in double precision, which
+// leaves the float results within 1 ulp.
+//
+
+constexpr double CONST_PI = 3.14159265358979323846;
+
+constexpr double constSqrt(double x) {
+
+    if (!(x > 0.0))
+        return 0.0;
+
+    // bring x into [0.25, 4] with exact power of 4 steps
+    double scale = 1.0;
+    while (x > 4.0) {
+        x *= 0.25;
+        scale *= 2.0;
+    }
+    while (x < 0.25) {
+        x *= 4.0;
+        scale *= 0.5;
+    }
+
+    double g = 1.0;
+    for (int i = 0; i < 8; ++i)
+        g = 0.5 * (g + x / g);
+    return g * scale;
+}
+
+// sin and cos series, for |x| <= pi/4
+constexpr double constSinSeries(double x) {
+
+    double term = x, sum = x;
+    for (int n = 1; n < 12; ++n) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double constCosSeries(double x) {
+
+    double term = 1.0, sum = 1.0;
+    for (int n = 1; n < 12; ++n) {
+        term *= -x * x / ((2 * n - 1) * (2 * n));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double constTan(double x) {
+
+    // tan has period pi
+    double k = x / CONST_PI;
+    long long n = (long long) (k < 0.0 ? k - 0.5 : k + 0.5);
+    double r = x - n * CONST_PI;
+
+    // past pi/4, tan(r) = 1 / tan(pi/2 - r)
+    if (r > CONST_PI / 4) {
+        double s = CONST_PI / 2 - r;
+        return constCosSeries(s) / constSinSeries(s);
+    }
+    if (r < -CONST_PI / 4) {
+        double s = -CONST_PI / 2 - r;
+        return constCosSeries(s) / constSinSeries(s);
+    }
+    return constSinSeries(r) / constCosSeries(r);
+}
+
+// ----------------------------------------------------
+// BUILDERS
+//
+
+constexpr mat4 identityMatrix() {
+
+    mat4 r = {};
+    r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0f;
+    return r;
+}
+
+constexpr mat4 translationMatrix(float x, float y, float z) {
+
+    mat4 r = identityMatrix();
+    r.m[12] = x;
+    r.m[13] = y;
+    r.m[14] = z;
+    return r;
+}
+
+constexpr mat4 scaleMatrix(float x, float y, float z) {
+
+    mat4 r = identityMatrix();
+    r.m[0] = x;
+    r.m[5] = y;
+    r.m[10] = z;
+    return r;
+}
+
+// 1 / tan(fov / 2), fov in degrees
+constexpr float focalLength(float fov) {
+
+    return (float) (1.0 / constTan(fov * (CONST_PI / 360.0)));
+}
+
+constexpr mat4 perspectiveMatrix(float fov, float ratio, float nearPlane, float farPlane) {
+
+    float f = focalLength(fov);
+
+    mat4 r = {};
+    r.m[0] = f / ratio;
+    r.m[1 * 4 + 1] = f;
+    r.m[2 * 4 + 2] = (farPlane + nearPlane) / (nearPlane - farPlane);
+    r.m[3 * 4 + 2] = (2.0f * farPlane * nearPlane) / (nearPlane - farPlane);
+    r.m[2 * 4 + 3] = -1.0f;
+    return r;
+}
+
+constexpr mat4 orthoMatrix(float left, float right, float bottom, float top, float nearPlane, float farPlane) {
+
+    mat4 r = identityMatrix();
+    r.m[0] = 2.0f / (right - left);
+    r.m[5] = 2.0f / (top - bottom);
+    r.m[10] = -2.0f / (farPlane - nearPlane);
+    r.m[12] = -(right + left) / (right - left);
+    r.m[13] = -(top + bottom) / (top - bottom);
+    r.m[14] = -(farPlane + nearPlane) / (farPlane - nearPlane);
+    return r;
+}
+
+// same construction as buildLookAt, with a vertical up vector
+constexpr mat4 lookAtMatrix(float posX, float posY, float posZ,
+                            float lookAtX, float lookAtY, float lookAtZ) {
+
+    float dir[3] = { lookAtX - posX, lookAtY - posY, lookAtZ - posZ };
+
+    float invLen = 1.0f / (float) constSqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+    dir[0] *= invLen;
+    dir[1] *= invLen;
+    dir[2] *= invLen;
+
+    float invRight = 1.0f / (float) constSqrt(dir[0] * dir[0] + dir[2] * dir[2]);
+    float right[3] = { -dir[2] * invRight, 0.0f, dir[0] * invRight };
+    float up[3] = { -right[2] * dir[1], right[2] * dir[0] - right[0] * dir[2], right[0] * dir[1] };
+
+    mat4 r = {};
+    r.m[0]  = right[0];
+    r.m[4]  = right[1];
+    r.m[8]  = right[2];
+    r.m[12] = -(right[0] * posX + right[2] * posZ);
+
+    r.m[1]  = up[0];
+    r.m[5]  = up[1];
+    r.m[9]  = up[2];
+    r.m[13] = -(up[0] * posX + up[1] * posY + up[2] * posZ);
+
+    r.m[2]  = -dir[0];
+    r.m[6]  = -dir[1];
+    r.m[10] = -dir[2];
+    r.m[14] = dir[0] * posX + dir[1] * posY + dir[2] * posZ;
+
+    r.m[15] = 1.0f;
+    return r;
+}
+
+// a * b, the multMatrix loop, so it matches mat4Mult bit for bit
+constexpr mat4 multMatrices(const mat4 &a, const mat4 &b) {
+
+    mat4 r = {};
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            r.m[j*4 + i] = 0.0f;
+            for (int k = 0; k < 4; ++k)
+                r.m[j*4 + i] += a.m[k*4 + i] * b.m[j*4 + k];
+        }
+    }
+    return r;
+}
+
+#endif
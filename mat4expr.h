@@ -0,0 +1,152 @@
+#ifndef MAT4EXPR_H
+#define MAT4EXPR_H
+
+#include "mat4.h"
+
+// ----------------------------------------------------
+// MATRIX EXPRESSIONS
+//
+// mat(P) * mat(V) * mat(M) builds a product expression
+// instead of multiplying right away. Applied to a vector
+// it becomes P * (V * (M * v)), three matrix * vector
+// steps kept in registers. Assigned to a matrix, every
+// column of the result is P * (V * column of M), so no
+// intermediate matrix is stored and the destination may
+// be one of the operands.
+//
+// Expressions hold pointers to their operands: use them
+// within one statement, don't keep them around.
+//
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MAT4EXPR_SSE 1
+#else
+#define MAT4EXPR_SSE 0
+#endif
+
+namespace mat4expr {
+
+#if MAT4EXPR_SSE
+
+typedef __m128 Column;
+
+inline Column load(const float *p) { return _mm_loadu_ps(p); }
+inline void store(float *p, Column c) { _mm_storeu_ps(p, c); }
+
+// m * v, m given by its columns
+inline Column transform(const float *m, Column v) {
+
+    Column r = _mm_mul_ps(_mm_loadu_ps(m + 0), _mm_shuffle_ps(v, v, 0x00));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_shuffle_ps(v, v, 0x55)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_shuffle_ps(v, v, 0xAA)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 12), _mm_shuffle_ps(v, v, 0xFF)));
+    return r;
+}
+
+#else
+
+struct Column {
+    float v[4];
+};
+
+inline Column load(const float *p) {
+
+    Column c = { { p[0], p[1], p[2], p[3] } };
+    return c;
+}
+
+inline void store(float *p, Column c) {
+
+    p[0] = c.v[0]; p[1] = c.v[1]; p[2] = c.v[2]; p[3] = c.v[3];
+}
+
+inline Column transform(const float *m, Column v) {
+
+    Column r;
+    for (int i = 0; i < 4; ++i)
+        r.v[i] = m[i] * v.v[0] + m[4 + i] * v.v[1] + m[8 + i] * v.v[2] + m[12 + i] * v.v[3];
+    return r;
+}
+
+#endif
+
+template <class E>
+struct Expr {
+    const E &self() const { return static_cast<const E &>(*this); }
+};
+
+// a matrix operand
+struct Ref : Expr<Ref> {
+
+    const float *m;
+
+    explicit Ref(const float *m) : m(m) {}
+
+    Column apply(Column v) const { return transform(m, v); }
+    Column column(int j) const { return load(m + 4 * j); }
+};
+
+// l * r, evaluated right to left
+template <class L, class R>
+struct Product : Expr<Product<L, R> > {
+
+    L l;
+    R r;
+
+    Product(const L &l, const R &r) : l(l), r(r) {}
+
+    Column apply(Column v) const { return l.apply(r.apply(v)); }
+    Column column(int j) const { return l.apply(r.column(j)); }
+};
+
+template <class L, class R>
+inline Product<L, R> operator*(const Expr<L> &l, const Expr<R> &r) {
+
+    return Product<L, R>(l.self(), r.self());
+}
+
+template <class E>
+inline vec4 operator*(const Expr<E> &e, const vec4 &v) {
+
+    vec4 res;
+    store(res.v, e.self().apply(load(v.v)));
+    return res;
+}
+
+// res = e, all four columns are computed before any is stored
+template <class E>
+inline void assign(float *res, const Expr<E> &e) {
+
+    Column c0 = e.self().column(0);
+    Column c1 = e.self().column(1);
+    Column c2 = e.self().column(2);
+    Column c3 = e.self().column(3);
+
+    store(res + 0, c0);
+    store(res + 4, c1);
+    store(res + 8, c2);
+    store(res + 12, c3);
+}
+
+template <class E>
+inline mat4 eval(const Expr<E> &e) {
+
+    mat4 res;
+    assign(res.m, e);
+    return res;
+}
+
+}
+
+inline mat4expr::Ref mat(const float *m) {
+
+    return mat4expr::Ref(m);
+}
+
+inline mat4expr::Ref mat(const mat4 &m) {
+
+    return mat4expr::Ref(m.m);
+}
+
+#endif
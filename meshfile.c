@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "meshfile.h"
+
+// ----------------------------------------------------
+// READING
+//
+
+static size_t indexSize(unsigned int type) {
+
+    return type == GL_UNSIGNED_SHORT ? 2 : type == GL_UNSIGNED_INT ? 4 : 0;
+}
+
+static bool fail(const char *path, const char *why) {
+
+    printf("%s: %s\n", path, why);
+    return false;
+}
+
+static bool inFile(unsigned long long fileSize, unsigned long long offset, unsigned long long size) {
+
+    return offset % MESH_FILE_ALIGNMENT == 0 && offset <= fileSize && size <= fileSize - offset;
+}
+
+bool meshFileCheckHeader(const MeshFileHeader *h, unsigned long long fileSize, VertexFormat *format, const char *path) {
+
+    if (fileSize < sizeof(MeshFileHeader) || h->magic != MESH_FILE_MAGIC)
+        return fail(path, "not a mesh file");
+    if (h->version != MESH_FILE_VERSION)
+        return fail(path, "unknown version");
+
+    // the format, rebuilt the way it was made
+    if (h->attribCount > VERTEX_MAX_ATTRIBS)
+        return fail(path, "bad vertex format");
+    vertexFormatInit(format);
+    for (unsigned int i = 0; i < h->attribCount; ++i) {
+        const MeshFileAttrib *a = &h->attribs[i];
+        if (a->semantic >= VERTEX_SEMANTICS || a->type >= VERTEX_TYPES ||
+            !vertexFormatAdd(format, (VertexSemantic) a->semantic, (VertexType) a->type, a->components))
+            return fail(path, "bad vertex format");
+    }
+    memcpy(format->positionCenter, h->positionCenter, sizeof(h->positionCenter));
+    memcpy(format->positionExtent, h->positionExtent, sizeof(h->positionExtent));
+    if ((unsigned int) format->stride != h->stride)
+        return fail(path, "bad vertex format");
+
+    if (indexSize(h->indexType) == 0)
+        return fail(path, "bad index type");
+    if (h->vertexSize != (unsigned long long) h->vertexCount * h->stride || !inFile(fileSize, h->vertexOffset, h->vertexSize) ||
+        h->indexSize != (unsigned long long) h->indexCount * indexSize(h->indexType) || !inFile(fileSize, h->indexOffset, h->indexSize))
+        return fail(path, "truncated");
+
+    if (h->lodCount == 0 || h->lodCount > MESH_FILE_MAX_LODS)
+        return fail(path, "bad levels of detail");
+    for (unsigned int i = 0; i < h->lodCount; ++i)
+        if (h->lods[i].firstIndex > h->indexCount || h->lods[i].indexCount > h->indexCount - h->lods[i].firstIndex)
+            return fail(path, "bad levels of detail");
+    return true;
+}
+
+bool meshFileOpen(MeshFile *file, const char *path) {
+
+    memset(file, 0, sizeof(MeshFile));
+    if (!mappedFileOpen(&file->map, path)) {
+        printf("%s: cannot open\n", path);
+        return false;
+    }
+
+    const MeshFileHeader *h = (const MeshFileHeader *) file->map.data;
+    if (!meshFileCheckHeader(h, file->map.size, &file->format, path)) {
+        meshFileClose(file);
+        return false;
+    }
+
+    file->header = h;
+    file->vertices = file->map.data + h->vertexOffset;
+    file->indices = file->map.data + h->indexOffset;
+    return true;
+}
+
+void meshFileClose(MeshFile *file) {
+
+    mappedFileClose(&file->map);
+    memset(file, 0, sizeof(MeshFile));
+}
+
+// ----------------------------------------------------
+// WRITING
+//
+
+void meshFileSetFormat(MeshFileHeader *header, const VertexFormat *fmt) {
+
+    header->stride = fmt->stride;
+    header->attribCount = fmt->attribCount;
+    memset(header->attribs, 0, sizeof(header->attribs));
+    for (int i = 0; i < fmt->attribCount; ++i) {
+        header->attribs[i].semantic = fmt->attribs[i].semantic;
+        header->attribs[i].type = fmt->attribs[i].type;
+        header->attribs[i].components = fmt->attribs[i].components;
+    }
+    memcpy(header->positionCenter, fmt->positionCenter, sizeof(header->positionCenter));
+    memcpy(header->positionExtent, fmt->positionExtent, sizeof(header->positionExtent));
+}
+
+static unsigned long long aligned(unsigned long long offset) {
+
+    return (offset + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+}
+
+static bool pad(FILE *f, unsigned long long from, unsigned long long to) {
+
+    static const unsigned char zeros[MESH_FILE_ALIGNMENT] = { 0 };
+    return fwrite(zeros, 1, (size_t)(to - from), f) == to - from;
+}
+
+bool meshFileWrite(const char *path, MeshFileHeader *header, const void *vertices, const void *indices) {
+
+    header->magic = MESH_FILE_MAGIC;
+    header->version = MESH_FILE_VERSION;
+    header->vertexSize = (unsigned long long) header->vertexCount * header->stride;
+    header->indexSize = (unsigned long long) header->indexCount * indexSize(header->indexType);
+    header->vertexOffset = aligned(sizeof(MeshFileHeader));
+    header->indexOffset = aligned(header->vertexOffset + header->vertexSize);
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    bool ok = fwrite(header, sizeof(MeshFileHeader), 1, f) == 1 &&
+              pad(f, sizeof(MeshFileHeader), header->vertexOffset) &&
+              fwrite(vertices, 1, (size_t) header->vertexSize, f) == header->vertexSize &&
+              pad(f, header->vertexOffset + header->vertexSize, header->indexOffset) &&
+              fwrite(indices, 1, (size_t) header->indexSize, f) == header->indexSize;
+
+    return fclose(f) == 0 && ok;
+}
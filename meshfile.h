@@ -0,0 +1,97 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include "vertexformat.h"
+#include "mapfile.h"
+
+// ----------------------------------------------------
+// MESH FILES
+//
+// Meshes as the GPU takes them: a header describing the
+// vertex format, bounds and levels of detail, then the
+// packed vertices and the indices, each starting on 64
+// bytes. Opening one maps it and checks the header; the
+// vertices and indices point into the mapping and go to
+// glBufferSubData as they are, without a copy or a
+// conversion on the way.
+//
+// Files are little endian, as the hosts are. The levels
+// of detail are ranges of the indices, from the full mesh
+// down, all over the same vertices.
+//
+
+#define MESH_FILE_EXTENSION ".g33m"
+#define MESH_FILE_MAGIC 0x4d333347      // "G33M"
+#define MESH_FILE_VERSION 1
+#define MESH_FILE_ALIGNMENT 64
+#define MESH_FILE_MAX_LODS 8
+
+struct MeshFileAttrib {
+    unsigned int semantic;
+    unsigned int type;
+    unsigned int components;
+};
+
+struct MeshFileLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error;                // in world units, 0 for the full mesh
+    unsigned int reserved;
+};
+
+struct MeshFileHeader {
+    unsigned int magic;
+    unsigned int version;
+
+    // the vertex format
+    unsigned int stride;
+    unsigned int attribCount;
+    MeshFileAttrib attribs[VERTEX_MAX_ATTRIBS];
+    float positionCenter[3];
+    float positionExtent[3];
+
+    unsigned int vertexCount;
+    unsigned int indexCount;
+    unsigned int indexType;     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    unsigned int lodCount;
+    MeshFileLod lods[MESH_FILE_MAX_LODS];
+
+    // as culling takes them
+    float center[3];
+    float extents[3];
+    float radius;
+    unsigned int reserved;
+
+    // in bytes from the start of the file
+    unsigned long long vertexOffset;
+    unsigned long long vertexSize;
+    unsigned long long indexOffset;
+    unsigned long long indexSize;
+};
+
+struct MeshFile {
+    MappedFile map;
+    const MeshFileHeader *header;
+    VertexFormat format;
+
+    // in the mapping
+    const void *vertices;
+    const void *indices;
+};
+
+// prints why when the file cannot be used
+bool meshFileOpen(MeshFile *file, const char *path);
+void meshFileClose(MeshFile *file);
+
+// the checks of meshFileOpen, for a header read from
+// elsewhere, of a file of fileSize bytes; rebuilds format
+bool meshFileCheckHeader(const MeshFileHeader *h, unsigned long long fileSize, VertexFormat *format, const char *path);
+
+// the format fields of a header to write
+void meshFileSetFormat(MeshFileHeader *header, const VertexFormat *fmt);
+
+// header gives the format, counts, levels and bounds, the
+// rest is filled in; false when the file cannot be written
+bool meshFileWrite(const char *path, MeshFileHeader *header, const void *vertices, const void *indices);
+
+#endif
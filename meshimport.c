@@ -0,0 +1,1076 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meshimport.h"
+#include "mapfile.h"
+#include "jobs.h"
+
+static const float defaultColor[4] = { 0.5f, 0.5f, 0.5f, 1.0f };
+
+// ----------------------------------------------------
+// NUMBERS
+//
+
+static const double powersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+static inline bool isDigit(char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+static inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// The digits are gathered in an integer, then scaled once
+// by an exact power of 10: correctly rounded to double for
+// up to 15 digits, so to float for all that matter.
+const char *importParseFloat(const char *p, const char *end, float *value) {
+
+    while (p < end && isBlank(*p))
+        p++;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    // 18 digits fit, the next ones only move the exponent
+    const unsigned long long limit = 100000000000000000ull;
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    bool digits = false;
+
+    for (; p < end && isDigit(*p); ++p, digits = true) {
+        if (mantissa < limit)
+            mantissa = mantissa * 10 + (*p - '0');
+        else
+            exponent++;
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && isDigit(*p); ++p, digits = true) {
+            if (mantissa < limit) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+        }
+    }
+    if (!digits)
+        return NULL;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negativeExponent = *q++ == '-';
+        if (q < end && isDigit(*q)) {
+            int e = 0;
+            for (; q < end && isDigit(*q); ++q)
+                if (e < 10000)
+                    e = e * 10 + (*q - '0');
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    double v = (double) mantissa;
+    if (exponent < 0)
+        v = exponent >= -22 ? v / powersOf10[-exponent] : v * pow(10.0, exponent);
+    else if (exponent > 0)
+        v = exponent <= 22 ? v * powersOf10[exponent] : v * pow(10.0, exponent);
+
+    *value = (float)(negative ? -v : v);
+    return p;
+}
+
+static const char *parseInt(const char *p, const char *end, long long *value) {
+
+    while (p < end && isBlank(*p))
+        p++;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p == end || !isDigit(*p))
+        return NULL;
+
+    long long v = 0;
+    for (; p < end && isDigit(*p); ++p)
+        if (v < (1ll << 40))
+            v = v * 10 + (*p - '0');
+
+    *value = negative ? -v : v;
+    return p;
+}
+
+// ----------------------------------------------------
+// PLY HEADERS
+//
+
+enum PlyType {
+    PLY_NONE,
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64
+};
+
+enum PlyFormat {
+    PLY_ASCII,
+    PLY_LITTLE_ENDIAN,
+    PLY_BIG_ENDIAN
+};
+
+#define PLY_MAX_PROPERTIES 32
+#define PLY_MAX_ELEMENTS 16
+#define PLY_MAX_NAME 32
+
+struct PlyProperty {
+    char name[PLY_MAX_NAME];
+    PlyType type;           // of the values of a list
+    PlyType countType;      // PLY_NONE when not a list
+};
+
+struct PlyElement {
+    char name[PLY_MAX_NAME];
+    long long count;
+    PlyProperty properties[PLY_MAX_PROPERTIES];
+    int propertyCount;
+};
+
+struct PlyHeader {
+    PlyFormat format;
+    PlyElement elements[PLY_MAX_ELEMENTS];
+    int elementCount;
+    size_t size;            // of the header, where data starts
+};
+
+static const struct {
+    const char *name;
+    PlyType type;
+} plyTypeNames[] = {
+    { "char", PLY_INT8 }, { "int8", PLY_INT8 },
+    { "uchar", PLY_UINT8 }, { "uint8", PLY_UINT8 },
+    { "short", PLY_INT16 }, { "int16", PLY_INT16 },
+    { "ushort", PLY_UINT16 }, { "uint16", PLY_UINT16 },
+    { "int", PLY_INT32 }, { "int32", PLY_INT32 },
+    { "uint", PLY_UINT32 }, { "uint32", PLY_UINT32 },
+    { "float", PLY_FLOAT32 }, { "float32", PLY_FLOAT32 },
+    { "double", PLY_FLOAT64 }, { "float64", PLY_FLOAT64 } };
+
+static PlyType plyType(const char *name) {
+
+    for (size_t i = 0; i < sizeof(plyTypeNames) / sizeof(plyTypeNames[0]); ++i)
+        if (strcmp(plyTypeNames[i].name, name) == 0)
+            return plyTypeNames[i].type;
+    return PLY_NONE;
+}
+
+static size_t plyTypeSize(PlyType type) {
+
+    static const size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+    return sizes[type];
+}
+
+// the next word of the line, false at its end
+static bool nextWord(const char **p, const char *end, char *word) {
+
+    const char *s = *p;
+    while (s < end && isBlank(*s))
+        s++;
+    if (s == end)
+        return false;
+
+    int n = 0;
+    while (s < end && !isBlank(*s)) {
+        if (n < PLY_MAX_NAME - 1)
+            word[n++] = *s;
+        s++;
+    }
+    word[n] = 0;
+    *p = s;
+    return true;
+}
+
+static bool parsePlyHeader(PlyHeader *h, const char *text, size_t size) {
+
+    const char *end = text + size;
+    const char *p = text;
+    char word[PLY_MAX_NAME];
+    bool magic = false, format = false;
+
+    memset(h, 0, sizeof(PlyHeader));
+
+    while (p < end) {
+        const char *eol = (const char *) memchr(p, '\n', end - p);
+        if (!eol)
+            return false;
+        const char *line = p;
+        p = eol + 1;
+
+        if (!nextWord(&line, eol, word))
+            continue;
+        if (!magic) {
+            if (strcmp(word, "ply") != 0)
+                return false;
+            magic = true;
+        } else if (strcmp(word, "format") == 0) {
+            if (!nextWord(&line, eol, word))
+                return false;
+            if (strcmp(word, "ascii") == 0)
+                h->format = PLY_ASCII;
+            else if (strcmp(word, "binary_little_endian") == 0)
+                h->format = PLY_LITTLE_ENDIAN;
+            else if (strcmp(word, "binary_big_endian") == 0)
+                h->format = PLY_BIG_ENDIAN;
+            else
+                return false;
+            format = true;
+        } else if (strcmp(word, "element") == 0) {
+            if (h->elementCount == PLY_MAX_ELEMENTS)
+                return false;
+            PlyElement *e = &h->elements[h->elementCount++];
+            long long count;
+            if (!nextWord(&line, eol, e->name) || !parseInt(line, eol, &count) || count < 0)
+                return false;
+            e->count = count;
+        } else if (strcmp(word, "property") == 0) {
+            if (h->elementCount == 0)
+                return false;
+            PlyElement *e = &h->elements[h->elementCount - 1];
+            if (e->propertyCount == PLY_MAX_PROPERTIES)
+                return false;
+            PlyProperty *prop = &e->properties[e->propertyCount++];
+            if (!nextWord(&line, eol, word))
+                return false;
+            if (strcmp(word, "list") == 0) {
+                if (!nextWord(&line, eol, word) || (prop->countType = plyType(word)) == PLY_NONE)
+                    return false;
+                if (!nextWord(&line, eol, word))
+                    return false;
+            }
+            if ((prop->type = plyType(word)) == PLY_NONE || !nextWord(&line, eol, prop->name))
+                return false;
+        } else if (strcmp(word, "end_header") == 0) {
+            h->size = p - text;
+            return format;
+        }
+        // comment and obj_info lines are skipped
+    }
+    return false;
+}
+
+static int plyFind(const PlyElement *e, const char *name) {
+
+    for (int i = 0; i < e->propertyCount; ++i)
+        if (strcmp(e->properties[i].name, name) == 0)
+            return i;
+    return -1;
+}
+
+// where the vertex element keeps what is imported
+struct PlyVertexLayout {
+    int property[7];        // x, y, z, red, green, blue, alpha
+    double range[7];        // of integer colors, 1 for floats
+};
+
+static void plyVertexLayout(PlyVertexLayout *layout, const PlyElement *e) {
+
+    static const char *names[7] = { "x", "y", "z", "red", "green", "blue", "alpha" };
+    for (int k = 0; k < 7; ++k) {
+        layout->property[k] = plyFind(e, names[k]);
+        layout->range[k] = 1.0;
+        if (k >= 3 && layout->property[k] >= 0) {
+            PlyType type = e->properties[layout->property[k]].type;
+            if (type == PLY_UINT8 || type == PLY_INT8)
+                layout->range[k] = 255.0;
+            else if (type == PLY_UINT16 || type == PLY_INT16)
+                layout->range[k] = 65535.0;
+        }
+    }
+}
+
+static void plyVertex(float *position, float *color, const PlyVertexLayout *layout, const double *values) {
+
+    for (int k = 0; k < 3; ++k)
+        position[k] = layout->property[k] >= 0 ? (float) values[layout->property[k]] : 0.0f;
+    position[3] = 1.0f;
+    for (int k = 0; k < 4; ++k) {
+        int property = layout->property[3 + k];
+        color[k] = property >= 0 ? (float)(values[property] / layout->range[3 + k]) : defaultColor[k];
+    }
+}
+
+static int plyFaceIndices(const PlyElement *e) {
+
+    int i = plyFind(e, "vertex_indices");
+    if (i < 0)
+        i = plyFind(e, "vertex_index");
+    return i >= 0 && e->properties[i].countType != PLY_NONE ? i : -1;
+}
+
+// ----------------------------------------------------
+// TEXT CHUNKS
+//
+
+struct ImportChunk {
+    float *positions;
+    float *colors;
+    int vertexCount;
+    int vertexCapacity;
+
+    unsigned int *indices;
+    int indexCount;
+    int indexCapacity;
+
+    // indices counted from the chunk's first vertex
+    int *relative;
+    int relativeCount;
+    int relativeCapacity;
+
+    const char *error;      // the line that could not be read
+};
+
+struct ImportPass;
+typedef void (*ImportLineFunc)(ImportChunk *chunk, const ImportPass *pass, const char *p, const char *end);
+
+struct ImportPass {
+    const char *text;
+    size_t begin;
+    size_t end;
+    int chunkCount;
+    ImportChunk *chunks;
+
+    ImportLineFunc parseLine;
+    const PlyElement *element;
+    PlyVertexLayout layout;
+    int faceIndices;
+};
+
+static void addVertex(ImportChunk *c, const float *position, const float *color) {
+
+    if (c->vertexCount == c->vertexCapacity) {
+        c->vertexCapacity = c->vertexCapacity ? c->vertexCapacity * 2 : 4096;
+        c->positions = (float *) realloc(c->positions, c->vertexCapacity * 4 * sizeof(float));
+        c->colors = (float *) realloc(c->colors, c->vertexCapacity * 4 * sizeof(float));
+    }
+    memcpy(c->positions + c->vertexCount * 4, position, 4 * sizeof(float));
+    memcpy(c->colors + c->vertexCount * 4, color, 4 * sizeof(float));
+    c->vertexCount++;
+}
+
+// a face corner: an absolute index, or a relative one
+struct ImportCorner {
+    unsigned int index;
+    bool relative;
+};
+
+static void addIndex(ImportChunk *c, ImportCorner corner) {
+
+    if (c->indexCount == c->indexCapacity) {
+        c->indexCapacity = c->indexCapacity ? c->indexCapacity * 2 : 16384;
+        c->indices = (unsigned int *) realloc(c->indices, c->indexCapacity * sizeof(unsigned int));
+    }
+    if (corner.relative) {
+        if (c->relativeCount == c->relativeCapacity) {
+            c->relativeCapacity = c->relativeCapacity ? c->relativeCapacity * 2 : 1024;
+            c->relative = (int *) realloc(c->relative, c->relativeCapacity * sizeof(int));
+        }
+        c->relative[c->relativeCount++] = c->indexCount;
+    }
+    c->indices[c->indexCount++] = corner.index;
+}
+
+// polygons as fans around their first corner
+static void addCorner(ImportChunk *c, ImportCorner *fan, int n, ImportCorner corner) {
+
+    if (n >= 2) {
+        addIndex(c, fan[0]);
+        addIndex(c, fan[1]);
+        addIndex(c, corner);
+    }
+    if (n == 0)
+        fan[0] = corner;
+    else
+        fan[1] = corner;
+}
+
+// where chunk k starts, at the start of a line
+static size_t chunkStart(const ImportPass *pass, int k) {
+
+    if (k == 0)
+        return pass->begin;
+    size_t x = pass->begin + (size_t) k * IMPORT_CHUNK_SIZE;
+    if (x >= pass->end)
+        return pass->end;
+    const char *nl = (const char *) memchr(pass->text + x - 1, '\n', pass->end - (x - 1));
+    return nl ? nl + 1 - pass->text : pass->end;
+}
+
+static void parseChunks(void *ctx, int begin, int end) {
+
+    ImportPass *pass = (ImportPass *) ctx;
+
+    for (int k = begin; k < end; ++k) {
+        ImportChunk *c = &pass->chunks[k];
+        const char *p = pass->text + chunkStart(pass, k);
+        const char *stop = pass->text + chunkStart(pass, k + 1);
+
+        while (p < stop && !c->error) {
+            const char *eol = (const char *) memchr(p, '\n', stop - p);
+            if (!eol)
+                eol = stop;
+            pass->parseLine(c, pass, p, eol);
+            p = eol + 1;
+        }
+    }
+}
+
+static void runPass(ImportPass *pass) {
+
+    size_t size = pass->end - pass->begin;
+    pass->chunkCount = (int)(size / IMPORT_CHUNK_SIZE) + 1;
+    pass->chunks = (ImportChunk *) calloc(pass->chunkCount, sizeof(ImportChunk));
+    parallelFor(pass->chunkCount, 1, parseChunks, pass);
+}
+
+// ----------------------------------------------------
+// MERGING
+//
+
+struct ImportMerge {
+    ImportedMesh *mesh;
+    const ImportChunk *chunks;
+    int *vertexBase;
+    int *indexBase;
+};
+
+static void mergeChunks(void *ctx, int begin, int end) {
+
+    ImportMerge *merge = (ImportMerge *) ctx;
+    ImportedMesh *mesh = merge->mesh;
+
+    for (int k = begin; k < end; ++k) {
+        const ImportChunk *c = &merge->chunks[k];
+        int vertexBase = merge->vertexBase[k];
+        unsigned int *indices = mesh->indices + merge->indexBase[k];
+
+        memcpy(mesh->positions + vertexBase * 4, c->positions, c->vertexCount * 4 * sizeof(float));
+        memcpy(mesh->colors + vertexBase * 4, c->colors, c->vertexCount * 4 * sizeof(float));
+        memcpy(indices, c->indices, c->indexCount * sizeof(unsigned int));
+
+        // they may reach back into earlier chunks, the sum wraps
+        for (int r = 0; r < c->relativeCount; ++r)
+            indices[c->relative[r]] += vertexBase;
+    }
+}
+
+static void freeChunks(ImportPass *pass) {
+
+    for (int k = 0; k < pass->chunkCount; ++k) {
+        free(pass->chunks[k].positions);
+        free(pass->chunks[k].colors);
+        free(pass->chunks[k].indices);
+        free(pass->chunks[k].relative);
+    }
+    free(pass->chunks);
+    pass->chunks = NULL;
+}
+
+static void growMesh(ImportedMesh *mesh, int vertexCount, int indexCount) {
+
+    mesh->positions = (float *) realloc(mesh->positions, (size_t)(mesh->vertexCount + vertexCount) * 4 * sizeof(float));
+    mesh->colors = (float *) realloc(mesh->colors, (size_t)(mesh->vertexCount + vertexCount) * 4 * sizeof(float));
+    mesh->indices = (unsigned int *) realloc(mesh->indices, (size_t)(mesh->indexCount + indexCount) * sizeof(unsigned int));
+}
+
+// appends the chunks to the mesh, in order
+static bool mergePass(ImportedMesh *mesh, ImportPass *pass) {
+
+    for (int k = 0; k < pass->chunkCount; ++k) {
+        const char *error = pass->chunks[k].error;
+        if (error) {
+            const char *eol = (const char *) memchr(error, '\n', pass->text + pass->end - error);
+            int length = (int)((eol ? eol : pass->text + pass->end) - error);
+            printf("mesh import: cannot read \"%.*s\"\n", length > 60 ? 60 : length, error);
+            freeChunks(pass);
+            return false;
+        }
+    }
+
+    ImportMerge merge;
+    merge.mesh = mesh;
+    merge.chunks = pass->chunks;
+    merge.vertexBase = (int *) malloc(pass->chunkCount * sizeof(int));
+    merge.indexBase = (int *) malloc(pass->chunkCount * sizeof(int));
+
+    long long vertices = 0, indices = 0;
+    for (int k = 0; k < pass->chunkCount; ++k) {
+        merge.vertexBase[k] = mesh->vertexCount + (int) vertices;
+        merge.indexBase[k] = mesh->indexCount + (int) indices;
+        vertices += pass->chunks[k].vertexCount;
+        indices += pass->chunks[k].indexCount;
+    }
+
+    bool fits = mesh->vertexCount + vertices < (1ll << 31) && mesh->indexCount + indices < (1ll << 31);
+    if (fits) {
+        growMesh(mesh, (int) vertices, (int) indices);
+        parallelFor(pass->chunkCount, 1, mergeChunks, &merge);
+        mesh->vertexCount += (int) vertices;
+        mesh->indexCount += (int) indices;
+    } else
+        printf("mesh import: too many vertices\n");
+
+    free(merge.vertexBase);
+    free(merge.indexBase);
+    freeChunks(pass);
+    return fits;
+}
+
+// counts the indices out of the vertices, by block
+struct ImportCheck {
+    const ImportedMesh *mesh;
+    int *bad;
+};
+
+#define CHECK_BLOCK (1 << 20)
+
+static void checkIndices(void *ctx, int begin, int end) {
+
+    ImportCheck *check = (ImportCheck *) ctx;
+    int bad = 0;
+    for (int i = begin; i < end; ++i)
+        bad += check->mesh->indices[i] >= (unsigned int) check->mesh->vertexCount;
+    check->bad[begin / CHECK_BLOCK] = bad;
+}
+
+static bool checkMesh(const ImportedMesh *mesh) {
+
+    int blocks = mesh->indexCount / CHECK_BLOCK + 1;
+    ImportCheck check = { mesh, (int *) calloc(blocks, sizeof(int)) };
+    parallelFor(mesh->indexCount, CHECK_BLOCK, checkIndices, &check);
+
+    int bad = 0;
+    for (int b = 0; b < blocks; ++b)
+        bad += check.bad[b];
+    free(check.bad);
+
+    if (bad)
+        printf("mesh import: %d indices out of the %d vertices\n", bad, mesh->vertexCount);
+    return bad == 0;
+}
+
+// ----------------------------------------------------
+// OBJ
+//
+
+static void parseObjLine(ImportChunk *c, const ImportPass *pass, const char *p, const char *end) {
+
+    (void) pass;
+    const char *line = p;
+    while (p < end && isBlank(*p))
+        p++;
+    if (end - p < 2 || !isBlank(p[1]))
+        return;
+
+    if (p[0] == 'v') {
+        float v[6], position[4], color[4];
+        int n = 0;
+        for (p++; n < 6; ++n) {
+            const char *q = importParseFloat(p, end, &v[n]);
+            if (!q)
+                break;
+            p = q;
+        }
+        if (n < 3) {
+            c->error = line;
+            return;
+        }
+        position[0] = v[0];
+        position[1] = v[1];
+        position[2] = v[2];
+        position[3] = 1.0f;
+        if (n == 6) {
+            color[0] = v[3];
+            color[1] = v[4];
+            color[2] = v[5];
+            color[3] = 1.0f;
+        } else
+            memcpy(color, defaultColor, sizeof(color));
+        addVertex(c, position, color);
+
+    } else if (p[0] == 'f') {
+        ImportCorner fan[2];
+        int n = 0;
+        for (p++; ; ++n) {
+            long long index;
+            const char *q = parseInt(p, end, &index);
+            if (!q)
+                break;
+            // texture coordinate and normal indices
+            while (q < end && !isBlank(*q))
+                q++;
+            p = q;
+
+            ImportCorner corner;
+            if (index > 0) {
+                corner.index = (unsigned int)(index - 1);
+                corner.relative = false;
+            } else if (index < 0) {
+                corner.index = (unsigned int)(c->vertexCount + index);
+                corner.relative = true;
+            } else {
+                c->error = line;
+                return;
+            }
+            addCorner(c, fan, n, corner);
+        }
+        if (n < 3)
+            c->error = line;
+    }
+}
+
+bool meshImportObj(ImportedMesh *mesh, const char *text, size_t size) {
+
+    memset(mesh, 0, sizeof(ImportedMesh));
+
+    ImportPass pass;
+    memset(&pass, 0, sizeof(pass));
+    pass.text = text;
+    pass.end = size;
+    pass.parseLine = parseObjLine;
+    runPass(&pass);
+
+    if (!mergePass(mesh, &pass) || !checkMesh(mesh)) {
+        importedMeshFree(mesh);
+        return false;
+    }
+    return true;
+}
+
+// ----------------------------------------------------
+// ASCII PLY
+//
+
+static void parsePlyVertexLine(ImportChunk *c, const ImportPass *pass, const char *p, const char *end) {
+
+    const PlyElement *e = pass->element;
+    const char *line = p;
+    double values[PLY_MAX_PROPERTIES];
+    float value, position[4], color[4];
+
+    for (int i = 0; i < e->propertyCount; ++i) {
+        int count = 1;
+        if (e->properties[i].countType != PLY_NONE) {
+            if (!(p = importParseFloat(p, end, &value)))
+                break;
+            count = (int) value;
+        }
+        for (int k = 0; k < count && p; ++k)
+            p = importParseFloat(p, end, &value);
+        if (!p)
+            break;
+        values[i] = value;
+    }
+    if (!p) {
+        c->error = line;
+        return;
+    }
+
+    plyVertex(position, color, &pass->layout, values);
+    addVertex(c, position, color);
+}
+
+static void parsePlyFaceLine(ImportChunk *c, const ImportPass *pass, const char *p, const char *end) {
+
+    const PlyElement *e = pass->element;
+    const char *line = p;
+    long long value;
+
+    for (int i = 0; i < e->propertyCount && p; ++i) {
+        if (e->properties[i].countType == PLY_NONE) {
+            float skipped;
+            p = importParseFloat(p, end, &skipped);
+            continue;
+        }
+        if (!(p = parseInt(p, end, &value)))
+            break;
+
+        long long count = value;
+        ImportCorner fan[2];
+        for (int k = 0; k < count && p; ++k) {
+            if (!(p = parseInt(p, end, &value)))
+                break;
+            if (i == pass->faceIndices) {
+                ImportCorner corner = { (unsigned int) value, false };
+                addCorner(c, fan, k, corner);
+            }
+        }
+    }
+    if (!p)
+        c->error = line;
+}
+
+// past the next count lines, NULL if there are fewer
+static const char *skipLines(const char *p, const char *end, long long count) {
+
+    for (long long i = 0; i < count; ++i) {
+        if (p >= end)
+            return NULL;
+        const char *nl = (const char *) memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+    }
+    return p;
+}
+
+static bool importPlyAscii(ImportedMesh *mesh, const PlyHeader *h, const char *text, size_t size) {
+
+    const char *p = text + h->size;
+    const char *end = text + size;
+
+    for (int i = 0; i < h->elementCount; ++i) {
+        const PlyElement *e = &h->elements[i];
+        const char *next = skipLines(p, end, e->count);
+        if (!next) {
+            printf("mesh import: the file ends in the %s\n", e->name);
+            return false;
+        }
+
+        ImportPass pass;
+        memset(&pass, 0, sizeof(pass));
+        pass.text = text;
+        pass.begin = p - text;
+        pass.end = next - text;
+        pass.element = e;
+
+        if (strcmp(e->name, "vertex") == 0) {
+            plyVertexLayout(&pass.layout, e);
+            pass.parseLine = parsePlyVertexLine;
+        } else if (strcmp(e->name, "face") == 0) {
+            pass.faceIndices = plyFaceIndices(e);
+            pass.parseLine = parsePlyFaceLine;
+        }
+
+        if (pass.parseLine) {
+            runPass(&pass);
+            if (!mergePass(mesh, &pass))
+                return false;
+        }
+        p = next;
+    }
+    return true;
+}
+
+// ----------------------------------------------------
+// BINARY PLY
+//
+
+static double plyRead(const unsigned char *p, PlyType type, bool swap) {
+
+    unsigned char b[8];
+    size_t n = plyTypeSize(type);
+    for (size_t i = 0; i < n; ++i)
+        b[i] = swap ? p[n - 1 - i] : p[i];
+
+    switch (type) {
+    case PLY_INT8:    return (signed char) b[0];
+    case PLY_UINT8:   return b[0];
+    case PLY_INT16:   { short v; memcpy(&v, b, 2); return v; }
+    case PLY_UINT16:  { unsigned short v; memcpy(&v, b, 2); return v; }
+    case PLY_INT32:   { int v; memcpy(&v, b, 4); return v; }
+    case PLY_UINT32:  { unsigned int v; memcpy(&v, b, 4); return v; }
+    case PLY_FLOAT32: { float v; memcpy(&v, b, 4); return v; }
+    case PLY_FLOAT64: { double v; memcpy(&v, b, 8); return v; }
+    default:          return 0.0;
+    }
+}
+
+// the size of one record at p, 0 when it runs past end
+static size_t plyRecordSize(const PlyElement *e, const unsigned char *p, const unsigned char *end, bool swap) {
+
+    size_t size = 0;
+    for (int i = 0; i < e->propertyCount; ++i) {
+        const PlyProperty *prop = &e->properties[i];
+        if (prop->countType == PLY_NONE) {
+            size += plyTypeSize(prop->type);
+            continue;
+        }
+        size_t countSize = plyTypeSize(prop->countType);
+        if (p + size + countSize > end)
+            return 0;
+        double count = plyRead(p + size, prop->countType, swap);
+        if (count < 0)
+            return 0;
+        size += countSize + (size_t) count * plyTypeSize(prop->type);
+    }
+    return p + size <= end ? size : 0;
+}
+
+static bool plyFixedSize(const PlyElement *e) {
+
+    for (int i = 0; i < e->propertyCount; ++i)
+        if (e->properties[i].countType != PLY_NONE)
+            return false;
+    return true;
+}
+
+struct PlyVertexJob {
+    ImportedMesh *mesh;
+    const PlyElement *element;
+    PlyVertexLayout layout;
+    const unsigned char *data;
+    size_t stride;
+    size_t offsets[PLY_MAX_PROPERTIES];
+    int base;
+    bool swap;
+};
+
+static void decodePlyVertices(void *ctx, int begin, int end) {
+
+    PlyVertexJob *job = (PlyVertexJob *) ctx;
+    const PlyElement *e = job->element;
+    double values[PLY_MAX_PROPERTIES];
+
+    for (int v = begin; v < end; ++v) {
+        const unsigned char *record = job->data + (size_t) v * job->stride;
+        for (int i = 0; i < e->propertyCount; ++i)
+            values[i] = plyRead(record + job->offsets[i], e->properties[i].type, job->swap);
+        int index = job->base + v;
+        plyVertex(job->mesh->positions + index * 4, job->mesh->colors + index * 4, &job->layout, values);
+    }
+}
+
+#define PLY_FACE_BLOCK 4096
+
+struct PlyFaceJob {
+    ImportedMesh *mesh;
+    const PlyElement *element;
+    int faceIndices;
+    long long faces;
+    const unsigned char **blockStart;
+    int *blockBase;
+    bool swap;
+};
+
+// the faces of the blocks, as fans
+static void decodePlyFaces(void *ctx, int begin, int end) {
+
+    PlyFaceJob *job = (PlyFaceJob *) ctx;
+    const PlyElement *e = job->element;
+
+    for (int b = begin; b < end; ++b) {
+        const unsigned char *p = job->blockStart[b];
+        unsigned int *out = job->mesh->indices + job->blockBase[b];
+        long long last = (long long)(b + 1) * PLY_FACE_BLOCK;
+        if (last > job->faces)
+            last = job->faces;
+
+        for (long long f = (long long) b * PLY_FACE_BLOCK; f < last; ++f) {
+            for (int i = 0; i < e->propertyCount; ++i) {
+                const PlyProperty *prop = &e->properties[i];
+                if (prop->countType == PLY_NONE) {
+                    p += plyTypeSize(prop->type);
+                    continue;
+                }
+                int count = (int) plyRead(p, prop->countType, job->swap);
+                size_t size = plyTypeSize(prop->type);
+                p += plyTypeSize(prop->countType);
+                if (i == job->faceIndices) {
+                    unsigned int first = (unsigned int) plyRead(p, prop->type, job->swap);
+                    for (int k = 2; k < count; ++k) {
+                        out[0] = first;
+                        out[1] = (unsigned int) plyRead(p + (k - 1) * size, prop->type, job->swap);
+                        out[2] = (unsigned int) plyRead(p + k * size, prop->type, job->swap);
+                        out += 3;
+                    }
+                }
+                p += count * size;
+            }
+        }
+    }
+}
+
+static bool importPlyBinary(ImportedMesh *mesh, const PlyHeader *h, const unsigned char *data, size_t size) {
+
+    const unsigned char *p = data + h->size;
+    const unsigned char *end = data + size;
+
+    // the hosts are little endian
+    bool swap = h->format == PLY_BIG_ENDIAN;
+
+    for (int i = 0; i < h->elementCount; ++i) {
+        const PlyElement *e = &h->elements[i];
+
+        if (strcmp(e->name, "vertex") == 0) {
+            if (!plyFixedSize(e) || e->count >= (1ll << 31) - mesh->vertexCount) {
+                printf("mesh import: cannot read the vertices\n");
+                return false;
+            }
+            PlyVertexJob job;
+            job.mesh = mesh;
+            job.element = e;
+            job.data = p;
+            job.stride = 0;
+            job.base = mesh->vertexCount;
+            job.swap = swap;
+            for (int k = 0; k < e->propertyCount; ++k) {
+                job.offsets[k] = job.stride;
+                job.stride += plyTypeSize(e->properties[k].type);
+            }
+            if ((size_t)(end - p) / (job.stride ? job.stride : 1) < (size_t) e->count) {
+                printf("mesh import: the file ends in the vertices\n");
+                return false;
+            }
+            plyVertexLayout(&job.layout, e);
+
+            growMesh(mesh, (int) e->count, 0);
+            parallelFor((int) e->count, 65536, decodePlyVertices, &job);
+            mesh->vertexCount += (int) e->count;
+            p += job.stride * e->count;
+            continue;
+        }
+
+        if (strcmp(e->name, "face") == 0) {
+            // where each block of faces starts and its first index
+            int blocks = (int)((e->count + PLY_FACE_BLOCK - 1) / PLY_FACE_BLOCK);
+            PlyFaceJob job;
+            job.mesh = mesh;
+            job.element = e;
+            job.faceIndices = plyFaceIndices(e);
+            job.faces = e->count;
+            job.blockStart = (const unsigned char **) malloc((blocks + 1) * sizeof(unsigned char *));
+            job.blockBase = (int *) malloc((blocks + 1) * sizeof(int));
+            job.swap = swap;
+
+            long long indices = 0;
+            bool ok = true;
+            for (long long f = 0; f < e->count && ok; ++f) {
+                if (f % PLY_FACE_BLOCK == 0) {
+                    job.blockStart[f / PLY_FACE_BLOCK] = p;
+                    job.blockBase[f / PLY_FACE_BLOCK] = mesh->indexCount + (int) indices;
+                }
+                size_t record = plyRecordSize(e, p, end, swap);
+                if (record == 0) {
+                    ok = false;
+                    break;
+                }
+                if (job.faceIndices >= 0) {
+                    size_t offset = 0;
+                    for (int k = 0; k < job.faceIndices; ++k)
+                        offset += e->properties[k].countType == PLY_NONE ? plyTypeSize(e->properties[k].type) :
+                            plyTypeSize(e->properties[k].countType) +
+                            (size_t) plyRead(p + offset, e->properties[k].countType, swap) * plyTypeSize(e->properties[k].type);
+                    int count = (int) plyRead(p + offset, e->properties[job.faceIndices].countType, swap);
+                    if (count > 2)
+                        indices += (count - 2) * 3;
+                }
+                ok = mesh->indexCount + indices < (1ll << 31);
+                p += record;
+            }
+
+            if (ok) {
+                growMesh(mesh, 0, (int) indices);
+                parallelFor(blocks, 1, decodePlyFaces, &job);
+                mesh->indexCount += (int) indices;
+            } else
+                printf("mesh import: cannot read the faces\n");
+
+            free(job.blockStart);
+            free(job.blockBase);
+            if (!ok)
+                return false;
+            continue;
+        }
+
+        // other elements are skipped
+        if (plyFixedSize(e)) {
+            size_t record = plyRecordSize(e, p, end, swap);
+            if ((size_t)(end - p) / (record ? record : 1) < (size_t) e->count) {
+                printf("mesh import: the file ends in the %s\n", e->name);
+                return false;
+            }
+            p += record * e->count;
+        } else {
+            for (long long k = 0; k < e->count; ++k) {
+                size_t record = plyRecordSize(e, p, end, swap);
+                if (record == 0) {
+                    printf("mesh import: the file ends in the %s\n", e->name);
+                    return false;
+                }
+                p += record;
+            }
+        }
+    }
+    return true;
+}
+
+bool meshImportPly(ImportedMesh *mesh, const unsigned char *data, size_t size) {
+
+    PlyHeader h;
+
+    memset(mesh, 0, sizeof(ImportedMesh));
+    if (!parsePlyHeader(&h, (const char *) data, size)) {
+        printf("mesh import: not a PLY file\n");
+        return false;
+    }
+
+    bool ok = h.format == PLY_ASCII ? importPlyAscii(mesh, &h, (const char *) data, size) :
+                                      importPlyBinary(mesh, &h, data, size);
+    if (!ok || !checkMesh(mesh)) {
+        importedMeshFree(mesh);
+        return false;
+    }
+    return true;
+}
+
+// ----------------------------------------------------
+// FILES
+//
+
+static bool hasExtension(const char *path, const char *extension) {
+
+    size_t n = strlen(path), e = strlen(extension);
+    if (n < e)
+        return false;
+    for (size_t i = 0; i < e; ++i) {
+        char c = path[n - e + i];
+        if ((c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c) != extension[i])
+            return false;
+    }
+    return true;
+}
+
+bool meshImport(ImportedMesh *mesh, const char *path) {
+
+    MappedFile mf;
+
+    memset(mesh, 0, sizeof(ImportedMesh));
+    bool obj = hasExtension(path, ".obj");
+    if (!obj && !hasExtension(path, ".ply")) {
+        printf("mesh import: %s is neither .obj nor .ply\n", path);
+        return false;
+    }
+    if (!mappedFileOpen(&mf, path)) {
+        printf("mesh import: cannot open %s\n", path);
+        return false;
+    }
+
+    bool ok = obj ? meshImportObj(mesh, (const char *) mf.data, mf.size) :
+                    meshImportPly(mesh, mf.data, mf.size);
+    mappedFileClose(&mf);
+    return ok;
+}
+
+void importedMeshFree(ImportedMesh *mesh) {
+
+    free(mesh->positions);
+    free(mesh->colors);
+    free(mesh->indices);
+    memset(mesh, 0, sizeof(ImportedMesh));
+}
@@ -0,0 +1,52 @@
+#ifndef MESHIMPORT_H
+#define MESHIMPORT_H
+
+#include <stddef.h>
+
+// ----------------------------------------------------
+// MESH IMPORT
+//
+// Wavefront OBJ, and PLY in ascii or binary of either
+// endianness, read from a mapped file into the 4 floats
+// per position and color that setupMesh packs.
+//
+// Text is cut into chunks of whole lines, parsed by all
+// the threads into vertices and indices of their own,
+// then merged in order; OBJ indices relative to the last
+// vertex are made absolute then. Numbers are read by a
+// parser of their own, strtod and sscanf being far too
+// slow. Binary PLY vertices have a fixed size and are
+// decoded in place; faces are found by a quick pass over
+// their vertex counts, then decoded in blocks.
+//
+// Polygons become fans of triangles. OBJ vertices may
+// have a color after their position, as many exporters
+// write; texture coordinates and normals are skipped.
+//
+
+#define IMPORT_CHUNK_SIZE (1 << 20)
+
+struct ImportedMesh {
+    float *positions;       // 4 floats a vertex, w is 1
+    float *colors;          // 4 floats a vertex, gray if none
+    int vertexCount;
+
+    unsigned int *indices;  // triangle list
+    int indexCount;
+};
+
+// by the extension of path, prints why when it fails
+bool meshImport(ImportedMesh *mesh, const char *path);
+
+// the same from memory
+bool meshImportObj(ImportedMesh *mesh, const char *text, size_t size);
+bool meshImportPly(ImportedMesh *mesh, const unsigned char *data, size_t size);
+
+void importedMeshFree(ImportedMesh *mesh);
+
+// the number parser, which stops at the first character
+// that is not part of the number and returns where, or
+// NULL when there is no number at text
+const char *importParseFloat(const char *text, const char *end, float *value);
+
+#endif
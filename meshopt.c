@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meshopt.h"
+#include "vertexformat.h"
+
+// ----------------------------------------------------
+// WELDING
+//
+
+static unsigned int hashVertex(const unsigned char *v, size_t stride) {
+
+    // FNV-1a
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < stride; ++i)
+        h = (h ^ v[i]) * 16777619u;
+    return h;
+}
+
+int meshWeld(const void *vertices, int count, size_t stride, void *welded, unsigned int *indices) {
+
+    const unsigned char *in = (const unsigned char *) vertices;
+    unsigned char *out = (unsigned char *) welded;
+
+    // open addressing, at most half full
+    unsigned int size = 16;
+    while (size < (unsigned int) count * 2)
+        size *= 2;
+    unsigned int *table = (unsigned int *) malloc(size * sizeof(unsigned int));
+    memset(table, 0xff, size * sizeof(unsigned int));
+
+    int unique = 0;
+    for (int i = 0; i < count; ++i) {
+        const unsigned char *v = in + i * stride;
+        unsigned int slot = hashVertex(v, stride) & (size - 1);
+
+        while (table[slot] != ~0u && memcmp(out + table[slot] * stride, v, stride) != 0)
+            slot = (slot + 1) & (size - 1);
+
+        if (table[slot] == ~0u) {
+            memcpy(out + unique * stride, v, stride);
+            table[slot] = unique++;
+        }
+        indices[i] = table[slot];
+    }
+
+    free(table);
+    return unique;
+}
+
+// ----------------------------------------------------
+// TRIANGLE ORDER
+//
+
+static float vertexScore(int cachePos, int live) {
+
+    // no triangle left to draw with it
+    if (live == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePos >= 0) {
+        // the last triangle's vertices, whichever comes next
+        // uses them anyway, so they are not favoured more
+        if (cachePos < 3)
+            score = 0.75f;
+        else
+            score = powf(1.0f - (cachePos - 3) * (1.0f / (MESH_CACHE_SIZE - 3)), 1.5f);
+    }
+
+    // finishing off a vertex frees its place in the cache
+    return score + 2.0f / sqrtf((float) live);
+}
+
+void meshOptimizeCache(unsigned int *indices, int indexCount, int vertexCount) {
+
+    int triCount = indexCount / 3;
+    if (triCount == 0)
+        return;
+
+    int *live = (int *) calloc(vertexCount, sizeof(int));
+    int *offsets = (int *) malloc((vertexCount + 1) * sizeof(int));
+    int *adjacency = (int *) malloc(triCount * 3 * sizeof(int));
+    int *cachePos = (int *) malloc(vertexCount * sizeof(int));
+    float *score = (float *) malloc(vertexCount * sizeof(float));
+    bool *emitted = (bool *) calloc(triCount, sizeof(bool));
+    unsigned int *out = (unsigned int *) malloc(triCount * 3 * sizeof(unsigned int));
+
+    // the triangles of each vertex
+    for (int i = 0; i < triCount * 3; ++i)
+        live[indices[i]]++;
+    offsets[0] = 0;
+    for (int v = 0; v < vertexCount; ++v) {
+        offsets[v + 1] = offsets[v] + live[v];
+        cachePos[v] = offsets[v];
+    }
+    for (int i = 0; i < triCount * 3; ++i)
+        adjacency[cachePos[indices[i]]++] = i / 3;
+
+    for (int v = 0; v < vertexCount; ++v) {
+        cachePos[v] = -1;
+        score[v] = vertexScore(-1, live[v]);
+    }
+
+    int cache[MESH_CACHE_SIZE + 3];
+    int cacheCount = 0;
+    int best = -1;
+    int cursor = 0;
+
+    for (int n = 0; n < triCount; ++n) {
+
+        // nothing in the cache has triangles left, the next
+        // one not drawn yet starts again
+        if (best < 0) {
+            while (emitted[cursor])
+                cursor++;
+            best = cursor;
+        }
+
+        const unsigned int *tri = indices + best * 3;
+        memcpy(out + n * 3, tri, 3 * sizeof(unsigned int));
+        emitted[best] = true;
+
+        // its vertices go to the front of the cache
+        int newCache[MESH_CACHE_SIZE + 3];
+        int newCount = 0;
+        for (int k = 0; k < 3; ++k) {
+            int v = tri[k];
+            int *adj = adjacency + offsets[v];
+            for (int j = 0; j < live[v]; ++j)
+                if (adj[j] == best) {
+                    adj[j] = adj[live[v] - 1];
+                    break;
+                }
+            live[v]--;
+
+            bool seen = false;
+            for (int j = 0; j < newCount; ++j)
+                seen |= newCache[j] == v;
+            if (!seen)
+                newCache[newCount++] = v;
+        }
+        for (int i = 0; i < cacheCount; ++i) {
+            int v = cache[i];
+            if (v != (int) tri[0] && v != (int) tri[1] && v != (int) tri[2])
+                newCache[newCount++] = v;
+        }
+
+        // those pushed out score as not cached
+        for (int i = 0; i < newCount; ++i) {
+            int v = newCache[i];
+            cachePos[v] = i < MESH_CACHE_SIZE ? i : -1;
+            score[v] = vertexScore(cachePos[v], live[v]);
+        }
+
+        // the best triangle using the cache
+        best = -1;
+        float bestScore = -1.0f;
+        for (int i = 0; i < newCount && i < MESH_CACHE_SIZE; ++i) {
+            int v = newCache[i];
+            for (int j = 0; j < live[v]; ++j) {
+                int t = adjacency[offsets[v] + j];
+                const unsigned int *u = indices + t * 3;
+                float s = score[u[0]] + score[u[1]] + score[u[2]];
+                if (s > bestScore) {
+                    bestScore = s;
+                    best = t;
+                }
+            }
+        }
+
+        cacheCount = newCount < MESH_CACHE_SIZE ? newCount : MESH_CACHE_SIZE;
+        memcpy(cache, newCache, cacheCount * sizeof(int));
+    }
+
+    memcpy(indices, out, triCount * 3 * sizeof(unsigned int));
+
+    free(live);
+    free(offsets);
+    free(adjacency);
+    free(cachePos);
+    free(score);
+    free(emitted);
+    free(out);
+}
+
+// ----------------------------------------------------
+// VERTEX ORDER
+//
+
+int meshOptimizeFetch(void *vertices, int vertexCount, size_t stride, unsigned int *indices, int indexCount) {
+
+    unsigned int *remap = (unsigned int *) malloc(vertexCount * sizeof(unsigned int));
+    memset(remap, 0xff, vertexCount * sizeof(unsigned int));
+
+    int used = 0;
+    for (int i = 0; i < indexCount; ++i) {
+        unsigned int v = indices[i];
+        if (remap[v] == ~0u)
+            remap[v] = used++;
+        indices[i] = remap[v];
+    }
+
+    unsigned char *in = (unsigned char *) vertices;
+    unsigned char *copy = (unsigned char *) malloc(used * stride);
+    for (int v = 0; v < vertexCount; ++v)
+        if (remap[v] != ~0u)
+            memcpy(copy + remap[v] * stride, in + v * stride, stride);
+    memcpy(in, copy, used * stride);
+
+    free(copy);
+    free(remap);
+    return used;
+}
+
+// ----------------------------------------------------
+// MEASURE
+//
+
+float meshAcmr(const unsigned int *indices, int indexCount, int vertexCount, int cacheSize) {
+
+    if (indexCount < 3)
+        return 0.0f;
+
+    // when each vertex last entered the cache, counted in
+    // misses: a FIFO holds the cacheSize last ones
+    unsigned int *stamp = (unsigned int *) calloc(vertexCount, sizeof(unsigned int));
+    unsigned int misses = 0;
+
+    for (int i = 0; i < indexCount; ++i) {
+        unsigned int v = indices[i];
+        if (stamp[v] == 0 || misses - stamp[v] >= (unsigned int) cacheSize)
+            stamp[v] = ++misses;
+    }
+
+    free(stamp);
+    return (float) misses / (indexCount / 3);
+}
+
+// ----------------------------------------------------
+// MESHES
+//
+
+void indexedMeshBuild(IndexedMesh *mesh, const void *vertices, int count, size_t stride) {
+
+    mesh->stride = stride;
+    mesh->vertices = (unsigned char *) malloc(count * stride);
+    mesh->indices = (unsigned int *) malloc(count * sizeof(unsigned int));
+    mesh->indexCount = count;
+    mesh->vertexCount = meshWeld(vertices, count, stride, mesh->vertices, mesh->indices);
+    mesh->vertices = (unsigned char *) realloc(mesh->vertices, mesh->vertexCount * stride);
+}
+
+void indexedMeshFree(IndexedMesh *mesh) {
+
+    free(mesh->vertices);
+    free(mesh->indices);
+    memset(mesh, 0, sizeof(IndexedMesh));
+}
+
+void indexedMeshOptimize(IndexedMesh *mesh, MeshOptStats *stats) {
+
+    stats->indices = mesh->indexCount;
+    stats->acmrBefore = meshAcmr(mesh->indices, mesh->indexCount, mesh->vertexCount, MESH_ACMR_CACHE_SIZE);
+
+    meshOptimizeCache(mesh->indices, mesh->indexCount, mesh->vertexCount);
+    mesh->vertexCount = meshOptimizeFetch(mesh->vertices, mesh->vertexCount, mesh->stride,
+                                          mesh->indices, mesh->indexCount);
+
+    stats->vertices = mesh->vertexCount;
+    stats->acmrAfter = meshAcmr(mesh->indices, mesh->indexCount, mesh->vertexCount, MESH_ACMR_CACHE_SIZE);
+}
+
+// ----------------------------------------------------
+// CHECK
+//
+
+int meshOptCheck() {
+
+    const int side = 64;
+    const int count = side * side * 6;
+    int failures = 0;
+
+    // a grid of quads as a triangle soup, in rows
+    float *soup = (float *) malloc(count * 3 * sizeof(float));
+    for (int q = 0; q < side * side; ++q) {
+        const int corners[6][2] = { {0,0}, {1,0}, {1,1}, {0,0}, {1,1}, {0,1} };
+        for (int c = 0; c < 6; ++c) {
+            float *v = soup + (q * 6 + c) * 3;
+            v[0] = (float)(q % side + corners[c][0]);
+            v[1] = 0.0f;
+            v[2] = (float)(q / side + corners[c][1]);
+        }
+    }
+
+    VertexFormat fmt;
+    vertexFormatScene(&fmt);
+    VertexSource src;
+    vertexSourceInit(&src, count);
+    vertexSourceSet(&src, VERTEX_POSITION, soup, 3);
+
+    // bytes differing from vertex to vertex, as the padding
+    // would hold if the packer left it
+    size_t size = (size_t) count * fmt.stride;
+    unsigned char *packed = (unsigned char *) malloc(size);
+    for (size_t i = 0; i < size; ++i)
+        packed[i] = (unsigned char)(i * 131 + 7);
+    vertexFormatPack(&fmt, &src, packed);
+
+    IndexedMesh mesh;
+    MeshOptStats stats;
+    indexedMeshBuild(&mesh, packed, count, fmt.stride);
+    indexedMeshOptimize(&mesh, &stats);
+
+    if (stats.vertices != (side + 1) * (side + 1)) {
+        printf("meshOptCheck: the grid welds to %d vertices, not %d\n", stats.vertices, (side + 1) * (side + 1));
+        ++failures;
+    }
+    if (stats.acmrAfter >= stats.acmrBefore) {
+        printf("meshOptCheck: ACMR %.3f after the optimization, %.3f before\n", stats.acmrAfter, stats.acmrBefore);
+        ++failures;
+    }
+
+    indexedMeshFree(&mesh);
+    free(packed);
+    free(soup);
+    return failures;
+}
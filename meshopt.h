@@ -0,0 +1,71 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <stddef.h>
+
+// ----------------------------------------------------
+// INDEXED MESHES
+//
+// Packed vertices that are byte for byte the same are
+// welded into one, the mesh becoming unique vertices and
+// indices into them. For triangle lists the indices are
+// then reordered for the post-transform vertex cache,
+// with Forsyth's linear speed algorithm: the triangle
+// emitted next is the one whose vertices score best, a
+// score rising for vertices recently used and for those
+// few triangles still need. Last the vertices are
+// reordered in the order the indices first use them, so
+// fetching them walks through memory.
+//
+// The cache is measured as the ACMR, the average cache
+// miss ratio: vertices transformed per triangle, from 0.5
+// for a large regular grid to 3 with no reuse at all.
+//
+
+// the size of the cache the triangle order is made for
+#define MESH_CACHE_SIZE 32
+
+// the FIFO cache of the hardware the ACMR is measured on
+#define MESH_ACMR_CACHE_SIZE 16
+
+struct IndexedMesh {
+    unsigned char *vertices;
+    int vertexCount;
+    size_t stride;
+
+    unsigned int *indices;
+    int indexCount;
+};
+
+struct MeshOptStats {
+    int indices;
+    int vertices;       // unique and used, after the optimization
+    float acmrBefore;
+    float acmrAfter;
+};
+
+// welds count packed vertices of stride bytes
+void indexedMeshBuild(IndexedMesh *mesh, const void *vertices, int count, size_t stride);
+void indexedMeshFree(IndexedMesh *mesh);
+
+// reorders the triangles, then the vertices, of a mesh
+// of triangle lists
+void indexedMeshOptimize(IndexedMesh *mesh, MeshOptStats *stats);
+
+// the steps, writes to welded and indices count entries
+// at most, returns the number of unique vertices
+int meshWeld(const void *vertices, int count, size_t stride, void *welded, unsigned int *indices);
+
+void meshOptimizeCache(unsigned int *indices, int indexCount, int vertexCount);
+
+// rewrites the indices as well, returns the number of
+// vertices used, which are moved to the start
+int meshOptimizeFetch(void *vertices, int vertexCount, size_t stride, unsigned int *indices, int indexCount);
+
+float meshAcmr(const unsigned int *indices, int indexCount, int vertexCount, int cacheSize);
+
+// welds and optimizes a packed grid, returns the number of
+// results that are not what a grid gives
+int meshOptCheck();
+
+#endif
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+#include "pack.h"
+#include "lz4.h"
+#include "jobs.h"
+
+// ----------------------------------------------------
+// READING
+//
+
+static bool fail(PackFile *pack, const char *path, const char *why) {
+
+    printf("%s: %s\n", path, why);
+    packClose(pack);
+    return false;
+}
+
+static bool inFile(const PackFile *pack, unsigned long long offset, unsigned long long size) {
+
+    return offset % 8 == 0 && offset <= pack->map.size && size <= pack->map.size - offset;
+}
+
+bool packOpen(PackFile *pack, const char *path) {
+
+    memset(pack, 0, sizeof(PackFile));
+    if (!mappedFileOpen(&pack->map, path)) {
+        printf("%s: cannot open\n", path);
+        return false;
+    }
+
+    const PackHeader *h = (const PackHeader *) pack->map.data;
+    if (pack->map.size < sizeof(PackHeader) || h->magic != PACK_MAGIC)
+        return fail(pack, path, "not a pack");
+    if (h->version != PACK_VERSION)
+        return fail(pack, path, "unknown version");
+    if (h->chunkSize == 0 || h->chunkSize > (1u << 30))
+        return fail(pack, path, "bad chunk size");
+    if (!inFile(pack, h->entryOffset, (unsigned long long) h->entryCount * sizeof(PackEntry)) ||
+        !inFile(pack, h->chunkOffset, (unsigned long long) h->chunkCount * sizeof(PackChunk)) ||
+        !inFile(pack, h->stringOffset, h->stringSize) ||
+        h->stringSize == 0 || pack->map.data[h->stringOffset + h->stringSize - 1] != 0)
+        return fail(pack, path, "truncated");
+
+    pack->entries = (const PackEntry *)(pack->map.data + h->entryOffset);
+    pack->chunks = (const PackChunk *)(pack->map.data + h->chunkOffset);
+    pack->strings = (const char *)(pack->map.data + h->stringOffset);
+
+    // so reading needs no checks but the chunks' content
+    for (unsigned int i = 0; i < h->entryCount; ++i) {
+        const PackEntry *e = &pack->entries[i];
+        if (e->name >= h->stringSize || e->firstChunk > h->chunkCount || e->chunkCount > h->chunkCount - e->firstChunk ||
+            e->chunkCount != (e->size + h->chunkSize - 1) / h->chunkSize)
+            return fail(pack, path, "bad entry");
+    }
+    for (unsigned int i = 0; i < h->chunkCount; ++i) {
+        const PackChunk *c = &pack->chunks[i];
+        if (c->size > h->chunkSize || c->offset > pack->map.size || c->size > pack->map.size - c->offset)
+            return fail(pack, path, "bad chunk");
+    }
+
+    pack->header = h;
+    return true;
+}
+
+void packClose(PackFile *pack) {
+
+    mappedFileClose(&pack->map);
+    memset(pack, 0, sizeof(PackFile));
+}
+
+const PackEntry *packFind(const PackFile *pack, const char *name) {
+
+    if (!pack->header)
+        return NULL;
+
+    int lo = 0, hi = (int) pack->header->entryCount;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int c = strcmp(pack->strings + pack->entries[mid].name, name);
+        if (c == 0)
+            return &pack->entries[mid];
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+const char *packName(const PackFile *pack, const PackEntry *entry) {
+
+    return pack->strings + entry->name;
+}
+
+struct ReadJob {
+    const PackFile *pack;
+    const PackEntry *entry;
+    unsigned long long offset;
+    unsigned long long end;
+    unsigned char *dst;
+    unsigned int first;             // chunk of the entry at offset
+    std::atomic<bool> corrupt;
+};
+
+static void readChunks(void *ctx, int begin, int end) {
+
+    ReadJob *job = (ReadJob *) ctx;
+    unsigned long long chunkSize = job->pack->header->chunkSize;
+    unsigned char *scratch = NULL;
+
+    for (int i = begin; i < end; ++i) {
+        unsigned int k = job->first + i;
+        const PackChunk *c = &job->pack->chunks[job->entry->firstChunk + k];
+        const unsigned char *data = job->pack->map.data + c->offset;
+
+        // the chunk and the part of it wanted
+        unsigned long long start = k * chunkSize;
+        unsigned long long rawSize = job->entry->size - start < chunkSize ? job->entry->size - start : chunkSize;
+        unsigned long long from = job->offset > start ? job->offset - start : 0;
+        unsigned long long to = job->end < start + rawSize ? job->end - start : rawSize;
+        unsigned char *out = job->dst + (start + from - job->offset);
+
+        if (c->size == rawSize) {
+            memcpy(out, data + from, (size_t)(to - from));
+            continue;
+        }
+        if (!scratch)
+            scratch = (unsigned char *) malloc((size_t) chunkSize);
+        if (lz4Decompress(data, c->size, scratch, (int) rawSize) != (int) rawSize) {
+            job->corrupt = true;
+            continue;
+        }
+        memcpy(out, scratch + from, (size_t)(to - from));
+    }
+    free(scratch);
+}
+
+bool packRead(const PackFile *pack, const PackEntry *entry, unsigned long long offset, size_t size, void *dst) {
+
+    ReadJob job;
+
+    if (offset > entry->size || size > entry->size - offset)
+        return false;
+    if (size == 0)
+        return true;
+
+    unsigned long long chunkSize = pack->header->chunkSize;
+    job.pack = pack;
+    job.entry = entry;
+    job.offset = offset;
+    job.end = offset + size;
+    job.dst = (unsigned char *) dst;
+    job.first = (unsigned int)(offset / chunkSize);
+    job.corrupt = false;
+
+    int count = (int)((job.end - 1) / chunkSize - job.first + 1);
+    parallelFor(count, PACK_CHUNKS_PER_JOB, readChunks, &job);
+    return !job.corrupt;
+}
+
+// ----------------------------------------------------
+// WRITING
+//
+// Chunks are compressed in batches on all the threads,
+// then written in order, so memory stays a batch worth.
+//
+
+#define PACK_WRITE_BATCH 256
+
+struct WriteChunk {
+    const unsigned char *data;
+    int rawSize;
+    unsigned char *compressed;      // lz4Bound of the chunk size
+    int size;
+};
+
+static void compressChunks(void *ctx, int begin, int end) {
+
+    WriteChunk *chunks = (WriteChunk *) ctx;
+    for (int i = begin; i < end; ++i) {
+        WriteChunk *c = &chunks[i];
+        c->size = lz4Compress(c->data, c->rawSize, c->compressed, c->rawSize - 1);
+        if (c->size == 0)
+            c->size = c->rawSize;
+    }
+}
+
+static int compareItems(const void *a, const void *b) {
+
+    return strcmp(((const PackItem *) a)->name, ((const PackItem *) b)->name);
+}
+
+static unsigned long long aligned(unsigned long long offset) {
+
+    return (offset + 7) / 8 * 8;
+}
+
+bool packWrite(const char *path, PackItem *items, int count) {
+
+    PackHeader header;
+    WriteChunk batch[PACK_WRITE_BATCH];
+
+    qsort(items, count, sizeof(PackItem), compareItems);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = PACK_MAGIC;
+    header.version = PACK_VERSION;
+    header.chunkSize = PACK_CHUNK_SIZE;
+    header.entryCount = count;
+
+    PackEntry *entries = (PackEntry *) calloc(count > 0 ? count : 1, sizeof(PackEntry));
+    unsigned long long stringSize = 0;
+    for (int i = 0; i < count; ++i) {
+        PackEntry *e = &entries[i];
+        e->name = (unsigned int) stringSize;
+        e->firstChunk = header.chunkCount;
+        e->chunkCount = (unsigned int)((items[i].size + PACK_CHUNK_SIZE - 1) / PACK_CHUNK_SIZE);
+        e->size = items[i].size;
+        header.chunkCount += e->chunkCount;
+        stringSize += strlen(items[i].name) + 1;
+    }
+    stringSize += stringSize == 0;
+
+    header.entryOffset = sizeof(PackHeader);
+    header.chunkOffset = header.entryOffset + (unsigned long long) count * sizeof(PackEntry);
+    header.stringOffset = header.chunkOffset + (unsigned long long) header.chunkCount * sizeof(PackChunk);
+    header.stringSize = stringSize;
+
+    char *strings = (char *) calloc((size_t) stringSize, 1);
+    for (int i = 0; i < count; ++i)
+        strcpy(strings + entries[i].name, items[i].name);
+
+    PackChunk *chunks = (PackChunk *) calloc(header.chunkCount > 0 ? header.chunkCount : 1, sizeof(PackChunk));
+    for (int i = 0; i < PACK_WRITE_BATCH; ++i)
+        batch[i].compressed = (unsigned char *) malloc(lz4Bound(PACK_CHUNK_SIZE));
+
+    FILE *f = fopen(path, "wb");
+    bool ok = f != NULL;
+
+    // the chunks first, their table is known after
+    unsigned long long offset = aligned(header.stringOffset + stringSize);
+    if (ok)
+        ok = fseek(f, (long) offset, SEEK_SET) == 0;
+
+    int item = 0;
+    unsigned long long itemOffset = 0;
+    unsigned int chunk = 0;
+    while (ok && chunk < header.chunkCount) {
+        int n = 0;
+        for (; n < PACK_WRITE_BATCH && chunk + n < header.chunkCount; ++n) {
+            while (itemOffset == items[item].size) {
+                ++item;
+                itemOffset = 0;
+            }
+            unsigned long long left = items[item].size - itemOffset;
+            batch[n].data = (const unsigned char *) items[item].data + itemOffset;
+            batch[n].rawSize = (int)(left < PACK_CHUNK_SIZE ? left : PACK_CHUNK_SIZE);
+            itemOffset += batch[n].rawSize;
+        }
+        parallelFor(n, 1, compressChunks, batch);
+
+        for (int i = 0; ok && i < n; ++i, ++chunk) {
+            const void *data = batch[i].size == batch[i].rawSize ? batch[i].data : batch[i].compressed;
+            chunks[chunk].offset = offset;
+            chunks[chunk].size = batch[i].size;
+            ok = fwrite(data, 1, batch[i].size, f) == (size_t) batch[i].size;
+            offset += batch[i].size;
+        }
+    }
+
+    if (ok)
+        ok = fseek(f, 0, SEEK_SET) == 0 &&
+             fwrite(&header, sizeof(header), 1, f) == 1 &&
+             fwrite(entries, sizeof(PackEntry), count, f) == (size_t) count &&
+             fwrite(chunks, sizeof(PackChunk), header.chunkCount, f) == header.chunkCount &&
+             fwrite(strings, 1, (size_t) stringSize, f) == stringSize;
+    if (f)
+        ok = fclose(f) == 0 && ok;
+
+    for (int i = 0; i < PACK_WRITE_BATCH; ++i)
+        free(batch[i].compressed);
+    free(chunks);
+    free(strings);
+    free(entries);
+    return ok;
+}
@@ -0,0 +1,100 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stddef.h>
+
+#include "mapfile.h"
+
+// ----------------------------------------------------
+// PACK FILES
+//
+// Many files in one, cut into chunks of 256 KB each
+// compressed on its own with LZ4, or stored when it does
+// not compress. A header, the entries sorted by name, the
+// chunk table and the names come first, the chunks after.
+//
+// Reading maps the pack, so the OS reads ahead while the
+// threads decompress: every thread takes a few chunks at
+// a time, decompresses each into a buffer of its own that
+// stays in its cache, then copies the part wanted to the
+// destination. LZ4 reads back what it writes, which must
+// not happen in a mapped GL buffer, uncached and write
+// combined; the copy out of the cache is one sequential
+// write there, and any range of an entry can be read, the
+// chunks at its ends copied only in part.
+//
+
+#define PACK_FILE_EXTENSION ".g33p"
+#define PACK_MAGIC 0x50333347           // "G33P"
+#define PACK_VERSION 1
+#define PACK_CHUNK_SIZE (256 << 10)
+
+// what cook -p writes next to the manifest, holding the
+// cooked files by their name
+#define PACK_FILE_NAME "assets" PACK_FILE_EXTENSION
+
+// chunks one thread takes at a time
+#define PACK_CHUNKS_PER_JOB 4
+
+struct PackHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int chunkSize;
+    unsigned int entryCount;
+    unsigned int chunkCount;
+    unsigned int reserved;
+
+    // in bytes from the start of the file
+    unsigned long long entryOffset;
+    unsigned long long chunkOffset;
+    unsigned long long stringOffset;
+    unsigned long long stringSize;
+};
+
+struct PackEntry {
+    unsigned int name;                  // offset in the strings
+    unsigned int firstChunk;
+    unsigned int chunkCount;
+    unsigned int reserved;
+    unsigned long long size;            // uncompressed
+};
+
+struct PackChunk {
+    unsigned long long offset;
+    unsigned int size;                  // stored when it is the chunk's own
+    unsigned int reserved;
+};
+
+struct PackFile {
+    MappedFile map;
+    const PackHeader *header;
+    const PackEntry *entries;
+    const PackChunk *chunks;
+    const char *strings;
+};
+
+// prints why when the file cannot be used
+bool packOpen(PackFile *pack, const char *path);
+void packClose(PackFile *pack);
+
+// NULL when there is no entry of that name
+const PackEntry *packFind(const PackFile *pack, const char *name);
+
+const char *packName(const PackFile *pack, const PackEntry *entry);
+
+// size bytes of the entry from offset to dst, on all the
+// threads; false when out of the entry or a chunk does not
+// decompress, there being no checksums
+bool packRead(const PackFile *pack, const PackEntry *entry, unsigned long long offset, size_t size, void *dst);
+
+struct PackItem {
+    const char *name;
+    const void *data;
+    size_t size;
+};
+
+// compresses on all the threads, sorts the items; false
+// when the file cannot be written
+bool packWrite(const char *path, PackItem *items, int count);
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#endif
+
+#include "programcache.h"
+#include "hash.h"
+#include "mapfile.h"
+
+static unsigned long long hashString(const char *s, unsigned long long seed) {
+
+    return hash64(s ? s : "", s ? strlen(s) : 0, seed);
+}
+
+void programCacheInit(ProgramCache *cache, const char *dir) {
+
+    memset(cache, 0, sizeof(ProgramCache));
+    snprintf(cache->dir, sizeof(cache->dir), "%s", dir);
+
+    GLint formats = 0;
+    if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    cache->supported = formats > 0;
+
+    cache->driver = hashString((const char *) glGetString(GL_VENDOR), PROGRAM_CACHE_VERSION);
+    cache->driver = hashString((const char *) glGetString(GL_RENDERER), cache->driver);
+    cache->driver = hashString((const char *) glGetString(GL_VERSION), cache->driver);
+
+    if (cache->supported) {
+#if defined(_WIN32)
+        _mkdir(dir);
+#else
+        mkdir(dir, 0777);
+#endif
+    }
+}
+
+unsigned long long programCacheKey(const ProgramCache *cache, const char *const *parts, int count) {
+
+    // the length of each too, so parts cannot run together
+    unsigned long long key = cache->driver;
+    for (int i = 0; i < count; ++i) {
+        unsigned long long length = parts[i] ? strlen(parts[i]) : 0;
+        key = hash64(&length, sizeof(length), key);
+        key = hashString(parts[i], key);
+    }
+    return key;
+}
+
+static void cachePath(const ProgramCache *cache, unsigned long long key, char *path, size_t size) {
+
+    snprintf(path, size, "%s/%016llx%s", cache->dir, key, PROGRAM_CACHE_EXTENSION);
+}
+
+GLuint programCacheLoad(ProgramCache *cache, unsigned long long key) {
+
+    MappedFile map;
+    char path[512];
+
+    if (!cache->supported)
+        return 0;
+    cachePath(cache, key, path, sizeof(path));
+    if (!mappedFileOpen(&map, path))
+        return 0;
+
+    const ProgramCacheHeader *h = (const ProgramCacheHeader *) map.data;
+    GLint linked = GL_FALSE;
+    GLuint program = 0;
+    if (map.size >= sizeof(ProgramCacheHeader) && h->magic == PROGRAM_CACHE_MAGIC &&
+        h->version == PROGRAM_CACHE_VERSION && h->key == key && h->driver == cache->driver &&
+        h->size == map.size - sizeof(ProgramCacheHeader)) {
+        program = glCreateProgram();
+        glProgramBinary(program, h->format, map.data + sizeof(ProgramCacheHeader), h->size);
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    }
+    mappedFileClose(&map);
+
+    if (linked != GL_TRUE) {
+        if (program)
+            glDeleteProgram(program);
+        remove(path);
+        ++cache->rejected;
+        return 0;
+    }
+    ++cache->loaded;
+    return program;
+}
+
+void programCacheHint(const ProgramCache *cache, GLuint program) {
+
+    if (cache->supported)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool programCacheStore(ProgramCache *cache, unsigned long long key, GLuint program) {
+
+    ProgramCacheHeader header;
+    char path[512], temporary[520];
+
+    if (!cache->supported)
+        return false;
+
+    GLint size = 0, linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (linked != GL_TRUE || size <= 0)
+        return false;
+
+    void *binary = malloc(size);
+    GLenum format = 0;
+    GLsizei length = 0;
+    glGetProgramBinary(program, size, &length, &format, binary);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = PROGRAM_CACHE_MAGIC;
+    header.version = PROGRAM_CACHE_VERSION;
+    header.format = format;
+    header.size = length;
+    header.key = key;
+    header.driver = cache->driver;
+
+    cachePath(cache, key, path, sizeof(path));
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE *f = length > 0 ? fopen(temporary, "wb") : NULL;
+    bool ok = false;
+    if (f) {
+        ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(binary, 1, length, f) == (size_t) length;
+        ok = commitFile(temporary, path, fclose(f) == 0 && ok);
+    }
+    free(binary);
+
+    if (ok)
+        ++cache->stored;
+    return ok;
+}
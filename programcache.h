@@ -0,0 +1,62 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <GL/glew.h>
+
+// ----------------------------------------------------
+// PROGRAM BINARY CACHE
+//
+// Linked programs saved with glGetProgramBinary and given
+// back to the driver with glProgramBinary the next time,
+// skipping the compile and link. A program is found by a
+// key hashing its sources, defines and whatever else the
+// caller puts in, and the vendor, renderer and version
+// strings of the driver, so a driver update misses
+// rather than loads binaries the new driver rejects.
+//
+// Drivers may still reject a binary; it is then removed
+// and the program built from source as if it was never
+// cached. Each program is one file in the cache directory,
+// written aside then renamed.
+//
+
+#define PROGRAM_CACHE_DIR "programs"
+#define PROGRAM_CACHE_EXTENSION ".g33b"
+#define PROGRAM_CACHE_MAGIC 0x42333347      // "G33B"
+#define PROGRAM_CACHE_VERSION 1
+
+struct ProgramCacheHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int format;                    // the driver's binary format
+    unsigned int size;
+    unsigned long long key;
+    unsigned long long driver;
+};
+
+struct ProgramCache {
+    char dir[256];
+    bool supported;                         // with a binary format at least
+    unsigned long long driver;              // hash of the driver strings
+
+    int loaded;
+    int stored;
+    int rejected;
+};
+
+// for the current context, creates dir
+void programCacheInit(ProgramCache *cache, const char *dir);
+
+unsigned long long programCacheKey(const ProgramCache *cache, const char *const *parts, int count);
+
+// a linked program from the binary of key, 0 when there
+// is none or the driver rejects it
+GLuint programCacheLoad(ProgramCache *cache, unsigned long long key);
+
+// before linking a program to store, so its binary is kept
+void programCacheHint(const ProgramCache *cache, GLuint program);
+
+// the binary of a linked program, false when not stored
+bool programCacheStore(ProgramCache *cache, unsigned long long key, GLuint program);
+
+#endif
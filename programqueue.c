@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "programqueue.h"
+#include "glproc.h"
+
+void programQueueInit(ProgramQueue *queue, ProgramCache *cache) {
+
+    memset(queue, 0, sizeof(ProgramQueue));
+    queue->cache = cache;
+
+    // as many compiler threads as the driver likes
+    GlMaxShaderCompilerThreadsProc maxThreads = (GlMaxShaderCompilerThreadsProc)
+        glProcForExtension("glMaxShaderCompilerThreadsKHR", "GL_KHR_parallel_shader_compile");
+    if (!maxThreads)
+        maxThreads = (GlMaxShaderCompilerThreadsProc)
+            glProcForExtension("glMaxShaderCompilerThreadsARB", "GL_ARB_parallel_shader_compile");
+    if (maxThreads) {
+        maxThreads(0xffffffff);
+        queue->parallel = true;
+    }
+}
+
+void programQueueFree(ProgramQueue *queue) {
+
+    for (int i = 0; i < queue->count; ++i)
+        for (int s = 0; s < 2; ++s)
+            if (queue->builds[i].shaders[s])
+                glDeleteShader(queue->builds[i].shaders[s]);
+    free(queue->builds);
+    memset(queue, 0, sizeof(ProgramQueue));
+}
+
+static GLuint compile(GLenum type, const char *source) {
+
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    return shader;
+}
+
+int programQueueSubmit(ProgramQueue *queue, const char *name, const char *vertexSource,
+                       const char *fragmentSource, ProgramSetup setup) {
+
+    if (queue->count == queue->capacity) {
+        queue->capacity = queue->capacity ? queue->capacity * 2 : 16;
+        queue->builds = (ProgramBuild *) realloc(queue->builds, queue->capacity * sizeof(ProgramBuild));
+    }
+    int index = queue->count++;
+    ProgramBuild *b = &queue->builds[index];
+    memset(b, 0, sizeof(ProgramBuild));
+    snprintf(b->name, sizeof(b->name), "%s", name);
+
+    if (queue->cache) {
+        const char *parts[] = { vertexSource, fragmentSource };
+        b->key = programCacheKey(queue->cache, parts, 2);
+        b->program = programCacheLoad(queue->cache, b->key);
+        if (b->program) {
+            b->state = PROGRAM_READY;
+            return index;
+        }
+    }
+
+    b->shaders[0] = compile(GL_VERTEX_SHADER, vertexSource);
+    b->shaders[1] = compile(GL_FRAGMENT_SHADER, fragmentSource);
+    b->program = glCreateProgram();
+    glAttachShader(b->program, b->shaders[0]);
+    glAttachShader(b->program, b->shaders[1]);
+    if (setup)
+        setup(b->program);
+    if (queue->cache)
+        programCacheHint(queue->cache, b->program);
+    glLinkProgram(b->program);
+
+    b->state = PROGRAM_BUILDING;
+    ++queue->building;
+    return index;
+}
+
+static void printLog(const char *name, GLuint object, bool program) {
+
+    GLint length = 0;
+    if (program)
+        glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+    else
+        glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+    if (length <= 1)
+        return;
+
+    char *log = (char *) malloc(length);
+    if (program)
+        glGetProgramInfoLog(object, length, NULL, log);
+    else
+        glGetShaderInfoLog(object, length, NULL, log);
+    printf("%s: %s\n", name, log);
+    free(log);
+}
+
+// the build is done, one way or the other
+static void finish(ProgramQueue *queue, ProgramBuild *b) {
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(b->program, GL_LINK_STATUS, &linked);
+
+    if (linked == GL_TRUE) {
+        b->state = PROGRAM_READY;
+        if (queue->cache)
+            programCacheStore(queue->cache, b->key, b->program);
+    } else {
+        b->state = PROGRAM_FAILED;
+        printLog(b->name, b->shaders[0], false);
+        printLog(b->name, b->shaders[1], false);
+        printLog(b->name, b->program, true);
+        glDeleteProgram(b->program);
+        b->program = 0;
+    }
+
+    // the program keeps them
+    for (int s = 0; s < 2; ++s) {
+        glDeleteShader(b->shaders[s]);
+        b->shaders[s] = 0;
+    }
+    --queue->building;
+}
+
+int programQueuePoll(ProgramQueue *queue) {
+
+    for (int i = 0; i < queue->count && queue->building > 0; ++i) {
+        ProgramBuild *b = &queue->builds[i];
+        if (b->state != PROGRAM_BUILDING)
+            continue;
+        if (queue->parallel) {
+            GLint done = GL_FALSE;
+            glGetProgramiv(b->program, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done)
+                continue;
+        }
+        finish(queue, b);
+    }
+    return queue->building;
+}
+
+void programQueueDelete(ProgramQueue *queue, int build) {
+
+    ProgramBuild *b = &queue->builds[build];
+    if (b->state == PROGRAM_BUILDING)
+        --queue->building;
+    for (int s = 0; s < 2; ++s) {
+        if (b->shaders[s])
+            glDeleteShader(b->shaders[s]);
+        b->shaders[s] = 0;
+    }
+    if (b->program)
+        glDeleteProgram(b->program);
+    b->program = 0;
+    b->state = PROGRAM_FAILED;
+}
+
+void programQueueFinish(ProgramQueue *queue) {
+
+    bool parallel = queue->parallel;
+    queue->parallel = false;
+    programQueuePoll(queue);
+    queue->parallel = parallel;
+}
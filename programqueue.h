@@ -0,0 +1,85 @@
+#ifndef PROGRAMQUEUE_H
+#define PROGRAMQUEUE_H
+
+#include <GL/glew.h>
+
+#include "programcache.h"
+
+// ----------------------------------------------------
+// PROGRAM BUILDS
+//
+// Programs are submitted all at once and built while the
+// renderer goes on. Submitting compiles and links right
+// away, never asking how it went: any query of a shader
+// or program waits for the driver to be done with it, so
+// asking after each would build them one by one.
+//
+// With KHR_parallel_shader_compile, or its ARB twin, the
+// driver builds on threads of its own and polling asks
+// GL_COMPLETION_STATUS, which does not wait, so a program
+// is picked up once done and the time to build them all
+// is that of the slowest. Without it polling waits for
+// the lot, which the driver was at least handed in one go.
+// Logs are only fetched for the builds that failed.
+//
+// Programs found in the program cache are ready at once.
+//
+
+enum ProgramBuildState {
+    PROGRAM_BUILDING,
+    PROGRAM_READY,
+    PROGRAM_FAILED
+};
+
+// called before linking, to bind locations
+typedef void (*ProgramSetup)(GLuint program);
+
+struct ProgramBuild {
+    char name[64];
+    GLuint program;
+    GLuint shaders[2];
+    ProgramBuildState state;
+    unsigned long long key;
+};
+
+struct ProgramQueue {
+    ProgramCache *cache;        // NULL for none
+    bool parallel;              // the driver builds in the background
+
+    ProgramBuild *builds;
+    int count;
+    int capacity;
+    int building;
+};
+
+// for the current context, cache may be NULL
+void programQueueInit(ProgramQueue *queue, ProgramCache *cache);
+
+// the shaders of builds still going, not the programs
+void programQueueFree(ProgramQueue *queue);
+
+// returns the build, the sources are copied by GL
+int programQueueSubmit(ProgramQueue *queue, const char *name, const char *vertexSource,
+                       const char *fragmentSource, ProgramSetup setup);
+
+// picks up the builds done, waiting for none of them when
+// the driver builds in parallel; returns those still going
+int programQueuePoll(ProgramQueue *queue);
+
+// waits for all
+void programQueueFinish(ProgramQueue *queue);
+
+// the program of a build no longer wanted, built or not;
+// the build is then as if it had failed
+void programQueueDelete(ProgramQueue *queue, int build);
+
+inline ProgramBuildState programQueueState(const ProgramQueue *queue, int build) {
+    return queue->builds[build].state;
+}
+
+// 0 until the program is ready
+inline GLuint programQueueProgram(const ProgramQueue *queue, int build) {
+    return queue->builds[build].state == PROGRAM_READY ? queue->builds[build].program : 0;
+}
+
+#endif
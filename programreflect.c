@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "programreflect.h"
+#include "hash.h"
+
+// ----------------------------------------------------
+// NAMES
+//
+
+// ids are indices into names plus one; the buckets hold
+// them by the hash of their name, 0 when empty
+static char **names;
+static unsigned int nameCount, nameCapacity;
+static unsigned int *buckets;
+static unsigned int bucketCount;
+
+static unsigned int bucketOf(const char *name, size_t length) {
+
+    return (unsigned int) hash64(name, length, 0) & (bucketCount - 1);
+}
+
+static unsigned int internName(const char *name, size_t length) {
+
+    if (bucketCount) {
+        for (unsigned int b = bucketOf(name, length); buckets[b]; b = (b + 1) & (bucketCount - 1)) {
+            const char *known = names[buckets[b] - 1];
+            if (strncmp(known, name, length) == 0 && known[length] == 0)
+                return buckets[b];
+        }
+    }
+
+    // half full at most
+    if (2 * (nameCount + 1) > bucketCount) {
+        bucketCount = bucketCount ? bucketCount * 2 : 64;
+        free(buckets);
+        buckets = (unsigned int *) calloc(bucketCount, sizeof(unsigned int));
+        for (unsigned int i = 0; i < nameCount; ++i) {
+            unsigned int b = bucketOf(names[i], strlen(names[i]));
+            while (buckets[b])
+                b = (b + 1) & (bucketCount - 1);
+            buckets[b] = i + 1;
+        }
+    }
+    if (nameCount == nameCapacity) {
+        nameCapacity = nameCapacity ? nameCapacity * 2 : 64;
+        names = (char **) realloc(names, nameCapacity * sizeof(char *));
+    }
+
+    char *copy = (char *) malloc(length + 1);
+    memcpy(copy, name, length);
+    copy[length] = 0;
+    names[nameCount++] = copy;
+
+    unsigned int b = bucketOf(name, length);
+    while (buckets[b])
+        b = (b + 1) & (bucketCount - 1);
+    buckets[b] = nameCount;
+    return nameCount;
+}
+
+unsigned int shaderNameId(const char *name) {
+
+    return internName(name, strlen(name));
+}
+
+// ----------------------------------------------------
+// TABLES
+//
+
+// a multiplier putting each id in a slot of its own, the
+// table growing until one does
+static void buildTable(ReflectTable *table, const ReflectEntry *entries, int count) {
+
+    memset(table, 0, sizeof(ReflectTable));
+    if (count == 0)
+        return;
+
+    int bits = 1;
+    while ((1 << bits) < count)
+        ++bits;
+
+    unsigned int *used = NULL;
+    for (;; ++bits) {
+        int size = 1 << bits;
+        used = (unsigned int *) realloc(used, size * sizeof(unsigned int));
+
+        unsigned int multiplier = 0x9e3779b1u;
+        for (int attempt = 0; attempt < 64; ++attempt, multiplier = multiplier * 1664525u + 1013904223u) {
+            multiplier |= 1;
+            memset(used, 0, size * sizeof(unsigned int));
+            bool collides = false;
+            for (int i = 0; i < count && !collides; ++i) {
+                unsigned int slot = (entries[i].name * multiplier) >> (32 - bits);
+                collides = used[slot] != 0;
+                used[slot] = 1;
+            }
+            if (collides)
+                continue;
+
+            table->slots = (ReflectEntry *) calloc(size, sizeof(ReflectEntry));
+            for (int i = 0; i < count; ++i)
+                table->slots[(entries[i].name * multiplier) >> (32 - bits)] = entries[i];
+            table->multiplier = multiplier;
+            table->bits = bits;
+            table->count = count;
+            free(used);
+            return;
+        }
+    }
+}
+
+// the name as an array is known by, without its [0]
+static unsigned int entryName(const char *name, GLsizei length) {
+
+    if (length > 3 && strcmp(name + length - 3, "[0]") == 0)
+        length -= 3;
+    return internName(name, length);
+}
+
+void programReflect(ProgramReflection *r, GLuint program) {
+
+    GLint count = 0, maxLength = 0;
+    GLsizei length;
+    GLint size;
+    GLenum type;
+
+    memset(r, 0, sizeof(ProgramReflection));
+
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    char *name = (char *) malloc(maxLength + 1);
+    ReflectEntry *entries = (ReflectEntry *) malloc((count + 1) * sizeof(ReflectEntry));
+    int n = 0;
+    for (GLint i = 0; i < count; ++i) {
+        glGetActiveUniform(program, i, maxLength + 1, &length, &size, &type, name);
+        GLint location = glGetUniformLocation(program, name);
+        if (location < 0)
+            continue;
+        entries[n].name = entryName(name, length);
+        entries[n].location = location;
+        entries[n].type = type;
+        entries[n].size = size;
+        ++n;
+    }
+    buildTable(&r->uniforms, entries, n);
+    free(entries);
+    free(name);
+
+    count = maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    name = (char *) malloc(maxLength + 1);
+    entries = (ReflectEntry *) malloc((count + 1) * sizeof(ReflectEntry));
+    n = 0;
+    for (GLint i = 0; i < count; ++i) {
+        glGetActiveAttrib(program, i, maxLength + 1, &length, &size, &type, name);
+        GLint location = glGetAttribLocation(program, name);
+        if (location < 0)
+            continue;   // gl_VertexID and the like
+        entries[n].name = entryName(name, length);
+        entries[n].location = location;
+        entries[n].type = type;
+        entries[n].size = size;
+        ++n;
+    }
+    buildTable(&r->attribs, entries, n);
+    free(entries);
+    free(name);
+}
+
+void programReflectionFree(ProgramReflection *r) {
+
+    free(r->uniforms.slots);
+    free(r->attribs.slots);
+    memset(r, 0, sizeof(ProgramReflection));
+}
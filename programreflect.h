@@ -0,0 +1,71 @@
+#ifndef PROGRAMREFLECT_H
+#define PROGRAMREFLECT_H
+
+#include <GL/glew.h>
+
+// ----------------------------------------------------
+// PROGRAM REFLECTION
+//
+// What a linked program has, asked of the driver once:
+// its active uniforms and attributes with their locations,
+// types and sizes, looked up afterwards without a call to
+// the driver or a string compared.
+//
+// Names are interned into ids, the same for every program
+// for as long as the process runs, so code asks for the id
+// of a name once and keeps it. The uniforms of a program,
+// and its attributes, go into a table of their own with a
+// multiplier picked so no two of their ids land in the
+// same slot: a lookup is a multiply, a shift and a compare.
+//
+// Arrays are known by their name without the [0]. Uniforms
+// in blocks have no location and are left out.
+//
+
+struct ReflectEntry {
+    unsigned int name;      // 0 for an empty slot
+    GLint location;
+    GLenum type;
+    GLint size;             // elements of an array, 1 otherwise
+};
+
+struct ReflectTable {
+    ReflectEntry *slots;
+    unsigned int multiplier;
+    int bits;               // 1 << bits slots
+    int count;
+};
+
+struct ProgramReflection {
+    ReflectTable uniforms;
+    ReflectTable attribs;
+};
+
+// the id of the name, the same each time, never 0; from
+// the GL thread only
+unsigned int shaderNameId(const char *name);
+
+// asks the driver, for a linked program
+void programReflect(ProgramReflection *r, GLuint program);
+void programReflectionFree(ProgramReflection *r);
+
+// NULL when the program does not have it
+inline const ReflectEntry *reflectFind(const ReflectTable *table, unsigned int name) {
+    if (!table->slots)
+        return NULL;
+    const ReflectEntry *e = &table->slots[(name * table->multiplier) >> (32 - table->bits)];
+    return e->name == name ? e : NULL;
+}
+
+// the location, -1 when the program does not have it
+inline GLint reflectUniform(const ProgramReflection *r, unsigned int name) {
+    const ReflectEntry *e = reflectFind(&r->uniforms, name);
+    return e ? e->location : -1;
+}
+
+inline GLint reflectAttrib(const ProgramReflection *r, unsigned int name) {
+    const ReflectEntry *e = reflectFind(&r->attribs, name);
+    return e ? e->location : -1;
+}
+
+#endif
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "quat.h"
+
+// as in mat4.c, no FMA contraction so every kernel set
+// gives the same bits
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
+// closer than this, slerp falls back to nlerp
+#define SLERP_THRESHOLD 0.9995f
+
+// ----------------------------------------------------
+// COMMON
+//
+
+void quatIdentity(float *q) {
+
+    q[0] = q[1] = q[2] = 0.0f;
+    q[3] = 1.0f;
+}
+
+void quatFromAxisAngle(float *q, const float *axis, float degrees) {
+
+    float half = degrees * (float)(3.14159265358979323846 / 360.0);
+    float s = sinf(half);
+
+    q[0] = axis[0] * s;
+    q[1] = axis[1] * s;
+    q[2] = axis[2] * s;
+    q[3] = cosf(half);
+}
+
+// element (row i, column j) is m[j*4 + i]
+void quatFromMatrix(float *q, const float *m) {
+
+    float trace = m[0] + m[5] + m[10];
+
+    if (trace > 0.0f) {
+        float s = sqrtf(trace + 1.0f) * 2.0f;
+        q[3] = 0.25f * s;
+        q[0] = (m[6] - m[9]) / s;
+        q[1] = (m[8] - m[2]) / s;
+        q[2] = (m[1] - m[4]) / s;
+    } else if (m[0] > m[5] && m[0] > m[10]) {
+        float s = sqrtf(1.0f + m[0] - m[5] - m[10]) * 2.0f;
+        q[3] = (m[6] - m[9]) / s;
+        q[0] = 0.25f * s;
+        q[1] = (m[4] + m[1]) / s;
+        q[2] = (m[8] + m[2]) / s;
+    } else if (m[5] > m[10]) {
+        float s = sqrtf(1.0f + m[5] - m[0] - m[10]) * 2.0f;
+        q[3] = (m[8] - m[2]) / s;
+        q[0] = (m[4] + m[1]) / s;
+        q[1] = 0.25f * s;
+        q[2] = (m[9] + m[6]) / s;
+    } else {
+        float s = sqrtf(1.0f + m[10] - m[0] - m[5]) * 2.0f;
+        q[3] = (m[1] - m[4]) / s;
+        q[0] = (m[8] + m[2]) / s;
+        q[1] = (m[9] + m[6]) / s;
+        q[2] = 0.25f * s;
+    }
+}
+
+void quatToMatrix(float *m, const float *q) {
+
+    float x = q[0], y = q[1], z = q[2], w = q[3];
+    float xx = x * x, yy = y * y, zz = z * z;
+    float xy = x * y, xz = x * z, yz = y * z;
+    float wx = w * x, wy = w * y, wz = w * z;
+
+    m[0]  = 1.0f - 2.0f * (yy + zz);
+    m[1]  = 2.0f * (xy + wz);
+    m[2]  = 2.0f * (xz - wy);
+    m[3]  = 0.0f;
+
+    m[4]  = 2.0f * (xy - wz);
+    m[5]  = 1.0f - 2.0f * (xx + zz);
+    m[6]  = 2.0f * (yz + wx);
+    m[7]  = 0.0f;
+
+    m[8]  = 2.0f * (xz + wy);
+    m[9]  = 2.0f * (yz - wx);
+    m[10] = 1.0f - 2.0f * (xx + yy);
+    m[11] = 0.0f;
+
+    m[12] = 0.0f;
+    m[13] = 0.0f;
+    m[14] = 0.0f;
+    m[15] = 1.0f;
+}
+
+void quatConjugate(float *res, const float *q) {
+
+    res[0] = -q[0];
+    res[1] = -q[1];
+    res[2] = -q[2];
+    res[3] = q[3];
+}
+
+// v + w * t + u x t with t = 2 * u x v, u the vector part
+void quatRotate(float *res, const float *q, const float *v) {
+
+    float t[3], c[3];
+
+    t[0] = 2.0f * (q[1] * v[2] - q[2] * v[1]);
+    t[1] = 2.0f * (q[2] * v[0] - q[0] * v[2]);
+    t[2] = 2.0f * (q[0] * v[1] - q[1] * v[0]);
+
+    c[0] = q[1] * t[2] - q[2] * t[1];
+    c[1] = q[2] * t[0] - q[0] * t[2];
+    c[2] = q[0] * t[1] - q[1] * t[0];
+
+    res[0] = v[0] + q[3] * t[0] + c[0];
+    res[1] = v[1] + q[3] * t[1] + c[1];
+    res[2] = v[2] + q[3] * t[2] + c[2];
+}
+
+// Weights of a and b for slerp, or false when they are
+// close enough for nlerp. d is the dot product of a and b.
+static bool slerpWeights(float d, float t, float *wa, float *wb) {
+
+    float sign = 1.0f;
+    if (d < 0.0f) {
+        d = -d;
+        sign = -1.0f;
+    }
+    if (d > SLERP_THRESHOLD)
+        return false;
+
+    float theta = acosf(d);
+    float s = sinf(theta);
+    *wa = sinf((1.0f - t) * theta) / s;
+    *wb = sign * sinf(t * theta) / s;
+    return true;
+}
+
+// ----------------------------------------------------
+// SCALAR
+//
+
+// (x*x' + y*y') + (z*z' + w*w'), the order dpps adds in
+static inline float dot4(const float *a, const float *b) {
+
+    return (a[0] * b[0] + a[1] * b[1]) + (a[2] * b[2] + a[3] * b[3]);
+}
+
+// Written with negated factors rather than subtractions,
+// which is the same float result, since GCC vectorizes it
+// into fused multiply-subtract-adds otherwise, whatever
+// fp-contract says.
+static void multScalar(float *res, const float *a, const float *b) {
+
+    float x = ((a[3] * b[0] + a[0] * b[3]) + a[1] * b[2]) + a[2] * -b[1];
+    float y = ((a[3] * b[1] + a[0] * -b[2]) + a[1] * b[3]) + a[2] * b[0];
+    float z = ((a[3] * b[2] + a[0] * b[1]) + a[1] * -b[0]) + a[2] * b[3];
+    float w = ((a[3] * b[3] + a[0] * -b[0]) + a[1] * -b[1]) + a[2] * -b[2];
+
+    res[0] = x;
+    res[1] = y;
+    res[2] = z;
+    res[3] = w;
+}
+
+static void nlerpScalar(float *res, const float *a, const float *b, float t) {
+
+    float wa = 1.0f - t;
+    float wb = dot4(a, b) < 0.0f ? -t : t;
+    float r[4];
+
+    for (int i = 0; i < 4; ++i)
+        r[i] = a[i] * wa + b[i] * wb;
+
+    float len = sqrtf(dot4(r, r));
+    for (int i = 0; i < 4; ++i)
+        res[i] = r[i] / len;
+}
+
+static void slerpScalar(float *res, const float *a, const float *b, float t) {
+
+    float wa, wb;
+
+    if (!slerpWeights(dot4(a, b), t, &wa, &wb)) {
+        nlerpScalar(res, a, b, t);
+        return;
+    }
+
+    for (int i = 0; i < 4; ++i)
+        res[i] = a[i] * wa + b[i] * wb;
+}
+
+static const QuatKernels kernelsScalar = {
+    ISA_SCALAR,
+    multScalar,
+    nlerpScalar,
+    slerpScalar
+};
+
+#if CPU_X86
+
+// ----------------------------------------------------
+// SSE2
+//
+// A quaternion per register. The products of mult are
+// aw * b, ax * (bw, -bz, by, -bx), ay * (bz, bw, -bx, -by)
+// and az * (-by, bx, bw, -bz), added left to right.
+//
+
+TARGET_SSE2
+static inline __m128 dotSSE2(__m128 a, __m128 b) {
+
+    __m128 p = _mm_mul_ps(a, b);
+    __m128 s = _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+TARGET_SSE2
+static void multSSE2(float *res, const float *a, const float *b) {
+
+    __m128 qa = _mm_loadu_ps(a);
+    __m128 qb = _mm_loadu_ps(b);
+
+    const __m128 signX = _mm_castsi128_ps(_mm_set_epi32(0x80000000, 0, 0x80000000, 0));
+    const __m128 signY = _mm_castsi128_ps(_mm_set_epi32(0x80000000, 0x80000000, 0, 0));
+    const __m128 signZ = _mm_castsi128_ps(_mm_set_epi32(0x80000000, 0, 0, 0x80000000));
+
+    __m128 bx = _mm_xor_ps(_mm_shuffle_ps(qb, qb, _MM_SHUFFLE(0, 1, 2, 3)), signX);
+    __m128 by = _mm_xor_ps(_mm_shuffle_ps(qb, qb, _MM_SHUFFLE(1, 0, 3, 2)), signY);
+    __m128 bz = _mm_xor_ps(_mm_shuffle_ps(qb, qb, _MM_SHUFFLE(2, 3, 0, 1)), signZ);
+
+    __m128 r = _mm_mul_ps(_mm_shuffle_ps(qa, qa, _MM_SHUFFLE(3, 3, 3, 3)), qb);
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(qa, qa, _MM_SHUFFLE(0, 0, 0, 0)), bx));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(qa, qa, _MM_SHUFFLE(1, 1, 1, 1)), by));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(qa, qa, _MM_SHUFFLE(2, 2, 2, 2)), bz));
+
+    _mm_storeu_ps(res, r);
+}
+
+TARGET_SSE2
+static inline __m128 blendSSE2(__m128 a, __m128 b, float wa, float wb) {
+
+    return _mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(wa)), _mm_mul_ps(b, _mm_set1_ps(wb)));
+}
+
+TARGET_SSE2
+static void nlerpSSE2(float *res, const float *a, const float *b, float t) {
+
+    __m128 qa = _mm_loadu_ps(a);
+    __m128 qb = _mm_loadu_ps(b);
+    float wb = _mm_cvtss_f32(dotSSE2(qa, qb)) < 0.0f ? -t : t;
+
+    __m128 r = blendSSE2(qa, qb, 1.0f - t, wb);
+    _mm_storeu_ps(res, _mm_div_ps(r, _mm_sqrt_ps(dotSSE2(r, r))));
+}
+
+TARGET_SSE2
+static void slerpSSE2(float *res, const float *a, const float *b, float t) {
+
+    __m128 qa = _mm_loadu_ps(a);
+    __m128 qb = _mm_loadu_ps(b);
+    float wa, wb;
+
+    if (!slerpWeights(_mm_cvtss_f32(dotSSE2(qa, qb)), t, &wa, &wb)) {
+        nlerpSSE2(res, a, b, t);
+        return;
+    }
+    _mm_storeu_ps(res, blendSSE2(qa, qb, wa, wb));
+}
+
+static const QuatKernels kernelsSSE2 = {
+    ISA_SSE2,
+    multSSE2,
+    nlerpSSE2,
+    slerpSSE2
+};
+
+// ----------------------------------------------------
+// SSE4.1
+//
+// dpps adds the products in the order of dot4.
+//
+
+TARGET_SSE41
+static void nlerpSSE41(float *res, const float *a, const float *b, float t) {
+
+    __m128 qa = _mm_loadu_ps(a);
+    __m128 qb = _mm_loadu_ps(b);
+    float wb = _mm_cvtss_f32(_mm_dp_ps(qa, qb, 0xF1)) < 0.0f ? -t : t;
+
+    __m128 r = _mm_add_ps(_mm_mul_ps(qa, _mm_set1_ps(1.0f - t)), _mm_mul_ps(qb, _mm_set1_ps(wb)));
+    _mm_storeu_ps(res, _mm_div_ps(r, _mm_sqrt_ps(_mm_dp_ps(r, r, 0xFF))));
+}
+
+TARGET_SSE41
+static void slerpSSE41(float *res, const float *a, const float *b, float t) {
+
+    __m128 qa = _mm_loadu_ps(a);
+    __m128 qb = _mm_loadu_ps(b);
+    float wa, wb;
+
+    if (!slerpWeights(_mm_cvtss_f32(_mm_dp_ps(qa, qb, 0xF1)), t, &wa, &wb)) {
+        nlerpSSE41(res, a, b, t);
+        return;
+    }
+    _mm_storeu_ps(res, _mm_add_ps(_mm_mul_ps(qa, _mm_set1_ps(wa)), _mm_mul_ps(qb, _mm_set1_ps(wb))));
+}
+
+static const QuatKernels kernelsSSE41 = {
+    ISA_SSE41,
+    multSSE2,
+    nlerpSSE41,
+    slerpSSE41
+};
+
+static const QuatKernels *tables[ISA_COUNT] = {
+    &kernelsScalar,
+    &kernelsSSE2,
+    &kernelsSSE41,
+    &kernelsSSE41,
+    &kernelsSSE41
+};
+
+#else
+
+static const QuatKernels *tables[ISA_COUNT] = {
+    &kernelsScalar,
+    &kernelsScalar,
+    &kernelsScalar,
+    &kernelsScalar,
+    &kernelsScalar
+};
+
+#endif
+
+// ----------------------------------------------------
+// BINDING
+//
+
+const QuatKernels *quatKernels = &kernelsScalar;
+
+void quatBind(CpuIsa isa) {
+
+    quatKernels = tables[isa];
+}
+
+// ----------------------------------------------------
+// CHECK
+//
+
+static unsigned int seed = 54321;
+
+static float randomFloat() {
+
+    seed = seed * 1664525u + 1013904223u;
+    return (float)(seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+}
+
+static void randomQuat(float *q) {
+
+    for (int i = 0; i < 4; ++i)
+        q[i] = randomFloat();
+    float len = sqrtf(dot4(q, q));
+    for (int i = 0; i < 4; ++i)
+        q[i] /= len;
+}
+
+static int compare(CpuIsa isa, const char *what, const float *res, const float *ref) {
+
+    if (memcmp(res, ref, 4 * sizeof(float)) == 0)
+        return 0;
+    printf("quatCheck: %s %s differs from the reference\n", cpuIsaName(isa), what);
+    return 1;
+}
+
+int quatCheck() {
+
+    int failures = 0;
+
+    for (int k = 1; k <= cpuDetect(); ++k) {
+        const QuatKernels *kernels = tables[k];
+
+        for (int round = 0; round < 1000; ++round) {
+            float a[4], b[4], r[4], e[4];
+            float t = (randomFloat() + 1.0f) * 0.5f;
+
+            randomQuat(a);
+            randomQuat(b);
+            // every few rounds, two close rotations for the nlerp fallback
+            if (round % 4 == 0)
+                nlerpScalar(b, a, b, 0.01f);
+
+            multScalar(e, a, b);
+            kernels->mult(r, a, b);
+            failures += compare(kernels->isa, "mult", r, e);
+
+            nlerpScalar(e, a, b, t);
+            kernels->nlerp(r, a, b, t);
+            failures += compare(kernels->isa, "nlerp", r, e);
+
+            slerpScalar(e, a, b, t);
+            kernels->slerp(r, a, b, t);
+            failures += compare(kernels->isa, "slerp", r, e);
+        }
+    }
+    return failures;
+}
@@ -0,0 +1,69 @@
+#ifndef QUAT_H
+#define QUAT_H
+
+// ----------------------------------------------------
+// QUATERNIONS
+//
+// Rotations as 4 floats (x, y, z, w), w being the real
+// part. Like the mat4 kernels, the SIMD versions of
+// mult, nlerp and slerp perform the very same float
+// operations as the scalar ones, in the same order.
+//
+
+#include "mat4.h"
+
+struct ALIGNED(16) quat {
+    float q[4];
+};
+
+void quatIdentity(float *q);
+
+// rotation of degrees around a unit axis
+void quatFromAxisAngle(float *q, const float *axis, float degrees);
+
+// rotation part of a column major matrix without scaling
+void quatFromMatrix(float *q, const float *m);
+
+// the rotation matrix, with no translation
+void quatToMatrix(float *m, const float *q);
+
+void quatConjugate(float *res, const float *q);
+
+// res = q applied to the vec3 v
+void quatRotate(float *res, const float *q, const float *v);
+
+struct QuatKernels {
+
+    CpuIsa isa;
+
+    // res = a * b, b applied first (res may alias a or b)
+    void (*mult)(float *res, const float *a, const float *b);
+
+    // interpolate from a (t = 0) to b (t = 1) along the shortest
+    // arc, nlerp normalizing a straight blend, slerp at constant speed
+    void (*nlerp)(float *res, const float *a, const float *b, float t);
+    void (*slerp)(float *res, const float *a, const float *b, float t);
+};
+
+extern const QuatKernels *quatKernels;
+
+// called by cpuInit with the level to use
+void quatBind(CpuIsa isa);
+
+// compares every kernel set against the scalar one,
+// returns the number of mismatches
+int quatCheck();
+
+inline void quatMult(float *res, const float *a, const float *b) {
+    quatKernels->mult(res, a, b);
+}
+
+inline void quatNlerp(float *res, const float *a, const float *b, float t) {
+    quatKernels->nlerp(res, a, b, t);
+}
+
+inline void quatSlerp(float *res, const float *a, const float *b, float t) {
+    quatKernels->slerp(res, a, b, t);
+}
+
+#endif
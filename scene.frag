@@ -0,0 +1,22 @@
+#version 330
+
+in vec4 Color;
+layout(location = 0) out vec4 outputF;
+
+#ifdef FOG
+// from where the fog starts to where it hides all
+uniform vec4 fogColor;
+uniform vec2 fogRange;
+
+in float Distance;
+#endif
+
+void main()
+{
+#ifdef FOG
+	float fog = clamp((Distance - fogRange.x) / (fogRange.y - fogRange.x), 0.0, 1.0);
+	outputF = mix(Color, fogColor, fog);
+#else
+	outputF = Color;
+#endif
+}
@@ -0,0 +1,62 @@
+#version 330
+
+// features, defined by the variant asked for:
+// VERTEX_COLOR, FOG, INSTANCING, QUANTIZED
+
+uniform mat4 viewMatrix, projMatrix;
+
+// the locations g33 binds the vertex formats to
+layout(location = 0) in vec4 position;
+
+#ifdef QUANTIZED
+// the box the positions are mapped from
+uniform vec3 positionCenter, positionExtent;
+#endif
+
+#ifdef VERTEX_COLOR
+layout(location = 1) in vec4 color;
+#endif
+
+#ifdef INSTANCING
+// advance once per instance
+layout(location = 2) in vec4 instanceRow0;
+layout(location = 3) in vec4 instanceRow1;
+layout(location = 4) in vec4 instanceRow2;
+layout(location = 5) in vec4 instanceColor;
+#endif
+
+out vec4 Color;
+#ifdef FOG
+out float Distance;
+#endif
+
+void main()
+{
+	vec4 local = position;
+#ifdef QUANTIZED
+	local.xyz = positionCenter + positionExtent * position.xyz;
+#endif
+
+#ifdef INSTANCING
+	vec4 world = vec4(dot(instanceRow0, local),
+	                  dot(instanceRow1, local),
+	                  dot(instanceRow2, local), 1.0);
+#else
+	vec4 world = local;
+#endif
+
+	// white without either
+	Color = vec4(1.0);
+#ifdef VERTEX_COLOR
+	Color = color;
+#endif
+#ifdef INSTANCING
+	Color *= instanceColor;
+#endif
+
+	vec4 view = viewMatrix * world;
+#ifdef FOG
+	Distance = -view.z;
+#endif
+	gl_Position = projMatrix * view;
+}
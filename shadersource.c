@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux__)
+#include <limits.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include "shadersource.h"
+#include "mapfile.h"
+#include "hash.h"
+
+void shaderLibraryInit(ShaderLibrary *lib, bool watch) {
+
+    memset(lib, 0, sizeof(ShaderLibrary));
+    lib->notify = -1;
+#if defined(__linux__)
+    if (watch)
+        lib->notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+void shaderLibraryFree(ShaderLibrary *lib) {
+
+    for (int i = 0; i < lib->count; ++i) {
+        free(lib->files[i].text);
+        free(lib->files[i].includes);
+    }
+    free(lib->files);
+    free(lib->watches);
+#if defined(__linux__)
+    if (lib->notify >= 0)
+        close(lib->notify);
+#endif
+    memset(lib, 0, sizeof(ShaderLibrary));
+    lib->notify = -1;
+}
+
+// ----------------------------------------------------
+// FILES
+//
+
+// the length of the directory part of path, its last
+// separator included, 0 for none
+static size_t dirLength(const char *path) {
+
+    size_t length = 0;
+    for (size_t i = 0; path[i]; ++i)
+        if (path[i] == '/' || path[i] == '\\')
+            length = i + 1;
+    return length;
+}
+
+static int findFile(const ShaderLibrary *lib, const char *path) {
+
+    for (int i = 0; i < lib->count; ++i)
+        if (strcmp(lib->files[i].path, path) == 0)
+            return i;
+    return -1;
+}
+
+static int internFile(ShaderLibrary *lib, const char *path) {
+
+    int index = findFile(lib, path);
+    if (index >= 0)
+        return index;
+
+    if (lib->count == lib->capacity) {
+        lib->capacity = lib->capacity ? lib->capacity * 2 : 16;
+        lib->files = (ShaderFile *) realloc(lib->files, lib->capacity * sizeof(ShaderFile));
+    }
+    ShaderFile *file = &lib->files[lib->count];
+    memset(file, 0, sizeof(ShaderFile));
+    snprintf(file->path, sizeof(file->path), "%s", path);
+    return lib->count++;
+}
+
+static void addInclude(ShaderFile *file, int include) {
+
+    for (int i = 0; i < file->includeCount; ++i)
+        if (file->includes[i] == include)
+            return;
+    if (file->includeCount == file->includeCapacity) {
+        file->includeCapacity = file->includeCapacity ? file->includeCapacity * 2 : 4;
+        file->includes = (int *) realloc(file->includes, file->includeCapacity * sizeof(int));
+    }
+    file->includes[file->includeCount++] = include;
+}
+
+// ----------------------------------------------------
+// EXPANSION
+//
+
+struct Text {
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+static void append(Text *text, const char *data, size_t size) {
+
+    if (text->size + size + 1 > text->capacity) {
+        text->capacity = (text->size + size + 1) * 2;
+        text->data = (char *) realloc(text->data, text->capacity);
+    }
+    memcpy(text->data + text->size, data, size);
+    text->size += size;
+}
+
+// so the next line is line of source file; before GLSL
+// 4.20 #line names the line before the next
+static void appendLine(Text *text, int version, int line, int file) {
+
+    char directive[64];
+    int length = snprintf(directive, sizeof(directive), "#line %d %d\n", version >= 420 ? line : line - 1, file);
+    append(text, directive, length);
+}
+
+// false when the line is not an #include, name NULL when
+// it is one without a name
+static bool includeName(const char *line, const char *end, const char **name, size_t *length) {
+
+    while (line < end && (*line == ' ' || *line == '\t'))
+        ++line;
+    if (end - line < 8 || strncmp(line, "#include", 8) != 0)
+        return false;
+    line += 8;
+    while (line < end && (*line == ' ' || *line == '\t'))
+        ++line;
+
+    *name = NULL;
+    if (line < end && (*line == '"' || *line == '<')) {
+        char close = *line == '"' ? '"' : '>';
+        const char *s = ++line;
+        while (line < end && *line != close && *line != '\n')
+            ++line;
+        if (line < end && *line == close) {
+            *name = s;
+            *length = line - s;
+        }
+    }
+    return true;
+}
+
+static bool expand(ShaderLibrary *lib, int index, int *version, Text *out) {
+
+    char path[SHADER_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s", lib->files[index].path);
+    lib->files[index].pass = lib->pass;
+    lib->files[index].includeCount = 0;
+
+    MappedFile map;
+    if (!mappedFileOpen(&map, path)) {
+        printf("%s: cannot open\n", path);
+        return false;
+    }
+    fileTime(path, &lib->files[index].size, &lib->files[index].time);
+
+    const char *s = (const char *) map.data;
+    const char *end = s + map.size;
+    bool ok = true;
+    for (int line = 1; s < end && ok; ++line) {
+        const char *next = (const char *) memchr(s, '\n', end - s);
+        next = next ? next + 1 : end;
+
+        const char *name;
+        size_t length;
+        if (!includeName(s, next, &name, &length)) {
+            const char *t = s;
+            while (t < next && (*t == ' ' || *t == '\t'))
+                ++t;
+            if (*version == 0 && next - t > 8 && strncmp(t, "#version", 8) == 0)
+                *version = atoi(t + 8);
+            append(out, s, next - s);
+            if (next == end && next[-1] != '\n')
+                append(out, "\n", 1);
+        } else if (!name || dirLength(path) + length >= SHADER_PATH_SIZE) {
+            printf("%s:%d: bad #include\n", path, line);
+            ok = false;
+        } else {
+            // next to the file including it
+            char includePath[SHADER_PATH_SIZE];
+            size_t dir = dirLength(path);
+            memcpy(includePath, path, dir);
+            memcpy(includePath + dir, name, length);
+            includePath[dir + length] = 0;
+
+            int include = internFile(lib, includePath);
+            addInclude(&lib->files[index], include);
+            if (lib->files[include].pass == lib->pass) {
+                append(out, "\n", 1);
+            } else {
+                appendLine(out, *version, 1, include);
+                ok = expand(lib, include, version, out);
+                appendLine(out, *version, line + 1, index);
+            }
+        }
+        s = next;
+    }
+
+    mappedFileClose(&map);
+    return ok;
+}
+
+// the text of the file again, the old one kept if it fails
+static bool expandText(ShaderLibrary *lib, int index) {
+
+    Text out = { NULL, 0, 0 };
+    int version = 0;
+
+    ++lib->pass;
+    if (!expand(lib, index, &version, &out)) {
+        free(out.data);
+        return false;
+    }
+    append(&out, "", 0);
+    out.data[out.size] = 0;
+
+    ShaderFile *file = &lib->files[index];
+    free(file->text);
+    file->text = out.data;
+    file->hash = hash64(out.data, out.size, 0);
+    file->stale = false;
+    return true;
+}
+
+// ----------------------------------------------------
+// WATCHING
+//
+
+static void watchDirs(ShaderLibrary *lib) {
+
+#if defined(__linux__)
+    if (lib->notify < 0)
+        return;
+
+    for (int i = 0; i < lib->count; ++i) {
+        char dir[SHADER_PATH_SIZE];
+        size_t length = dirLength(lib->files[i].path);
+        if (length == 0)
+            strcpy(dir, ".");
+        else {
+            memcpy(dir, lib->files[i].path, length - 1);
+            dir[length - 1] = 0;
+        }
+
+        // the same watch for a directory watched already;
+        // editors often save to a new file renamed over the old
+        int wd = inotify_add_watch(lib->notify, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0)
+            continue;
+        bool known = false;
+        for (int w = 0; w < lib->watchCount; ++w)
+            known = known || lib->watches[w].wd == wd;
+        if (known)
+            continue;
+
+        if (lib->watchCount == lib->watchCapacity) {
+            lib->watchCapacity = lib->watchCapacity ? lib->watchCapacity * 2 : 4;
+            lib->watches = (ShaderWatch *) realloc(lib->watches, lib->watchCapacity * sizeof(ShaderWatch));
+        }
+        ShaderWatch *watch = &lib->watches[lib->watchCount++];
+        watch->wd = wd;
+        snprintf(watch->dir, sizeof(watch->dir), "%s", length ? dir : "");
+    }
+#endif
+}
+
+// marks the files the events are about
+static void readEvents(ShaderLibrary *lib) {
+
+#if defined(__linux__)
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t length = read(lib->notify, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+
+        for (char *e = buffer; e < buffer + length; e += sizeof(struct inotify_event) + ((struct inotify_event *) e)->len) {
+            const struct inotify_event *event = (const struct inotify_event *) e;
+            if (event->len == 0)
+                continue;
+            for (int w = 0; w < lib->watchCount; ++w) {
+                if (lib->watches[w].wd != event->wd)
+                    continue;
+                // a path too long for a file of the library
+                // is not one of them
+                char path[SHADER_PATH_SIZE + NAME_MAX + 2];
+                int length;
+                if (lib->watches[w].dir[0])
+                    length = snprintf(path, sizeof(path), "%s/%s", lib->watches[w].dir, event->name);
+                else
+                    length = snprintf(path, sizeof(path), "%s", event->name);
+                if (length < 0 || length >= SHADER_PATH_SIZE)
+                    continue;
+                int file = findFile(lib, path);
+                if (file >= 0)
+                    lib->files[file].stale = true;
+            }
+        }
+    }
+#endif
+}
+
+// marks the files whose size or time moved
+static void checkTimes(ShaderLibrary *lib) {
+
+    for (int i = 0; i < lib->count; ++i) {
+        unsigned long long size;
+        long long time;
+        if (fileTime(lib->files[i].path, &size, &time) &&
+            (size != lib->files[i].size || time != lib->files[i].time))
+            lib->files[i].stale = true;
+    }
+}
+
+// ----------------------------------------------------
+// LIBRARY
+//
+
+int shaderLibraryOpen(ShaderLibrary *lib, const char *path) {
+
+    if (strlen(path) >= SHADER_PATH_SIZE) {
+        printf("%s: path too long\n", path);
+        return -1;
+    }
+    int index = internFile(lib, path);
+    if (!lib->files[index].text && !expandText(lib, index))
+        return -1;
+    watchDirs(lib);
+    return index;
+}
+
+const char *shaderLibraryText(ShaderLibrary *lib, int file) {
+
+    if (!lib->files[file].text || lib->files[file].stale)
+        expandText(lib, file);
+    return lib->files[file].text;
+}
+
+int shaderLibraryPoll(ShaderLibrary *lib) {
+
+    if (lib->notify >= 0)
+        readEvents(lib);
+    else
+        checkTimes(lib);
+
+    // and the files including them, to the top
+    for (bool more = true; more; ) {
+        more = false;
+        for (int i = 0; i < lib->count; ++i) {
+            ShaderFile *file = &lib->files[i];
+            for (int k = 0; k < file->includeCount && !file->stale; ++k)
+                if (lib->files[file->includes[k]].stale)
+                    more = file->stale = true;
+        }
+    }
+
+    int changed = 0;
+    for (int i = 0; i < lib->count; ++i) {
+        if (!lib->files[i].stale || !lib->files[i].text)
+            continue;
+        unsigned long long hash = lib->files[i].hash;
+        if (expandText(lib, i) && lib->files[i].hash != hash) {
+            ++lib->files[i].generation;
+            ++changed;
+        }
+    }
+
+    // new includes get watched too
+    for (int i = 0; i < lib->count; ++i)
+        lib->files[i].stale = false;
+    if (changed)
+        watchDirs(lib);
+    return changed;
+}
@@ -0,0 +1,81 @@
+#ifndef SHADERSOURCE_H
+#define SHADERSOURCE_H
+
+// ----------------------------------------------------
+// SHADER SOURCES
+//
+// Shader files read from a mapping, with their #include
+// "name" lines replaced by the file named, found next to
+// the file including it. A file is included once in a
+// source however many files include it, and a #line
+// before and after each keeps the error messages right:
+// the source string number is the index of the file.
+//
+// Files are kept by path, one entry each whatever the
+// number of sources including it, with the includes of
+// each; the expanded text of a file is kept until it or
+// anything it includes changes.
+//
+// Changes are picked up by polling, which never waits:
+// on Linux inotify watches the directories of the files,
+// elsewhere their times are looked at. A changed file
+// is expanded again then, along with those including it,
+// and its generation moves when its text did change.
+//
+
+#define SHADER_PATH_SIZE 256
+
+struct ShaderFile {
+    char path[SHADER_PATH_SIZE];    // with the directory it was found in
+    char *text;                     // expanded, NULL until asked for
+    unsigned long long hash;        // of text
+    unsigned int generation;
+    unsigned int pass;              // the last expansion it is in
+    bool stale;
+
+    int *includes;                  // those it includes itself
+    int includeCount;
+    int includeCapacity;
+
+    unsigned long long size;        // when last read, for the polling
+    long long time;
+};
+
+struct ShaderWatch {
+    int wd;
+    char dir[SHADER_PATH_SIZE];
+};
+
+struct ShaderLibrary {
+    ShaderFile *files;
+    int count;
+    int capacity;
+    unsigned int pass;
+
+    int notify;                     // inotify, -1 without
+    ShaderWatch *watches;
+    int watchCount;
+    int watchCapacity;
+};
+
+// watch for inotify, where there is one
+void shaderLibraryInit(ShaderLibrary *lib, bool watch);
+void shaderLibraryFree(ShaderLibrary *lib);
+
+// the file, read with what it includes; -1 and prints why
+// when it cannot be
+int shaderLibraryOpen(ShaderLibrary *lib, const char *path);
+
+// expanded, owned by the library, valid until the next poll
+const char *shaderLibraryText(ShaderLibrary *lib, int file);
+
+// moves each time the text of the file changes
+inline unsigned int shaderLibraryGeneration(const ShaderLibrary *lib, int file) {
+    return lib->files[file].generation;
+}
+
+// picks up the files changed, returns how many of the
+// texts asked for are new
+int shaderLibraryPoll(ShaderLibrary *lib);
+
+#endif
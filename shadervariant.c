@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shadervariant.h"
+
+static const char *featureNames[SHADER_FEATURES] = {
+    "VERTEX_COLOR",
+    "FOG",
+    "INSTANCING",
+    "QUANTIZED"
+};
+
+const char *shaderFeatureName(int feature) {
+
+    return feature >= 0 && feature < SHADER_FEATURES ? featureNames[feature] : NULL;
+}
+
+// ----------------------------------------------------
+// SOURCES
+//
+
+static bool identifierChar(char c) {
+
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// name as a whole identifier, not part of a longer one
+static bool usesName(const char *source, const char *name) {
+
+    size_t length = strlen(name);
+    for (const char *s = strstr(source, name); s; s = strstr(s + 1, name))
+        if ((s == source || !identifierChar(s[-1])) && !identifierChar(s[length]))
+            return true;
+    return false;
+}
+
+static unsigned int usedFeatures(const char *source) {
+
+    unsigned int features = 0;
+    for (int i = 0; i < SHADER_FEATURES; ++i)
+        if (usesName(source, featureNames[i]))
+            features |= 1u << i;
+    return features;
+}
+
+char *shaderVariantSource(const char *source, unsigned int features) {
+
+    // the end of the #version line, which must stay first,
+    // and the number of the line after it
+    const char *rest = source;
+    int line = 1;
+    int version = 0;
+    for (const char *s = source; *s; ++line) {
+        const char *end = strchr(s, '\n');
+        end = end ? end + 1 : s + strlen(s);
+        const char *t = s;
+        while (t < end && (*t == ' ' || *t == '\t'))
+            ++t;
+        if (strncmp(t, "#version", 8) == 0) {
+            version = atoi(t + 8);
+            rest = end;
+            ++line;
+            break;
+        }
+        s = end;
+    }
+    if (rest == source)
+        line = 1;
+
+    size_t head = rest - source;
+    size_t size = strlen(source);
+    char *variant = (char *) malloc(size + 2 + SHADER_FEATURES * 32 + 32);
+    char *out = variant;
+
+    memcpy(out, source, head);
+    out += head;
+    if (head > 0 && out[-1] != '\n')
+        *out++ = '\n';
+    for (int i = 0; i < SHADER_FEATURES; ++i)
+        if (features & (1u << i))
+            out += sprintf(out, "#define %s 1\n", featureNames[i]);
+
+    // before GLSL 4.20 #line names the line before the next
+    out += sprintf(out, "#line %d\n", version >= 420 ? line : line - 1);
+    memcpy(out, rest, size - head + 1);
+    return variant;
+}
+
+// ----------------------------------------------------
+// VARIANTS
+//
+
+void shaderVariantsInit(ShaderVariants *set, ProgramQueue *queue, const char *name,
+                        const char *vertexSource, const char *fragmentSource, ProgramSetup setup) {
+
+    memset(set, 0, sizeof(ShaderVariants));
+    snprintf(set->name, sizeof(set->name), "%s", name);
+    set->vertexSource = strdup(vertexSource);
+    set->fragmentSource = strdup(fragmentSource);
+    set->features = usedFeatures(vertexSource) | usedFeatures(fragmentSource);
+    set->setup = setup;
+    set->queue = queue;
+}
+
+void shaderVariantsFree(ShaderVariants *set) {
+
+    for (int i = 0; i < set->count; ++i)
+        programQueueDelete(set->queue, set->variants[i].build);
+
+    free(set->vertexSource);
+    free(set->fragmentSource);
+    free(set->variants);
+    memset(set, 0, sizeof(ShaderVariants));
+}
+
+bool shaderVariantsFailed(const ShaderVariants *set) {
+
+    for (int i = 0; i < set->count; ++i)
+        if (programQueueState(set->queue, set->variants[i].build) == PROGRAM_FAILED)
+            return true;
+    return false;
+}
+
+GLuint shaderVariantsGet(ShaderVariants *set, unsigned int features) {
+
+    features &= set->features;
+    for (int i = 0; i < set->count; ++i)
+        if (set->variants[i].features == features)
+            return programQueueProgram(set->queue, set->variants[i].build);
+
+    if (set->count == set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : 8;
+        set->variants = (ShaderVariant *) realloc(set->variants, set->capacity * sizeof(ShaderVariant));
+    }
+
+    // named by its features in the logs
+    char name[128];
+    int length = snprintf(name, sizeof(name), "%s", set->name);
+    for (int i = 0; i < SHADER_FEATURES && length < (int) sizeof(name); ++i)
+        if (features & (1u << i))
+            length += snprintf(name + length, sizeof(name) - length, " %s", featureNames[i]);
+
+    char *vs = shaderVariantSource(set->vertexSource, features);
+    char *fs = shaderVariantSource(set->fragmentSource, features);
+    ShaderVariant *v = &set->variants[set->count++];
+    v->features = features;
+    v->build = programQueueSubmit(set->queue, name, vs, fs, set->setup);
+    free(vs);free(fs);
+
+    return programQueueProgram(set->queue, v->build);
+}
@@ -0,0 +1,72 @@
+#ifndef SHADERVARIANT_H
+#define SHADERVARIANT_H
+
+#include <GL/glew.h>
+
+#include "programqueue.h"
+
+// ----------------------------------------------------
+// SHADER VARIANTS
+//
+// One pair of shaders written for several features, each
+// behind an #ifdef of its name, specialized by defining
+// the features asked for after the #version line. What is
+// not asked for is gone before the driver optimizes, the
+// branches and the attributes with it.
+//
+// The features of a pair are the names its sources use,
+// found when it is made; bits asked for that it does not
+// use are dropped, so asking with them gives the same
+// variant. Variants are built on first use, through the
+// program queue and so the program cache, each being its
+// own sources there.
+//
+
+enum ShaderFeature {
+    SHADER_VERTEX_COLOR = 1 << 0,   // color attribute, else a uniform color
+    SHADER_FOG          = 1 << 1,   // linear fog on the view distance
+    SHADER_INSTANCING   = 1 << 2,   // model rows and color per instance
+    SHADER_QUANTIZED    = 1 << 3,   // VERTEX_SNORM16 positions, mapped to their box
+    SHADER_FEATURES     = 4
+};
+
+struct ShaderVariant {
+    unsigned int features;
+    int build;                  // in the queue
+};
+
+struct ShaderVariants {
+    char name[64];
+    char *vertexSource;
+    char *fragmentSource;
+    unsigned int features;      // those the sources use
+    ProgramSetup setup;
+    ProgramQueue *queue;
+
+    ShaderVariant *variants;
+    int count;
+    int capacity;
+};
+
+// the sources are copied
+void shaderVariantsInit(ShaderVariants *set, ProgramQueue *queue, const char *name,
+                        const char *vertexSource, const char *fragmentSource, ProgramSetup setup);
+
+// deletes the programs of its variants
+void shaderVariantsFree(ShaderVariants *set);
+
+// the program for these features, 0 while it builds or
+// when it failed; submits it the first time
+GLuint shaderVariantsGet(ShaderVariants *set, unsigned int features);
+
+// when a variant asked for did not build
+bool shaderVariantsFailed(const ShaderVariants *set);
+
+// "VERTEX_COLOR"... as the sources test them
+const char *shaderFeatureName(int feature);
+
+// source with the features defined after its #version
+// line and the line numbers kept, to free
+char *shaderVariantSource(const char *source, unsigned int features);
+
+#endif
@@ -0,0 +1,168 @@
+#include <string.h>
+
+#include "streambuffer.h"
+#include "glproc.h"
+
+// ----------------------------------------------------
+// FENCES
+//
+
+// waits for the oldest frame and gives its space back
+static void retireFrame(StreamBuffer *sb, bool wait) {
+
+    StreamFrame *frame = &sb->frames[0];
+
+    GLenum status = glClientWaitSync(frame->fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        if (!wait)
+            return;
+        sb->stats.waits++;
+        do
+            status = glClientWaitSync(frame->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        while (status == GL_TIMEOUT_EXPIRED);
+    }
+
+    glDeleteSync(frame->fence);
+    sb->used -= frame->bytes;
+    sb->frameCount--;
+    memmove(sb->frames, sb->frames + 1, sb->frameCount * sizeof(StreamFrame));
+}
+
+// ----------------------------------------------------
+// STREAM BUFFERS
+//
+
+bool streamBufferInit(StreamBuffer *sb, size_t size) {
+
+    memset(sb, 0, sizeof(StreamBuffer));
+    sb->size = size;
+
+    // errors left by earlier calls are not this one's
+    while (glGetError() != GL_NO_ERROR)
+        ;
+    glGenBuffers(1, &sb->buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, sb->buffer);
+
+    GlBufferStorageProc bufferStorage = (GlBufferStorageProc)
+        glProcFor("glBufferStorage", "GL_ARB_buffer_storage", 4, 4);
+    if (bufferStorage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        bufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+        sb->mapped = (unsigned char *) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+        sb->persistent = sb->mapped != NULL;
+    }
+
+    // a buffer made with glBufferStorage cannot be redefined
+    if (!sb->persistent) {
+        if (bufferStorage) {
+            glDeleteBuffers(1, &sb->buffer);
+            glGenBuffers(1, &sb->buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, sb->buffer);
+        }
+        // nor those of the persistent mapping that failed
+        while (glGetError() != GL_NO_ERROR)
+            ;
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+    }
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+void streamBufferFree(StreamBuffer *sb) {
+
+    while (sb->frameCount)
+        retireFrame(sb, true);
+
+    if (sb->persistent) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, sb->buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+    glDeleteBuffers(1, &sb->buffer);
+    memset(sb, 0, sizeof(StreamBuffer));
+}
+
+void *streamBufferMap(StreamBuffer *sb, size_t size, size_t alignment, size_t *offset) {
+
+    if (alignment == 0)
+        alignment = 1;
+    if (size > sb->size) {
+        sb->stats.overflows++;
+        return NULL;
+    }
+
+    size_t start = (sb->head + alignment - 1) / alignment * alignment;
+    size_t taken = start + size - sb->head;
+    bool wrap = start + size > sb->size;
+
+    // from the start again, the end of the ring is lost
+    if (wrap) {
+        start = 0;
+        taken = sb->size - sb->head + size;
+    }
+
+    if (sb->persistent) {
+        // the frames still reading the space must be done
+        while (sb->used + taken > sb->size && sb->frameCount)
+            retireFrame(sb, true);
+        if (sb->used + taken > sb->size) {
+            // the current frame alone fills the ring
+            sb->stats.overflows++;
+            return NULL;
+        }
+    } else if (wrap) {
+        // new storage, the GPU keeps reading the old one
+        glBindBuffer(GL_COPY_WRITE_BUFFER, sb->buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, sb->size, NULL, GL_STREAM_DRAW);
+        taken = size;
+        sb->used = 0;
+    }
+
+    if (wrap)
+        sb->stats.wraps++;
+    sb->stats.bytes += size;
+    sb->head = start + size;
+    sb->used += taken;
+    sb->frameBytes += taken;
+    *offset = start;
+
+    if (sb->persistent)
+        return sb->mapped + start;
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, sb->buffer);
+    return glMapBufferRange(GL_COPY_WRITE_BUFFER, start, size,
+                            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+void streamBufferUnmap(StreamBuffer *sb) {
+
+    // coherent memory is seen by the GPU as it is written
+    if (sb->persistent)
+        return;
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, sb->buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+}
+
+void streamBufferEndFrame(StreamBuffer *sb) {
+
+    if (!sb->persistent) {
+        sb->frameBytes = 0;
+        return;
+    }
+
+    // give back what the GPU is done with, without waiting
+    while (sb->frameCount) {
+        int before = sb->frameCount;
+        retireFrame(sb, sb->frameCount == STREAM_MAX_FRAMES);
+        if (sb->frameCount == before)
+            break;
+    }
+
+    if (sb->frameBytes == 0)
+        return;
+
+    StreamFrame *frame = &sb->frames[sb->frameCount++];
+    frame->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame->bytes = sb->frameBytes;
+    sb->frameBytes = 0;
+}
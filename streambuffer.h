@@ -0,0 +1,72 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+// ----------------------------------------------------
+// STREAM BUFFERS
+//
+// A ring in one buffer object for what changes every
+// frame: debug lines, particles, per object constants.
+// Writes go straight to memory the GPU reads from.
+//
+// With ARB_buffer_storage the buffer is mapped once,
+// persistent and coherent. Each frame ends with a fence,
+// and space is only written again once the frame that
+// used it is done, so nothing waits on the driver.
+//
+// Without it, each write maps its range unsynchronized,
+// which is safe since the ring never goes back over
+// what was written since the last wrap, and wrapping
+// orphans the storage so the GPU keeps the old one.
+//
+
+#define STREAM_MAX_FRAMES 4
+
+struct StreamFrame {
+    GLsync fence;
+    size_t bytes;       // taken from the ring in the frame
+};
+
+struct StreamStats {
+    size_t bytes;       // written since the last reset
+    int waits;          // times a fence had to be waited on
+    int wraps;
+    int overflows;      // writes bigger than the ring
+};
+
+struct StreamBuffer {
+    GLuint buffer;
+    size_t size;
+    bool persistent;
+    unsigned char *mapped;  // the whole ring, when persistent
+
+    size_t head;        // where the next write goes
+    size_t used;        // bytes not yet given back
+    size_t frameBytes;  // taken in the current frame
+
+    // frames still read by the GPU, oldest first
+    StreamFrame frames[STREAM_MAX_FRAMES];
+    int frameCount;
+
+    StreamStats stats;
+};
+
+// after glewInit, size in bytes
+bool streamBufferInit(StreamBuffer *sb, size_t size);
+void streamBufferFree(StreamBuffer *sb);
+
+// space for size bytes at a multiple of alignment, with the
+// offset of the space in the buffer; returns NULL if size
+// is more than the ring holds. What is written becomes
+// visible to GL with streamBufferUnmap, and must be drawn
+// before streamBufferEndFrame.
+void *streamBufferMap(StreamBuffer *sb, size_t size, size_t alignment, size_t *offset);
+void streamBufferUnmap(StreamBuffer *sb);
+
+// once a frame, after the draws that read the frame's data
+void streamBufferEndFrame(StreamBuffer *sb);
+
+#endif
@@ -0,0 +1,231 @@
+#include <math.h>
+#include <string.h>
+
+#include "matrixstack.h"
+
+
+static const float identityMatrix[16] =
+{
+	1.0f, 0.0f, 0.0f, 0.0f,
+	0.0f, 1.0f, 0.0f, 0.0f,
+	0.0f, 0.0f, 1.0f, 0.0f,
+	0.0f, 0.0f, 0.0f, 1.0f
+};
+
+
+//---------
+/// Math
+//---------
+
+
+void matrixMult(float* res, const float* a, const float* b)
+{
+	float m[16];
+	int i, j, k;
+
+	for (i = 0; i < 4; ++i)
+		for (j = 0; j < 4; ++j)
+		{
+			m[j*4+i] = 0.0f;
+			for (k = 0; k < 4; ++k)
+				m[j*4+i] += a[k*4+i] * b[j*4+k];
+		}
+
+	memcpy(res, m, sizeof(m));
+}
+
+
+//----------
+/// Levels
+//----------
+
+
+static void ResetLevel(MatrixLevel* level)
+{
+	memcpy(level->local, identityMatrix, sizeof(identityMatrix));
+	level->identity = 1;
+	level->dirty = 1;
+}
+
+
+// Recomputes concat only if this level or one below changed
+static MatrixLevel* ResolveLevel(MatrixStack* stack, int n)
+{
+	MatrixLevel* level = &stack->levels[n];
+	MatrixLevel* parent = NULL;
+
+	if (n > 0)
+		parent = ResolveLevel(stack, n - 1);
+
+	if (level->dirty || (parent && level->parentStamp != parent->stamp))
+	{
+		if (!parent)
+			memcpy(level->concat, level->local, sizeof(level->concat));
+		else if (level->identity)
+			memcpy(level->concat, parent->concat, sizeof(level->concat));
+		else
+			matrixMult(level->concat, parent->concat, level->local);
+
+		level->parentStamp = parent ? parent->stamp : 0;
+		level->stamp = ++stack->stamps;
+		level->dirty = 0;
+	}
+
+	return level;
+}
+
+
+//---------
+/// Stack
+//---------
+
+
+void matrixStackInit(MatrixStack* stack)
+{
+	stack->top = 0;
+	stack->stamps = 0;
+	ResetLevel(&stack->levels[0]);
+}
+
+
+// The new level starts as the identity, so until it changes
+// its product is a copy of the parent's cached one
+int matrixStackPush(MatrixStack* stack)
+{
+	if (stack->top + 1 >= MATRIX_STACK_DEPTH)
+		return 0;
+
+	ResetLevel(&stack->levels[++stack->top]);
+	return 1;
+}
+
+
+int matrixStackPop(MatrixStack* stack)
+{
+	if (stack->top == 0)
+		return 0;
+
+	--stack->top;
+	return 1;
+}
+
+
+void matrixStackLoadIdentity(MatrixStack* stack)
+{
+	ResetLevel(&stack->levels[stack->top]);
+}
+
+
+void matrixStackLoad(MatrixStack* stack, const float* m)
+{
+	MatrixLevel* level = &stack->levels[stack->top];
+
+	memcpy(level->local, m, sizeof(level->local));
+	level->identity = 0;
+	level->dirty = 1;
+}
+
+
+void matrixStackMult(MatrixStack* stack, const float* m)
+{
+	MatrixLevel* level = &stack->levels[stack->top];
+
+	if (level->identity)
+		memcpy(level->local, m, sizeof(level->local));
+	else
+		matrixMult(level->local, level->local, m);
+	level->identity = 0;
+	level->dirty = 1;
+}
+
+
+void matrixStackTranslate(MatrixStack* stack, float x, float y, float z)
+{
+	float m[16];
+
+	memcpy(m, identityMatrix, sizeof(m));
+	m[12] = x;
+	m[13] = y;
+	m[14] = z;
+	matrixStackMult(stack, m);
+}
+
+
+// Same matrix as glRotatef
+void matrixStackRotate(MatrixStack* stack, float degrees, float x, float y, float z)
+{
+	float m[16];
+	float len = sqrtf(x*x + y*y + z*z);
+	float angle = degrees * (float)M_PI / 180.0f;
+	float c = cosf(angle);
+	float s = sinf(angle);
+	float t = 1.0f - c;
+
+	if (len == 0.0f)
+		return;
+	x /= len;
+	y /= len;
+	z /= len;
+
+	m[0] = x*x*t + c;	m[4] = x*y*t - z*s;	m[8] = x*z*t + y*s;		m[12] = 0.0f;
+	m[1] = y*x*t + z*s;	m[5] = y*y*t + c;	m[9] = y*z*t - x*s;		m[13] = 0.0f;
+	m[2] = z*x*t - y*s;	m[6] = z*y*t + x*s;	m[10] = z*z*t + c;		m[14] = 0.0f;
+	m[3] = 0.0f;		m[7] = 0.0f;		m[11] = 0.0f;			m[15] = 1.0f;
+	matrixStackMult(stack, m);
+}
+
+
+void matrixStackScale(MatrixStack* stack, float x, float y, float z)
+{
+	float m[16];
+
+	memcpy(m, identityMatrix, sizeof(m));
+	m[0] = x;
+	m[5] = y;
+	m[10] = z;
+	matrixStackMult(stack, m);
+}
+
+
+// Same matrix as buildPerspective in camera.c
+void matrixStackPerspective(MatrixStack* stack, float fov, float ratio, float nearPlane, float farPlane)
+{
+	float m[16];
+	float focal = 1.0f / tanf(fov * (float)M_PI / 360.0f);
+
+	memset(m, 0, sizeof(m));
+	m[0] = focal / ratio;
+	m[1 * 4 + 1] = focal;
+	m[2 * 4 + 2] = (farPlane + nearPlane) / (nearPlane - farPlane);
+	m[3 * 4 + 2] = (2.0f * farPlane * nearPlane) / (nearPlane - farPlane);
+	m[2 * 4 + 3] = -1.0f;
+	matrixStackMult(stack, m);
+}
+
+
+void matrixStackOrtho(MatrixStack* stack, float left, float right, float bottom, float top, float nearPlane, float farPlane)
+{
+	float m[16];
+
+	memset(m, 0, sizeof(m));
+	m[0] = 2.0f / (right - left);
+	m[5] = 2.0f / (top - bottom);
+	m[10] = -2.0f / (farPlane - nearPlane);
+	m[12] = -(right + left) / (right - left);
+	m[13] = -(top + bottom) / (top - bottom);
+	m[14] = -(farPlane + nearPlane) / (farPlane - nearPlane);
+	m[15] = 1.0f;
+	matrixStackMult(stack, m);
+}
+
+
+const float* matrixStackTop(MatrixStack* stack)
+{
+	return ResolveLevel(stack, stack->top)->concat;
+}
+
+
+unsigned int matrixStackStamp(MatrixStack* stack)
+{
+	return ResolveLevel(stack, stack->top)->stamp;
+}
@@ -0,0 +1,70 @@
+#ifndef MATRIXSTACK_H
+#define MATRIXSTACK_H
+
+
+//----------------
+/// Matrix stack
+//----------------
+
+
+// A CPU replacement for glMatrixMode / glPushMatrix /
+// gluPerspective, for contexts without the fixed function
+// matrices. Matrices are column major, as uniforms expect.
+//
+// Each level keeps its own matrix and the product of the
+// levels below it with it. Products are only redone when
+// a level or one below it changed, so pushing again and
+// again on an unchanged parent costs a copy at most.
+// The stamp of the top changes whenever its product does,
+// so callers can skip uploading an unchanged matrix.
+
+
+#define MATRIX_STACK_DEPTH 32
+
+
+typedef struct
+{
+	float local[16];			// this level's matrix
+	float concat[16];			// product of every level up to this one
+	int identity;				// local is the identity
+	int dirty;					// local changed since concat was computed
+	unsigned int stamp;			// changes each time concat does
+	unsigned int parentStamp;	// stamp of the parent concat was computed from
+} MatrixLevel;
+
+
+typedef struct
+{
+	MatrixLevel levels[MATRIX_STACK_DEPTH];
+	int top;
+	unsigned int stamps;
+} MatrixStack;
+
+
+void matrixStackInit(MatrixStack* stack);
+
+// return 0 on overflow / underflow
+int matrixStackPush(MatrixStack* stack);
+int matrixStackPop(MatrixStack* stack);
+
+// these change the top level: top = top * m
+void matrixStackLoadIdentity(MatrixStack* stack);
+void matrixStackLoad(MatrixStack* stack, const float* m);
+void matrixStackMult(MatrixStack* stack, const float* m);
+void matrixStackTranslate(MatrixStack* stack, float x, float y, float z);
+void matrixStackRotate(MatrixStack* stack, float degrees, float x, float y, float z);
+void matrixStackScale(MatrixStack* stack, float x, float y, float z);
+
+// the matrices of gluPerspective and glOrtho
+void matrixStackPerspective(MatrixStack* stack, float fov, float ratio, float nearPlane, float farPlane);
+void matrixStackOrtho(MatrixStack* stack, float left, float right, float bottom, float top, float nearPlane, float farPlane);
+
+// product of the whole stack, valid until the next change
+const float* matrixStackTop(MatrixStack* stack);
+unsigned int matrixStackStamp(MatrixStack* stack);
+
+// res = a * b, res may be a or b
+void matrixMult(float* res, const float* a, const float* b);
+
+
+#endif
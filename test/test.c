@@ -17,6 +17,7 @@
 #endif
 #include <stdlib.h>
 #include <stdio.h>
+#include "matrixstack.h"
 
 
 //-------
@@ -25,7 +26,6 @@
 
 
 // - I found some demos on the net that set cColorBits = 32
-// - Is it realy necessary to recompile the shaders when switching fullscreen / windowed mode?
 
 
 //-------
@@ -101,6 +101,60 @@ static void printexit(char* format, ...)
 }
 
 
+//------------
+/// Matrices
+//------------
+
+
+// Replaces the fixed function matrices, that core contexts
+// do not have. The product is uploaded to the program as
+// a uniform, and only when one of the stacks changed.
+
+
+MatrixStack projectionStack;
+MatrixStack modelviewStack;
+
+
+static void InitMatrices()
+{
+	matrixStackInit(&projectionStack);
+	matrixStackInit(&modelviewStack);
+	matrixStackTranslate(&modelviewStack, 0.0f, 0.0f, -3.0f);
+}
+
+
+static void SetupProjection(GLsizei width, GLsizei height)
+{
+	matrixStackLoadIdentity(&projectionStack);
+	matrixStackPerspective(&projectionStack, 45.0f, (GLfloat)width/(GLfloat)height, 0.1f, 100.0f);
+}
+
+
+#ifdef GLEW_
+GLint idMvpMatrix;
+
+unsigned int uploadedProjection;
+unsigned int uploadedModelview;
+
+
+static void UploadMatrices()
+{
+	unsigned int projection = matrixStackStamp(&projectionStack);
+	unsigned int modelview = matrixStackStamp(&modelviewStack);
+	float mvp[16];
+	
+	if (projection == uploadedProjection && modelview == uploadedModelview)
+		return;
+	
+	matrixMult(mvp, matrixStackTop(&projectionStack), matrixStackTop(&modelviewStack));
+	glUniformMatrix4fv(idMvpMatrix, 1, GL_FALSE, mvp);
+	
+	uploadedProjection = projection;
+	uploadedModelview = modelview;
+}
+#endif
+
+
 //-----------
 /// Shaders
 //-----------
@@ -108,27 +162,31 @@ static void printexit(char* format, ...)
 
 #ifdef GLEW_
 static const char* pVS = "							\n\
-#version 120										\n\
+#version 330 core									\n\
+													\n\
+uniform mat4 mvpMatrix;								\n\
 													\n\
-attribute vec3 vertex_coord;						\n\
+in vec4 vertex_coord;								\n\
 													\n\
-varying vec4 final_color;							\n\
+out vec4 final_color;								\n\
 													\n\
 void main()											\n\
 {													\n\
-	gl_Position = gl_Vertex;						\n\
+	gl_Position = mvpMatrix * vertex_coord;			\n\
 	final_color = vec4(.525, .322, .004, 1.0);		\n\
 }";
 
 
 static const char* pFS = "							\n\
-#version 120										\n\
+#version 330 core									\n\
 													\n\
-varying vec4 final_color;							\n\
+in vec4 final_color;								\n\
+													\n\
+out vec4 frag_color;								\n\
 													\n\
 void main()											\n\
 {													\n\
-	gl_FragColor = final_color;						\n\
+	frag_color = final_color;						\n\
 }";
 
 
@@ -184,6 +242,7 @@ static void AddShaders(GLuint ShaderProgram)
 
 
 #ifdef GLEW_
+GLuint VAO;
 GLuint VBO;
 
 
@@ -195,6 +254,10 @@ static void CreateVertexBuffer()
 		0.0f, 1.0f, 0.0f, 1.0f
 	};
 
+	// Core contexts draw nothing without a vertex array
+	glGenVertexArrays(1, &VAO);
+	glBindVertexArray(VAO);
+	
 	glGenBuffers(1, &VBO);
 
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
@@ -232,25 +295,29 @@ GLvoid ResizeGLScene(GLsizei width, GLsizei height)		// Resize And Initialize Th
 
 	glViewport(0, 0, width, height);					// Reset The Current Viewport
 
-	glMatrixMode(GL_PROJECTION);						// Select The Projection Matrix
-	glLoadIdentity();									// Reset The Projection Matrix
-
-	// Calculate The Aspect Ratio Of The Window
-	gluPerspective(45.0f, (GLfloat)width/(GLfloat)height, 0.1f, 100.0f);
+	SetupProjection(width, height);						// Calculate The Projection Matrix
 
+#ifdef IMMEDIATE_
+	glMatrixMode(GL_PROJECTION);						// Select The Projection Matrix
+	glLoadMatrixf(matrixStackTop(&projectionStack));	// Load The Projection Matrix
 	glMatrixMode(GL_MODELVIEW);							// Select The Modelview Matrix
 	glLoadIdentity();									// Reset The Modelview Matrix
+#endif
 }
 
 
 void SetupGL(GLvoid)									// All Setup For OpenGL Goes Here
 {
+#ifdef IMMEDIATE_
 	glShadeModel(GL_SMOOTH);							// Enable Smooth Shading
+#endif
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);				// Black Background
 	glClearDepth(1.0f);									// Depth Buffer Setup
 	glEnable(GL_DEPTH_TEST);							// Enables Depth Testing
 	glDepthFunc(GL_LEQUAL);								// The Type Of Depth Testing To Do
+#ifdef IMMEDIATE_
 	glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);	// Really Nice Perspective Calculations
+#endif
 }
 
 
@@ -515,8 +582,11 @@ static void AdjustGLContext()
 		int attribs[] =
 		{
 			WGL_CONTEXT_MAJOR_VERSION_ARB, 3,
-			WGL_CONTEXT_MINOR_VERSION_ARB, 0,
+			WGL_CONTEXT_MINOR_VERSION_ARB, 3,
 			WGL_CONTEXT_FLAGS_ARB, 0,
+			#ifndef IMMEDIATE_
+			WGL_CONTEXT_PROFILE_MASK_ARB, WGL_CONTEXT_CORE_PROFILE_BIT_ARB,
+			#endif
 			0
 		};
 		
@@ -569,6 +639,7 @@ void RenderScene()
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
 	
+	UploadMatrices();
 	glDrawArrays(GL_TRIANGLES, 0, 3);
 	
 	glDisableVertexAttribArray(0);
@@ -576,6 +647,162 @@ void RenderScene()
 }
 
 
+//------------------
+/// Program binary
+//------------------
+
+
+// The linked program is saved with glGetProgramBinary and
+// loaded back the next time, at startup and when switching
+// fullscreen / windowed mode recreates the context, so the
+// shaders are only compiled when the binary is missing or
+// the driver rejects it. The key hashes the shaders and the
+// driver strings, so either changing misses; each key has
+// its own file in the cache directory, named by the key.
+
+
+#define PROGRAM_CACHE_DIR "programs"
+
+
+typedef struct
+{
+	unsigned long long key;
+	GLenum format;
+	GLint size;
+} ProgramBinaryHeader;
+
+
+static double Seconds()
+{
+	LARGE_INTEGER frequency, counter;
+	
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+
+static BOOL ProgramBinarySupported()
+{
+	GLint formats = 0;
+	
+	if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+
+// FNV-1a, the terminating 0 included
+static unsigned long long HashString(unsigned long long hash, const char* s)
+{
+	do
+	{
+		hash ^= (unsigned char)(s ? *s : 0);
+		hash *= 0x100000001b3ULL;
+	} while (s && *s++);
+	return hash;
+}
+
+
+static unsigned long long ProgramKey()
+{
+	unsigned long long key = 0xcbf29ce484222325ULL;
+	
+	key = HashString(key, pVS);
+	key = HashString(key, pFS);
+	key = HashString(key, (const char*)glGetString(GL_VENDOR));
+	key = HashString(key, (const char*)glGetString(GL_RENDERER));
+	key = HashString(key, (const char*)glGetString(GL_VERSION));
+	return key;
+}
+
+
+static void ProgramBinaryPath(char* path, size_t size, unsigned long long key, const char* suffix)
+{
+	_snprintf(path, size, "%s/%016llx.bin%s", PROGRAM_CACHE_DIR, key, suffix);
+	path[size - 1] = 0;
+}
+
+
+static BOOL LoadProgramBinary(GLuint p)
+{
+	ProgramBinaryHeader header;
+	GLint linked = GL_FALSE;
+	char path[MAX_PATH];
+	long length;
+	
+	if (!ProgramBinarySupported())
+		return FALSE;
+	
+	unsigned long long key = ProgramKey();
+	ProgramBinaryPath(path, sizeof(path), key, "");
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return FALSE;
+	
+	// the size read is trusted only as far as the file goes
+	fseek(file, 0, SEEK_END);
+	length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	
+	if (length >= (long)sizeof(header) && fread(&header, sizeof(header), 1, file) == 1 &&
+		header.key == key && header.size > 0 && header.size <= length - (long)sizeof(header))
+	{
+		void* binary = malloc(header.size);
+		if (binary && fread(binary, 1, header.size, file) == (size_t)header.size)
+		{
+			glProgramBinary(p, header.format, binary, header.size);
+			glGetProgramiv(p, GL_LINK_STATUS, &linked);
+		}
+		free(binary);
+	}
+	fclose(file);
+	
+	if (linked != GL_TRUE)
+		printlog("Program binary out of date or rejected");
+	return linked == GL_TRUE;
+}
+
+
+static void SaveProgramBinary(GLuint p)
+{
+	ProgramBinaryHeader header;
+	GLint linked = GL_FALSE;
+	char path[MAX_PATH], temporary[MAX_PATH];
+	
+	if (!ProgramBinarySupported())
+		return;
+	
+	glGetProgramiv(p, GL_LINK_STATUS, &linked);
+	glGetProgramiv(p, GL_PROGRAM_BINARY_LENGTH, &header.size);
+	if (linked != GL_TRUE || header.size <= 0)
+		return;
+	
+	void* binary = malloc(header.size);
+	if (!binary)
+		return;
+	glGetProgramBinary(p, header.size, &header.size, &header.format, binary);
+	header.key = ProgramKey();
+	
+	// written aside and renamed, so a binary is whole or absent
+	CreateDirectoryA(PROGRAM_CACHE_DIR, NULL);
+	ProgramBinaryPath(path, sizeof(path), header.key, "");
+	ProgramBinaryPath(temporary, sizeof(temporary), header.key, ".tmp");
+	FILE* file = fopen(temporary, "wb");
+	if (file)
+	{
+		BOOL written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(binary, 1, header.size, file) == (size_t)header.size;
+		written = fclose(file) == 0 && written;
+		if (written && MoveFileExA(temporary, path, MOVEFILE_REPLACE_EXISTING))
+			printlog("Program binary saved");
+		else
+			DeleteFileA(temporary);
+	}
+	free(binary);
+}
+
+
 //-----------
 /// Program
 //-----------
@@ -589,18 +816,38 @@ static void CreateProgram()
 	CreateVertexBuffer();
 	
 	GLuint p;
+	double start = Seconds();
 	
 	// Create the program
 	p = glCreateProgram();
 	printlog("Program created");
 	
-	AddShaders(p);
+	if (LoadProgramBinary(p))
+		printlog("Program loaded from its binary in %.2f ms", (Seconds() - start) * 1000.0);
+	else
+	{
+		CreateShaders();
+		AddShaders(p);
+		glBindAttribLocation(p, 0, "vertex_coord");
+		glBindFragDataLocation(p, 0, "frag_color");
+		
+		// Link, keeping the binary
+		if (ProgramBinarySupported())
+			glProgramParameteri(p, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(p);
+		printlog("Program compiled in %.2f ms", (Seconds() - start) * 1000.0);
+		SaveProgramBinary(p);
+	}
 	
-	// Link and set program to use
-	glLinkProgram(p);
+	// Set program to use
 	glUseProgram(p);
 	
 	idProgram = p;
+	idMvpMatrix = glGetUniformLocation(p, "mvpMatrix");
+	
+	// A new program has no matrix yet
+	uploadedProjection = 0;
+	uploadedModelview = 0;
 }
 
 
@@ -639,6 +886,8 @@ int main(void)
 	BOOL	done=FALSE;								// Bool Variable To Exit Loop
 #endif
 	
+	InitMatrices();
+	
 #ifdef GLFW_
 	// Initialize GLFW
 	if (!glfwInit())
@@ -650,10 +899,10 @@ int main(void)
 	#ifdef OPENGL3_
 	glfwWindowHint(GLFW_FSAA_SAMPLES, 8);
 	glfwWindowHint(GLFW_OPENGL_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_OPENGL_VERSION_MINOR, 0);
+	glfwWindowHint(GLFW_OPENGL_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
     // only enable NON-deprecated features
-    // from belkiss: glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     // from belkiss: glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     // from belkiss: glfwWindowHint(GLFW_OPENGL_ROBUSTNESS, GLFW_OPENGL_NO_ROBUSTNESS);
 	#endif
@@ -668,6 +917,7 @@ int main(void)
 		exit(EXIT_FAILURE);
 	}
 	glfwMakeContextCurrent(window);
+	SetupProjection(600, 400);
 	
 	glfwSetWindowTitle(window, "Hello world from GLFW!");
 	
@@ -677,10 +927,10 @@ int main(void)
 		printexit("Unable to initialize GLEW: %d %s %s", err, glewGetErrorString(err), glewGetString(GLEW_VERSION));
 	else
 		printlog("GLEW initialized");
-	if (glewIsSupported("GL_VERSION_3_0"))
-		printlog("Ready for OpenGL 3.0");
+	if (glewIsSupported("GL_VERSION_3_3"))
+		printlog("Ready for OpenGL 3.3");
 	else
-		printexit("OpenGL 3.0 not supported");
+		printexit("OpenGL 3.3 not supported");
 	#endif
 #else
 	CreateGLWindow(L"OpenGL", 640, 480, fullscreen);
@@ -698,7 +948,6 @@ int main(void)
 
 #ifdef GLEW_
 #ifndef IMMEDIATE_
-	CreateShaders();
 	CreateProgram();
 #endif
 #endif
@@ -777,7 +1026,6 @@ int main(void)
 				AdjustGLContext();
 				#ifndef IMMEDIATE_
 				ReleaseProgram();
-				CreateShaders();
 				CreateProgram();
 				#endif
 				#endif
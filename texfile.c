@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "texfile.h"
+
+// ----------------------------------------------------
+// READING
+//
+
+static bool fail(TextureFile *file, const char *path, const char *why) {
+
+    printf("%s: %s\n", path, why);
+    textureFileClose(file);
+    return false;
+}
+
+bool textureFileOpen(TextureFile *file, const char *path) {
+
+    memset(file, 0, sizeof(TextureFile));
+    if (!mappedFileOpen(&file->map, path)) {
+        printf("%s: cannot open\n", path);
+        return false;
+    }
+
+    const TextureFileHeader *h = (const TextureFileHeader *) file->map.data;
+    if (file->map.size < sizeof(TextureFileHeader) || h->magic != TEXTURE_FILE_MAGIC)
+        return fail(file, path, "not a texture file");
+    if (h->version != TEXTURE_FILE_VERSION)
+        return fail(file, path, "unknown version");
+    if (h->levelCount == 0 || h->levelCount > TEXTURE_FILE_MAX_LEVELS)
+        return fail(file, path, "bad levels");
+
+    for (unsigned int i = 0; i < h->levelCount; ++i) {
+        const TextureFileLevel *l = &h->levels[i];
+        if (l->size != (unsigned long long) l->width * l->height * h->bytesPerPixel)
+            return fail(file, path, "bad levels");
+        if (l->offset % TEXTURE_FILE_ALIGNMENT != 0 || l->offset > file->map.size || l->size > file->map.size - l->offset)
+            return fail(file, path, "truncated");
+    }
+
+    file->header = h;
+    return true;
+}
+
+void textureFileClose(TextureFile *file) {
+
+    mappedFileClose(&file->map);
+    memset(file, 0, sizeof(TextureFile));
+}
+
+const void *textureFileLevel(const TextureFile *file, int level) {
+
+    return file->map.data + file->header->levels[level].offset;
+}
+
+// ----------------------------------------------------
+// WRITING
+//
+
+static unsigned long long aligned(unsigned long long offset) {
+
+    return (offset + TEXTURE_FILE_ALIGNMENT - 1) / TEXTURE_FILE_ALIGNMENT * TEXTURE_FILE_ALIGNMENT;
+}
+
+static bool pad(FILE *f, unsigned long long from, unsigned long long to) {
+
+    static const unsigned char zeros[TEXTURE_FILE_ALIGNMENT] = { 0 };
+    return fwrite(zeros, 1, (size_t)(to - from), f) == to - from;
+}
+
+bool textureFileWrite(const char *path, TextureFileHeader *header, const void *const *levels) {
+
+    header->magic = TEXTURE_FILE_MAGIC;
+    header->version = TEXTURE_FILE_VERSION;
+
+    unsigned long long offset = sizeof(TextureFileHeader);
+    for (unsigned int i = 0; i < header->levelCount; ++i) {
+        TextureFileLevel *l = &header->levels[i];
+        l->size = (unsigned long long) l->width * l->height * header->bytesPerPixel;
+        l->offset = aligned(offset);
+        offset = l->offset + l->size;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    bool ok = fwrite(header, sizeof(TextureFileHeader), 1, f) == 1;
+    offset = sizeof(TextureFileHeader);
+    for (unsigned int i = 0; ok && i < header->levelCount; ++i) {
+        const TextureFileLevel *l = &header->levels[i];
+        ok = pad(f, offset, l->offset) && fwrite(levels[i], 1, (size_t) l->size, f) == l->size;
+        offset = l->offset + l->size;
+    }
+
+    return fclose(f) == 0 && ok;
+}
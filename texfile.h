@@ -0,0 +1,65 @@
+#ifndef TEXFILE_H
+#define TEXFILE_H
+
+#include "mapfile.h"
+
+// ----------------------------------------------------
+// TEXTURE FILES
+//
+// Textures as glTexImage2D takes them: a header giving
+// the GL formats and the size of each level, then the
+// levels from the full image down to 1x1, each starting
+// on 64 bytes. Like mesh files they are opened by mapping
+// them, the levels pointing into the mapping.
+//
+// The cooker writes RGBA8, rows tightly packed, which
+// suits the default GL_UNPACK_ALIGNMENT of 4.
+//
+
+#define TEXTURE_FILE_EXTENSION ".g33t"
+#define TEXTURE_FILE_MAGIC 0x54333347   // "G33T"
+#define TEXTURE_FILE_VERSION 1
+#define TEXTURE_FILE_ALIGNMENT 64
+#define TEXTURE_FILE_MAX_LEVELS 16
+
+struct TextureFileLevel {
+    unsigned int width;
+    unsigned int height;
+
+    // in bytes from the start of the file
+    unsigned long long offset;
+    unsigned long long size;
+};
+
+struct TextureFileHeader {
+    unsigned int magic;
+    unsigned int version;
+
+    // as glTexImage2D takes them
+    unsigned int internalFormat;
+    unsigned int format;
+    unsigned int type;
+    unsigned int bytesPerPixel;
+
+    unsigned int levelCount;
+    unsigned int reserved;
+    TextureFileLevel levels[TEXTURE_FILE_MAX_LEVELS];
+};
+
+struct TextureFile {
+    MappedFile map;
+    const TextureFileHeader *header;
+};
+
+// prints why when the file cannot be used
+bool textureFileOpen(TextureFile *file, const char *path);
+void textureFileClose(TextureFile *file);
+
+// in the mapping
+const void *textureFileLevel(const TextureFile *file, int level);
+
+// header gives the formats and the level sizes, the
+// offsets are filled in; false when it cannot be written
+bool textureFileWrite(const char *path, TextureFileHeader *header, const void *const *levels);
+
+#endif
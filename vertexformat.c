@@ -0,0 +1,456 @@
+#include <string.h>
+#include <math.h>
+
+#include <GL/glew.h>
+
+#include "vertexformat.h"
+#include "cpu.h"
+
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
+// ----------------------------------------------------
+// CONVERSIONS
+//
+
+// round to nearest even, with denormals, infinities and nans
+static unsigned short halfFromFloat(float f) {
+
+    unsigned int x;
+    memcpy(&x, &f, sizeof(x));
+
+    unsigned int sign = (x >> 16) & 0x8000;
+    unsigned int mag = x & 0x7fffffff;
+
+    if (mag >= 0x7f800000)
+        return sign | 0x7c00 | (mag > 0x7f800000 ? 0x200 : 0);
+
+    // 65520 and above round to infinity
+    if (mag >= 0x477ff000)
+        return sign | 0x7c00;
+
+    // below 2^-14 the half is denormal
+    if (mag < 0x38800000) {
+        if (mag < 0x33000000)
+            return sign;
+        unsigned int e = mag >> 23;
+        unsigned int m = (mag & 0x7fffff) | 0x800000;
+        unsigned int shift = 126 - e;
+        unsigned int h = m >> shift;
+        unsigned int rem = m & ((1u << shift) - 1);
+        unsigned int halfway = 1u << (shift - 1);
+        if (rem > halfway || (rem == halfway && (h & 1)))
+            h++;
+        return sign | h;
+    }
+
+    unsigned int h = (mag - 0x38000000) >> 13;
+    unsigned int rem = mag & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+        h++;
+    return sign | h;
+}
+
+static float halfToFloat(unsigned short h) {
+
+    unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+    unsigned int e = (h >> 10) & 0x1f;
+    unsigned int m = h & 0x3ff;
+    unsigned int x;
+
+    if (e == 0) {
+        float f = m * (1.0f / 16777216.0f);
+        return sign ? -f : f;
+    }
+    if (e == 31)
+        x = sign | 0x7f800000 | (m << 13);
+    else
+        x = sign | ((e + 112) << 23) | (m << 13);
+
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static short snorm16(float f) {
+
+    f = f < -1.0f ? -1.0f : f > 1.0f ? 1.0f : f;
+    return (short) lrintf(f * 32767.0f);
+}
+
+static float fromSnorm16(short s) {
+
+    float f = s * (1.0f / 32767.0f);
+    return f < -1.0f ? -1.0f : f;
+}
+
+static unsigned char unorm8(float f) {
+
+    f = f < 0.0f ? 0.0f : f > 1.0f ? 1.0f : f;
+    return (unsigned char) lrintf(f * 255.0f);
+}
+
+static float signNotZero(float f) {
+
+    return f >= 0.0f ? 1.0f : -1.0f;
+}
+
+// the unit octahedron unfolded on the [-1, 1] square,
+// the lower half folded over the corners
+static void octEncode(float *e, const float *n) {
+
+    float l = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+
+    if (l == 0.0f) {
+        e[0] = e[1] = 0.0f;
+        return;
+    }
+
+    float x = n[0] / l, y = n[1] / l;
+    if (n[2] < 0.0f) {
+        float fx = (1.0f - fabsf(y)) * signNotZero(x);
+        float fy = (1.0f - fabsf(x)) * signNotZero(y);
+        x = fx;
+        y = fy;
+    }
+    e[0] = x;
+    e[1] = y;
+}
+
+static void octDecode(float *n, const float *e) {
+
+    float x = e[0], y = e[1], z = 1.0f - fabsf(x) - fabsf(y);
+
+    if (z < 0.0f) {
+        float fx = (1.0f - fabsf(y)) * signNotZero(x);
+        float fy = (1.0f - fabsf(x)) * signNotZero(y);
+        x = fx;
+        y = fy;
+    }
+
+    float inv = 1.0f / sqrtf(x * x + y * y + z * z);
+    n[0] = x * inv;
+    n[1] = y * inv;
+    n[2] = z * inv;
+}
+
+// ----------------------------------------------------
+// FORMATS
+//
+
+static const struct {
+    int size;           // bytes per component
+    unsigned int glType;
+    bool normalized;
+} typeInfo[VERTEX_TYPES] = {
+    { 4, GL_FLOAT,         false },
+    { 2, GL_HALF_FLOAT,    false },
+    { 2, GL_SHORT,         true },
+    { 1, GL_UNSIGNED_BYTE, true },
+    { 2, GL_SHORT,         true },
+};
+
+void vertexFormatInit(VertexFormat *fmt) {
+
+    memset(fmt, 0, sizeof(VertexFormat));
+
+    for (int k = 0; k < 3; ++k)
+        fmt->positionExtent[k] = 1.0f;
+}
+
+bool vertexFormatAdd(VertexFormat *fmt, VertexSemantic semantic, VertexType type, int components) {
+
+    if (fmt->attribCount == VERTEX_MAX_ATTRIBS || components < 1 || components > 4)
+        return false;
+    if (type == VERTEX_OCT16 && components != 3)
+        return false;
+    if (type == VERTEX_SNORM16 && semantic == VERTEX_POSITION && components > 3)
+        return false;
+
+    VertexAttrib *a = &fmt->attribs[fmt->attribCount++];
+    a->semantic = semantic;
+    a->type = type;
+    a->components = type == VERTEX_OCT16 ? 2 : components;
+    a->offset = fmt->stride;
+    a->glType = typeInfo[type].glType;
+    a->normalized = typeInfo[type].normalized;
+
+    fmt->stride += (a->components * typeInfo[type].size + 3) & ~3;
+    return true;
+}
+
+void vertexFormatSetBounds(VertexFormat *fmt, const float *lo, const float *hi) {
+
+    for (int k = 0; k < 3; ++k) {
+        fmt->positionCenter[k] = 0.5f * (lo[k] + hi[k]);
+        fmt->positionExtent[k] = 0.5f * (hi[k] - lo[k]);
+        if (fmt->positionExtent[k] <= 0.0f)
+            fmt->positionExtent[k] = 1.0f;
+    }
+}
+
+const VertexAttrib *vertexFormatFind(const VertexFormat *fmt, VertexSemantic semantic) {
+
+    for (int i = 0; i < fmt->attribCount; ++i)
+        if (fmt->attribs[i].semantic == semantic)
+            return &fmt->attribs[i];
+    return NULL;
+}
+
+bool vertexFormatEqual(const VertexFormat *a, const VertexFormat *b) {
+
+    if (a->attribCount != b->attribCount || a->stride != b->stride)
+        return false;
+
+    for (int i = 0; i < a->attribCount; ++i)
+        if (a->attribs[i].semantic != b->attribs[i].semantic ||
+            a->attribs[i].type != b->attribs[i].type ||
+            a->attribs[i].components != b->attribs[i].components)
+            return false;
+
+    return memcmp(a->positionCenter, b->positionCenter, sizeof(a->positionCenter)) == 0 &&
+           memcmp(a->positionExtent, b->positionExtent, sizeof(a->positionExtent)) == 0;
+}
+
+void vertexFormatLegacy(VertexFormat *fmt) {
+
+    vertexFormatInit(fmt);
+    vertexFormatAdd(fmt, VERTEX_POSITION, VERTEX_FLOAT, 4);
+    vertexFormatAdd(fmt, VERTEX_COLOR, VERTEX_FLOAT, 4);
+}
+
+void vertexFormatScene(VertexFormat *fmt) {
+
+    vertexFormatInit(fmt);
+    vertexFormatAdd(fmt, VERTEX_POSITION, VERTEX_HALF, 3);
+    vertexFormatAdd(fmt, VERTEX_COLOR, VERTEX_UNORM8, 4);
+}
+
+void vertexSourceInit(VertexSource *src, int count) {
+
+    memset(src, 0, sizeof(VertexSource));
+    src->count = count;
+}
+
+void vertexSourceSet(VertexSource *src, VertexSemantic semantic, const float *data, int stride) {
+
+    src->data[semantic] = data;
+    src->stride[semantic] = stride;
+}
+
+// ----------------------------------------------------
+// PACKING
+//
+// One attribute at a time over all the vertices, so the
+// type is only switched on once per attribute.
+//
+
+#if CPU_X86
+
+// The conversion instruction rounds to nearest even as
+// halfFromFloat does. 4 floats are read per vertex, so
+// the last ones go through halfFromFloat when the source
+// has less than 4 floats per vertex.
+TARGET_F16C
+static void packHalfF16C(const float *in, int inStride, int n, int count, unsigned char *out, int outStride) {
+
+    // vertices whose 4 floats stay inside the source
+    int fast = 0, i = 0;
+    if (inStride >= 4)
+        fast = count;
+    else if (inStride > 0)
+        fast = count - (4 + inStride - 1) / inStride + 1;
+
+    for (; i < fast; ++i, in += inStride, out += outStride) {
+        __m128i h = _mm_cvtps_ph(_mm_loadu_ps(in), _MM_FROUND_TO_NEAREST_INT);
+        unsigned short v[8];
+        _mm_storeu_si128((__m128i *) v, h);
+        memcpy(out, v, n * sizeof(unsigned short));
+    }
+    for (; i < count; ++i, in += inStride, out += outStride)
+        for (int k = 0; k < n; ++k) {
+            unsigned short h = halfFromFloat(in[k]);
+            memcpy(out + k * sizeof(unsigned short), &h, sizeof(h));
+        }
+}
+
+#endif
+
+static void packAttrib(const VertexFormat *fmt, const VertexAttrib *a, const VertexSource *src, unsigned char *dst) {
+
+    const float *in = src->data[a->semantic];
+    int inStride = src->stride[a->semantic];
+    int n = a->components;
+    int count = src->count;
+    unsigned char *out = dst + a->offset;
+
+    // what attributes without data are filled with
+    float missing[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    if (a->semantic == VERTEX_COLOR)
+        missing[0] = missing[1] = missing[2] = missing[3] = 1.0f;
+    if (!in) {
+        in = missing;
+        inStride = 0;
+    }
+
+    switch (a->type) {
+
+    case VERTEX_FLOAT:
+        for (int i = 0; i < count; ++i, in += inStride, out += fmt->stride)
+            memcpy(out, in, n * sizeof(float));
+        break;
+
+    case VERTEX_HALF:
+#if CPU_X86
+        if (cpuIsa() >= ISA_AVX2) {
+            packHalfF16C(in, inStride, n, count, out, fmt->stride);
+            break;
+        }
+#endif
+        for (int i = 0; i < count; ++i, in += inStride, out += fmt->stride) {
+            unsigned short h[4];
+            for (int k = 0; k < n; ++k)
+                h[k] = halfFromFloat(in[k]);
+            memcpy(out, h, n * sizeof(unsigned short));
+        }
+        break;
+
+    case VERTEX_SNORM16:
+        if (a->semantic == VERTEX_POSITION) {
+            float scale[3];
+            for (int k = 0; k < 3; ++k)
+                scale[k] = 1.0f / fmt->positionExtent[k];
+            for (int i = 0; i < count; ++i, in += inStride, out += fmt->stride) {
+                short s[3];
+                for (int k = 0; k < n; ++k)
+                    s[k] = snorm16((in[k] - fmt->positionCenter[k]) * scale[k]);
+                memcpy(out, s, n * sizeof(short));
+            }
+        } else {
+            for (int i = 0; i < count; ++i, in += inStride, out += fmt->stride) {
+                short s[4];
+                for (int k = 0; k < n; ++k)
+                    s[k] = snorm16(in[k]);
+                memcpy(out, s, n * sizeof(short));
+            }
+        }
+        break;
+
+    case VERTEX_UNORM8:
+        for (int i = 0; i < count; ++i, in += inStride, out += fmt->stride)
+            for (int k = 0; k < n; ++k)
+                out[k] = unorm8(in[k]);
+        break;
+
+    case VERTEX_OCT16:
+        for (int i = 0; i < count; ++i, in += inStride, out += fmt->stride) {
+            float e[2];
+            short s[2];
+            octEncode(e, in);
+            s[0] = snorm16(e[0]);
+            s[1] = snorm16(e[1]);
+            memcpy(out, s, sizeof(s));
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+// the bytes an attribute leaves of its slot rounded up to
+// 4, zeroed so identical vertices are identical in bytes,
+// for welding and for the files cooked
+static void zeroPadding(const VertexFormat *fmt, const VertexAttrib *a, int count, unsigned char *dst) {
+
+    size_t used = a->components * typeInfo[a->type].size;
+    size_t slot = (used + 3) & ~(size_t) 3;
+    if (used == slot)
+        return;
+
+    unsigned char *out = dst + a->offset + used;
+    for (int i = 0; i < count; ++i, out += fmt->stride)
+        memset(out, 0, slot - used);
+}
+
+void vertexFormatPack(const VertexFormat *fmt, const VertexSource *src, void *dst) {
+
+    for (int i = 0; i < fmt->attribCount; ++i) {
+        packAttrib(fmt, &fmt->attribs[i], src, (unsigned char *) dst);
+        zeroPadding(fmt, &fmt->attribs[i], src->count, (unsigned char *) dst);
+    }
+}
+
+int vertexFormatUnpack(const VertexFormat *fmt, const void *vertices, int index,
+                       VertexSemantic semantic, float *out) {
+
+    const VertexAttrib *a = vertexFormatFind(fmt, semantic);
+    if (!a)
+        return 0;
+
+    const unsigned char *in = (const unsigned char *) vertices + (size_t) index * fmt->stride + a->offset;
+    int n = a->components;
+
+    switch (a->type) {
+
+    case VERTEX_FLOAT:
+        memcpy(out, in, n * sizeof(float));
+        return n;
+
+    case VERTEX_HALF: {
+        unsigned short h[4];
+        memcpy(h, in, n * sizeof(unsigned short));
+        for (int k = 0; k < n; ++k)
+            out[k] = halfToFloat(h[k]);
+        return n;
+    }
+
+    case VERTEX_SNORM16: {
+        short s[4];
+        memcpy(s, in, n * sizeof(short));
+        for (int k = 0; k < n; ++k)
+            out[k] = fromSnorm16(s[k]);
+        if (semantic == VERTEX_POSITION)
+            for (int k = 0; k < n; ++k)
+                out[k] = fmt->positionCenter[k] + fmt->positionExtent[k] * out[k];
+        return n;
+    }
+
+    case VERTEX_UNORM8:
+        for (int k = 0; k < n; ++k)
+            out[k] = in[k] * (1.0f / 255.0f);
+        return n;
+
+    case VERTEX_OCT16: {
+        short s[2];
+        float e[2];
+        memcpy(s, in, sizeof(s));
+        e[0] = fromSnorm16(s[0]);
+        e[1] = fromSnorm16(s[1]);
+        octDecode(out, e);
+        return 3;
+    }
+
+    default:
+        return 0;
+    }
+}
+
+// ----------------------------------------------------
+// GL
+//
+
+void vertexFormatBind(const VertexFormat *fmt, const int *locations, size_t offset) {
+
+    for (int i = 0; i < fmt->attribCount; ++i) {
+        const VertexAttrib *a = &fmt->attribs[i];
+        int location = locations[a->semantic];
+        if (location < 0)
+            continue;
+
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, a->components, a->glType, a->normalized,
+                              fmt->stride, (const void *)(offset + a->offset));
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <stddef.h>
+
+// ----------------------------------------------------
+// VERTEX FORMATS
+//
+// A format describes one interleaved vertex: which
+// attributes it holds, how each is stored and where.
+// Geometry is written in floats and packed into the
+// format, and the glVertexAttribPointer calls are made
+// from the same description, so the two always agree.
+//
+// Packed types trade precision for bandwidth: positions
+// in half floats or snorm16 (the w of 1 is left to GL),
+// colors in unorm8 and normals as octahedral snorm16.
+// Half float and normalized types need nothing from the
+// shaders, the other two are decoded there:
+//
+//   position = positionCenter + positionExtent * position;
+//
+//   vec3 octDecode(vec2 e) {
+//       vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+//       if (n.z < 0.0)
+//           n.xy = (1.0 - abs(n.yx)) * sign(n.xy);
+//       return normalize(n);
+//   }
+//
+// with sign() taken as 1 at 0, as the packer does.
+//
+
+#define VERTEX_MAX_ATTRIBS 8
+
+enum VertexSemantic {
+    VERTEX_POSITION,
+    VERTEX_NORMAL,
+    VERTEX_COLOR,
+    VERTEX_TEXCOORD,
+    VERTEX_SEMANTICS
+};
+
+enum VertexType {
+    VERTEX_FLOAT,
+    VERTEX_HALF,
+    VERTEX_SNORM16,     // positions are scaled to the format bounds
+    VERTEX_UNORM8,
+    VERTEX_OCT16,       // unit vec3 as 2 snorm16, for normals
+    VERTEX_TYPES
+};
+
+struct VertexAttrib {
+    VertexSemantic semantic;
+    VertexType type;
+    int components;     // as given to GL, 2 for VERTEX_OCT16
+    int offset;         // in bytes from the start of the vertex
+
+    // the arguments of glVertexAttribPointer
+    unsigned int glType;
+    bool normalized;
+};
+
+struct VertexFormat {
+    VertexAttrib attribs[VERTEX_MAX_ATTRIBS];
+    int attribCount;
+    int stride;         // bytes per vertex, a multiple of 4
+
+    // the box VERTEX_SNORM16 positions are mapped from
+    float positionCenter[3];
+    float positionExtent[3];
+};
+
+// where packing reads each attribute from, in floats,
+// with the number of floats from one vertex to the next
+struct VertexSource {
+    const float *data[VERTEX_SEMANTICS];
+    int stride[VERTEX_SEMANTICS];
+    int count;
+};
+
+void vertexFormatInit(VertexFormat *fmt);
+
+// appends an attribute, aligned on 4 bytes, returns false
+// when the format is full or the type cannot hold it
+bool vertexFormatAdd(VertexFormat *fmt, VertexSemantic semantic, VertexType type, int components);
+
+// the box VERTEX_SNORM16 positions must fit in
+void vertexFormatSetBounds(VertexFormat *fmt, const float *lo, const float *hi);
+
+const VertexAttrib *vertexFormatFind(const VertexFormat *fmt, VertexSemantic semantic);
+
+bool vertexFormatEqual(const VertexFormat *a, const VertexFormat *b);
+
+// 4 floats of position and color per vertex, as GL gets them now
+void vertexFormatLegacy(VertexFormat *fmt);
+
+// half float positions and unorm8 colors, 12 bytes, as the
+// scene draws them and the cooker writes them
+void vertexFormatScene(VertexFormat *fmt);
+
+void vertexSourceInit(VertexSource *src, int count);
+void vertexSourceSet(VertexSource *src, VertexSemantic semantic, const float *data, int stride);
+
+// writes src->count vertices to dst, fmt->stride bytes each,
+// attributes without data get 0 (1 for colors), the padding
+// after an attribute 0
+void vertexFormatPack(const VertexFormat *fmt, const VertexSource *src, void *dst);
+
+// the floats a vertex attribute holds, as the shader sees
+// them after decoding, returns the number of components
+int vertexFormatUnpack(const VertexFormat *fmt, const void *vertices, int index,
+                       VertexSemantic semantic, float *out);
+
+// sets the attribute pointers of the bound VAO, for the
+// vertices at offset bytes in the bound GL_ARRAY_BUFFER;
+// locations are indexed by semantic, -1 when unused
+void vertexFormatBind(const VertexFormat *fmt, const int *locations, size_t offset);
+
+#endif
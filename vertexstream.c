@@ -0,0 +1,299 @@
+#include <string.h>
+
+#include "vertexstream.h"
+#include "jobs.h"
+
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
+// points per job, a multiple of 16 so chunks stay aligned
+#define VERTEX_CHUNK 16384
+
+// ----------------------------------------------------
+// STREAMS
+//
+
+void vertexStreamInit(VertexStream *s) {
+
+    memset(s, 0, sizeof(VertexStream));
+}
+
+void vertexStreamFree(VertexStream *s) {
+
+    cpuFree(s->x);
+    vertexStreamInit(s);
+}
+
+// the four arrays share one allocation
+void vertexStreamResize(VertexStream *s, int count) {
+
+    if (count > s->capacity) {
+        int capacity = (count + 15) & ~15;
+        float *p = (float *) cpuAlloc(4 * capacity * sizeof(float));
+
+        if (s->count) {
+            memcpy(p + 0 * capacity, s->x, s->count * sizeof(float));
+            memcpy(p + 1 * capacity, s->y, s->count * sizeof(float));
+            memcpy(p + 2 * capacity, s->z, s->count * sizeof(float));
+            memcpy(p + 3 * capacity, s->w, s->count * sizeof(float));
+        }
+        cpuFree(s->x);
+
+        s->capacity = capacity;
+        s->x = p + 0 * capacity;
+        s->y = p + 1 * capacity;
+        s->z = p + 2 * capacity;
+        s->w = p + 3 * capacity;
+    }
+    s->count = count;
+}
+
+void vertexStreamFromAoS(VertexStream *s, const float *xyzw, int count) {
+
+    vertexStreamResize(s, count);
+
+    for (int i = 0; i < count; ++i) {
+        s->x[i] = xyzw[i*4 + 0];
+        s->y[i] = xyzw[i*4 + 1];
+        s->z[i] = xyzw[i*4 + 2];
+        s->w[i] = xyzw[i*4 + 3];
+    }
+}
+
+void vertexStreamToAoS(const VertexStream *s, float *xyzw) {
+
+    for (int i = 0; i < s->count; ++i) {
+        xyzw[i*4 + 0] = s->x[i];
+        xyzw[i*4 + 1] = s->y[i];
+        xyzw[i*4 + 2] = s->z[i];
+        xyzw[i*4 + 3] = s->w[i];
+    }
+}
+
+// ----------------------------------------------------
+// SCALAR
+//
+
+static void transformScalar(const float *m, const VertexStream *in, VertexStream *out, int begin, int end) {
+
+    for (int i = begin; i < end; ++i) {
+        float x = in->x[i], y = in->y[i], z = in->z[i], w = in->w[i];
+        out->x[i] = m[0] * x + m[4] * y + m[8]  * z + m[12] * w;
+        out->y[i] = m[1] * x + m[5] * y + m[9]  * z + m[13] * w;
+        out->z[i] = m[2] * x + m[6] * y + m[10] * z + m[14] * w;
+        out->w[i] = m[3] * x + m[7] * y + m[11] * z + m[15] * w;
+    }
+}
+
+static void projectScalar(const float *m, const VertexStream *in, VertexStream *out, int begin, int end) {
+
+    for (int i = begin; i < end; ++i) {
+        float x = in->x[i], y = in->y[i], z = in->z[i], w = in->w[i];
+        float cw = m[3] * x + m[7] * y + m[11] * z + m[15] * w;
+        float inv = 1.0f / cw;
+        out->x[i] = (m[0] * x + m[4] * y + m[8]  * z + m[12] * w) * inv;
+        out->y[i] = (m[1] * x + m[5] * y + m[9]  * z + m[13] * w) * inv;
+        out->z[i] = (m[2] * x + m[6] * y + m[10] * z + m[14] * w) * inv;
+        out->w[i] = cw;
+    }
+}
+
+static const VertexKernels kernelsScalar = {
+    ISA_SCALAR,
+    transformScalar,
+    projectScalar
+};
+
+#if CPU_X86
+
+// ----------------------------------------------------
+// SSE2
+//
+// The chunks start on multiples of 16 points, so the
+// vector loop uses aligned accesses and the few points
+// past the last full vector go through the scalar loop.
+//
+
+TARGET_SSE2
+static inline __m128 rowSSE2(const float *m, int row, __m128 x, __m128 y, __m128 z, __m128 w) {
+
+    __m128 r = _mm_mul_ps(_mm_set1_ps(m[row]), x);
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m[4 + row]), y));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m[8 + row]), z));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m[12 + row]), w));
+    return r;
+}
+
+TARGET_SSE2
+static void transformSSE2(const float *m, const VertexStream *in, VertexStream *out, int begin, int end) {
+
+    int i = begin;
+
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_load_ps(in->x + i);
+        __m128 y = _mm_load_ps(in->y + i);
+        __m128 z = _mm_load_ps(in->z + i);
+        __m128 w = _mm_load_ps(in->w + i);
+        _mm_store_ps(out->x + i, rowSSE2(m, 0, x, y, z, w));
+        _mm_store_ps(out->y + i, rowSSE2(m, 1, x, y, z, w));
+        _mm_store_ps(out->z + i, rowSSE2(m, 2, x, y, z, w));
+        _mm_store_ps(out->w + i, rowSSE2(m, 3, x, y, z, w));
+    }
+    transformScalar(m, in, out, i, end);
+}
+
+TARGET_SSE2
+static void projectSSE2(const float *m, const VertexStream *in, VertexStream *out, int begin, int end) {
+
+    const __m128 one = _mm_set1_ps(1.0f);
+    int i = begin;
+
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_load_ps(in->x + i);
+        __m128 y = _mm_load_ps(in->y + i);
+        __m128 z = _mm_load_ps(in->z + i);
+        __m128 w = _mm_load_ps(in->w + i);
+        __m128 cw = rowSSE2(m, 3, x, y, z, w);
+        __m128 inv = _mm_div_ps(one, cw);
+        _mm_store_ps(out->x + i, _mm_mul_ps(rowSSE2(m, 0, x, y, z, w), inv));
+        _mm_store_ps(out->y + i, _mm_mul_ps(rowSSE2(m, 1, x, y, z, w), inv));
+        _mm_store_ps(out->z + i, _mm_mul_ps(rowSSE2(m, 2, x, y, z, w), inv));
+        _mm_store_ps(out->w + i, cw);
+    }
+    projectScalar(m, in, out, i, end);
+}
+
+static const VertexKernels kernelsSSE2 = {
+    ISA_SSE2,
+    transformSSE2,
+    projectSSE2
+};
+
+// ----------------------------------------------------
+// AVX2
+//
+
+TARGET_AVX2
+static inline __m256 rowAVX2(const float *m, int row, __m256 x, __m256 y, __m256 z, __m256 w) {
+
+    __m256 r = _mm256_mul_ps(_mm256_broadcast_ss(m + row), x);
+    r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_broadcast_ss(m + 4 + row), y));
+    r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_broadcast_ss(m + 8 + row), z));
+    r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_broadcast_ss(m + 12 + row), w));
+    return r;
+}
+
+TARGET_AVX2
+static void transformAVX2(const float *m, const VertexStream *in, VertexStream *out, int begin, int end) {
+
+    int i = begin;
+
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_load_ps(in->x + i);
+        __m256 y = _mm256_load_ps(in->y + i);
+        __m256 z = _mm256_load_ps(in->z + i);
+        __m256 w = _mm256_load_ps(in->w + i);
+        _mm256_store_ps(out->x + i, rowAVX2(m, 0, x, y, z, w));
+        _mm256_store_ps(out->y + i, rowAVX2(m, 1, x, y, z, w));
+        _mm256_store_ps(out->z + i, rowAVX2(m, 2, x, y, z, w));
+        _mm256_store_ps(out->w + i, rowAVX2(m, 3, x, y, z, w));
+    }
+    transformScalar(m, in, out, i, end);
+}
+
+TARGET_AVX2
+static void projectAVX2(const float *m, const VertexStream *in, VertexStream *out, int begin, int end) {
+
+    const __m256 one = _mm256_set1_ps(1.0f);
+    int i = begin;
+
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_load_ps(in->x + i);
+        __m256 y = _mm256_load_ps(in->y + i);
+        __m256 z = _mm256_load_ps(in->z + i);
+        __m256 w = _mm256_load_ps(in->w + i);
+        __m256 cw = rowAVX2(m, 3, x, y, z, w);
+        __m256 inv = _mm256_div_ps(one, cw);
+        _mm256_store_ps(out->x + i, _mm256_mul_ps(rowAVX2(m, 0, x, y, z, w), inv));
+        _mm256_store_ps(out->y + i, _mm256_mul_ps(rowAVX2(m, 1, x, y, z, w), inv));
+        _mm256_store_ps(out->z + i, _mm256_mul_ps(rowAVX2(m, 2, x, y, z, w), inv));
+        _mm256_store_ps(out->w + i, cw);
+    }
+    projectScalar(m, in, out, i, end);
+}
+
+static const VertexKernels kernelsAVX2 = {
+    ISA_AVX2,
+    transformAVX2,
+    projectAVX2
+};
+
+// SSE4.1 adds nothing here and AVX-512 is bandwidth bound
+static const VertexKernels *tables[ISA_COUNT] = {
+    &kernelsScalar,
+    &kernelsSSE2,
+    &kernelsSSE2,
+    &kernelsAVX2,
+    &kernelsAVX2
+};
+
+#else
+
+static const VertexKernels *tables[ISA_COUNT] = {
+    &kernelsScalar,
+    &kernelsScalar,
+    &kernelsScalar,
+    &kernelsScalar,
+    &kernelsScalar
+};
+
+#endif
+
+const VertexKernels *vertexKernels = &kernelsScalar;
+
+void vertexBind(CpuIsa isa) {
+
+    vertexKernels = tables[isa];
+}
+
+// ----------------------------------------------------
+// THREADING
+//
+
+struct VertexJob {
+    const float *m;
+    const VertexStream *in;
+    VertexStream *out;
+    void (*kernel)(const float *m, const VertexStream *in, VertexStream *out, int begin, int end);
+};
+
+static void vertexJob(void *ctx, int begin, int end) {
+
+    VertexJob *job = (VertexJob *) ctx;
+    job->kernel(job->m, job->in, job->out, begin, end);
+}
+
+static void run(VertexStream *out, const VertexStream *in, const float *m,
+                void (*kernel)(const float *, const VertexStream *, VertexStream *, int, int)) {
+
+    // the kernels read the matrix for every vector, keep a copy handy
+    float mat[16];
+    memcpy(mat, m, sizeof(mat));
+
+    if (out != in)
+        vertexStreamResize(out, in->count);
+
+    VertexJob job = { mat, in, out, kernel };
+    parallelFor(in->count, VERTEX_CHUNK, vertexJob, &job);
+}
+
+void vertexStreamTransform(VertexStream *out, const VertexStream *in, const float *m) {
+
+    run(out, in, m, vertexKernels->transform);
+}
+
+void vertexStreamProject(VertexStream *out, const VertexStream *in, const float *m) {
+
+    run(out, in, m, vertexKernels->project);
+}
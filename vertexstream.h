@@ -0,0 +1,56 @@
+#ifndef VERTEXSTREAM_H
+#define VERTEXSTREAM_H
+
+#include "cpu.h"
+
+// ----------------------------------------------------
+// VERTEX STREAMS
+//
+// Positions stored as structure of arrays, one aligned
+// array per component, so the kernels transform 4, 8
+// or more points per instruction. This is for geometry
+// processed on the cpu (picking, culling, bounds), the
+// arrays handed to GL stay 4 floats per vertex.
+//
+
+struct VertexStream {
+
+    int count;
+    int capacity;
+
+    float *x;
+    float *y;
+    float *z;
+    float *w;
+};
+
+void vertexStreamInit(VertexStream *s);
+void vertexStreamFree(VertexStream *s);
+void vertexStreamResize(VertexStream *s, int count);
+
+// from and to 4 floats per vertex, as in vertices1
+void vertexStreamFromAoS(VertexStream *s, const float *xyzw, int count);
+void vertexStreamToAoS(const VertexStream *s, float *xyzw);
+
+// out = m * in, out may be in
+void vertexStreamTransform(VertexStream *out, const VertexStream *in, const float *m);
+
+// clip = m * in, out = (clip.xyz / clip.w, clip.w), out may be in
+// m would typically be camera.viewProj
+void vertexStreamProject(VertexStream *out, const VertexStream *in, const float *m);
+
+struct VertexKernels {
+
+    CpuIsa isa;
+
+    // the same operations on the points in [begin, end)
+    void (*transform)(const float *m, const VertexStream *in, VertexStream *out, int begin, int end);
+    void (*project)(const float *m, const VertexStream *in, VertexStream *out, int begin, int end);
+};
+
+extern const VertexKernels *vertexKernels;
+
+// called by cpuInit with the level to use
+void vertexBind(CpuIsa isa);
+
+#endif